@@ -27,6 +27,9 @@
 /* Enable client capability only */
 #define ENABLE_CLIENT_ONLY 1
 
+/* Write log output on a separate thread */
+#define ENABLE_ASYNC_LOG 1
+
 /* Enable client/server capability */
 #define ENABLE_CLIENT_SERVER 1
 
@@ -320,6 +323,9 @@
 /* struct sock_extended_err needed for extended socket error support */
 #define HAVE_SOCK_EXTENDED_ERR 1
 
+/* Define to 1 if you have the `splice' function. */
+#define HAVE_SPLICE 1
+
 /* Define to 1 if you have the `stat' function. */
 #define HAVE_STAT 1
 
@@ -39,6 +39,38 @@
 
 #include <wchar.h>
 
+/* gc_arena chunks, see gc_malloc() */
+#define GC_CHUNK_SIZE      2048 /* including the chunk header */
+#define GC_CHUNK_MAX_ALLOC 512  /* larger allocations get their own gc_entry */
+#define GC_CHUNK_CACHE_MAX 16   /* chunks kept per thread */
+
+/* same alignment as malloc() on common platforms */
+#define GC_ALIGN           (2 * sizeof(void *))
+#define GC_ALIGN_SIZE(n)   (((n) + GC_ALIGN - 1) & ~(GC_ALIGN - 1))
+#define GC_CHUNK_HEADER    GC_ALIGN_SIZE(sizeof(struct gc_chunk))
+
+#ifdef _MSC_VER
+#define GC_THREAD_LOCAL __declspec(thread)
+#else
+#define GC_THREAD_LOCAL __thread
+#endif
+
+static GC_THREAD_LOCAL struct gc_chunk *gc_chunk_cache;
+static GC_THREAD_LOCAL int gc_chunk_cache_len;
+
+/* free buffers, see alloc_buf_pooled() */
+#define BUF_POOL_SIZES     4    /* distinct buffer capacities pooled */
+#define BUF_POOL_MAX       64   /* free buffers kept per capacity */
+
+struct buf_pool
+{
+    int capacity;
+    int n_free;
+    uint8_t *free;              /* list linked through the first bytes of each buffer */
+};
+
+static GC_THREAD_LOCAL struct buf_pool buf_pool[BUF_POOL_SIZES];
+
 size_t
 array_mult_safe(const size_t m1, const size_t m2, const size_t extra)
 {
@@ -191,6 +223,118 @@ free_buf(struct buffer *buf)
     CLEAR(*buf);
 }
 
+/*
+ * Buffer pool
+ *
+ * Buffers which are only held for a while, but over and over again,
+ * like the control channel buffers of a TLS key, are given back to a
+ * small per-thread pool and handed out again from there, so that
+ * keeping them only while they are in use does not cost a malloc()
+ * each time.
+ */
+
+struct buffer
+alloc_buf_pooled(size_t size)
+{
+    int i;
+
+    for (i = 0; i < BUF_POOL_SIZES; ++i)
+    {
+        struct buf_pool *bp = &buf_pool[i];
+        if (bp->free && bp->capacity == (int)size)
+        {
+            struct buffer buf;
+
+            CLEAR(buf);
+            buf.data = bp->free;
+            buf.capacity = bp->capacity;
+            memcpy(&bp->free, buf.data, sizeof(bp->free));
+            memset(buf.data, 0, sizeof(void *));
+            --bp->n_free;
+            return buf;
+        }
+    }
+    return alloc_buf(size);
+}
+
+void
+free_buf_pooled(struct buffer *buf)
+{
+    struct buf_pool *bp = NULL;
+    int i;
+
+    if (!buf->data || buf->capacity < (int)sizeof(bp->free))
+    {
+        free_buf(buf);
+        return;
+    }
+
+    /* prefer the pool of this capacity, or take over an empty one */
+    for (i = 0; i < BUF_POOL_SIZES; ++i)
+    {
+        if (buf_pool[i].capacity == buf->capacity)
+        {
+            bp = &buf_pool[i];
+            break;
+        }
+        if (!bp && !buf_pool[i].free)
+        {
+            bp = &buf_pool[i];
+        }
+    }
+
+    if (bp && (bp->capacity != buf->capacity || bp->n_free < BUF_POOL_MAX))
+    {
+        /* these may have held key material */
+        secure_memzero(buf->data, buf->capacity);
+        if (bp->capacity != buf->capacity)
+        {
+            bp->capacity = buf->capacity;
+            bp->n_free = 0;
+        }
+        memcpy(buf->data, &bp->free, sizeof(bp->free));
+        bp->free = buf->data;
+        ++bp->n_free;
+        CLEAR(*buf);
+    }
+    else
+    {
+        free_buf(buf);
+    }
+}
+
+size_t
+buf_pool_bytes(void)
+{
+    size_t bytes = 0;
+    int i;
+
+    for (i = 0; i < BUF_POOL_SIZES; ++i)
+    {
+        bytes += (size_t)buf_pool[i].n_free * buf_pool[i].capacity;
+    }
+    return bytes;
+}
+
+void
+free_buf_pool(void)
+{
+    int i;
+
+    for (i = 0; i < BUF_POOL_SIZES; ++i)
+    {
+        struct buf_pool *bp = &buf_pool[i];
+        while (bp->free)
+        {
+            uint8_t *next;
+            memcpy(&next, bp->free, sizeof(next));
+            free(bp->free);
+            bp->free = next;
+        }
+        CLEAR(*bp);
+    }
+}
+
 static void
 free_buf_gc(struct buffer *buf, struct gc_arena *gc)
 {
@@ -209,11 +353,22 @@ free_buf_gc(struct buffer *buf, struct gc_arena *gc)
                 *e = (*e)->next;
                 free(to_delete);
 
-                break;
+                CLEAR(*buf);
+                return;
             }
 
             e = &(*e)->next;
         }
+
+        /*
+         * Memory carved out of a chunk is only freed with the arena,
+         * unless it was the last allocation, then its space is reused.
+         */
+        if (buf->data && gc->ptr
+            && buf->data + GC_ALIGN_SIZE((size_t)buf->capacity) == gc->ptr)
+        {
+            gc->ptr = buf->data;
+        }
     }
 
     CLEAR(*buf);
@@ -399,8 +554,74 @@ cleanup:
 
 /*
  * Garbage collection
+ *
+ * Small allocations are carved out of fixed-size chunks by bumping a
+ * pointer, so that an arena which is created and freed per packet
+ * normally costs no malloc() at all: gc_free() hands the chunks back to
+ * a small per-thread cache, from which the next arena takes its first
+ * chunk.  Larger allocations still get their own gc_entry.
+ *
+ * DMALLOC builds keep one gc_entry per allocation, so that leaks are
+ * attributed to the file and line which made the allocation.
  */
 
+#ifndef DMALLOC
+static void
+gc_chunk_new(struct gc_arena *a)
+{
+    struct gc_chunk *c = gc_chunk_cache;
+    if (c)
+    {
+        gc_chunk_cache = c->next;
+        --gc_chunk_cache_len;
+    }
+    else
+    {
+        c = (struct gc_chunk *) malloc(GC_CHUNK_SIZE);
+        check_malloc_return(c);
+    }
+    c->next = a->chunks;
+    a->chunks = c;
+    a->ptr = (uint8_t *) c + GC_CHUNK_HEADER;
+    a->end = (uint8_t *) c + GC_CHUNK_SIZE;
+}
+#endif
+
+static void
+gc_chunk_release(struct gc_chunk *c)
+{
+    while (c != NULL)
+    {
+        struct gc_chunk *next = c->next;
+        if (gc_chunk_cache_len < GC_CHUNK_CACHE_MAX)
+        {
+            c->next = gc_chunk_cache;
+            gc_chunk_cache = c;
+            ++gc_chunk_cache_len;
+        }
+        else
+        {
+            free(c);
+        }
+        c = next;
+    }
+}
+
+void
+gc_free_chunk_cache(void)
+{
+    struct gc_chunk *c = gc_chunk_cache;
+    gc_chunk_cache = NULL;
+    gc_chunk_cache_len = 0;
+
+    while (c != NULL)
+    {
+        struct gc_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
 void *
 #ifdef DMALLOC
 gc_malloc_debug(size_t size, bool clear, struct gc_arena *a, const char *file, int line)
@@ -411,16 +632,31 @@ gc_malloc(size_t size, bool clear, struct gc_arena *a)
     void *ret;
     if (a)
     {
-        struct gc_entry *e;
+#ifndef DMALLOC
+        if (size <= GC_CHUNK_MAX_ALLOC)
+        {
+            const size_t asize = GC_ALIGN_SIZE(size);
+            if (!a->ptr || (size_t)(a->end - a->ptr) < asize)
+            {
+                gc_chunk_new(a);
+            }
+            ret = a->ptr;
+            a->ptr += asize;
+        }
+        else
+#endif
+        {
+            struct gc_entry *e;
 #ifdef DMALLOC
-        e = (struct gc_entry *) openvpn_dmalloc(file, line, size + sizeof(struct gc_entry));
+            e = (struct gc_entry *) openvpn_dmalloc(file, line, size + sizeof(struct gc_entry));
 #else
-        e = (struct gc_entry *) malloc(size + sizeof(struct gc_entry));
+            e = (struct gc_entry *) malloc(size + sizeof(struct gc_entry));
 #endif
-        check_malloc_return(e);
-        ret = (char *) e + sizeof(struct gc_entry);
-        e->next = a->list;
-        a->list = e;
+            check_malloc_return(e);
+            ret = (char *) e + sizeof(struct gc_entry);
+            e->next = a->list;
+            a->list = e;
+        }
     }
     else
     {
@@ -451,6 +687,11 @@ x_gc_free(struct gc_arena *a)
         free(e);
         e = next;
     }
+
+    gc_chunk_release(a->chunks);
+    a->chunks = NULL;
+    a->ptr = NULL;
+    a->end = NULL;
 }
 
 /*
@@ -511,6 +752,30 @@ gc_transfer(struct gc_arena *dest, struct gc_arena *src)
             dest->list = src->list;
             src->list = NULL;
         }
+
+        struct gc_chunk *c = src->chunks;
+        if (c)
+        {
+            while (c->next != NULL)
+            {
+                c = c->next;
+            }
+            if (dest->chunks)
+            {
+                /* keep allocating from dest's current chunk */
+                c->next = dest->chunks->next;
+                dest->chunks->next = src->chunks;
+            }
+            else
+            {
+                dest->chunks = src->chunks;
+                dest->ptr = src->ptr;
+                dest->end = src->end;
+            }
+            src->chunks = NULL;
+            src->ptr = NULL;
+            src->end = NULL;
+        }
     }
 }
 
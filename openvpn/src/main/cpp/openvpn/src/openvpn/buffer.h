@@ -79,8 +79,9 @@ struct buffer
  * Garbage collection entry for one dynamically allocated block of memory.
  *
  * This structure represents one link in the linked list contained in a \c
- * gc_arena structure.  Each time the \c gc_malloc() function is called,
- * it allocates \c sizeof(gc_entry) + the requested number of bytes.  The
+ * gc_arena structure.  Allocations too large to be carved out of a
+ * \c gc_chunk are made individually: \c gc_malloc() allocates
+ * \c sizeof(gc_entry) + the requested number of bytes, and the
  * \c gc_entry is then stored as a header in front of the memory address
  * returned to the caller.
  */
@@ -90,6 +91,18 @@ struct gc_entry
                                  *   linked list. */
 };
 
+/**
+ * Block of memory from which small allocations in a \c gc_arena are
+ * carved out by bumping a pointer.  All chunks have the same size, so
+ * that chunks released by \c gc_free() can be kept in a per-thread
+ * cache and reused by the next arena without calling \c malloc().
+ */
+struct gc_chunk
+{
+    struct gc_chunk *next;      /**< Pointer to the next chunk owned by
+                                 *   the same arena, or in the cache. */
+};
+
 /**
  * Garbage collection entry for a specially allocated structure that needs
  * a custom free function to be freed like struct addrinfo
@@ -107,17 +120,24 @@ struct gc_entry_special
  * Garbage collection arena used to keep track of dynamically allocated
  * memory.
  *
- * This structure contains a linked list of \c gc_entry structures.  When
- * a block of memory is allocated using the \c gc_malloc() function, the
- * allocation is registered in the function's \c gc_arena argument.  All
- * the dynamically allocated memory registered in a \c gc_arena can be
- * freed using the \c gc_free() function.
+ * This structure contains a linked list of \c gc_chunk structures and a
+ * linked list of \c gc_entry structures.  When a block of memory is
+ * allocated using the \c gc_malloc() function, it is taken from the
+ * current chunk of the function's \c gc_arena argument, or registered
+ * in its \c gc_entry list if it is large.  All the dynamically allocated
+ * memory registered in a \c gc_arena can be freed using the
+ * \c gc_free() function.
  */
 struct gc_arena
 {
     struct gc_entry *list;      /**< First element of the linked list of
                                  *   \c gc_entry structures. */
     struct gc_entry_special *list_special;
+    struct gc_chunk *chunks;    /**< First element of the linked list of
+                                 *   \c gc_chunk structures, the one
+                                 *   currently allocated from. */
+    uint8_t *ptr;               /**< Next free byte in the current chunk. */
+    uint8_t *end;               /**< End of the current chunk. */
 };
 
 
@@ -133,6 +153,27 @@ void buf_clear(struct buffer *buf);
 
 void free_buf(struct buffer *buf);
 
+/*
+ * Like alloc_buf(), but reuse a buffer of the same size given back by
+ * free_buf_pooled() if there is one.
+ */
+struct buffer alloc_buf_pooled(size_t size);
+
+/*
+ * Free a buffer, keeping it wiped in a small per-thread pool for the
+ * next alloc_buf_pooled() of the same size.
+ */
+void free_buf_pooled(struct buffer *buf);
+
+/* number of bytes held by the calling thread's buffer pool */
+size_t buf_pool_bytes(void);
+
+/*
+ * Free the buffers pooled by the calling thread, called before
+ * a thread which used alloc_buf_pooled() exits.
+ */
+void free_buf_pool(void);
+
 bool buf_assign(struct buffer *dest, const struct buffer *src);
 
 void string_clear(char *str);
@@ -992,10 +1033,16 @@ void x_gc_free(struct gc_arena *a);
 
 void x_gc_freespecial(struct gc_arena *a);
 
+/*
+ * Free the chunks cached by the calling thread, called before
+ * a thread which used gc_arena objects exits.
+ */
+void gc_free_chunk_cache(void);
+
 static inline bool
 gc_defined(struct gc_arena *a)
 {
-    return a->list != NULL;
+    return a->list != NULL || a->chunks != NULL;
 }
 
 static inline void
@@ -1003,6 +1050,9 @@ gc_init(struct gc_arena *a)
 {
     a->list = NULL;
     a->list_special = NULL;
+    a->chunks = NULL;
+    a->ptr = NULL;
+    a->end = NULL;
 }
 
 static inline void
@@ -1022,7 +1072,7 @@ gc_new(void)
 static inline void
 gc_free(struct gc_arena *a)
 {
-    if (a->list)
+    if (a->list || a->chunks)
     {
         x_gc_free(a);
     }
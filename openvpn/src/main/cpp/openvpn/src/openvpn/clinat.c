@@ -34,6 +34,96 @@
 #include "socket.h"
 #include "memdbg.h"
 
+static inline unsigned int
+index_slot(const in_addr_t key, const int mask)
+{
+    return ((key * 2654435761u) ^ (unsigned int)mask) & (CLIENT_NAT_HASH_SIZE - 1);
+}
+
+static void
+build_index(struct client_nat_option_list *list, const int direction, const int field)
+{
+    struct client_nat_index *idx = &list->index[direction][field];
+    int i;
+
+    CLEAR(*idx);
+    for (i = 0; i < list->n; ++i)
+    {
+        const struct client_nat_entry *e = &list->entries[i];
+        const in_addr_t from = direction ? e->foreign_network : e->network;
+        unsigned int slot;
+        int m;
+
+        if (((e->type ^ direction) ? CN_DADDR : CN_SADDR) != field)
+        {
+            continue;
+        }
+        if ((from & e->netmask) != from)
+        {
+            continue; /* can never match a masked address */
+        }
+
+        for (m = 0; m < idx->n_masks && idx->masks[m] != e->netmask; ++m)
+        {
+        }
+        if (m == idx->n_masks)
+        {
+            idx->masks[m] = e->netmask;
+            idx->first_rule[m] = i;
+            ++idx->n_masks;
+        }
+
+        /* an earlier rule with the same network and netmask wins */
+        for (slot = index_slot(from, m); idx->slots[slot].rule; slot = (slot + 1) & (CLIENT_NAT_HASH_SIZE - 1))
+        {
+            if (idx->slots[slot].key == from && idx->slots[slot].mask == m)
+            {
+                break;
+            }
+        }
+        if (!idx->slots[slot].rule)
+        {
+            idx->slots[slot].key = from;
+            idx->slots[slot].mask = (uint8_t) m;
+            idx->slots[slot].rule = (uint8_t) (i + 1);
+        }
+    }
+}
+
+/*
+ * Return the index of the first rule in idx matching addr, or -1.
+ */
+static inline int
+lookup_index(const struct client_nat_index *idx, const in_addr_t addr)
+{
+    int ret = -1;
+    int m;
+
+    for (m = 0; m < idx->n_masks; ++m)
+    {
+        const in_addr_t key = addr & idx->masks[m];
+        unsigned int slot;
+
+        if (ret >= 0 && idx->first_rule[m] > ret)
+        {
+            break;
+        }
+        for (slot = index_slot(key, m); idx->slots[slot].rule; slot = (slot + 1) & (CLIENT_NAT_HASH_SIZE - 1))
+        {
+            if (idx->slots[slot].key == key && idx->slots[slot].mask == m)
+            {
+                const int rule = idx->slots[slot].rule - 1;
+                if (ret < 0 || rule < ret)
+                {
+                    ret = rule;
+                }
+                break;
+            }
+        }
+    }
+    return ret;
+}
+
 static bool
 add_entry(struct client_nat_option_list *dest,
           const struct client_nat_entry *e)
@@ -46,6 +136,10 @@ add_entry(struct client_nat_option_list *dest,
     else
     {
         dest->entries[dest->n++] = *e;
+        build_index(dest, CN_OUTGOING, CN_SADDR);
+        build_index(dest, CN_OUTGOING, CN_DADDR);
+        build_index(dest, CN_INCOMING, CN_SADDR);
+        build_index(dest, CN_INCOMING, CN_DADDR);
         return true;
     }
 }
@@ -197,61 +291,40 @@ client_nat_transform(const struct client_nat_option_list *list,
                      const int direction)
 {
     struct ip_tcp_udp_hdr *h = (struct ip_tcp_udp_hdr *) BPTR(ipbuf);
-    int i;
-    uint32_t addr, *addr_ptr;
-    const uint32_t *from, *to;
+    uint32_t *addr_ptrs[2];
+    int field;
     int accumulate = 0;
-    unsigned int amask;
-    unsigned int alog = 0;
+    bool modified = false;
 
     if (check_debug_level(D_CLIENT_NAT))
     {
         print_pkt(&h->ip, "BEFORE", direction, D_CLIENT_NAT);
     }
 
-    for (i = 0; i < list->n; ++i)
+    addr_ptrs[CN_SADDR] = &h->ip.saddr;
+    addr_ptrs[CN_DADDR] = &h->ip.daddr;
+
+    /* the first matching rule rewrites each address */
+    for (field = CN_SADDR; field <= CN_DADDR; ++field)
     {
-        const struct client_nat_entry *e = &list->entries[i]; /* current NAT rule */
-        if (e->type ^ direction)
-        {
-            addr = *(addr_ptr = &h->ip.daddr);
-            amask = 2;
-        }
-        else
-        {
-            addr = *(addr_ptr = &h->ip.saddr);
-            amask = 1;
-        }
-        if (direction)
+        const int i = lookup_index(&list->index[direction][field], *addr_ptrs[field]);
+        if (i >= 0)
         {
-            from = &e->foreign_network;
-            to = &e->network;
-        }
-        else
-        {
-            from = &e->network;
-            to = &e->foreign_network;
-        }
+            const struct client_nat_entry *e = &list->entries[i];
+            const in_addr_t to = direction ? e->network : e->foreign_network;
+            uint32_t addr = *addr_ptrs[field];
 
-        if (((addr & e->netmask) == *from) && !(amask & alog))
-        {
-            /* pre-adjust IP checksum */
+            /* the IP and TCP/UDP checksums both cover the addresses,
+             * so one accumulated delta adjusts all of them */
             ADD_CHECKSUM_32(accumulate, addr);
-
-            /* do NAT transform */
-            addr = (addr & ~e->netmask) | *to;
-
-            /* post-adjust IP checksum */
+            addr = (addr & ~e->netmask) | to;
             SUB_CHECKSUM_32(accumulate, addr);
 
-            /* write the modified address to packet */
-            *addr_ptr = addr;
-
-            /* mark as modified */
-            alog |= amask;
+            *addr_ptrs[field] = addr;
+            modified = true;
         }
     }
-    if (alog)
+    if (modified)
     {
         if (check_debug_level(D_CLIENT_NAT))
         {
@@ -40,9 +40,36 @@ struct client_nat_entry {
     in_addr_t foreign_network;
 };
 
+#define CN_SADDR 0
+#define CN_DADDR 1
+
+#define CLIENT_NAT_HASH_SIZE 256 /* power of 2, well above MAX_CLIENT_NAT */
+
+/*
+ * Index over the rules which rewrite one address field in one
+ * direction.  Rules are grouped by netmask, and each group is
+ * looked up by masked address in a small hash table, so a packet
+ * costs one probe per distinct netmask rather than one test per
+ * rule.  Masks are kept in order of their first rule, which lets
+ * the lookup stop as soon as no earlier rule can match.
+ */
+struct client_nat_index {
+    int n_masks;
+    in_addr_t masks[MAX_CLIENT_NAT];
+    int first_rule[MAX_CLIENT_NAT];
+    struct {
+        in_addr_t key;          /* masked address */
+        uint8_t mask;           /* index into masks */
+        uint8_t rule;           /* 1 + index into entries, 0 if slot is empty */
+    } slots[CLIENT_NAT_HASH_SIZE];
+};
+
 struct client_nat_option_list {
     int n;
     struct client_nat_entry entries[MAX_CLIENT_NAT];
+
+    /* rebuilt whenever an entry is added, [direction][CN_SADDR/CN_DADDR] */
+    struct client_nat_index index[2][2];
 };
 
 struct client_nat_option_list *new_client_nat_list(struct gc_arena *gc);
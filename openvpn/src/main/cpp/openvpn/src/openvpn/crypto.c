@@ -71,6 +71,7 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work,
     uint8_t *mac_out = NULL;
     const cipher_kt_t *cipher_kt = cipher_ctx_get_cipher_kt(ctx->cipher);
     const int mac_len = cipher_kt_tag_size(cipher_kt);
+    const bool quiet = (opt->flags & CO_NO_LOG) != 0;
 
     /* IV, packet-ID and implicit IV required for this mode. */
     ASSERT(ctx->cipher);
@@ -92,7 +93,10 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work,
         /* IV starts with packet id to make the IV unique for packet */
         if (!packet_id_write(&opt->packet_id.send, &iv_buffer, false, false))
         {
-            msg(D_CRYPT_ERRORS, "ENCRYPT ERROR: packet ID roll over");
+            if (!quiet)
+            {
+                msg(D_CRYPT_ERRORS, "ENCRYPT ERROR: packet ID roll over");
+            }
             goto err;
         }
 
@@ -102,7 +106,10 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work,
 
         /* Write explicit part of IV to work buffer */
         ASSERT(buf_write(&work, iv, iv_len - ctx->implicit_iv_len));
-        dmsg(D_PACKET_CONTENT, "ENCRYPT IV: %s", format_hex(iv, iv_len, 0, &gc));
+        if (!quiet)
+        {
+            dmsg(D_PACKET_CONTENT, "ENCRYPT IV: %s", format_hex(iv, iv_len, 0, &gc));
+        }
 
         /* Init cipher_ctx with IV.  key & keylen are already initialized */
         ASSERT(cipher_ctx_reset(ctx->cipher, iv));
@@ -112,22 +119,31 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work,
     mac_out = buf_write_alloc(&work, mac_len);
     ASSERT(mac_out);
 
-    dmsg(D_PACKET_CONTENT, "ENCRYPT FROM: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
+    if (!quiet)
+    {
+        dmsg(D_PACKET_CONTENT, "ENCRYPT FROM: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
+    }
 
     /* Buffer overflow check */
     if (!buf_safe(&work, buf->len + cipher_ctx_block_size(ctx->cipher)))
     {
-        msg(D_CRYPT_ERRORS,
-            "ENCRYPT: buffer size error, bc=%d bo=%d bl=%d wc=%d wo=%d wl=%d",
-            buf->capacity, buf->offset, buf->len, work.capacity, work.offset,
-            work.len);
+        if (!quiet)
+        {
+            msg(D_CRYPT_ERRORS,
+                "ENCRYPT: buffer size error, bc=%d bo=%d bl=%d wc=%d wo=%d wl=%d",
+                buf->capacity, buf->offset, buf->len, work.capacity, work.offset,
+                work.len);
+        }
         goto err;
     }
 
     /* For AEAD ciphers, authenticate Additional Data, including opcode */
     ASSERT(cipher_ctx_update_ad(ctx->cipher, BPTR(&work), BLEN(&work) - mac_len));
-    dmsg(D_PACKET_CONTENT, "ENCRYPT AD: %s",
-         format_hex(BPTR(&work), BLEN(&work) - mac_len, 0, &gc));
+    if (!quiet)
+    {
+        dmsg(D_PACKET_CONTENT, "ENCRYPT AD: %s",
+             format_hex(BPTR(&work), BLEN(&work) - mac_len, 0, &gc));
+    }
 
     /* Encrypt packet ID, payload */
     ASSERT(cipher_ctx_update(ctx->cipher, BEND(&work), &outlen, BPTR(buf), BLEN(buf)));
@@ -142,7 +158,10 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work,
 
     *buf = work;
 
-    dmsg(D_PACKET_CONTENT, "ENCRYPT TO: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
+    if (!quiet)
+    {
+        dmsg(D_PACKET_CONTENT, "ENCRYPT TO: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
+    }
 
     gc_free(&gc);
     return;
@@ -254,6 +254,12 @@ struct crypto_options
 #define CO_MUTE_REPLAY_WARNINGS (1<<2)
     /**< Bit-flag indicating not to display
      *   replay warnings. */
+#define CO_NO_LOG               (1<<3)
+    /**< Bit-flag indicating not to log at
+     *   all, because the caller is not the
+     *   main thread (--tun-queues workers).
+     *   Only honored by openvpn_encrypt()
+     *   with AEAD ciphers. */
     unsigned int flags;         /**< Bit-flags determining behavior of
                                  *   security operation functions. */
 };
@@ -347,6 +347,18 @@ cipher_ctx_t *cipher_ctx_new(void);
  */
 void cipher_ctx_free(cipher_ctx_t *ctx);
 
+/**
+ * Copy an initialised cipher context, including its key schedule, so
+ * that the copy can be used on another thread.
+ *
+ * @param dst           Cipher context allocated with cipher_ctx_new()
+ * @param src           Initialised cipher context
+ *
+ * @return              true on success, false if the backend cannot
+ *                      copy contexts
+ */
+bool cipher_ctx_copy(cipher_ctx_t *dst, const cipher_ctx_t *src);
+
 /**
  * Initialise a cipher context, based on the given key and key type.
  *
@@ -594,6 +594,13 @@ cipher_ctx_free(mbedtls_cipher_context_t *ctx)
     free(ctx);
 }
 
+bool
+cipher_ctx_copy(mbedtls_cipher_context_t *dst, const mbedtls_cipher_context_t *src)
+{
+    /* mbed TLS has no way to duplicate an initialised context */
+    return false;
+}
+
 void
 cipher_ctx_init(mbedtls_cipher_context_t *ctx, const uint8_t *key, int key_len,
                 const mbedtls_cipher_info_t *kt, const mbedtls_operation_t operation)
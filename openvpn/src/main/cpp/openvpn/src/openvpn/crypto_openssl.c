@@ -766,6 +766,12 @@ cipher_ctx_free(EVP_CIPHER_CTX *ctx)
     EVP_CIPHER_CTX_free(ctx);
 }
 
+bool
+cipher_ctx_copy(EVP_CIPHER_CTX *dst, const EVP_CIPHER_CTX *src)
+{
+    return EVP_CIPHER_CTX_copy(dst, src) == 1;
+}
+
 void
 cipher_ctx_init(EVP_CIPHER_CTX *ctx, const uint8_t *key, int key_len,
                 const EVP_CIPHER *kt, int enc)
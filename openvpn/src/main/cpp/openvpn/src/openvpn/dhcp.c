@@ -152,11 +152,11 @@ dhcp_extract_router_msg(struct buffer *ipbuf)
 {
     struct dhcp_full *df = (struct dhcp_full *) BPTR(ipbuf);
     const int optlen = BLEN(ipbuf) - (sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_udphdr) + sizeof(struct dhcp));
+    int l4_offset;
 
     if (optlen >= 0
-        && df->ip.protocol == OPENVPN_IPPROTO_UDP
-        && df->udp.source == htons(BOOTPS_PORT)
-        && df->udp.dest == htons(BOOTPC_PORT)
+        && (ip_classify(BPTR(ipbuf), BLEN(ipbuf), &l4_offset) & IPC_DHCP_REPLY)
+        && l4_offset == sizeof(struct openvpn_iphdr) /* struct dhcp_full has no room for IP options */
         && df->dhcp.op == BOOTREPLY)
     {
         const int message_type = get_dhcp_message_type(&df->dhcp, optlen);
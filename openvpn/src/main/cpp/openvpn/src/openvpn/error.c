@@ -42,6 +42,7 @@
 #include "integer.h"
 #include "ps.h"
 #include "mstats.h"
+#include "logq.h"
 
 
 #if SYSLOG_CAPABILITY
@@ -62,6 +63,16 @@ static int mute_cutoff;     /* GLOBAL */
 static int mute_count;      /* GLOBAL */
 static int mute_category;   /* GLOBAL */
 
+/* Rate limit state, per mute category */
+struct log_rate {
+    time_t window;
+    unsigned int count;
+    unsigned int suppressed;
+};
+
+static unsigned int log_rate_limit;                   /* GLOBAL */
+static struct log_rate log_rate[MUTE_LEVEL_MASK + 1]; /* GLOBAL */
+
 /*
  * Output mode priorities are as follows:
  *
@@ -139,6 +150,12 @@ set_mute_cutoff(const int cutoff)
     }
 }
 
+void
+set_log_rate_limit(const int limit)
+{
+    log_rate_limit = limit > 0 ? limit : 0;
+}
+
 int
 get_debug_level(void)
 {
@@ -173,6 +190,7 @@ error_reset(void)
     mute_cutoff = 0;
     mute_count = 0;
     mute_category = 0;
+    log_rate_limit = 0;
     default_out = OPENVPN_MSG_FP;
     default_err = OPENVPN_MSG_FP;
 
@@ -215,6 +233,101 @@ msg_fp(const unsigned int flags)
 
 int x_msg_line_num; /* GLOBAL */
 
+/*
+ * Write a formatted message to syslog or the log file.  tv is the time
+ * of the msg() call, or NULL for now.
+ */
+static void
+msg_output(const unsigned int flags, const struct timeval *tv,
+           const char *prefix, const char *prefix_sep, const char *m1)
+{
+    if (use_syslog && !std_redir && !forked)
+    {
+#if SYSLOG_CAPABILITY
+        int level;
+
+        if (flags & (M_FATAL|M_NONFATAL|M_USAGE_SMALL))
+        {
+            level = LOG_ERR;
+        }
+        else if (flags & M_WARN)
+        {
+            level = LOG_WARNING;
+        }
+        else
+        {
+            level = LOG_NOTICE;
+        }
+
+        syslog(level, "%s%s%s",
+               prefix,
+               prefix_sep,
+               m1);
+#endif
+    }
+    else
+    {
+        FILE *fp = msg_fp(flags);
+        const bool show_usec = check_debug_level(DEBUG_LEVEL_USEC_TIME);
+        struct timeval now_tv;
+
+        if (!tv)
+        {
+            gettimeofday(&now_tv, NULL);
+            tv = &now_tv;
+        }
+
+        if (machine_readable_output)
+        {
+            fprintf(fp, "%" PRIi64 ".%06ld %x %s%s%s%s",
+                    (int64_t)tv->tv_sec,
+                    (long)tv->tv_usec,
+                    flags,
+                    prefix,
+                    prefix_sep,
+                    m1,
+                    "\n");
+
+        }
+        else if ((flags & M_NOPREFIX) || suppress_timestamps)
+        {
+            fprintf(fp, "%s%s%s%s",
+                    prefix,
+                    prefix_sep,
+                    m1,
+                    (flags&M_NOLF) ? "" : "\n");
+        }
+        else
+        {
+            struct gc_arena gc = gc_new();
+
+            fprintf(fp, "%s %s%s%s%s",
+                    time_string(tv->tv_sec, tv->tv_usec, show_usec, &gc),
+                    prefix,
+                    prefix_sep,
+                    m1,
+                    (flags&M_NOLF) ? "" : "\n");
+            gc_free(&gc);
+        }
+        fflush(fp);
+        ++x_msg_line_num;
+    }
+}
+
+#ifdef ENABLE_ASYNC_LOG
+static void
+msg_output_queued(const struct log_queue_entry *e)
+{
+    msg_output(e->flags, &e->tv, "", "", e->text);
+}
+
+void
+msg_queue_start(const unsigned int size)
+{
+    log_queue_start(size, msg_output_queued);
+}
+#endif
+
 void
 x_msg(const unsigned int flags, const char *format, ...)
 {
@@ -228,9 +341,6 @@ void
 x_msg_va(const unsigned int flags, const char *format, va_list arglist)
 {
     struct gc_arena gc;
-#if SYSLOG_CAPABILITY
-    int level;
-#endif
     char *m1;
     char *m2;
     char *tmp;
@@ -282,21 +392,6 @@ x_msg_va(const unsigned int flags, const char *format, va_list arglist)
         SWAP;
     }
 
-#if SYSLOG_CAPABILITY
-    if (flags & (M_FATAL|M_NONFATAL|M_USAGE_SMALL))
-    {
-        level = LOG_ERR;
-    }
-    else if (flags & M_WARN)
-    {
-        level = LOG_WARNING;
-    }
-    else
-    {
-        level = LOG_NOTICE;
-    }
-#endif
-
     /* set up client prefix */
     if (flags & M_NOIPREFIX)
     {
@@ -328,55 +423,17 @@ x_msg_va(const unsigned int flags, const char *format, va_list arglist)
 
     if (!(flags & M_MSG_VIRT_OUT))
     {
-        if (use_syslog && !std_redir && !forked)
-        {
-#if SYSLOG_CAPABILITY
-            syslog(level, "%s%s%s",
-                   prefix,
-                   prefix_sep,
-                   m1);
-#endif
-        }
-        else
+#ifdef ENABLE_ASYNC_LOG
+        /* fatal errors are written out before exiting */
+        if (forked || (flags & (M_FATAL|M_USAGE_SMALL))
+            || !log_queue_push(flags, prefix, prefix_sep, m1))
         {
-            FILE *fp = msg_fp(flags);
-            const bool show_usec = check_debug_level(DEBUG_LEVEL_USEC_TIME);
-
-            if (machine_readable_output)
-            {
-                struct timeval tv;
-                gettimeofday(&tv, NULL);
-
-                fprintf(fp, "%" PRIi64 ".%06ld %x %s%s%s%s",
-                        (int64_t)tv.tv_sec,
-                        (long)tv.tv_usec,
-                        flags,
-                        prefix,
-                        prefix_sep,
-                        m1,
-                        "\n");
-
-            }
-            else if ((flags & M_NOPREFIX) || suppress_timestamps)
-            {
-                fprintf(fp, "%s%s%s%s",
-                        prefix,
-                        prefix_sep,
-                        m1,
-                        (flags&M_NOLF) ? "" : "\n");
-            }
-            else
-            {
-                fprintf(fp, "%s %s%s%s%s",
-                        time_string(0, 0, show_usec, &gc),
-                        prefix,
-                        prefix_sep,
-                        m1,
-                        (flags&M_NOLF) ? "" : "\n");
-            }
-            fflush(fp);
-            ++x_msg_line_num;
+            log_queue_flush();
+            msg_output(flags, NULL, prefix, prefix_sep, m1);
         }
+#else
+        msg_output(flags, NULL, prefix, prefix_sep, m1);
+#endif
     }
 
     if (flags & M_FATAL)
@@ -397,6 +454,42 @@ x_msg_va(const unsigned int flags, const char *format, va_list arglist)
     gc_free(&gc);
 }
 
+/*
+ * Apply --log-rate, which limits each mute category to a number of
+ * messages per second.  Uncategorized messages are not limited.
+ */
+static bool
+log_rate_ok(const int category)
+{
+    struct log_rate *r = &log_rate[category];
+
+    if (!category)
+    {
+        return true;
+    }
+    if (r->window != now)
+    {
+        const unsigned int suppressed = r->suppressed;
+
+        r->window = now;
+        r->count = 0;
+        r->suppressed = 0;
+        if (suppressed)
+        {
+            msg(M_INFO | M_NOMUTE,
+                "%u message(s) of category %d suppressed by --log-rate",
+                suppressed,
+                category);
+        }
+    }
+    if (++r->count > log_rate_limit)
+    {
+        ++r->suppressed;
+        return false;
+    }
+    return true;
+}
+
 /*
  * Apply muting filter.
  */
@@ -404,6 +497,11 @@ bool
 dont_mute(unsigned int flags)
 {
     bool ret = true;
+    if (log_rate_limit > 0 && !(flags & (M_NOMUTE|M_FATAL))
+        && !log_rate_ok(DECODE_MUTE_LEVEL(flags)))
+    {
+        return false;
+    }
     if (mute_cutoff > 0 && !(flags & M_NOMUTE))
     {
         const int mute_level = DECODE_MUTE_LEVEL(flags);
@@ -749,6 +847,10 @@ openvpn_exit(const int status)
 {
     if (!forked)
     {
+#ifdef ENABLE_ASYNC_LOG
+        log_queue_stop();
+#endif
+
         tun_abort();
 
 #ifdef _WIN32
@@ -205,6 +205,15 @@ bool set_debug_level(const int level, const unsigned int flags);
 
 bool set_mute_cutoff(const int cutoff);
 
+/* limit messages per second and mute category, 0 to disable */
+void set_log_rate_limit(const int limit);
+
+#ifdef ENABLE_ASYNC_LOG
+/* hand msg() output to a --log-queue thread */
+void msg_queue_start(const unsigned int size);
+
+#endif
+
 int get_debug_level(void);
 
 int get_mute_cutoff(void);
@@ -42,6 +42,7 @@
 #include "dhcp.h"
 #include "common.h"
 #include "ssl_verify.h"
+#include "tunmq.h"
 
 #include "memdbg.h"
 
@@ -738,6 +739,19 @@ encrypt_sign(struct context *c, bool comp_frag)
         co = &c->c2.crypto_options;
     }
 
+#ifdef ENABLE_TUN_MQ
+    /* share the packet ID counter with the tun queue workers */
+    struct crypto_options co_mq;
+    if (co && c->c2.tls_multi)
+    {
+        co = tun_mq_pre_encrypt(c, co, &co_mq);
+        if (!co)
+        {
+            c->c2.buf.len = 0;
+        }
+    }
+#endif
+
     /* Encrypt and authenticate the packet */
     openvpn_encrypt(&c->c2.buf, b->encrypt_buf, co);
 
@@ -1983,6 +1997,11 @@ pre_select(struct context *c)
     check_fragment(c);
 #endif
 
+#ifdef ENABLE_TUN_MQ
+    /* Publish key changes to the tun queue workers */
+    tun_mq_update(c);
+#endif
+
     /* Update random component of timeout */
     check_timeout_random_component(c);
 }
@@ -2010,6 +2029,9 @@ io_wait_dowork(struct context *c, const unsigned int flags)
 #ifdef ENABLE_ASYNC_PUSH
     static int file_shift = 8;     /* listening inotify events */
 #endif
+#ifdef ENABLE_ASYNC_PK
+    static int async_pk_shift = 10; /* offloaded private key operation done */
+#endif
 
     /*
      * Decide what kind of events we want to wait for.
@@ -2126,6 +2148,14 @@ io_wait_dowork(struct context *c, const unsigned int flags)
     }
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+    /* wake up when a handshake worker has finished */
+    if (c->options.mode == MODE_SERVER && tls_async_pk_event_fd() >= 0)
+    {
+        event_ctl(c->c2.event_set, tls_async_pk_event_fd(), EVENT_READ, (void *)&async_pk_shift);
+    }
+#endif
+
     /*
      * Possible scenarios:
      *  (1) tcp/udp port has data available to read
@@ -49,6 +49,7 @@
 #include "ping.h"
 #include "mstats.h"
 #include "ssl_verify.h"
+#include "tunmq.h"
 #include "tls_crypt.h"
 #include "forward.h"
 
@@ -975,6 +976,10 @@ uninit_static(void)
 #if defined(MEASURE_TLS_HANDSHAKE_STATS)
     show_tls_performance_stats();
 #endif
+
+    /* the thread running openvpn_main() may be reused by an embedding app */
+    gc_free_chunk_cache();
+    free_buf_pool();
 }
 
 void
@@ -986,6 +991,7 @@ init_verb_mute(struct context *c, unsigned int flags)
         set_check_status(D_LINK_ERRORS, D_READ_WRITE);
         set_debug_level(c->options.verbosity, SDL_CONSTRAIN);
         set_mute_cutoff(c->options.mute);
+        set_log_rate_limit(c->options.log_rate);
     }
 
     /* special D_LOG_RW mode */
@@ -1928,6 +1934,12 @@ do_close_tun(struct context *c, bool force)
         {
             static_context = NULL;
 
+#ifdef ENABLE_TUN_MQ
+            /* the workers poll the queue fds which close_tun() closes,
+             * e.g. when pulled options changed on a --persist-tun restart */
+            tun_mq_free(c);
+#endif
+
 #ifdef ENABLE_MANAGEMENT
             /* tell management layer we are about to close the TUN/TAP device */
             if (management)
@@ -4376,6 +4388,11 @@ close_instance(struct context *c)
         }
 #endif
 
+#ifdef ENABLE_TUN_MQ
+        /* stop the tun queue workers while key and socket are still there */
+        tun_mq_free(c);
+#endif
+
         /* free buffers */
         do_close_free_buf(c);
 
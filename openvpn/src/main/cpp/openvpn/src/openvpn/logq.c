@@ -0,0 +1,325 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#ifdef ENABLE_ASYNC_LOG
+
+#include <pthread.h>
+
+#include "buffer.h"
+#include "errlevel.h"
+#include "logq.h"
+
+#include "memdbg.h"
+
+/*
+ * Bounded multi-producer, single-consumer ring (D. Vyukov).  Each slot
+ * carries a sequence number: a producer may fill slot i & mask when its
+ * sequence is i, and publishes it by setting the sequence to i + 1.  The
+ * consumer hands it back for round i + size by setting it to i + size.
+ *
+ * Producers never wait for each other or for the log thread.  The only
+ * lock is taken when the log thread has gone to sleep on an empty queue,
+ * to wake it up again.
+ */
+
+struct log_queue_slot {
+    unsigned int seq;
+    struct log_queue_entry e;
+};
+
+static struct {
+    struct log_queue_slot *slots;
+    unsigned int mask;
+    log_queue_writer_t writer;
+    bool active;
+
+    unsigned int tail;          /* next slot to claim, producers */
+    unsigned int head;          /* next slot to write out, log thread */
+    unsigned int done;          /* slots written out so far */
+    unsigned int dropped;
+    unsigned int flush_waiters;
+    bool sleeping;
+    bool halt;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* signalled to wake up the log thread */
+    pthread_cond_t flushed;     /* broadcast when done has advanced */
+} log_queue; /* GLOBAL */
+
+static bool
+log_queue_ready(const unsigned int head)
+{
+    const struct log_queue_slot *s = &log_queue.slots[head & log_queue.mask];
+    return __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) == head + 1;
+}
+
+static void
+log_queue_report_dropped(const unsigned int dropped)
+{
+    struct log_queue_entry e;
+
+    e.flags = M_INFO;
+    gettimeofday(&e.tv, NULL);
+    openvpn_snprintf(e.text, sizeof(e.text),
+                     "NOTE: %u log message(s) dropped, --log-queue is full",
+                     dropped);
+    (*log_queue.writer)(&e);
+}
+
+static void *
+log_queue_thread(void *arg)
+{
+    unsigned int reported = 0;
+    unsigned int head = log_queue.head;
+
+    while (true)
+    {
+        unsigned int dropped;
+
+        if (log_queue_ready(head))
+        {
+            struct log_queue_slot *s = &log_queue.slots[head & log_queue.mask];
+            (*log_queue.writer)(&s->e);
+            __atomic_store_n(&s->seq, head + log_queue.mask + 1, __ATOMIC_RELEASE);
+            ++head;
+            __atomic_store_n(&log_queue.done, head, __ATOMIC_SEQ_CST);
+
+            /* pairs with the flush_waiters increment and done load in
+             * log_queue_flush(): one of the two sees the other */
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&log_queue.flush_waiters, __ATOMIC_SEQ_CST))
+            {
+                pthread_mutex_lock(&log_queue.lock);
+                pthread_cond_broadcast(&log_queue.flushed);
+                pthread_mutex_unlock(&log_queue.lock);
+            }
+            continue;
+        }
+
+        /* queue is empty, report drops before going to sleep */
+        dropped = __atomic_load_n(&log_queue.dropped, __ATOMIC_RELAXED);
+        if (dropped != reported)
+        {
+            log_queue_report_dropped(dropped - reported);
+            reported = dropped;
+        }
+
+        pthread_mutex_lock(&log_queue.lock);
+
+        /* never sleep on a waiting flush, it may have missed the last
+         * broadcast; flush_waiters only changes under the lock */
+        if (log_queue.flush_waiters)
+        {
+            pthread_cond_broadcast(&log_queue.flushed);
+        }
+
+        __atomic_store_n(&log_queue.sleeping, true, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (!log_queue_ready(head))
+        {
+            if (log_queue.halt)
+            {
+                pthread_mutex_unlock(&log_queue.lock);
+                break;
+            }
+            pthread_cond_wait(&log_queue.wake, &log_queue.lock);
+        }
+        __atomic_store_n(&log_queue.sleeping, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&log_queue.lock);
+    }
+
+    log_queue.head = head;
+    gc_free_chunk_cache();
+    return NULL;
+}
+
+void
+log_queue_start(unsigned int size, log_queue_writer_t writer)
+{
+    sigset_t all, old;
+    unsigned int n = 2;
+    unsigned int i;
+
+    ASSERT(!log_queue.active);
+
+    while (n < size && n < (1u << 20))
+    {
+        n <<= 1;
+    }
+
+    CLEAR(log_queue);
+    ALLOC_ARRAY_CLEAR(log_queue.slots, struct log_queue_slot, n);
+    for (i = 0; i < n; ++i)
+    {
+        log_queue.slots[i].seq = i;
+    }
+    log_queue.mask = n - 1;
+    log_queue.writer = writer;
+
+    pthread_mutex_init(&log_queue.lock, NULL);
+    pthread_cond_init(&log_queue.wake, NULL);
+    pthread_cond_init(&log_queue.flushed, NULL);
+
+    /* signals must keep going to the event loop thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if (pthread_create(&log_queue.thread, NULL, log_queue_thread, NULL))
+    {
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        msg(M_WARN, "Cannot start --log-queue thread, logging synchronously");
+        free(log_queue.slots);
+        CLEAR(log_queue);
+        return;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    __atomic_store_n(&log_queue.active, true, __ATOMIC_RELEASE);
+}
+
+void
+log_queue_stop(void)
+{
+    if (!__atomic_load_n(&log_queue.active, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&log_queue.lock);
+    log_queue.halt = true;
+    pthread_cond_signal(&log_queue.wake);
+    pthread_mutex_unlock(&log_queue.lock);
+    pthread_join(log_queue.thread, NULL);
+
+    __atomic_store_n(&log_queue.active, false, __ATOMIC_RELEASE);
+
+    pthread_cond_destroy(&log_queue.flushed);
+    pthread_cond_destroy(&log_queue.wake);
+    pthread_mutex_destroy(&log_queue.lock);
+    free(log_queue.slots);
+    log_queue.slots = NULL;
+}
+
+bool
+log_queue_push(unsigned int flags, const char *prefix,
+               const char *prefix_sep, const char *m1)
+{
+    const size_t prefix_len = strlen(prefix);
+    const size_t sep_len = strlen(prefix_sep);
+    const size_t m1_len = strlen(m1);
+    struct log_queue_slot *s;
+    unsigned int pos;
+
+    if (!__atomic_load_n(&log_queue.active, __ATOMIC_ACQUIRE)
+        || prefix_len + sep_len + m1_len >= LOG_QUEUE_TEXT_SIZE)
+    {
+        return false;
+    }
+
+    /* claim a slot */
+    pos = __atomic_load_n(&log_queue.tail, __ATOMIC_RELAXED);
+    while (true)
+    {
+        int diff;
+
+        s = &log_queue.slots[pos & log_queue.mask];
+        diff = (int) (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&log_queue.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* full */
+            __atomic_add_fetch(&log_queue.dropped, 1, __ATOMIC_RELAXED);
+            return true;
+        }
+        else
+        {
+            pos = __atomic_load_n(&log_queue.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    s->e.flags = flags;
+    gettimeofday(&s->e.tv, NULL);
+    memcpy(s->e.text, prefix, prefix_len);
+    memcpy(s->e.text + prefix_len, prefix_sep, sep_len);
+    memcpy(s->e.text + prefix_len + sep_len, m1, m1_len + 1);
+
+    /* publish, then wake up the log thread if it is sleeping */
+    __atomic_store_n(&s->seq, pos + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_queue.sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&log_queue.lock);
+        pthread_cond_signal(&log_queue.wake);
+        pthread_mutex_unlock(&log_queue.lock);
+    }
+    return true;
+}
+
+void
+log_queue_flush(void)
+{
+    unsigned int target;
+
+    if (!__atomic_load_n(&log_queue.active, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    target = __atomic_load_n(&log_queue.tail, __ATOMIC_ACQUIRE);
+    pthread_mutex_lock(&log_queue.lock);
+    __atomic_add_fetch(&log_queue.flush_waiters, 1, __ATOMIC_SEQ_CST);
+    while ((int) (__atomic_load_n(&log_queue.done, __ATOMIC_SEQ_CST) - target) < 0)
+    {
+        pthread_cond_signal(&log_queue.wake);
+        pthread_cond_wait(&log_queue.flushed, &log_queue.lock);
+    }
+    __atomic_sub_fetch(&log_queue.flush_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&log_queue.lock);
+}
+
+unsigned int
+log_queue_dropped(void)
+{
+    return __atomic_load_n(&log_queue.dropped, __ATOMIC_RELAXED);
+}
+
+#else  /* ifdef ENABLE_ASYNC_LOG */
+static void
+dummy(void)
+{
+}
+#endif /* ENABLE_ASYNC_LOG */
@@ -0,0 +1,85 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Asynchronous log output.  Messages are handed from the threads
+ * calling msg() to a log thread through a bounded lock-free ring, so
+ * that writing to the log file, stdout or syslog never blocks packet
+ * processing.  If the ring is full, messages are dropped and counted.
+ */
+
+#ifndef LOGQ_H
+#define LOGQ_H
+
+#ifdef ENABLE_ASYNC_LOG
+
+#include "basic.h"
+
+/* longer messages bypass the queue */
+#define LOG_QUEUE_TEXT_SIZE 1024
+
+struct log_queue_entry {
+    unsigned int flags;         /* msg() flags */
+    struct timeval tv;          /* time of the msg() call */
+    char text[LOG_QUEUE_TEXT_SIZE];
+};
+
+/* called on the log thread for each queued message */
+typedef void (*log_queue_writer_t)(const struct log_queue_entry *e);
+
+/**
+ * Start the log thread.
+ *
+ * @param size    number of queued messages, rounded up to a power of 2
+ * @param writer  output function
+ */
+void log_queue_start(unsigned int size, log_queue_writer_t writer);
+
+/**
+ * Write out all queued messages and stop the log thread.
+ */
+void log_queue_stop(void);
+
+/**
+ * Queue a message, the text is prefix, prefix_sep and m1 concatenated.
+ *
+ * @return true if the message was queued or dropped because the queue
+ *         is full, false if the log thread is not running or the message
+ *         is too long, so that the caller must write it itself.
+ */
+bool log_queue_push(unsigned int flags, const char *prefix,
+                    const char *prefix_sep, const char *m1);
+
+/**
+ * Wait until all messages queued so far have been written out.
+ * Called before writing a message directly, to keep the log in order.
+ */
+void log_queue_flush(void);
+
+/**
+ * Return the number of messages dropped because the queue was full.
+ */
+unsigned int log_queue_dropped(void);
+
+#endif /* ENABLE_ASYNC_LOG */
+#endif /* LOGQ_H */
@@ -67,6 +67,8 @@ static void man_output_standalone(struct management *man, volatile int *signal_r
 
 static void man_reset_client_socket(struct management *man, const bool exiting);
 
+static void man_special_state(struct management *man);
+
 static void
 man_help(void)
 {
@@ -180,7 +182,7 @@ man_welcome(struct management *man)
         MANAGEMENT_VERSION);
     if (man->persist.special_state_msg)
     {
-        msg(M_CLIENT, "%s", man->persist.special_state_msg);
+        man_special_state(man);
     }
 }
 
@@ -261,6 +263,26 @@ man_output_list_push(struct management *man, const char *str)
     man_output_list_push_finalize(man);
 }
 
+/*
+ * (Re)send the pending query, e.g. to a freshly connected client.
+ */
+static void
+man_special_state(struct management *man)
+{
+    msg(M_CLIENT, "%s", man->persist.special_state_msg);
+#ifdef TARGET_ANDROID
+    if (man->persist.special_state_payload)
+    {
+        const struct buffer_entry *e;
+        for (e = man->persist.special_state_payload->head; e; e = e->next)
+        {
+            man_output_list_push_str(man, BSTR(&e->buf));
+        }
+        man_output_list_push_finalize(man);
+    }
+#endif
+}
+
 static void
 man_prompt(struct management *man)
 {
@@ -427,7 +449,7 @@ man_signal(struct management *man, const char *name)
         {
             if (man->persist.special_state_msg)
             {
-                msg(M_CLIENT, "%s", man->persist.special_state_msg);
+                man_special_state(man);
             }
             else
             {
@@ -2098,14 +2120,110 @@ man_recv_with_fd(int fd, void *ptr, size_t nbytes, int flags, int *recvfd)
     return (n);
 }
 
+/*
+ * Tun configuration items which may be deferred and sent as part of a
+ * CONFIG_BATCH request.  Everything else (OPENTUN, PROTECTFD, ...) needs
+ * an immediate answer or a file descriptor and is never queued.
+ */
+static bool
+man_android_config_item(const char *command)
+{
+    static const char *items[] = {
+        "IFCONFIG", "IFCONFIG6", "ROUTE", "ROUTE6",
+        "DNSSERVER", "DNS6SERVER", "DNSDOMAIN"
+    };
+    int i;
+
+    for (i = 0; i < SIZE(items); ++i)
+    {
+        if (streq(command, items[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+man_android_config_queue(struct management *man, const char *command, const char *msg)
+{
+    struct gc_arena gc = gc_new();
+    struct buffer item = alloc_buf_gc(strlen(command) + strlen(msg) + 4, &gc);
+
+    if (!man->persist.android_config)
+    {
+        man->persist.android_config = buffer_list_new(0);
+    }
+
+    buf_printf(&item, "%s %s\r\n", command, msg);
+    man->persist.android_config_len += BLEN(&item);
+    buffer_list_push(man->persist.android_config, BSTR(&item));
+
+    gc_free(&gc);
+}
+
+/*
+ * Send all queued configuration items with a single NEED-OK:
+ *
+ *   >NEED-OK:Need 'CONFIG_BATCH' confirmation MSG:<count> <length>
+ *
+ * followed by exactly <count> lines, one "<command> <msg>" item per
+ * line in the order they were queued.  <length> is the total size of
+ * these lines in bytes, including their "\r\n" endings, so the UI can
+ * check that it received the whole batch before acknowledging it once.
+ */
+static bool
+man_android_config_flush(struct management *man)
+{
+    struct buffer_list *items = man->persist.android_config;
+    struct user_pass up;
+    bool ret;
+
+    if (!buffer_list_defined(items))
+    {
+        return true;
+    }
+
+    CLEAR(up);
+    openvpn_snprintf(up.username, sizeof(up.username), "%d %d",
+                     items->size, man->persist.android_config_len);
+
+    man->persist.special_state_payload = items;
+    management_query_user_pass(man, &up, "CONFIG_BATCH", GET_USER_PASS_NEED_OK, (void *) 0);
+    man->persist.special_state_payload = NULL;
+
+    ret = strcmp("ok", up.password) == 0;
+    if (!ret)
+    {
+        msg(M_WARN, "WARNING: management client did not accept %d tun configuration items",
+            items->size);
+    }
+
+    buffer_list_reset(items);
+    man->persist.android_config_len = 0;
+    return ret;
+}
+
 /*
  * The android control method will instruct the GUI part of openvpn to do
  * the route/ifconfig/open tun command.   See doc/android.txt for details.
+ *
+ * Configuration items are queued for newer clients and sent in bulk
+ * ahead of the next request which is not a configuration item.
  */
 bool
 management_android_control(struct management *man, const char *command, const char *msg)
 {
     struct user_pass up;
+
+    if (man->connection.client_version >= MANAGEMENT_VERSION_CONFIG_BATCH
+        && man_android_config_item(command))
+    {
+        man_android_config_queue(man, command, msg);
+        return true;
+    }
+    man_android_config_flush(man);
+
     CLEAR(up);
     strncpy(up.username, msg, sizeof(up.username)-1);
 
@@ -2123,6 +2241,9 @@ int
 managment_android_persisttun_action(struct management *man)
 {
     struct user_pass up;
+
+    man_android_config_flush(man);
+
     CLEAR(up);
     strcpy(up.username,"tunmethod");
     management_query_user_pass(management, &up, "PERSIST_TUN_ACTION",
@@ -2357,6 +2478,10 @@ man_persist_close(struct man_persist *mp)
         log_history_close(mp->state);
     }
 
+#ifdef TARGET_ANDROID
+    buffer_list_free(mp->android_config);
+#endif
+
     CLEAR(*mp);
 }
 
@@ -3453,7 +3578,7 @@ management_query_user_pass(struct management *man,
         if (ret)
         {
             man->persist.special_state_msg = BSTR(&alert_msg);
-            msg(M_CLIENT, "%s", man->persist.special_state_msg);
+            man_special_state(man);
 
             /* tell command line parser which info we need */
             man->connection.up_query_mode = up_query_mode;
@@ -216,6 +216,12 @@ struct man_persist {
     bool hold_release;
 
     const char *special_state_msg;
+#ifdef TARGET_ANDROID
+    struct buffer_list *special_state_payload; /* lines following special_state_msg */
+
+    struct buffer_list *android_config; /* queued CONFIG_BATCH items */
+    int android_config_len;             /* bytes of queued items, including line ends */
+#endif
 
     counter_type bytes_in;
     counter_type bytes_out;
@@ -393,6 +399,13 @@ bool management_query_user_pass(struct management *man,
                                 const char *static_challenge);
 
 #ifdef TARGET_ANDROID
+/*
+ * Clients announcing at least this version receive the tun/route/DNS
+ * configuration as one CONFIG_BATCH request instead of a NEED-OK
+ * round-trip per item.
+ */
+#define MANAGEMENT_VERSION_CONFIG_BATCH 4
+
 bool management_android_control(struct management *man, const char *command, const char *msg);
 
 #define ANDROID_KEEP_OLD_TUN 1
@@ -132,44 +132,233 @@ mbuf_extract_item(struct mbuf_set *ms, struct mbuf_item *item)
     return ret;
 }
 
-struct multi_instance *
-mbuf_peek_dowork(struct mbuf_set *ms)
+struct mbuf_fq *
+mbuf_fq_init(unsigned int capacity, int quantum)
 {
-    struct multi_instance *ret = NULL;
-    if (ms)
+    struct mbuf_fq *ret;
+    ALLOC_OBJ_CLEAR(ret, struct mbuf_fq);
+    ret->capacity = capacity;
+    ret->quantum = max_int(quantum, 1);
+    return ret;
+}
+
+void
+mbuf_fq_free(struct mbuf_fq *fq)
+{
+    if (fq)
     {
-        int i;
-        for (i = 0; i < (int) ms->len; ++i)
+        while (fq->head)
         {
-            struct mbuf_item *item = &ms->array[MBUF_INDEX(ms->head, i, ms->capacity)];
-            if (item->instance)
-            {
-                ret = item->instance;
-                break;
-            }
+            mbuf_fq_flow_free(fq, fq->head);
+        }
+        free(fq);
+    }
+}
+
+void
+mbuf_fq_flow_init(struct mbuf_fq_flow *flow, struct multi_instance *instance)
+{
+    CLEAR(*flow);
+    flow->instance = instance;
+}
+
+static void
+mbuf_fq_link(struct mbuf_fq *fq, struct mbuf_fq_flow *flow)
+{
+    flow->prev = fq->tail;
+    flow->next = NULL;
+    if (fq->tail)
+    {
+        fq->tail->next = flow;
+    }
+    else
+    {
+        fq->head = flow;
+    }
+    fq->tail = flow;
+}
+
+static void
+mbuf_fq_unlink(struct mbuf_fq *fq, struct mbuf_fq_flow *flow)
+{
+    if (flow->prev)
+    {
+        flow->prev->next = flow->next;
+    }
+    else
+    {
+        fq->head = flow->next;
+    }
+    if (flow->next)
+    {
+        flow->next->prev = flow->prev;
+    }
+    else
+    {
+        fq->tail = flow->prev;
+    }
+    flow->prev = flow->next = NULL;
+}
+
+static void
+mbuf_fq_deactivate(struct mbuf_fq *fq, struct mbuf_fq_flow *flow)
+{
+    if (flow->active)
+    {
+        mbuf_fq_unlink(fq, flow);
+        flow->active = false;
+        flow->deficit = 0;
+        --fq->n_active;
+    }
+}
+
+/*
+ * Drop the oldest packet queued for flow.
+ */
+static void
+mbuf_fq_drop(struct mbuf_fq *fq, struct mbuf_fq_flow *flow)
+{
+    struct mbuf_item rm;
+    if (mbuf_extract_item(flow->queue, &rm))
+    {
+        mbuf_free_buf(rm.buffer);
+        --fq->len;
+        ++flow->n_dropped;
+        ++fq->n_dropped;
+        msg(D_MULTI_DROPPED, "MBUF: mbuf packet dropped");
+    }
+    if (!mbuf_len(flow->queue))
+    {
+        mbuf_fq_deactivate(fq, flow);
+    }
+}
+
+/*
+ * When the scheduler is full, the flow with the deepest
+ * queue pays for the new packet.
+ */
+static struct mbuf_fq_flow *
+mbuf_fq_longest(struct mbuf_fq *fq, struct mbuf_fq_flow *flow)
+{
+    struct mbuf_fq_flow *ret = flow;
+    struct mbuf_fq_flow *f;
+    for (f = fq->head; f != NULL; f = f->next)
+    {
+        if (mbuf_fq_flow_len(f) > mbuf_fq_flow_len(ret))
+        {
+            ret = f;
         }
     }
     return ret;
 }
 
 void
-mbuf_dereference_instance(struct mbuf_set *ms, struct multi_instance *mi)
+mbuf_fq_flow_free(struct mbuf_fq *fq, struct mbuf_fq_flow *flow)
 {
-    if (ms)
+    if (flow->queue)
     {
-        int i;
-        for (i = 0; i < (int) ms->len; ++i)
+        fq->len -= mbuf_len(flow->queue);
+        mbuf_free(flow->queue);
+        flow->queue = NULL;
+    }
+    mbuf_fq_deactivate(fq, flow);
+}
+
+void
+mbuf_fq_add_buf(struct mbuf_fq *fq, struct mbuf_fq_flow *flow, struct mbuf_buffer *mb)
+{
+    struct mbuf_item item;
+
+    if (!flow->queue)
+    {
+        flow->queue = mbuf_init(fq->capacity);
+    }
+
+    if (fq->len >= fq->capacity)
+    {
+        mbuf_fq_drop(fq, mbuf_fq_longest(fq, flow));
+    }
+
+    item.buffer = mb;
+    item.instance = flow->instance;
+    mbuf_add_item(flow->queue, &item);
+    if (++fq->len > fq->max_queued)
+    {
+        fq->max_queued = fq->len;
+    }
+
+    if (!flow->active)
+    {
+        mbuf_fq_link(fq, flow);
+        flow->active = true;
+        ++fq->n_active;
+    }
+}
+
+/*
+ * Return the flow which is allowed to send next, granting
+ * quanta and rotating the active list as needed.  Calling
+ * it again without extracting a packet returns the same flow.
+ */
+static struct mbuf_fq_flow *
+mbuf_fq_select(struct mbuf_fq *fq)
+{
+    while (fq->head)
+    {
+        struct mbuf_fq_flow *flow = fq->head;
+        if (!mbuf_len(flow->queue))
         {
-            struct mbuf_item *item = &ms->array[MBUF_INDEX(ms->head, i, ms->capacity)];
-            if (item->instance == mi)
+            mbuf_fq_deactivate(fq, flow);
+        }
+        else if (flow->deficit > 0)
+        {
+            return flow;
+        }
+        else
+        {
+            flow->deficit += fq->quantum;
+            if (flow->deficit <= 0 && flow != fq->tail)
+            {
+                mbuf_fq_unlink(fq, flow);
+                mbuf_fq_link(fq, flow);
+            }
+        }
+    }
+    return NULL;
+}
+
+bool
+mbuf_fq_extract_item(struct mbuf_fq *fq, struct mbuf_item *item)
+{
+    struct mbuf_fq_flow *flow;
+
+    if (fq && (flow = mbuf_fq_select(fq)))
+    {
+        if (mbuf_extract_item(flow->queue, item))
+        {
+            --fq->len;
+            flow->deficit -= BLEN(&item->buffer->buf);
+            if (!mbuf_len(flow->queue))
+            {
+                mbuf_fq_deactivate(fq, flow);
+            }
+            else if (flow->deficit <= 0 && flow != fq->tail)
             {
-                mbuf_free_buf(item->buffer);
-                item->buffer = NULL;
-                item->instance = NULL;
-                msg(D_MBUF, "MBUF: dereferenced queued packet");
+                /* round used up, go to the back of the line */
+                mbuf_fq_unlink(fq, flow);
+                mbuf_fq_link(fq, flow);
             }
+            return true;
         }
     }
+    return false;
+}
+
+struct multi_instance *
+mbuf_fq_peek_dowork(struct mbuf_fq *fq)
+{
+    struct mbuf_fq_flow *flow = mbuf_fq_select(fq);
+    return flow ? flow->instance : NULL;
 }
 
 #else  /* if P2MP */
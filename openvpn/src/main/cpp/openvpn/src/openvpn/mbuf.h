@@ -35,6 +35,7 @@
 
 #include "basic.h"
 #include "buffer.h"
+#include "common.h"
 
 struct multi_instance;
 
@@ -64,6 +65,37 @@ struct mbuf_set
     struct mbuf_item *array;
 };
 
+/*
+ * Per-instance queue, scheduled by an mbuf_fq.
+ */
+struct mbuf_fq_flow
+{
+    struct mbuf_set *queue;     /* allocated on first use */
+    struct multi_instance *instance;
+    struct mbuf_fq_flow *prev;
+    struct mbuf_fq_flow *next;
+    int deficit;                /* bytes this flow may still send in the current round */
+    bool active;                /* linked into mbuf_fq active list */
+    counter_type n_dropped;
+};
+
+/*
+ * Deficit round robin scheduler over per-instance queues, so that
+ * one instance with a deep queue does not add latency to the
+ * packets queued for every other instance.
+ */
+struct mbuf_fq
+{
+    struct mbuf_fq_flow *head;  /* active flows, in round robin order */
+    struct mbuf_fq_flow *tail;
+    unsigned int capacity;      /* max packets queued over all flows */
+    unsigned int len;
+    unsigned int max_queued;
+    unsigned int n_active;
+    int quantum;                /* bytes added to a flow's deficit per round */
+    counter_type n_dropped;
+};
+
 struct mbuf_set *mbuf_init(unsigned int size);
 
 void mbuf_free(struct mbuf_set *ms);
@@ -76,8 +108,6 @@ void mbuf_add_item(struct mbuf_set *ms, const struct mbuf_item *item);
 
 bool mbuf_extract_item(struct mbuf_set *ms, struct mbuf_item *item);
 
-void mbuf_dereference_instance(struct mbuf_set *ms, struct multi_instance *mi);
-
 static inline bool
 mbuf_defined(const struct mbuf_set *ms)
 {
@@ -96,14 +126,44 @@ mbuf_maximum_queued(const struct mbuf_set *ms)
     return (int) ms->max_queued;
 }
 
-struct multi_instance *mbuf_peek_dowork(struct mbuf_set *ms);
+struct mbuf_fq *mbuf_fq_init(unsigned int capacity, int quantum);
+
+void mbuf_fq_free(struct mbuf_fq *fq);
+
+void mbuf_fq_flow_init(struct mbuf_fq_flow *flow, struct multi_instance *instance);
+
+void mbuf_fq_flow_free(struct mbuf_fq *fq, struct mbuf_fq_flow *flow);
+
+void mbuf_fq_add_buf(struct mbuf_fq *fq, struct mbuf_fq_flow *flow, struct mbuf_buffer *mb);
+
+bool mbuf_fq_extract_item(struct mbuf_fq *fq, struct mbuf_item *item);
+
+struct multi_instance *mbuf_fq_peek_dowork(struct mbuf_fq *fq);
+
+static inline bool
+mbuf_fq_defined(const struct mbuf_fq *fq)
+{
+    return fq && fq->len;
+}
+
+static inline int
+mbuf_fq_maximum_queued(const struct mbuf_fq *fq)
+{
+    return (int) fq->max_queued;
+}
+
+static inline unsigned int
+mbuf_fq_flow_len(const struct mbuf_fq_flow *flow)
+{
+    return flow->queue ? mbuf_len(flow->queue) : 0;
+}
 
 static inline struct multi_instance *
-mbuf_peek(struct mbuf_set *ms)
+mbuf_fq_peek(struct mbuf_fq *fq)
 {
-    if (mbuf_defined(ms))
+    if (mbuf_fq_defined(fq))
     {
-        return mbuf_peek_dowork(ms);
+        return mbuf_fq_peek_dowork(fq);
     }
     else
     {
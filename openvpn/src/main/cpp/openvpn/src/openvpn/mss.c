@@ -39,98 +39,104 @@
  */
 
 /*
- * IPv4 packet: find TCP header, check flags for "SYN"
- *              if yes, hand to mss_fixup_dowork()
+ * IPv4 packet: hand TCP SYN with options to mss_fixup_dowork(),
+ *              see ip_classify()
  */
 void
 mss_fixup_ipv4(struct buffer *buf, int maxmss)
 {
-    const struct openvpn_iphdr *pip;
-    int hlen;
+    int l4_offset;
+    const unsigned int ipc = ip_classify(BPTR(buf), BLEN(buf), &l4_offset);
 
-    if (BLEN(buf) < (int) sizeof(struct openvpn_iphdr))
-    {
-        return;
-    }
-
-    verify_align_4(buf);
-    pip = (struct openvpn_iphdr *) BPTR(buf);
-
-    hlen = OPENVPN_IPH_GET_LEN(pip->version_len);
-
-    if (pip->protocol == OPENVPN_IPPROTO_TCP
-        && ntohs(pip->tot_len) == BLEN(buf)
-        && (ntohs(pip->frag_off) & OPENVPN_IP_OFFMASK) == 0
-        && hlen <= BLEN(buf)
-        && BLEN(buf) - hlen
-        >= (int) sizeof(struct openvpn_tcphdr))
+    if ((ipc & (IPC_IPV4 | IPC_TCP_SYN)) == (IPC_IPV4 | IPC_TCP_SYN))
     {
         struct buffer newbuf = *buf;
-        if (buf_advance(&newbuf, hlen))
+        verify_align_4(buf);
+        if (buf_advance(&newbuf, l4_offset))
         {
-            struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) BPTR(&newbuf);
-            if (tc->flags & OPENVPN_TCPH_SYN_MASK)
-            {
-                mss_fixup_dowork(&newbuf, (uint16_t) maxmss);
-            }
+            mss_fixup_dowork(&newbuf, (uint16_t) maxmss, false);
         }
     }
 }
 
 /*
- * IPv6 packet: find TCP header, check flags for "SYN"
- *              if yes, hand to mss_fixup_dowork()
- *              (IPv6 header structure is sufficiently different from IPv4...)
+ * IPv6 packet: hand TCP SYN with options to mss_fixup_dowork(),
+ *              see ip_classify()
+ *
+ * An IPv6 packet could, theoretically, have a chain of multiple headers
+ * before the final header (TCP, UDP, ...), so we'd need to walk that
+ * chain (see RFC 2460 and RFC 6564 for details).
+ *
+ * In practice, "most typically used" extension headers (AH, routing,
+ * fragment, mobility) are very unlikely to be seen inside an OpenVPN
+ * tun, so for now, we only handle the case of "single next header = TCP"
  */
 void
 mss_fixup_ipv6(struct buffer *buf, int maxmss)
 {
-    const struct openvpn_ipv6hdr *pip6;
-    struct buffer newbuf;
+    int l4_offset;
+    const unsigned int ipc = ip_classify(BPTR(buf), BLEN(buf), &l4_offset);
 
-    if (BLEN(buf) < (int) sizeof(struct openvpn_ipv6hdr))
+    if ((ipc & (IPC_IPV6 | IPC_TCP_SYN)) == (IPC_IPV6 | IPC_TCP_SYN))
     {
-        return;
+        struct buffer newbuf = *buf;
+        verify_align_4(buf);
+        if (buf_advance(&newbuf, l4_offset))
+        {
+            mss_fixup_dowork(&newbuf, (uint16_t) maxmss-20, false);
+        }
     }
+}
 
-    verify_align_4(buf);
-    pip6 = (struct openvpn_ipv6hdr *) BPTR(buf);
+/*
+ * mss_fixup_ipv4() or mss_fixup_ipv6(), whichever matches the packet,
+ * without the D_MSS log message.  For the --tun-queues worker threads,
+ * which must not call msg().
+ */
+void
+mss_fixup_ip_quiet(struct buffer *buf, int maxmss)
+{
+    int l4_offset;
+    const unsigned int ipc = ip_classify(BPTR(buf), BLEN(buf), &l4_offset);
 
-    /* do we have the full IPv6 packet?
-     * "payload_len" does not include IPv6 header (+40 bytes)
-     */
-    if (BLEN(buf) != (int) ntohs(pip6->payload_len)+40)
+    if (ipc & IPC_TCP_SYN)
     {
-        return;
+        struct buffer newbuf = *buf;
+        verify_align_4(buf);
+        if (buf_advance(&newbuf, l4_offset))
+        {
+            mss_fixup_dowork(&newbuf, (uint16_t) (ipc & IPC_IPV6 ? maxmss-20 : maxmss), true);
+        }
     }
+}
 
-    /* follow header chain until we reach final header, then check for TCP
-     *
-     * An IPv6 packet could, theoretically, have a chain of multiple headers
-     * before the final header (TCP, UDP, ...), so we'd need to walk that
-     * chain (see RFC 2460 and RFC 6564 for details).
-     *
-     * In practice, "most typically used" extension headers (AH, routing,
-     * fragment, mobility) are very unlikely to be seen inside an OpenVPN
-     * tun, so for now, we only handle the case of "single next header = TCP"
-     */
-    if (pip6->nexthdr != OPENVPN_IPPROTO_TCP)
-    {
-        return;
-    }
+/*
+ * lower the MSS value of the option at opt to maxmss
+ */
+static inline void
+mss_update(struct openvpn_tcphdr *tc, uint8_t *opt, uint16_t maxmss, bool quiet)
+{
+    const uint16_t mssval = (opt[2]<<8)+opt[3];
+    uint16_t old_word, new_word;
 
-    /* skip IPv6 header (40 bytes),
-     * verify remainder is large enough to contain a full TCP header
-     */
-    newbuf = *buf;
-    if (buf_advance( &newbuf, 40 )
-        && BLEN(&newbuf) >= (int) sizeof(struct openvpn_tcphdr))
+    if (mssval > maxmss)
     {
-        struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) BPTR(&newbuf);
-        if (tc->flags & OPENVPN_TCPH_SYN_MASK)
+        if (!quiet)
+        {
+            dmsg(D_MSS, "MSS: %d -> %d", (int) mssval, (int) maxmss);
+        }
+        memcpy(&old_word, opt + 2, sizeof(old_word));
+        opt[2] = (maxmss>>8)&0xff;
+        opt[3] = maxmss&0xff;
+        memcpy(&new_word, opt + 2, sizeof(new_word));
+        if ((opt - (uint8_t *) tc) & 1)
         {
-            mss_fixup_dowork(&newbuf, (uint16_t) maxmss-20);
+            /* at an odd offset, the MSS bytes fall in the other
+             * halves of two checksum words */
+            old_word = (uint16_t) ((old_word << 8) | (old_word >> 8));
+            new_word = (uint16_t) ((new_word << 8) | (new_word >> 8));
         }
+        update_checksum16(&tc->check, old_word, new_word);
     }
 }
 
@@ -140,12 +146,10 @@ mss_fixup_ipv6(struct buffer *buf, int maxmss)
  */
 
 void
-mss_fixup_dowork(struct buffer *buf, uint16_t maxmss)
+mss_fixup_dowork(struct buffer *buf, uint16_t maxmss, bool quiet)
 {
     int hlen, olen, optlen;
     uint8_t *opt;
-    uint16_t mssval;
-    int accumulate;
     struct openvpn_tcphdr *tc;
 
     if (BLEN(buf) < (int) sizeof(struct openvpn_tcphdr))
@@ -164,10 +168,19 @@ mss_fixup_dowork(struct buffer *buf, uint16_t maxmss)
         return;
     }
 
-    for (olen = hlen - sizeof(struct openvpn_tcphdr),
-         opt = (uint8_t *)(tc + 1);
-         olen > 1;
-         olen -= optlen, opt += optlen)
+    olen = hlen - sizeof(struct openvpn_tcphdr);
+    opt = (uint8_t *)(tc + 1);
+
+    /* every common stack sends MSS as the first option */
+    if (olen >= OPENVPN_TCPOLEN_MAXSEG
+        && opt[0] == OPENVPN_TCPOPT_MAXSEG
+        && opt[1] == OPENVPN_TCPOLEN_MAXSEG)
+    {
+        mss_update(tc, opt, maxmss, quiet);
+        return;
+    }
+
+    for (; olen > 1; olen -= optlen, opt += optlen)
     {
         if (*opt == OPENVPN_TCPOPT_EOL)
         {
@@ -190,16 +203,7 @@ mss_fixup_dowork(struct buffer *buf, uint16_t maxmss)
                 {
                     continue;
                 }
-                mssval = (opt[2]<<8)+opt[3];
-                if (mssval > maxmss)
-                {
-                    dmsg(D_MSS, "MSS: %d -> %d", (int) mssval, (int) maxmss);
-                    accumulate = htons(mssval);
-                    opt[2] = (maxmss>>8)&0xff;
-                    opt[3] = maxmss&0xff;
-                    accumulate -= htons(maxmss);
-                    ADJUST_CHECKSUM(accumulate, tc->check);
-                }
+                mss_update(tc, opt, maxmss, quiet);
             }
         }
     }
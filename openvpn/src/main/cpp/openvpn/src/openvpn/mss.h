@@ -31,6 +31,8 @@ void mss_fixup_ipv4(struct buffer *buf, int maxmss);
 
 void mss_fixup_ipv6(struct buffer *buf, int maxmss);
 
-void mss_fixup_dowork(struct buffer *buf, uint16_t maxmss);
+void mss_fixup_ip_quiet(struct buffer *buf, int maxmss);
+
+void mss_fixup_dowork(struct buffer *buf, uint16_t maxmss, bool quiet);
 
 #endif
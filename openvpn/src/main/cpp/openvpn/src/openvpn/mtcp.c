@@ -69,6 +69,10 @@
 #define MTCP_FILE_CLOSE_WRITE ((void *)5)
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+#define MTCP_ASYNC_PK_DONE ((void *)6)
+#endif
+
 #define MTCP_N           ((void *)16) /* upper bound on MTCP_x */
 
 struct ta_iow_flags
@@ -283,6 +287,14 @@ multi_tcp_wait(const struct context *c,
     event_ctl(mtcp->es, c->c2.inotify_fd, EVENT_READ, MTCP_FILE_CLOSE_WRITE);
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+    /* wake up when a handshake worker has finished */
+    if (tls_async_pk_event_fd() >= 0)
+    {
+        event_ctl(mtcp->es, tls_async_pk_event_fd(), EVENT_READ, MTCP_ASYNC_PK_DONE);
+    }
+#endif
+
     status = event_wait(mtcp->es, &c->c2.timeval, mtcp->esr, mtcp->maxevents);
     update_time();
     mtcp->n_esr = 0;
@@ -740,6 +752,12 @@ multi_tcp_process_io(struct multi_context *m)
             {
                 multi_process_file_closed(m, MPP_PRE_SELECT | MPP_RECORD_TOUCH);
             }
+#endif
+#ifdef ENABLE_ASYNC_PK
+            else if (e->arg == MTCP_ASYNC_PK_DONE)
+            {
+                multi_process_async_pk(m);
+            }
 #endif
         }
         if (IS_SIG(&m->top))
@@ -754,7 +772,7 @@ multi_tcp_process_io(struct multi_context *m)
      */
     {
         struct multi_instance *mi;
-        while (!IS_SIG(&m->top) && (mi = mbuf_peek(m->mbuf)) != NULL)
+        while (!IS_SIG(&m->top) && (mi = mbuf_fq_peek(m->mbuf)) != NULL)
         {
             multi_tcp_action(m, mi, TA_SOCKET_WRITE, true);
         }
@@ -41,6 +41,78 @@
 #include <sys/inotify.h>
 #endif
 
+/*
+ * Decide whether a packet from a peer without an instance may create
+ * one.  A reset is answered with a handshake cookie instead, so that
+ * no state is committed before the peer has shown that it receives
+ * packets sent to its source address.  Returns true if the packet
+ * echoed a valid cookie, setting *cookie, or is a tls-crypt-v2 reset.
+ */
+static bool
+multi_check_handshake_cookie(struct multi_context *m,
+                             struct tls_pre_decrypt_state *state,
+                             bool *cookie)
+{
+    struct gc_arena gc = gc_new();
+    const struct openvpn_sockaddr *from = &m->top.c2.from.dest;
+    const int window = m->top.options.handshake_window;
+    bool ret = false;
+
+    *cookie = false;
+    switch (tls_pre_decrypt_lite(m->top.c2.tls_auth_standalone, state,
+                                 &m->top.c2.from, &m->top.c2.buf))
+    {
+        case VERDICT_VALID_RESET_V2:
+        {
+            const struct session_id sid =
+                tls_cookie_session_id(m->cookie_hmac, &state->peer_session_id,
+                                      from, window, 0);
+
+            ASSERT(buf_init(&m->cookie_reply, FRAME_HEADROOM(&m->top.c2.frame)));
+            if (tls_reset_standalone(m->top.c2.tls_auth_standalone, state, &sid,
+                                     &m->cookie_reply))
+            {
+                m->cookie_reply_dest = m->top.c2.from;
+                ++m->n_cookies_sent;
+                dmsg(D_MULTI_DEBUG, "MULTI: answering reset from %s with a handshake cookie",
+                     print_link_socket_actual(&m->top.c2.from, &gc));
+            }
+            else
+            {
+                buf_reset_len(&m->cookie_reply);
+            }
+            break;
+        }
+
+        case VERDICT_VALID_RESET_V3:
+            /* the peer's later packets can only be unwrapped with the
+             * tls-crypt-v2 client key of this reset */
+            ret = true;
+            break;
+
+        case VERDICT_VALID_CONTROL:
+            if (tls_cookie_check(m->cookie_hmac, state, from, window))
+            {
+                ++m->n_cookies_validated;
+                *cookie = true;
+                ret = true;
+            }
+            else
+            {
+                ++m->n_cookies_rejected;
+                dmsg(D_MULTI_DEBUG, "MULTI: control packet from %s without a valid handshake cookie",
+                     print_link_socket_actual(&m->top.c2.from, &gc));
+            }
+            break;
+
+        case VERDICT_INVALID:
+            break;
+    }
+
+    gc_free(&gc);
+    return ret;
+}
+
 /*
  * Get a client instance based on real address.  If
  * the instance doesn't exist, create it while
@@ -97,8 +169,11 @@ multi_get_create_instance_udp(struct multi_context *m, bool *floated)
         }
         if (!mi)
         {
+            struct tls_pre_decrypt_state state;
+            bool cookie = false;
+
             if (!m->top.c2.tls_auth_standalone
-                || tls_pre_decrypt_lite(m->top.c2.tls_auth_standalone, &m->top.c2.from, &m->top.c2.buf))
+                || multi_check_handshake_cookie(m, &state, &cookie))
             {
                 if (frequency_limit_event_allowed(m->new_connection_limiter))
                 {
@@ -126,6 +201,12 @@ multi_get_create_instance_udp(struct multi_context *m, bool *floated)
                         /* should not really end up here, since multi_create_instance returns null
                          * if amount of clients exceeds max_clients */
                         ASSERT(i < m->max_clients);
+
+                        if (cookie)
+                        {
+                            tls_multi_accept_cookie(mi->context.c2.tls_multi, &state,
+                                                    &m->top.c2.from);
+                        }
                     }
                 }
                 else
@@ -160,7 +241,18 @@ multi_get_create_instance_udp(struct multi_context *m, bool *floated)
 static inline void
 multi_process_outgoing_link(struct multi_context *m, const unsigned int mpp_flags)
 {
-    struct multi_instance *mi = multi_process_outgoing_link_pre(m);
+    struct multi_instance *mi;
+
+    /* reply to a reset, which has no instance to send it */
+    if (BLEN(&m->cookie_reply) > 0)
+    {
+        m->top.c2.to_link = m->cookie_reply;
+        m->top.c2.to_link_addr = &m->cookie_reply_dest;
+        process_outgoing_link(&m->top);
+        buf_reset_len(&m->cookie_reply);
+    }
+
+    mi = multi_process_outgoing_link_pre(m);
     if (mi)
     {
         multi_process_outgoing_link_dowork(m, mi, mpp_flags);
@@ -202,6 +294,12 @@ multi_process_io_udp(struct multi_context *m)
     {
         strcat(buf, "FC/");
     }
+#endif
+#ifdef ENABLE_ASYNC_PK
+    else if (status & ASYNC_PK_DONE)
+    {
+        strcat(buf, "PK/");
+    }
 #endif
     printf("IO %s\n", buf);
 #endif /* ifdef MULTI_DEBUG_EVENT_LOOP */
@@ -249,6 +347,13 @@ multi_process_io_udp(struct multi_context *m)
         multi_process_file_closed(m, mpp_flags);
     }
 #endif
+#ifdef ENABLE_ASYNC_PK
+    /* handshake worker finished */
+    else if (status & ASYNC_PK_DONE)
+    {
+        multi_process_async_pk(m);
+    }
+#endif
 }
 
 /*
@@ -270,10 +375,14 @@ p2mp_iow_flags(const struct multi_context *m)
             flags |= IOW_TO_LINK;
         }
     }
-    else if (mbuf_defined(m->mbuf))
+    else if (mbuf_fq_defined(m->mbuf))
     {
         flags |= IOW_MBUF;
     }
+    else if (BLEN(&m->cookie_reply) > 0)
+    {
+        flags |= IOW_TO_LINK;
+    }
     else
     {
         flags |= IOW_READ;
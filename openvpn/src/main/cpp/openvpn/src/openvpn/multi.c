@@ -374,9 +374,25 @@ multi_init(struct multi_context *m, struct context *t, bool tcp_mode, int thread
                                                      t->options.cf_per);
 
     /*
-     * Allocate broadcast/multicast buffer list
+     * Secret for the handshake cookies which UDP peers must echo
+     * back before we create an instance for them.
      */
-    m->mbuf = mbuf_init(t->options.n_bcast_buf);
+    if (!tcp_mode)
+    {
+        uint8_t key[32];
+
+        ASSERT(rand_bytes(key, sizeof(key)));
+        m->cookie_hmac = hmac_ctx_new();
+        hmac_ctx_init(m->cookie_hmac, key, sizeof(key), md_kt_get("SHA256"));
+        secure_memzero(key, sizeof(key));
+        m->cookie_reply = alloc_buf(BUF_SIZE(&t->c2.frame));
+    }
+
+    /*
+     * Allocate broadcast/multicast queue scheduler,
+     * one round grants each instance about one packet.
+     */
+    m->mbuf = mbuf_fq_init(t->options.n_bcast_buf, MAX_RW_SIZE_TUN(&t->c2.frame));
 
     /*
      * Different status file format options are available
@@ -676,10 +692,11 @@ multi_close_instance(struct multi_context *m,
         {
             multi_tcp_dereference_instance(m->mtcp, mi);
         }
-
-        mbuf_dereference_instance(m->mbuf, mi);
     }
 
+    /* the flow is linked into m->mbuf, which outlives the instance */
+    mbuf_fq_flow_free(m->mbuf, &mi->mbuf_flow);
+
 #ifdef MANAGEMENT_DEF_AUTH
     set_cc_config(mi, NULL);
 #endif
@@ -734,6 +751,15 @@ multi_uninit(struct multi_context *m)
 
             multi_reap_all(m);
 
+#ifdef ENABLE_ASYNC_PK
+            while (m->async_pk_waiters)
+            {
+                struct multi_instance *mi = m->async_pk_waiters;
+                m->async_pk_waiters = mi->async_pk_next;
+                multi_instance_dec_refcount(mi);
+            }
+#endif
+
             hash_free(m->hash);
             hash_free(m->vhash);
             hash_free(m->iter);
@@ -750,9 +776,16 @@ multi_uninit(struct multi_context *m)
 #endif
 
             schedule_free(m->schedule);
-            mbuf_free(m->mbuf);
+            mbuf_fq_free(m->mbuf);
             ifconfig_pool_free(m->ifconfig_pool);
             frequency_limit_free(m->new_connection_limiter);
+            if (m->cookie_hmac)
+            {
+                hmac_ctx_cleanup(m->cookie_hmac);
+                hmac_ctx_free(m->cookie_hmac);
+                m->cookie_hmac = NULL;
+            }
+            free_buf(&m->cookie_reply);
             multi_reap_free(m->reaper);
             mroute_helper_free(m->route_helper);
             multi_tcp_free(m->mtcp);
@@ -781,6 +814,7 @@ multi_create_instance(struct multi_context *m, const struct mroute_addr *real)
     mi->vaddr_handle = -1;
     mi->created = now;
     mroute_addr_init(&mi->real);
+    mbuf_fq_flow_init(&mi->mbuf_flow, mi);
 
     if (real)
     {
@@ -924,12 +958,64 @@ multi_print_status(struct multi_context *m, struct status_output *so, const int
             }
             hash_iterator_free(&hi);
 
+            status_printf(so, "CLIENT QUEUE STATS");
+            status_printf(so, "Common Name,Real Address,Queue Depth,Queue Drops,Rate Limit Drops");
+            hash_iterator_init(m->hash, &hi);
+            while ((he = hash_iterator_next(&hi)))
+            {
+                struct gc_arena gc = gc_new();
+                const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+                if (!mi->halt)
+                {
+                    status_printf(so, "%s,%s,%u," counter_format "," counter_format,
+                                  tls_common_name(mi->context.c2.tls_multi, false),
+                                  mroute_addr_print(&mi->real, &gc),
+                                  mbuf_fq_flow_len(&mi->mbuf_flow),
+                                  mi->mbuf_flow.n_dropped,
+                                  mi->n_rate_limit_dropped);
+                }
+                gc_free(&gc);
+            }
+            hash_iterator_free(&hi);
+
+            status_printf(so, "CLIENT MEMORY STATS");
+            status_printf(so, "Common Name,Real Address,Control Channel Buffers");
+            hash_iterator_init(m->hash, &hi);
+            while ((he = hash_iterator_next(&hi)))
+            {
+                struct gc_arena gc = gc_new();
+                const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+                if (!mi->halt && mi->context.c2.tls_multi)
+                {
+                    status_printf(so, "%s,%s,%u",
+                                  tls_common_name(mi->context.c2.tls_multi, false),
+                                  mroute_addr_print(&mi->real, &gc),
+                                  (unsigned int)tls_multi_buffer_bytes(mi->context.c2.tls_multi));
+                }
+                gc_free(&gc);
+            }
+            hash_iterator_free(&hi);
+
             status_printf(so, "GLOBAL STATS");
             if (m->mbuf)
             {
                 status_printf(so, "Max bcast/mcast queue length,%d",
-                              mbuf_maximum_queued(m->mbuf));
+                              mbuf_fq_maximum_queued(m->mbuf));
+                status_printf(so, "Bcast/mcast queue drops," counter_format,
+                              m->mbuf->n_dropped);
             }
+            if (m->cookie_hmac)
+            {
+                status_printf(so, "Handshake cookies sent," counter_format,
+                              m->n_cookies_sent);
+                status_printf(so, "Handshake cookies validated," counter_format,
+                              m->n_cookies_validated);
+                status_printf(so, "Handshake cookies rejected," counter_format,
+                              m->n_cookies_rejected);
+            }
+            status_printf(so, "Pooled buffers,%u", (unsigned int)buf_pool_bytes());
 
             status_printf(so, "END");
         }
@@ -1009,11 +1095,64 @@ multi_print_status(struct multi_context *m, struct status_output *so, const int
             }
             hash_iterator_free(&hi);
 
+            status_printf(so, "HEADER%cCLIENT_QUEUE%cCommon Name%cReal Address%cQueue Depth%cQueue Drops%cRate Limit Drops",
+                          sep, sep, sep, sep, sep, sep);
+            hash_iterator_init(m->hash, &hi);
+            while ((he = hash_iterator_next(&hi)))
+            {
+                struct gc_arena gc = gc_new();
+                const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+                if (!mi->halt)
+                {
+                    status_printf(so, "CLIENT_QUEUE%c%s%c%s%c%u%c" counter_format "%c" counter_format,
+                                  sep, tls_common_name(mi->context.c2.tls_multi, false),
+                                  sep, mroute_addr_print(&mi->real, &gc),
+                                  sep, mbuf_fq_flow_len(&mi->mbuf_flow),
+                                  sep, mi->mbuf_flow.n_dropped,
+                                  sep, mi->n_rate_limit_dropped);
+                }
+                gc_free(&gc);
+            }
+            hash_iterator_free(&hi);
+
+            status_printf(so, "HEADER%cCLIENT_MEMORY%cCommon Name%cReal Address%cControl Channel Buffers",
+                          sep, sep, sep, sep);
+            hash_iterator_init(m->hash, &hi);
+            while ((he = hash_iterator_next(&hi)))
+            {
+                struct gc_arena gc = gc_new();
+                const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+                if (!mi->halt && mi->context.c2.tls_multi)
+                {
+                    status_printf(so, "CLIENT_MEMORY%c%s%c%s%c%u",
+                                  sep, tls_common_name(mi->context.c2.tls_multi, false),
+                                  sep, mroute_addr_print(&mi->real, &gc),
+                                  sep, (unsigned int)tls_multi_buffer_bytes(mi->context.c2.tls_multi));
+                }
+                gc_free(&gc);
+            }
+            hash_iterator_free(&hi);
+
             if (m->mbuf)
             {
                 status_printf(so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
-                              sep, sep, mbuf_maximum_queued(m->mbuf));
+                              sep, sep, mbuf_fq_maximum_queued(m->mbuf));
+                status_printf(so, "GLOBAL_STATS%cBcast/mcast queue drops%c" counter_format,
+                              sep, sep, m->mbuf->n_dropped);
             }
+            if (m->cookie_hmac)
+            {
+                status_printf(so, "GLOBAL_STATS%cHandshake cookies sent%c" counter_format,
+                              sep, sep, m->n_cookies_sent);
+                status_printf(so, "GLOBAL_STATS%cHandshake cookies validated%c" counter_format,
+                              sep, sep, m->n_cookies_validated);
+                status_printf(so, "GLOBAL_STATS%cHandshake cookies rejected%c" counter_format,
+                              sep, sep, m->n_cookies_rejected);
+            }
+            status_printf(so, "GLOBAL_STATS%cPooled buffers%c%u",
+                          sep, sep, (unsigned int)buf_pool_bytes());
 
             status_printf(so, "END");
         }
@@ -2171,16 +2310,17 @@ multi_add_mbuf(struct multi_context *m,
                struct multi_instance *mi,
                struct mbuf_buffer *mb)
 {
-    if (multi_output_queue_ready(m, mi))
+    if (!multi_output_queue_ready(m, mi))
+    {
+        msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_add_mbuf)");
+    }
+    else if (!multi_rate_limit_ready(mi, BLEN(&mb->buf)))
     {
-        struct mbuf_item item;
-        item.buffer = mb;
-        item.instance = mi;
-        mbuf_add_item(m->mbuf, &item);
+        msg(D_MULTI_DROPPED, "MULTI: packet dropped due to client rate limit (multi_add_mbuf)");
     }
     else
     {
-        msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_add_mbuf)");
+        mbuf_fq_add_buf(m->mbuf, &mi->mbuf_flow, mb);
     }
 }
 
@@ -2317,6 +2457,40 @@ multi_schedule_context_wakeup(struct multi_context *m, struct multi_instance *mi
                        compute_wakeup_sigma(&mi->context.c2.timeval));
 }
 
+#ifdef ENABLE_ASYNC_PK
+void
+multi_process_async_pk(struct multi_context *m)
+{
+    struct multi_instance **prev = &m->async_pk_waiters;
+
+    tls_async_pk_event_clear();
+
+    while (*prev)
+    {
+        struct multi_instance *mi = *prev;
+
+        if (!mi->halt && mi->context.c2.tls_multi
+            && tls_multi_async_pk_status(mi->context.c2.tls_multi) == ASYNC_PK_PENDING)
+        {
+            prev = &mi->async_pk_next;
+            continue;
+        }
+
+        *prev = mi->async_pk_next;
+        mi->async_pk_waiting = false;
+
+        if (!mi->halt)
+        {
+            /* make the next pre_select() call tls_multi_process() right away */
+            interval_action(&mi->context.c2.tmp_int);
+            CLEAR(mi->context.c2.timeval);
+            multi_schedule_context_wakeup(m, mi);
+        }
+        multi_instance_dec_refcount(mi);
+    }
+}
+#endif /* ifdef ENABLE_ASYNC_PK */
+
 /*
  * Figure instance-specific timers, convert
  * earliest to absolute time in mi->wakeup,
@@ -2366,6 +2540,18 @@ multi_process_post(struct multi_context *m, struct multi_instance *mi, const uns
         }
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+        /* handshake paused on an offloaded private key operation? */
+        if (mi->context.c2.tls_multi && !mi->async_pk_waiting
+            && tls_multi_async_pk_status(mi->context.c2.tls_multi) != ASYNC_PK_NONE)
+        {
+            multi_instance_inc_refcount(mi);
+            mi->async_pk_waiting = true;
+            mi->async_pk_next = m->async_pk_waiters;
+            m->async_pk_waiters = mi;
+        }
+#endif
+
         if (!IS_SIG(&mi->context))
         {
             /* connection is "established" when SSL/TLS key negotiation succeeds
@@ -2816,17 +3002,23 @@ multi_process_incoming_tun(struct multi_context *m, const unsigned int mpp_flags
                     else
 #endif
                     {
-                        if (multi_output_queue_ready(m, m->pending))
+                        if (!multi_output_queue_ready(m, m->pending))
                         {
-                            /* transfer packet pointer from top-level context buffer to instance */
-                            c->c2.buf = m->top.c2.buf;
+                            /* drop packet */
+                            msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_process_incoming_tun)");
+                            buf_reset_len(&c->c2.buf);
                         }
-                        else
+                        else if (!multi_rate_limit_ready(m->pending, BLEN(&m->top.c2.buf)))
                         {
                             /* drop packet */
-                            msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (multi_process_incoming_tun)");
+                            msg(D_MULTI_DROPPED, "MULTI: packet dropped due to client rate limit (multi_process_incoming_tun)");
                             buf_reset_len(&c->c2.buf);
                         }
+                        else
+                        {
+                            /* transfer packet pointer from top-level context buffer to instance */
+                            c->c2.buf = m->top.c2.buf;
+                        }
                     }
 
                     /* encrypt in instance context */
@@ -2849,11 +3041,11 @@ multi_process_incoming_tun(struct multi_context *m, const unsigned int mpp_flags
  * queue.
  */
 struct multi_instance *
-multi_get_queue(struct mbuf_set *ms)
+multi_get_queue(struct mbuf_fq *fq)
 {
     struct mbuf_item item;
 
-    if (mbuf_extract_item(ms, &item)) /* cleartext IP packet */
+    if (mbuf_fq_extract_item(fq, &item)) /* cleartext IP packet */
     {
         unsigned int pip_flags = PIPV4_PASSTOS | PIPV6_IMCP_NOHOST_SERVER;
 
@@ -90,6 +90,15 @@ struct multi_instance {
     ifconfig_pool_handle vaddr_handle;
     char msg_prefix[MULTI_PREFIX_MAX_LENGTH];
 
+    /* queued client-to-client/bcast/mcast packets for this instance */
+    struct mbuf_fq_flow mbuf_flow;
+
+#ifdef ENABLE_FEATURE_SHAPER
+    /* --client-rate-limit policer */
+    struct token_bucket rate_limit;
+#endif
+    counter_type n_rate_limit_dropped;
+
     /* queued outgoing data in Server/TCP mode */
     unsigned int tcp_rwflags;
     struct mbuf_set *tcp_link_out_deferred;
@@ -115,6 +124,11 @@ struct multi_instance {
 #ifdef ENABLE_ASYNC_PUSH
     int inotify_watch; /* watch descriptor for acf */
 #endif
+
+#ifdef ENABLE_ASYNC_PK
+    bool async_pk_waiting;      /**< On multi_context.async_pk_waiters */
+    struct multi_instance *async_pk_next;
+#endif
 };
 
 
@@ -148,13 +162,22 @@ struct multi_context {
                                  *   address of the remote peer, optimized
                                  *   for iteration. */
     struct schedule *schedule;
-    struct mbuf_set *mbuf;      /**< Set of buffers for passing data
+    struct mbuf_fq *mbuf;       /**< Per-instance queues for passing data
                                  *   channel packets between VPN tunnel
-                                 *   instances. */
+                                 *   instances, scheduled round robin. */
     struct multi_tcp *mtcp;     /**< State specific to OpenVPN using TCP
                                  *   as external transport. */
     struct ifconfig_pool *ifconfig_pool;
     struct frequency_limit *new_connection_limiter;
+    hmac_ctx_t *cookie_hmac;    /**< Keyed with a random secret, computes
+                                 *   the handshake cookies of UDP peers. */
+    struct buffer cookie_reply; /**< Reset reply carrying a handshake
+                                 *   cookie, waiting to be sent. */
+    struct link_socket_actual cookie_reply_dest;
+    counter_type n_cookies_sent;      /**< Resets answered with a cookie. */
+    counter_type n_cookies_validated; /**< Peers which echoed a valid cookie. */
+    counter_type n_cookies_rejected;  /**< Control packets from unknown
+                                       *   peers without a valid cookie. */
     struct mroute_helper *route_helper;
     struct multi_reap *reaper;
     struct mroute_addr local;
@@ -188,6 +211,12 @@ struct multi_context {
     struct hash *inotify_watchers;
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+    /** Instances whose handshake is paused on an offloaded private key
+     *  operation, each holding a reference. */
+    struct multi_instance *async_pk_waiters;
+#endif
+
     struct deferred_signal_schedule_entry deferred_shutdown_signal;
 };
 
@@ -332,7 +361,7 @@ void multi_process_drop_outgoing_tun(struct multi_context *m, const unsigned int
 
 void multi_print_status(struct multi_context *m, struct status_output *so, const int version);
 
-struct multi_instance *multi_get_queue(struct mbuf_set *ms);
+struct multi_instance *multi_get_queue(struct mbuf_fq *fq);
 
 void multi_add_mbuf(struct multi_context *m,
                     struct multi_instance *mi,
@@ -361,6 +390,18 @@ void multi_process_file_closed(struct multi_context *m, const unsigned int mpp_f
 
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+/**
+ * Called when a handshake worker has finished an offloaded private key
+ * operation.  Schedules the instances whose handshake can be resumed
+ * for immediate processing.
+ *
+ * @param m multi_context
+ */
+void multi_process_async_pk(struct multi_context *m);
+
+#endif
+
 /*
  * Return true if our output queue is not full
  */
@@ -378,6 +419,32 @@ multi_output_queue_ready(const struct multi_context *m,
     }
 }
 
+/*
+ * Enforce the --client-rate-limit of an instance on a
+ * packet destined for it.  Return false if the packet
+ * should be dropped.
+ */
+static inline bool
+multi_rate_limit_ready(struct multi_instance *mi, const int len)
+{
+#ifdef ENABLE_FEATURE_SHAPER
+    const int rate = mi->context.options.client_rate_limit;
+    if (rate)
+    {
+        if (mi->rate_limit.bytes_per_second != rate)
+        {
+            token_bucket_init(&mi->rate_limit, rate);
+        }
+        if (!token_bucket_consume(&mi->rate_limit, len))
+        {
+            ++mi->n_rate_limit_dropped;
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
 /*
  * Determine which instance has pending output
  * and prepare the output for sending in
@@ -392,7 +459,7 @@ multi_process_outgoing_link_pre(struct multi_context *m)
     {
         mi = m->pending;
     }
-    else if (mbuf_defined(m->mbuf))
+    else if (mbuf_fq_defined(m->mbuf))
     {
         mi = multi_get_queue(m->mbuf);
     }
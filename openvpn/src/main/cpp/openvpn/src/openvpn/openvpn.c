@@ -277,6 +277,13 @@ openvpn_main(int argc, char *argv[])
             {
                 c.did_we_daemonize = possibly_become_daemon(&c.options);
                 write_pid(c.options.writepid);
+#ifdef ENABLE_ASYNC_LOG
+                /* after daemonizing, the thread would not survive fork() */
+                if (c.options.log_queue)
+                {
+                    msg_queue_start(c.options.log_queue);
+                }
+#endif
             }
 
 #ifdef ENABLE_MANAGEMENT
@@ -245,6 +245,9 @@ struct context_2
 #endif
 #ifdef ENABLE_ASYNC_PUSH
 #define FILE_CLOSED       (1<<8)
+#endif
+#ifdef ENABLE_ASYNC_PK
+#define ASYNC_PK_DONE     (1<<10)
 #endif
 
     unsigned int event_set_status;
@@ -337,6 +340,11 @@ struct context_2
     struct tls_multi *tls_multi; /**< TLS state structure for this VPN
                                   *   tunnel. */
 
+#ifdef ENABLE_TUN_MQ
+    struct tun_mq *tun_mq;      /**< Worker threads serving the other
+                                 *   queues of a multi-queue tun. */
+#endif
+
     struct tls_auth_standalone *tls_auth_standalone;
     /**< TLS state structure required for the
      *   initial authentication of a client's
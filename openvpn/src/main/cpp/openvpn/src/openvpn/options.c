@@ -215,6 +215,11 @@ static const char usage_message[] =
     "                  --route-up script using environmental variables.\n"
     "--route-nopull  : When used with --client or --pull, accept options pushed\n"
     "                  by server EXCEPT for routes and dhcp options.\n"
+#ifdef ENABLE_RTNL
+    "--route-method m : Which method to use for adding routes and addresses:\n"
+    "                  adaptive (default) -- Use netlink, fall back to ip/route.\n"
+    "                  exe -- Run the ip/route/ifconfig commands.\n"
+#endif
     "--allow-pull-fqdn : Allow client to pull DNS names from server for\n"
     "                    --ifconfig, --route, and --route-gateway.\n"
     "--redirect-gateway [flags]: Automatically execute routing\n"
@@ -294,6 +299,10 @@ static const char usage_message[] =
     "                  can be matched in policy routing and packetfilter rules.\n"
 #endif
     "--txqueuelen n  : Set the tun/tap TX queue length to n (Linux only).\n"
+#ifdef ENABLE_TUN_MQ
+    "--tun-queues n  : Open n tun queues and encrypt the packets read from\n"
+    "                  all but the first on worker threads (Linux, UDP and TLS only).\n"
+#endif
 #ifdef ENABLE_MEMSTATS
     "--memstats file : Write live usage stats to memory mapped binary file.\n"
 #endif
@@ -344,6 +353,11 @@ static const char usage_message[] =
     "                       and received from TCP/UDP (caps) or tun/tap (lc)\n"
     "                : 6 to 11 -- debug messages of increasing verbosity\n"
     "--mute n        : Log at most n consecutive messages in the same category.\n"
+    "--log-rate n    : Log at most n messages per second in the same category.\n"
+#ifdef ENABLE_ASYNC_LOG
+    "--log-queue n   : Write log output on a separate thread, queueing up to\n"
+    "                  n messages.\n"
+#endif
     "--status file n : Write operational status to file every n seconds.\n"
     "--status-version [n] : Choose the status file format version number.\n"
     "                  Currently, n can be 1, 2, or 3 (default=1).\n"
@@ -474,6 +488,12 @@ static const char usage_message[] =
     "                  virtual address table to v.\n"
     "--bcast-buffers n : Allocate n broadcast buffers.\n"
     "--tcp-queue-limit n : Maximum number of queued TCP output packets.\n"
+#ifdef ENABLE_FEATURE_SHAPER
+    "--client-rate-limit n : Drop packets to a client beyond n bytes per second.\n"
+#endif
+#ifdef ENABLE_ASYNC_PK
+    "--handshake-workers n : Run TLS private key operations on n worker threads.\n"
+#endif
     "--tcp-nodelay   : Macro that sets TCP_NODELAY socket flag on the server\n"
     "                  as well as pushes it to connecting clients.\n"
     "--learn-address cmd : Run command cmd to validate client virtual addresses.\n"
@@ -1263,6 +1283,8 @@ show_p2mp_parms(const struct options *o)
     SHOW_INT(ifconfig_ipv6_pool_netbits);
     SHOW_INT(n_bcast_buf);
     SHOW_INT(tcp_queue_limit);
+    SHOW_INT(client_rate_limit);
+    SHOW_INT(handshake_workers);
     SHOW_INT(real_hash_size);
     SHOW_INT(virtual_hash_size);
     SHOW_STR(client_connect_script);
@@ -1539,6 +1561,9 @@ show_settings(const struct options *o)
     SHOW_STR(dev);
     SHOW_STR(dev_type);
     SHOW_STR(dev_node);
+#ifdef ENABLE_TUN_MQ
+    SHOW_INT(tuntap_options.queues);
+#endif
     SHOW_STR(lladdr);
     SHOW_INT(topology);
     SHOW_STR(ifconfig_local);
@@ -1599,6 +1624,10 @@ show_settings(const struct options *o)
     SHOW_INT(nice);
     SHOW_INT(verbosity);
     SHOW_INT(mute);
+    SHOW_INT(log_rate);
+#ifdef ENABLE_ASYNC_LOG
+    SHOW_INT(log_queue);
+#endif
 #ifdef ENABLE_DEBUG
     SHOW_INT(gremlin);
 #endif
@@ -2202,6 +2231,63 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
     }
 #endif
 
+#ifdef ENABLE_TUN_MQ
+    /*
+     * Worker queues only do the tun -> link path of a UDP, TLS
+     * point-to-point tunnel, so reject options which would need
+     * other per-packet work on that path.
+     */
+    if (options->tuntap_options.queues > 1)
+    {
+        if (dev != DEV_TYPE_TUN)
+        {
+            msg(M_USAGE, "--tun-queues requires --dev tun");
+        }
+        if (!proto_is_udp(ce->proto))
+        {
+            msg(M_USAGE, "--tun-queues can only be used with --proto udp");
+        }
+        if (options->mode == MODE_SERVER)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --mode server");
+        }
+        if (!options->tls_client && !options->tls_server)
+        {
+            msg(M_USAGE, "--tun-queues requires --tls-client or --tls-server");
+        }
+        if (ce->socks_proxy_server)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --socks-proxy");
+        }
+#ifdef ENABLE_FRAGMENT
+        if (ce->fragment)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --fragment");
+        }
+#endif
+#ifdef ENABLE_FEATURE_SHAPER
+        if (options->shaper)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --shaper");
+        }
+#endif
+#if PASSTOS_CAPABILITY
+        if (options->passtos)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --passtos");
+        }
+#endif
+        if (options->client_nat)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --client-nat");
+        }
+        if (options->block_ipv6)
+        {
+            msg(M_USAGE, "--tun-queues cannot be used with --block-ipv6");
+        }
+    }
+#endif /* ENABLE_TUN_MQ */
+
     if (!ce->remote && ce->proto == PROTO_TCP_CLIENT)
     {
         msg(M_USAGE, "--remote MUST be used in TCP Client mode");
@@ -2460,6 +2546,10 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
         {
             msg(M_USAGE, "--stale-routes-check requires --mode server");
         }
+        if (options->handshake_workers)
+        {
+            msg(M_USAGE, "--handshake-workers requires --mode server");
+        }
     }
 #endif /* P2MP_SERVER */
 
@@ -5783,6 +5873,30 @@ add_option(struct options *options,
         VERIFY_PERMISSION(OPT_P_MESSAGES);
         options->mute = positive_atoi(p[1]);
     }
+    else if (streq(p[0], "log-rate") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_MESSAGES);
+        options->log_rate = positive_atoi(p[1]);
+    }
+    else if (streq(p[0], "log-queue") && p[1] && !p[2])
+    {
+#ifdef ENABLE_ASYNC_LOG
+        int log_queue;
+
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        log_queue = atoi(p[1]);
+        if (log_queue < 0 || log_queue > MAX_LOG_QUEUE)
+        {
+            msg(msglevel, "--log-queue must be between 0 and %d", MAX_LOG_QUEUE);
+            goto err;
+        }
+        options->log_queue = log_queue;
+#else  /* ENABLE_ASYNC_LOG */
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        msg(msglevel, "--log-queue requires OpenVPN to be built with --enable-async-log");
+        goto err;
+#endif /* ENABLE_ASYNC_LOG */
+    }
     else if (streq(p[0], "errors-to-stderr") && !p[1])
     {
         VERIFY_PERMISSION(OPT_P_MESSAGES);
@@ -5918,6 +6032,25 @@ add_option(struct options *options,
         msg(msglevel, "--txqueuelen not supported on this OS");
         goto err;
 #endif
+    }
+    else if (streq(p[0], "tun-queues") && p[1] && !p[2])
+    {
+#ifdef ENABLE_TUN_MQ
+        int queues;
+
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        queues = atoi(p[1]);
+        if (queues < 1 || queues > MAX_TUN_QUEUES)
+        {
+            msg(msglevel, "--tun-queues must be between 1 and %d", MAX_TUN_QUEUES);
+            goto err;
+        }
+        options->tuntap_options.queues = queues;
+#else  /* ENABLE_TUN_MQ */
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        msg(msglevel, "--tun-queues requires OpenVPN to be built with --enable-tun-mq");
+        goto err;
+#endif /* ENABLE_TUN_MQ */
     }
     else if (streq(p[0], "shaper") && p[1] && !p[2])
     {
@@ -6896,6 +7029,47 @@ add_option(struct options *options,
         }
         options->tcp_queue_limit = tcp_queue_limit;
     }
+    else if (streq(p[0], "client-rate-limit") && p[1] && !p[2])
+    {
+#ifdef ENABLE_FEATURE_SHAPER
+        int client_rate_limit;
+
+        VERIFY_PERMISSION(OPT_P_INHERIT);
+        client_rate_limit = atoi(p[1]);
+        if (client_rate_limit != 0
+            && (client_rate_limit < SHAPER_MIN || client_rate_limit > SHAPER_MAX))
+        {
+            msg(msglevel, "Bad client-rate-limit value, must be 0 or between %d and %d",
+                SHAPER_MIN, SHAPER_MAX);
+            goto err;
+        }
+        options->client_rate_limit = client_rate_limit;
+#else /* ENABLE_FEATURE_SHAPER */
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        msg(msglevel, "--client-rate-limit requires the gettimeofday() function which is missing");
+        goto err;
+#endif /* ENABLE_FEATURE_SHAPER */
+    }
+    else if (streq(p[0], "handshake-workers") && p[1] && !p[2])
+    {
+#ifdef ENABLE_ASYNC_PK
+        int handshake_workers;
+
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        handshake_workers = atoi(p[1]);
+        if (handshake_workers < 0 || handshake_workers > MAX_HANDSHAKE_WORKERS)
+        {
+            msg(msglevel, "--handshake-workers must be between 0 and %d",
+                MAX_HANDSHAKE_WORKERS);
+            goto err;
+        }
+        options->handshake_workers = handshake_workers;
+#else  /* ENABLE_ASYNC_PK */
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        msg(msglevel, "--handshake-workers requires OpenVPN to be built with --enable-async-pk");
+        goto err;
+#endif /* ENABLE_ASYNC_PK */
+    }
 #if PORT_SHARE
     else if (streq(p[0], "port-share") && p[1] && p[2] && !p[4])
     {
@@ -7108,21 +7282,7 @@ add_option(struct options *options,
         goto err;
 #endif
     }
-#ifdef _WIN32
-    else if (streq(p[0], "win-sys") && p[1] && !p[2])
-    {
-        VERIFY_PERMISSION(OPT_P_GENERAL);
-        if (streq(p[1], "env"))
-        {
-            msg(M_INFO, "NOTE: --win-sys env is default from OpenVPN 2.3.	 "
-                "This entry will now be ignored.  "
-                "Please remove this entry from your configuration file.");
-        }
-        else
-        {
-            set_win_sys_path(p[1], es);
-        }
-    }
+#if defined(_WIN32) || defined(ENABLE_RTNL)
     else if (streq(p[0], "route-method") && p[1] && !p[2])
     {
         VERIFY_PERMISSION(OPT_P_ROUTE_EXTRAS);
@@ -7143,6 +7303,25 @@ add_option(struct options *options,
             msg(msglevel, "--route method must be 'adaptive', 'ipapi', or 'exe'");
             goto err;
         }
+#ifdef ENABLE_RTNL
+        options->tuntap_options.route_method = options->route_method;
+#endif
+    }
+#endif
+#ifdef _WIN32
+    else if (streq(p[0], "win-sys") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        if (streq(p[1], "env"))
+        {
+            msg(M_INFO, "NOTE: --win-sys env is default from OpenVPN 2.3.	 "
+                "This entry will now be ignored.  "
+                "Please remove this entry from your configuration file.");
+        }
+        else
+        {
+            set_win_sys_path(p[1], es);
+        }
     }
     else if (streq(p[0], "ip-win32") && p[1] && !p[4])
     {
@@ -7412,10 +7591,12 @@ add_option(struct options *options,
         VERIFY_PERMISSION(OPT_P_IPWIN32);
         foreign_option(options, p, 3, es);
     }
+#ifndef ENABLE_RTNL
     else if (streq(p[0], "route-method") && p[1] && !p[2]) /* ignore when pushed to non-Windows OS */
     {
         VERIFY_PERMISSION(OPT_P_ROUTE_EXTRAS);
     }
+#endif
 #endif /* ifdef _WIN32 */
 #if PASSTOS_CAPABILITY
     else if (streq(p[0], "passtos") && !p[1])
@@ -56,6 +56,21 @@
 #define OPTION_PARM_SIZE 256
 #define OPTION_LINE_SIZE 256
 
+/*
+ * Upper bound for --handshake-workers.
+ */
+#define MAX_HANDSHAKE_WORKERS 64
+
+/*
+ * Upper bound for --tun-queues.
+ */
+#define MAX_TUN_QUEUES 64
+
+/*
+ * Upper bound for --log-queue.
+ */
+#define MAX_LOG_QUEUE 65536
+
 extern const char title_string[];
 
 #if P2MP
@@ -313,6 +328,10 @@ struct options
     int nice;
     int verbosity;
     int mute;
+    int log_rate;
+#ifdef ENABLE_ASYNC_LOG
+    int log_queue;
+#endif
 
 #ifdef ENABLE_DEBUG
     int gremlin;
@@ -432,6 +451,8 @@ struct options
     bool disable;
     int n_bcast_buf;
     int tcp_queue_limit;
+    int client_rate_limit;
+    int handshake_workers;
     struct iroute *iroutes;
     struct iroute_ipv6 *iroutes_ipv6;                   /* IPv6 */
     bool push_ifconfig_defined;
@@ -612,9 +633,11 @@ struct options
     const char *exit_event_name;
     bool exit_event_initial_state;
     bool show_net_up;
-    int route_method;
     bool block_outside_dns;
 #endif
+#if defined(_WIN32) || defined(ENABLE_RTNL)
+    int route_method;
+#endif
 
     bool use_peer_id;
     uint32_t peer_id;
@@ -684,7 +707,7 @@ struct options
 #define PUSH_DEFINED(opt) (false)
 #endif
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(ENABLE_RTNL)
 #define ROUTE_OPTION_FLAGS(o) ((o)->route_method & ROUTE_METHOD_MASK)
 #else
 #define ROUTE_OPTION_FLAGS(o) (0)
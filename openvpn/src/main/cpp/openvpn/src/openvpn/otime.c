@@ -115,6 +115,9 @@ time_string(time_t t, int usec, bool show_usec, struct gc_arena *gc)
 {
     struct buffer out = alloc_buf_gc(64, gc);
     struct timeval tv;
+#ifndef _WIN32
+    char ctime_buf[32];
+#endif
 
     if (t)
     {
@@ -127,7 +130,12 @@ time_string(time_t t, int usec, bool show_usec, struct gc_arena *gc)
     }
 
     t = tv.tv_sec;
+#ifdef _WIN32
     buf_printf(&out, "%s", ctime(&t));
+#else
+    /* may be called from the --log-queue thread */
+    buf_printf(&out, "%s", ctime_r(&t, ctime_buf));
+#endif
     buf_rmtail(&out, '\n');
 
     if (show_usec && tv.tv_usec)
@@ -49,6 +49,8 @@ pf_destroy(struct pf_set *pfs)
             hash_free(pfs->cns.hash_table);
         }
 
+        free(pfs->sns.ranges);
+
         {
             struct pf_cn_elem *l = pfs->cns.list;
             while (l)
@@ -177,6 +179,116 @@ genhash(struct pf_cn_set *cns, const char *prefix, const int n_clients)
     return status;
 }
 
+static int
+in_addr_t_compare(const void *a, const void *b)
+{
+    const in_addr_t x = *(const in_addr_t *)a;
+    const in_addr_t y = *(const in_addr_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Compile the ordered [subnets] rule list into a sorted table of
+ * non-overlapping address ranges, each tagged with the first rule
+ * that matches it.  This preserves the first-match semantics of
+ * the rule list while letting pf_addr_test_dowork use a binary
+ * search instead of walking every rule for every packet.
+ */
+static void
+pf_subnet_compile(struct pf_subnet_set *sns)
+{
+    const struct pf_subnet *e;
+    const struct ipv4_subnet **rules;
+    in_addr_t *bounds;
+    int n_bounds = 0;
+    int n_rules = 0;
+    int i;
+
+    for (e = sns->list; e != NULL; e = e->next)
+    {
+        ++n_rules;
+    }
+
+    /* every rule contributes at most its first and one-past-last address */
+    ALLOC_ARRAY(bounds, in_addr_t, 2 * n_rules + 1);
+    bounds[n_bounds++] = 0;
+    for (e = sns->list; e != NULL; e = e->next)
+    {
+        const in_addr_t last = e->rule.network | ~e->rule.netmask;
+        bounds[n_bounds++] = e->rule.network;
+        if (last != IPV4_NETMASK_HOST)
+        {
+            bounds[n_bounds++] = last + 1;
+        }
+    }
+    qsort(bounds, n_bounds, sizeof(in_addr_t), in_addr_t_compare);
+    {
+        int n_unique = 1;
+        for (i = 1; i < n_bounds; ++i)
+        {
+            if (bounds[i] != bounds[n_unique - 1])
+            {
+                bounds[n_unique++] = bounds[i];
+            }
+        }
+        n_bounds = n_unique;
+    }
+
+    /* assign each elementary range the first rule which covers it */
+    ALLOC_ARRAY_CLEAR(rules, const struct ipv4_subnet *, n_bounds);
+    for (e = sns->list; e != NULL; e = e->next)
+    {
+        const in_addr_t last = e->rule.network | ~e->rule.netmask;
+        const in_addr_t *start = bsearch(&e->rule.network, bounds, n_bounds,
+                                         sizeof(in_addr_t), in_addr_t_compare);
+        ASSERT(start);
+        for (i = (int)(start - bounds); i < n_bounds && bounds[i] <= last; ++i)
+        {
+            if (!rules[i])
+            {
+                rules[i] = &e->rule;
+            }
+        }
+    }
+
+    /* merge neighbours decided by the same rule */
+    ALLOC_ARRAY(sns->ranges, struct pf_subnet_range, n_bounds);
+    sns->n_ranges = 0;
+    for (i = 0; i < n_bounds; ++i)
+    {
+        if (!sns->n_ranges || sns->ranges[sns->n_ranges - 1].rule != rules[i])
+        {
+            struct pf_subnet_range *r = &sns->ranges[sns->n_ranges++];
+            r->low = bounds[i];
+            r->rule = rules[i];
+        }
+    }
+
+    free(rules);
+    free(bounds);
+}
+
+static inline const struct ipv4_subnet *
+pf_subnet_lookup(const struct pf_subnet_set *sns, const in_addr_t addr)
+{
+    int low = 0;
+    int high = sns->n_ranges - 1;
+
+    while (low < high)
+    {
+        const int mid = (low + high + 1) / 2;
+        if (sns->ranges[mid].low <= addr)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    return sns->ranges[low].rule;
+}
+
 static struct pf_set *
 pf_init(const struct buffer_list *bl, const char *prefix, const bool allow_kill)
 {
@@ -306,6 +418,7 @@ done:
             {
                 ++n_errors;
             }
+            pf_subnet_compile(&pfs->sns);
         }
         if (n_errors)
         {
@@ -503,20 +616,16 @@ pf_addr_test_dowork(const struct context *src, const struct mroute_addr *dest, c
     if (pfs && !pfs->kill)
     {
         const in_addr_t addr = in_addr_t_from_mroute_addr(dest);
-        const struct pf_subnet *se = pfs->sns.list;
-        while (se)
+        const struct ipv4_subnet *rule = pf_subnet_lookup(&pfs->sns, addr);
+        if (rule)
         {
-            if ((addr & se->rule.netmask) == se->rule.network)
-            {
 #ifdef ENABLE_DEBUG
-                if (check_debug_level(D_PF_DEBUG))
-                {
-                    pf_addr_test_print("PF_ADDR_MATCH", prefix, src, dest, !se->rule.exclude, &se->rule);
-                }
-#endif
-                return !se->rule.exclude;
+            if (check_debug_level(D_PF_DEBUG))
+            {
+                pf_addr_test_print("PF_ADDR_MATCH", prefix, src, dest, !rule->exclude, rule);
             }
-            se = se->next;
+#endif
+            return !rule->exclude;
         }
 #ifdef ENABLE_DEBUG
         if (check_debug_level(D_PF_DEBUG))
@@ -696,6 +805,19 @@ pf_subnet_set_print(const struct pf_subnet_set *s, const int lev)
                 print_in_addr_t(e->rule.netmask, 0, &gc),
                 drop_accept(!e->rule.exclude));
         }
+
+        msg(lev, "  ----------");
+
+        {
+            int i;
+            for (i = 0; i < s->n_ranges; ++i)
+            {
+                const struct pf_subnet_range *r = &s->ranges[i];
+                msg(lev, "   %s+ %s",
+                    print_in_addr_t(r->low, 0, &gc),
+                    drop_accept(r->rule ? !r->rule->exclude : s->default_allow));
+            }
+        }
     }
     gc_free(&gc);
 }
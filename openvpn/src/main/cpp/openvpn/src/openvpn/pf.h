@@ -47,9 +47,23 @@ struct pf_subnet {
     struct ipv4_subnet rule;
 };
 
+/*
+ * One entry of the compiled subnet table.  Entries are sorted
+ * by low and together cover the whole IPv4 address space, so
+ * an address belongs to the last entry whose low is <= address.
+ */
+struct pf_subnet_range {
+    in_addr_t low;
+    const struct ipv4_subnet *rule; /* first matching rule, or NULL for default */
+};
+
 struct pf_subnet_set {
     bool default_allow;
     struct pf_subnet *list;
+
+    /* list compiled into non-overlapping ranges, see pf_subnet_compile */
+    struct pf_subnet_range *ranges;
+    int n_ranges;
 };
 
 struct pf_cn {
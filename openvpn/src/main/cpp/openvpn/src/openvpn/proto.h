@@ -236,6 +236,156 @@ struct ip_tcp_udp_hdr {
 #define MTU_TO_MSS(mtu) (mtu - sizeof(struct openvpn_iphdr) \
                          - sizeof(struct openvpn_tcphdr))
 
+/*
+ * Incrementally update an internet checksum when one 16-bit word
+ * changes from old_word to new_word (RFC 1624 eqn. 3,
+ * HC' = ~(~HC + ~m + m')).  All values in network byte order.
+ */
+static inline void
+update_checksum16(uint16_t *cksum, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = (uint16_t) ~*cksum;
+    sum += (uint16_t) ~old_word;
+    sum += new_word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    *cksum = (uint16_t) ~sum;
+}
+
+/*
+ * Flags returned by ip_classify()
+ */
+#define IPC_IPV4       (1<<0) /* IPv4 header present */
+#define IPC_IPV6       (1<<1) /* IPv6 header present */
+#define IPC_TCP_SYN    (1<<2) /* whole, unfragmented TCP SYN carrying options */
+#define IPC_DHCP_REPLY (1<<3) /* whole, unfragmented IPv4 UDP from port 67 to 68 */
+
+/* SYN flag set and data offset beyond the 20 byte TCP header */
+static inline bool
+ip_classify_tcp_syn(const uint8_t *tcp)
+{
+    const struct openvpn_tcphdr *tc = (const struct openvpn_tcphdr *) tcp;
+    return ((tc->flags & OPENVPN_TCPH_SYN_MASK) != 0) & (tc->doff_res >= 0x60);
+}
+
+static inline unsigned int
+ip_classify_ipv4(const uint8_t *p, int len, int *l4_offset)
+{
+    const int hlen = OPENVPN_IPH_GET_LEN(p[0]);
+    const bool whole = (((p[2] << 8) | p[3]) == len)
+                       & ((((p[6] << 8) | p[7]) & OPENVPN_IP_OFFMASK) == 0)
+                       & (hlen >= (int) sizeof(struct openvpn_iphdr))
+                       & (hlen + (int) sizeof(struct openvpn_tcphdr) <= len);
+    const uint8_t *l4 = p + hlen;
+
+    *l4_offset = hlen;
+    if (!whole)
+    {
+        return IPC_IPV4;
+    }
+    if (p[9] == OPENVPN_IPPROTO_TCP)
+    {
+        return IPC_IPV4 | (ip_classify_tcp_syn(l4) ? IPC_TCP_SYN : 0);
+    }
+    /* BOOTPS (67) to BOOTPC (68), compared as one word */
+    return IPC_IPV4 | ((p[9] == OPENVPN_IPPROTO_UDP)
+                       & ((((uint32_t) l4[0] << 24) | (l4[1] << 16) | (l4[2] << 8) | l4[3])
+                          == ((67u << 16) | 68u)) ? IPC_DHCP_REPLY : 0);
+}
+
+/* only "single next header = TCP", like mss_fixup_ipv6() always did */
+static inline unsigned int
+ip_classify_ipv6(const uint8_t *p, int len, int *l4_offset)
+{
+    const bool tcp = (((p[4] << 8) | p[5]) + (int) sizeof(struct openvpn_ipv6hdr) == len)
+                     & (p[6] == OPENVPN_IPPROTO_TCP)
+                     & (len >= (int) (sizeof(struct openvpn_ipv6hdr) + sizeof(struct openvpn_tcphdr)));
+
+    *l4_offset = sizeof(struct openvpn_ipv6hdr);
+    if (!tcp)
+    {
+        return IPC_IPV6;
+    }
+    return IPC_IPV6 | (ip_classify_tcp_syn(p + sizeof(struct openvpn_ipv6hdr)) ? IPC_TCP_SYN : 0);
+}
+
+/*
+ * Classify the IP packet of len bytes at p from its first few header
+ * bytes, so that the per-packet hooks (--mssfix, --route-gateway dhcp)
+ * only parse packets that concern them.  Returns IPC_* flags; for
+ * IPC_TCP_SYN and IPC_DHCP_REPLY, *l4_offset is set to the start of
+ * the TCP/UDP header.  Length and fragment checks are combined without
+ * branching, so most packets cost a few loads and compares.
+ */
+static inline unsigned int
+ip_classify(const uint8_t *p, int len, int *l4_offset)
+{
+    if (len < (int) sizeof(struct openvpn_iphdr))
+    {
+        return 0;
+    }
+    switch (OPENVPN_IPH_GET_VER(p[0]))
+    {
+        case 4:
+            return ip_classify_ipv4(p, len, l4_offset);
+
+        case 6:
+            return ip_classify_ipv6(p, len, l4_offset);
+
+        default:
+            return 0;
+    }
+}
+
+/*
+ * Symmetric hash of the IP 5-tuple of the packet of len bytes at p:
+ * both directions of a TCP/UDP flow hash to the same value.  Ports
+ * are left out for fragments, so that all fragments of a datagram
+ * hash alike.  Used to spread flows over the queues of a multi-queue
+ * tun device.
+ */
+static inline uint32_t
+ip_flow_hash(const uint8_t *p, int len)
+{
+    uint32_t h = 0;
+    int l4 = 0;
+    uint8_t proto = 0;
+
+    if (len >= (int) sizeof(struct openvpn_iphdr) && OPENVPN_IPH_GET_VER(p[0]) == 4)
+    {
+        const struct openvpn_iphdr *iph = (const struct openvpn_iphdr *) p;
+        h = iph->saddr ^ iph->daddr;
+        proto = iph->protocol;
+        /* no ports unless this is an unfragmented datagram (MF clear, offset 0) */
+        if (!(((p[6] << 8) | p[7]) & (OPENVPN_IP_OFFMASK | 0x2000)))
+        {
+            l4 = OPENVPN_IPH_GET_LEN(p[0]);
+        }
+    }
+    else if (len >= (int) sizeof(struct openvpn_ipv6hdr) && OPENVPN_IPH_GET_VER(p[0]) == 6)
+    {
+        const struct openvpn_ipv6hdr *ip6 = (const struct openvpn_ipv6hdr *) p;
+        int i;
+        for (i = 0; i < 16; ++i)
+        {
+            h = ((h << 8) | (h >> 24)) ^ (ip6->saddr.s6_addr[i] ^ ip6->daddr.s6_addr[i]);
+        }
+        proto = ip6->nexthdr;
+        l4 = sizeof(struct openvpn_ipv6hdr);
+    }
+
+    if (l4 && (proto == OPENVPN_IPPROTO_TCP || proto == OPENVPN_IPPROTO_UDP)
+        && l4 + 4 <= len)
+    {
+        h ^= (uint32_t) (((p[l4] << 8) | p[l4 + 1]) ^ ((p[l4 + 2] << 8) | p[l4 + 3]));
+    }
+    h ^= proto;
+
+    /* mix, so that the low bits depend on all input bits */
+    h *= 0x9e3779b1u;
+    return h ^ (h >> 16);
+}
+
 /*
  * This returns an ip protocol version of packet inside tun
  * and offset of IP header (via parameter).
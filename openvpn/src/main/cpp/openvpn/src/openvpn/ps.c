@@ -44,6 +44,11 @@ struct port_share *port_share = NULL; /* GLOBAL */
 /* size of i/o buffers */
 #define PROXY_CONNECTION_BUFFER_SIZE 1500
 
+#if PORT_SHARE_SPLICE
+/* max bytes moved through the splice pipe per splice() call */
+#define PROXY_CONNECTION_SPLICE_SIZE 65536
+#endif
+
 /* Command codes for foreground -> background communication */
 #define COMMAND_REDIRECT 10
 #define COMMAND_EXIT     11
@@ -75,6 +80,11 @@ struct proxy_connection {
     int rwflags;
     int sd;
     char *jfn;
+    counter_type n_bytes; /* bytes forwarded from sd to counterpart->sd */
+#if PORT_SHARE_SPLICE
+    int pipe_fd[2];       /* kernel pipe carrying data from sd to counterpart->sd */
+    int pipe_len;         /* bytes currently held in pipe_fd */
+#endif
 };
 
 #if 0
@@ -254,6 +264,40 @@ port_share_sendmsg(const socket_descriptor_t sd,
     }
 }
 
+#if PORT_SHARE_SPLICE
+
+/*
+ * Create the pipe used to splice() data from pc->sd to its counterpart.
+ * On failure, pc falls back to copying through pc->buf.
+ */
+static void
+proxy_connection_pipe_init(struct proxy_connection *pc)
+{
+    pc->pipe_len = 0;
+    if (pipe(pc->pipe_fd))
+    {
+        msg(D_PS_PROXY_DEBUG|M_ERRNO, "PORT SHARE PROXY: cannot create splice pipe, falling back to copy");
+        pc->pipe_fd[0] = pc->pipe_fd[1] = -1;
+        return;
+    }
+    set_nonblock(pc->pipe_fd[0]);
+    set_nonblock(pc->pipe_fd[1]);
+}
+
+static void
+proxy_connection_pipe_close(struct proxy_connection *pc)
+{
+    if (pc->pipe_fd[0] >= 0)
+    {
+        close(pc->pipe_fd[0]);
+        close(pc->pipe_fd[1]);
+        pc->pipe_fd[0] = pc->pipe_fd[1] = -1;
+    }
+    pc->pipe_len = 0;
+}
+
+#endif /* PORT_SHARE_SPLICE */
+
 static void
 proxy_entry_close_sd(struct proxy_connection *pc, struct event_set *es)
 {
@@ -278,7 +322,17 @@ proxy_entry_mark_for_close(struct proxy_connection *pc, struct event_set *es)
     if (pc->defined)
     {
         struct proxy_connection *cp = pc->counterpart;
+        if (socket_defined(pc->sd))
+        {
+            msg(D_PS_PROXY, "PORT SHARE PROXY: close sd=%d, forwarded " counter_format " bytes%s%s",
+                (int)pc->sd, pc->n_bytes,
+                pc->jfn ? ", journal " : "",
+                pc->jfn ? pc->jfn : "");
+        }
         proxy_entry_close_sd(pc, es);
+#if PORT_SHARE_SPLICE
+        proxy_connection_pipe_close(pc);
+#endif
         free_buf(&pc->buf);
         pc->buffer_initial = false;
         pc->rwflags = 0;
@@ -456,6 +510,9 @@ proxy_entry_new(struct proxy_connection **list,
     pc->buffer_initial = true;
     pc->rwflags = EVENT_UNDEF;
     pc->sd = sd_client;
+#if PORT_SHARE_SPLICE
+    proxy_connection_pipe_init(pc);
+#endif
 
     /* server object */
     cp->defined = true;
@@ -465,6 +522,9 @@ proxy_entry_new(struct proxy_connection **list,
     cp->buffer_initial = false;
     cp->rwflags = EVENT_UNDEF;
     cp->sd = sd_server;
+#if PORT_SHARE_SPLICE
+    proxy_connection_pipe_init(cp);
+#endif
 
     /* add to list */
     *list = pc;
@@ -611,6 +671,7 @@ proxy_connection_io_send(struct proxy_connection *pc, int *bytes_sent)
     else
     {
         *bytes_sent += status;
+        pc->n_bytes += status;
         if (status != pc->buf.len)
         {
             dmsg(D_PS_PROXY_DEBUG, "PORT SHARE PROXY: partial write[%d], tried=%d got=%d", (int)sd, pc->buf.len, status);
@@ -635,6 +696,55 @@ proxy_connection_io_send(struct proxy_connection *pc, int *bytes_sent)
     return IOSTAT_GOOD;
 }
 
+#if PORT_SHARE_SPLICE
+
+/*
+ * Move data from pc->sd to pc->counterpart->sd through pc's pipe,
+ * without copying it through userspace.
+ */
+static int
+proxy_connection_io_splice(struct proxy_connection *pc, int *bytes_sent)
+{
+    const socket_descriptor_t sd = pc->counterpart->sd;
+    ssize_t status;
+
+    if (!pc->pipe_len)
+    {
+        status = splice(pc->sd, NULL, pc->pipe_fd[1], NULL, PROXY_CONNECTION_SPLICE_SIZE,
+                        SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+        if (status < 0)
+        {
+            return (errno == EAGAIN) ? IOSTAT_EAGAIN_ON_READ : IOSTAT_READ_ERROR;
+        }
+        else if (!status)
+        {
+            return IOSTAT_READ_ERROR;
+        }
+        dmsg(D_PS_PROXY_DEBUG, "PORT SHARE PROXY: splice read[%d] %d", (int)pc->sd, (int)status);
+        pc->pipe_len = (int)status;
+    }
+
+    status = splice(pc->pipe_fd[0], NULL, sd, NULL, pc->pipe_len,
+                    SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+    if (status < 0)
+    {
+        return (errno == EAGAIN) ? IOSTAT_EAGAIN_ON_WRITE : IOSTAT_WRITE_ERROR;
+    }
+
+    *bytes_sent += (int)status;
+    pc->n_bytes += status;
+    pc->pipe_len -= (int)status;
+    if (pc->pipe_len)
+    {
+        dmsg(D_PS_PROXY_DEBUG, "PORT SHARE PROXY: partial splice write[%d], pending=%d", (int)sd, pc->pipe_len);
+        return IOSTAT_EAGAIN_ON_WRITE;
+    }
+    dmsg(D_PS_PROXY_DEBUG, "PORT SHARE PROXY: splice wrote[%d] %d", (int)sd, (int)status);
+    return IOSTAT_GOOD;
+}
+
+#endif /* PORT_SHARE_SPLICE */
+
 /*
  * Forward data from pc to pc->counterpart.
  */
@@ -645,6 +755,18 @@ proxy_connection_io_xfer(struct proxy_connection *pc, const int max_transfer)
     int transferred = 0;
     while (transferred < max_transfer)
     {
+#if PORT_SHARE_SPLICE
+        /* initial data is always sent from pc->buf before splicing */
+        if (pc->pipe_fd[0] >= 0 && !BLEN(&pc->buf))
+        {
+            const int status = proxy_connection_io_splice(pc, &transferred);
+            if (status != IOSTAT_GOOD)
+            {
+                return status;
+            }
+            continue;
+        }
+#endif
         if (!BLEN(&pc->buf))
         {
             const int status = proxy_connection_io_recv(pc);
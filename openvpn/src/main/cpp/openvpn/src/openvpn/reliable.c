@@ -308,30 +308,55 @@ done:
 void
 reliable_init(struct reliable *rel, int buf_size, int offset, int array_size, bool hold)
 {
-    int i;
-
     CLEAR(*rel);
     ASSERT(array_size > 0 && array_size <= RELIABLE_CAPACITY);
     rel->hold = hold;
     rel->size = array_size;
     rel->offset = offset;
+    rel->buf_size = buf_size;
+}
+
+void
+reliable_free(struct reliable *rel)
+{
+    int i;
     for (i = 0; i < rel->size; ++i)
     {
         struct reliable_entry *e = &rel->array[i];
-        e->buf = alloc_buf(buf_size);
-        ASSERT(buf_init(&e->buf, offset));
+        free_buf_pooled(&e->buf);
     }
 }
 
+/* give back the buffers of inactive entries */
 void
-reliable_free(struct reliable *rel)
+reliable_release_buffers(struct reliable *rel)
 {
     int i;
     for (i = 0; i < rel->size; ++i)
     {
         struct reliable_entry *e = &rel->array[i];
-        free_buf(&e->buf);
+        if (!e->active && e->buf.data)
+        {
+            free_buf_pooled(&e->buf);
+        }
+    }
+}
+
+/* bytes of buffer memory currently held */
+size_t
+reliable_buffer_bytes(const struct reliable *rel)
+{
+    size_t bytes = 0;
+    int i;
+    for (i = 0; i < rel->size; ++i)
+    {
+        const struct reliable_entry *e = &rel->array[i];
+        if (e->buf.data)
+        {
+            bytes += e->buf.capacity;
+        }
     }
+    return bytes;
 }
 
 /* no active buffers? */
@@ -350,11 +375,61 @@ reliable_empty(const struct reliable *rel)
     return true;
 }
 
+interval_t
+reliable_retransmit_timeout(const struct reliable *rel)
+{
+    if (!rel->srtt)
+    {
+        return rel->initial_timeout;
+    }
+    return constrain_int((rel->srtt + 4 * rel->rttvar + 999) / 1000,
+                         1, RELIABLE_MAX_TIMEOUT);
+}
+
+/* update the round trip estimate as in RFC 6298, rtt in ms */
+static void
+reliable_update_rtt(struct reliable *rel, int rtt)
+{
+    rtt = max_int(rtt, 1);
+    if (!rel->srtt)
+    {
+        rel->srtt = rtt;
+        rel->rttvar = rtt / 2;
+    }
+    else
+    {
+        rel->rttvar = (3 * rel->rttvar + abs(rel->srtt - rtt)) / 4;
+        rel->srtt = max_int((7 * rel->srtt + rtt) / 8, 1);
+    }
+    dmsg(D_REL_DEBUG, "ACK rtt=%d srtt=%d rttvar=%d", rtt, rel->srtt, rel->rttvar);
+}
+
+/* ACK for pid received: count it against all older packets still unacknowledged */
+static void
+reliable_ack_gap(struct reliable *rel, packet_id_type pid)
+{
+    int i;
+    for (i = 0; i < rel->size; ++i)
+    {
+        struct reliable_entry *e = &rel->array[i];
+        if (e->active && e->n_sent && reliable_pid_min(e->packet_id, pid)
+            && ++e->n_acks_after == RELIABLE_FAST_RETRANSMIT && e->next_try > now)
+        {
+            dmsg(D_REL_DEBUG, "ACK fast retransmit of ID " packet_id_format,
+                 (packet_id_print_type)e->packet_id);
+            e->next_try = now;
+        }
+    }
+}
+
 /* del acknowledged items from send buf */
 void
 reliable_send_purge(struct reliable *rel, const struct reliable_ack *ack)
 {
+    struct timeval tv;
     int i, j;
+
+    tv_clear(&tv);
     for (i = 0; i < ack->len; ++i)
     {
         packet_id_type pid = ack->packet_id[i];
@@ -366,6 +441,17 @@ reliable_send_purge(struct reliable *rel, const struct reliable_ack *ack)
                 dmsg(D_REL_DEBUG,
                      "ACK received for pid " packet_id_format ", deleting from send buffer",
                      (packet_id_print_type)pid);
+
+                /* Karn's algorithm: the ACK of a resent packet is ambiguous */
+                if (e->n_sent == 1)
+                {
+                    if (!tv.tv_sec)
+                    {
+                        openvpn_gettimeofday(&tv, NULL);
+                    }
+                    reliable_update_rtt(rel, tv_subtract(&tv, &e->sent, RELIABLE_MAX_TIMEOUT) / 1000);
+                }
+                reliable_ack_gap(rel, pid);
 #if 0
                 /* DEBUGGING -- how close were we timing out on ACK failure and resending? */
                 {
@@ -478,6 +564,10 @@ reliable_get_buf(struct reliable *rel)
         struct reliable_entry *e = &rel->array[i];
         if (!e->active)
         {
+            if (!e->buf.data)
+            {
+                e->buf = alloc_buf_pooled(rel->buf_size);
+            }
             ASSERT(buf_init(&e->buf, rel->offset));
             return &e->buf;
         }
@@ -586,10 +676,16 @@ reliable_send(struct reliable *rel, int *opcode)
     }
     if (best)
     {
+        if (!best->n_sent++)
+        {
+            openvpn_gettimeofday(&best->sent, NULL);
+        }
+        best->n_acks_after = 0;
 #ifdef EXPONENTIAL_BACKOFF
         /* exponential backoff */
         best->next_try = local_now + best->timeout;
-        best->timeout *= 2;
+        best->timeout = min_int(best->timeout * 2,
+                                max_int(RELIABLE_MAX_TIMEOUT, rel->initial_timeout));
 #else
         /* constant timeout, no backoff */
         best->next_try = local_now + best->timeout;
@@ -616,7 +712,7 @@ reliable_schedule_now(struct reliable *rel)
         if (e->active)
         {
             e->next_try = now;
-            e->timeout = rel->initial_timeout;
+            e->timeout = reliable_retransmit_timeout(rel);
         }
     }
 }
@@ -710,7 +806,9 @@ reliable_mark_active_outgoing(struct reliable *rel, struct buffer *buf, int opco
             e->active = true;
             e->opcode = opcode;
             e->next_try = 0;
-            e->timeout = rel->initial_timeout;
+            e->timeout = reliable_retransmit_timeout(rel);
+            e->n_sent = 0;
+            e->n_acks_after = 0;
             dmsg(D_REL_DEBUG, "ACK mark active outgoing ID " packet_id_format, (packet_id_print_type)e->packet_id);
             return;
         }
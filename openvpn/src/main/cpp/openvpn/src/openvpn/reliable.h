@@ -52,6 +52,13 @@
                                  *   the reliability layer for one VPN
                                  *   tunnel in one direction can store. */
 
+#define RELIABLE_FAST_RETRANSMIT 3 /**< Retransmit a packet at once when
+                                    *   this many packets sent after it
+                                    *   have been acknowledged. */
+
+#define RELIABLE_MAX_TIMEOUT 60 /**< Upper bound in seconds for the
+                                 *   retransmit timeout after backoff. */
+
 /**
  * The acknowledgment structure in which packet IDs are stored for later
  * acknowledgment.
@@ -73,6 +80,10 @@ struct reliable_entry
     time_t next_try;
     packet_id_type packet_id;
     int opcode;
+    int n_sent;                 /**< Number of times this packet was sent. */
+    int n_acks_after;           /**< ACKs received for later packets while
+                                 *   this one is unacknowledged. */
+    struct timeval sent;        /**< Time of the first transmission. */
     struct buffer buf;
 };
 
@@ -84,8 +95,11 @@ struct reliable
 {
     int size;
     interval_t initial_timeout;
+    int srtt;   /**< Smoothed round trip time in ms, 0 until measured. */
+    int rttvar; /**< Round trip time variation in ms. */
     packet_id_type packet_id;
     int offset;
+    int buf_size; /* entry buffers are allocated on first use */
     bool hold; /* don't xmit until reliable_schedule_now is called */
     struct reliable_entry array[RELIABLE_CAPACITY];
 };
@@ -180,6 +194,9 @@ bool reliable_ack_write(struct reliable_ack *ack,
 /**
  * Initialize a reliable structure.
  *
+ * The buffers are not allocated here, but taken from the buffer pool
+ * when an entry is first used, see \c reliable_release_buffers().
+ *
  * @param rel The reliable structure to initialize.
  * @param buf_size The size of the buffers in which packets will be
  *     stored.
@@ -198,6 +215,22 @@ void reliable_init(struct reliable *rel, int buf_size, int offset, int array_siz
  */
 void reliable_free(struct reliable *rel);
 
+/**
+ * Give the buffers of all inactive entries back to the buffer pool.
+ * They are allocated again when an entry is next used.
+ *
+ * @param rel The reliable structure whose buffers to release.
+ */
+void reliable_release_buffers(struct reliable *rel);
+
+/**
+ * Return the number of bytes of buffer memory held by a reliable
+ * structure.
+ *
+ * @param rel The reliable structure.
+ */
+size_t reliable_buffer_bytes(const struct reliable *rel);
+
 /* add to extra_frame the maximum number of bytes we will need for reliable_ack_write */
 void reliable_ack_adjust_frame_parameters(struct frame *frame, int max);
 
@@ -462,6 +495,19 @@ reliable_set_timeout(struct reliable *rel, interval_t timeout)
     rel->initial_timeout = timeout;
 }
 
+/**
+ * Return the retransmit timeout for newly sent packets.
+ *
+ * Until a round trip has been measured, this is the timeout set with
+ * \c reliable_set_timeout().  Afterwards it is SRTT + 4 * RTTVAR as in
+ * RFC 6298, rounded up to whole seconds.
+ *
+ * @param rel The reliable structure for outgoing packets.
+ *
+ * @return The timeout in seconds.
+ */
+interval_t reliable_retransmit_timeout(const struct reliable *rel);
+
 /* print a reliable ACK record coming off the wire */
 const char *reliable_ack_print(struct buffer *buf, bool verbose, struct gc_arena *gc);
 
@@ -41,6 +41,7 @@
 #include "manage.h"
 #include "win32.h"
 #include "options.h"
+#include "rtnl.h"
 
 #include "memdbg.h"
 
@@ -66,6 +67,138 @@ static void delete_route(struct route_ipv4 *r, const struct tuntap *tt, unsigned
 
 static void get_bypass_addresses(struct route_bypass *rb, const unsigned int flags);
 
+#ifdef ENABLE_RTNL
+/*
+ * While add_routes() or delete_routes() walk the route lists, the route
+ * changes are queued here and sent to the kernel as one rtnetlink batch.
+ */
+static struct rtnl_batch *route_batch; /* GLOBAL */
+
+#ifdef ENABLE_IPROUTE
+#define ROUTE_EXE_NAME "ip"
+#else
+#define ROUTE_EXE_NAME "route"
+#endif
+
+/* what a failed netlink request needs to be retried with ip/route */
+struct route_batch_context {
+    const struct tuntap *tt;
+    unsigned int flags;
+    const struct route_gateway_info *rgi;
+    const struct env_set *es;
+};
+
+static void
+route_batch_begin(const unsigned int flags)
+{
+    if ((flags & ROUTE_METHOD_MASK) != ROUTE_METHOD_EXE)
+    {
+        route_batch = rtnl_batch_new();
+    }
+}
+
+static void
+route_batch_commit(const struct tuntap *tt, unsigned int flags,
+                   const struct route_gateway_info *rgi, const struct env_set *es)
+{
+    if (route_batch)
+    {
+        struct route_batch_context ctx;
+
+        ctx.tt = tt;
+        ctx.flags = (flags & ~ROUTE_METHOD_MASK) | ROUTE_METHOD_EXE;
+        ctx.rgi = rgi;
+        ctx.es = es;
+
+        rtnl_batch_commit(route_batch, &ctx);
+        rtnl_batch_free(route_batch);
+        route_batch = NULL;
+    }
+}
+
+static inline bool
+route_batch_active(const unsigned int flags)
+{
+    return route_batch && (flags & ROUTE_METHOD_MASK) != ROUTE_METHOD_EXE;
+}
+
+/*
+ * Called with the kernel's answer for each queued route.  Failed
+ * requests are reported and retried with ip/route.
+ */
+static void
+add_route_rtnl_result(void *arg, void *cookie, int error)
+{
+    const struct route_batch_context *ctx = (const struct route_batch_context *) arg;
+    struct route_ipv4 *r = (struct route_ipv4 *) cookie;
+
+    if (error)
+    {
+        struct gc_arena gc = gc_new();
+        msg(M_WARN, "ERROR: netlink route add %s/%d failed: %s",
+            print_in_addr_t(r->network, 0, &gc), netmask_to_netbits2(r->netmask),
+            strerror(error));
+        msg(D_ROUTE, "Route addition fallback to %s", ROUTE_EXE_NAME);
+        add_route(r, ctx->tt, ctx->flags, ctx->rgi, ctx->es);
+        gc_free(&gc);
+    }
+}
+
+static void
+delete_route_rtnl_result(void *arg, void *cookie, int error)
+{
+    const struct route_batch_context *ctx = (const struct route_batch_context *) arg;
+    struct route_ipv4 *r = (struct route_ipv4 *) cookie;
+
+    /* ESRCH: the route is gone already, e.g. with its interface */
+    if (error && error != ESRCH)
+    {
+        struct gc_arena gc = gc_new();
+        msg(M_WARN, "ERROR: netlink route delete %s/%d failed: %s",
+            print_in_addr_t(r->network, 0, &gc), netmask_to_netbits2(r->netmask),
+            strerror(error));
+        msg(D_ROUTE, "Route deletion fallback to %s", ROUTE_EXE_NAME);
+        r->flags |= RT_ADDED;
+        delete_route(r, ctx->tt, ctx->flags, ctx->rgi, ctx->es);
+        gc_free(&gc);
+    }
+}
+
+static void
+add_route_ipv6_rtnl_result(void *arg, void *cookie, int error)
+{
+    const struct route_batch_context *ctx = (const struct route_batch_context *) arg;
+    struct route_ipv6 *r6 = (struct route_ipv6 *) cookie;
+
+    if (error)
+    {
+        struct gc_arena gc = gc_new();
+        msg(M_WARN, "ERROR: netlink route add %s/%d failed: %s",
+            print_in6_addr(r6->network, 0, &gc), r6->netbits, strerror(error));
+        msg(D_ROUTE, "Route addition fallback to %s", ROUTE_EXE_NAME);
+        add_route_ipv6(r6, ctx->tt, ctx->flags, ctx->es);
+        gc_free(&gc);
+    }
+}
+
+static void
+delete_route_ipv6_rtnl_result(void *arg, void *cookie, int error)
+{
+    const struct route_batch_context *ctx = (const struct route_batch_context *) arg;
+    const struct route_ipv6 *r6 = (const struct route_ipv6 *) cookie;
+
+    if (error && error != ESRCH)
+    {
+        struct gc_arena gc = gc_new();
+        msg(M_WARN, "ERROR: netlink route delete %s/%d failed: %s",
+            print_in6_addr(r6->network, 0, &gc), r6->netbits, strerror(error));
+        msg(D_ROUTE, "Route deletion fallback to %s", ROUTE_EXE_NAME);
+        delete_route_ipv6(r6, ctx->tt, ctx->flags, ctx->es);
+        gc_free(&gc);
+    }
+}
+#endif /* ENABLE_RTNL */
+
 #ifdef ENABLE_DEBUG
 
 static void
@@ -1190,6 +1323,9 @@ add_routes(struct route_list *rl, struct route_ipv6_list *rl6, const struct tunt
         }
 #endif
 
+#ifdef ENABLE_RTNL
+        route_batch_begin(flags);
+#endif
         for (r = rl->routes; r; r = r->next)
         {
             check_subnet_conflict(r->network, r->netmask, "route");
@@ -1199,6 +1335,9 @@ add_routes(struct route_list *rl, struct route_ipv6_list *rl6, const struct tunt
             }
             add_route(r, tt, flags, &rl->rgi, es);
         }
+#ifdef ENABLE_RTNL
+        route_batch_commit(tt, flags, &rl->rgi, es);
+#endif
         rl->iflags |= RL_ROUTES_ADDED;
     }
     if (rl6 && !(rl6->iflags & RL_ROUTES_ADDED) )
@@ -1213,6 +1352,9 @@ add_routes(struct route_list *rl, struct route_ipv6_list *rl6, const struct tunt
                 "fail or may not work as expected.", tt->actual_name);
         }
 
+#ifdef ENABLE_RTNL
+        route_batch_begin(flags);
+#endif
         for (r = rl6->routes_ipv6; r; r = r->next)
         {
             if (flags & ROUTE_DELETE_FIRST)
@@ -1221,6 +1363,9 @@ add_routes(struct route_list *rl, struct route_ipv6_list *rl6, const struct tunt
             }
             add_route_ipv6(r, tt, flags, es);
         }
+#ifdef ENABLE_RTNL
+        route_batch_commit(tt, flags, NULL, es);
+#endif
         rl6->iflags |= RL_ROUTES_ADDED;
     }
 }
@@ -1232,10 +1377,16 @@ delete_routes(struct route_list *rl, struct route_ipv6_list *rl6,
     if (rl && rl->iflags & RL_ROUTES_ADDED)
     {
         struct route_ipv4 *r;
+#ifdef ENABLE_RTNL
+        route_batch_begin(flags);
+#endif
         for (r = rl->routes; r; r = r->next)
         {
             delete_route(r, tt, flags, &rl->rgi, es);
         }
+#ifdef ENABLE_RTNL
+        route_batch_commit(tt, flags, &rl->rgi, es);
+#endif
         rl->iflags &= ~RL_ROUTES_ADDED;
     }
 
@@ -1249,10 +1400,16 @@ delete_routes(struct route_list *rl, struct route_ipv6_list *rl6,
     if (rl6 && (rl6->iflags & RL_ROUTES_ADDED) )
     {
         struct route_ipv6 *r6;
+#ifdef ENABLE_RTNL
+        route_batch_begin(flags);
+#endif
         for (r6 = rl6->routes_ipv6; r6; r6 = r6->next)
         {
             delete_route_ipv6(r6, tt, flags, es);
         }
+#ifdef ENABLE_RTNL
+        route_batch_commit(tt, flags, NULL, es);
+#endif
         rl6->iflags &= ~RL_ROUTES_ADDED;
     }
 
@@ -1563,6 +1720,27 @@ add_route(struct route_ipv4 *r,
     }
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNL
+    if (route_batch_active(flags))
+    {
+        const in_addr_t dst = htonl(r->network);
+        const in_addr_t gw = htonl(r->gateway);
+        const bool on_link = is_on_link(is_local_route, flags, rgi);
+
+        if (rtnl_route(route_batch, true, AF_INET, &dst, netmask_to_netbits2(r->netmask),
+                       on_link ? NULL : &gw, on_link ? rgi->iface : NULL,
+                       (r->flags & RT_METRIC_DEFINED) ? r->metric : -1,
+                       add_route_rtnl_result, r))
+        {
+            msg(D_ROUTE, "netlink: route add %s/%d %s %s", network,
+                netmask_to_netbits2(r->netmask), on_link ? "dev" : "via",
+                on_link ? rgi->iface : gateway);
+            /* until add_route_rtnl_result() says otherwise */
+            status = true;
+            goto done;
+        }
+    }
+#endif
 #ifdef ENABLE_IPROUTE
     argv_printf(&argv, "%s route add %s/%d",
                 iproute_path,
@@ -1934,6 +2112,18 @@ add_route_ipv6(struct route_ipv6 *r6, const struct tuntap *tt, unsigned int flag
     }
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNL
+    if (route_batch_active(flags)
+        && rtnl_route(route_batch, true, AF_INET6, &r6->network, r6->netbits,
+                      gateway_needed ? &r6->gateway : NULL, device,
+                      ((r6->flags & RT_METRIC_DEFINED) && r6->metric > 0) ? r6->metric : -1,
+                      add_route_ipv6_rtnl_result, r6))
+    {
+        /* until add_route_ipv6_rtnl_result() says otherwise */
+        status = true;
+        goto done;
+    }
+#endif
 #ifdef ENABLE_IPROUTE
     argv_printf(&argv, "%s -6 route add %s/%d dev %s",
                 iproute_path,
@@ -2183,6 +2373,20 @@ delete_route(struct route_ipv4 *r,
     }
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNL
+    if (route_batch_active(flags))
+    {
+        const in_addr_t dst = htonl(r->network);
+
+        if (rtnl_route(route_batch, false, AF_INET, &dst, netmask_to_netbits2(r->netmask),
+                       NULL, NULL, (r->flags & RT_METRIC_DEFINED) ? r->metric : -1,
+                       delete_route_rtnl_result, r))
+        {
+            msg(D_ROUTE, "netlink: route del %s/%d", network, netmask_to_netbits2(r->netmask));
+            goto done;
+        }
+    }
+#endif
 #ifdef ENABLE_IPROUTE
     argv_printf(&argv, "%s route del %s/%d",
                 iproute_path,
@@ -2394,6 +2598,18 @@ delete_route_ipv6(const struct route_ipv6 *r6, const struct tuntap *tt, unsigned
 
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNL
+    if (route_batch_active(flags)
+        && rtnl_route(route_batch, false, AF_INET6, &r6->network, r6->netbits,
+                      gateway_needed ? &r6->gateway : NULL, device,
+                      ((r6->flags & RT_METRIC_DEFINED) && r6->metric > 0) ? r6->metric : -1,
+                      delete_route_ipv6_rtnl_result, (void *) r6))
+    {
+        argv_reset(&argv);
+        gc_free(&gc);
+        return;
+    }
+#endif
 #ifdef ENABLE_IPROUTE
     argv_printf(&argv, "%s -6 route del %s/%d dev %s",
                 iproute_path,
@@ -32,9 +32,9 @@
 #include "tun.h"
 #include "misc.h"
 
-#ifdef _WIN32
+#if defined(_WIN32) || defined(ENABLE_RTNL)
 /*
- * Windows route methods
+ * Route methods.  On Linux, IPAPI means netlink and EXE means ip/route.
  */
 #define ROUTE_METHOD_ADAPTIVE  0  /* try IP helper first then route.exe */
 #define ROUTE_METHOD_IPAPI     1  /* use IP helper API */
@@ -0,0 +1,433 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#ifdef ENABLE_RTNL
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "buffer.h"
+#include "error.h"
+#include "errlevel.h"
+#include "fdmisc.h"
+#include "rtnl.h"
+
+#include "memdbg.h"
+
+/* room for the attributes of any request queued below */
+#define RTNL_ATTR_SPACE 96
+
+/*
+ * Requests sent with one sendmsg().  The kernel processes them one by
+ * one while sendmsg() runs, so a chunk must not produce more answers
+ * than fit into the socket receive buffer.
+ */
+#define RTNL_CHUNK 256
+
+/* how long to wait for answers the kernel should already have queued */
+#define RTNL_TIMEOUT 5
+
+struct rtnl_req {
+    struct {
+        struct nlmsghdr nh;
+        union {
+            struct rtmsg rtm;
+            struct ifaddrmsg ifa;
+            struct ifinfomsg ifi;
+        } u;
+        char attrs[RTNL_ATTR_SPACE];
+    } m;
+
+    rtnl_result_fn fn;
+    void *cookie;
+    int error;                  /* -1 until answered */
+
+    struct rtnl_req *next;
+};
+
+struct rtnl_batch {
+    int fd;
+    unsigned int seq;
+    struct rtnl_req *head;
+    struct rtnl_req *tail;
+};
+
+struct rtnl_batch *
+rtnl_batch_new(void)
+{
+    struct rtnl_batch *b;
+    struct timeval tv;
+    int fd;
+
+    fd = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+        msg(D_ROUTE|M_ERRNO, "RTNL: socket() failed");
+        return NULL;
+    }
+    set_cloexec(fd);
+
+#ifdef NETLINK_CAP_ACK
+    {
+        /* don't echo failed requests back, we only need their sequence number */
+        int on = 1;
+        setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &on, sizeof(on));
+    }
+#endif
+
+    CLEAR(tv);
+    tv.tv_sec = RTNL_TIMEOUT;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+    {
+        msg(D_ROUTE|M_ERRNO, "RTNL: setsockopt(SO_RCVTIMEO) failed");
+        close(fd);
+        return NULL;
+    }
+
+    ALLOC_OBJ_CLEAR(b, struct rtnl_batch);
+    b->fd = fd;
+    b->seq = (unsigned int) time(NULL);
+    return b;
+}
+
+static void
+rtnl_batch_reset(struct rtnl_batch *b)
+{
+    struct rtnl_req *req = b->head;
+    while (req)
+    {
+        struct rtnl_req *next = req->next;
+        free(req);
+        req = next;
+    }
+    b->head = b->tail = NULL;
+}
+
+void
+rtnl_batch_free(struct rtnl_batch *b)
+{
+    if (b)
+    {
+        rtnl_batch_reset(b);
+        close(b->fd);
+        free(b);
+    }
+}
+
+static struct rtnl_req *
+rtnl_req_new(unsigned short type, unsigned short flags,
+             size_t len, rtnl_result_fn fn, void *cookie)
+{
+    struct rtnl_req *req;
+
+    ALLOC_OBJ_CLEAR(req, struct rtnl_req);
+    req->m.nh.nlmsg_len = NLMSG_LENGTH(len);
+    req->m.nh.nlmsg_type = type;
+    req->m.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    req->fn = fn;
+    req->cookie = cookie;
+    req->error = -1;
+    return req;
+}
+
+static void
+rtnl_req_queue(struct rtnl_batch *b, struct rtnl_req *req)
+{
+    if (b->tail)
+    {
+        b->tail->next = req;
+    }
+    else
+    {
+        b->head = req;
+    }
+    b->tail = req;
+}
+
+static void
+rtnl_addattr(struct rtnl_req *req, unsigned short type, const void *data, size_t len)
+{
+    const size_t off = NLMSG_ALIGN(req->m.nh.nlmsg_len);
+    struct rtattr *rta = (struct rtattr *) ((char *) &req->m + off);
+
+    ASSERT(off + RTA_SPACE(len) <= sizeof(req->m));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    req->m.nh.nlmsg_len = off + RTA_SPACE(len);
+}
+
+static int
+rtnl_addr_len(int family)
+{
+    return family == AF_INET6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+}
+
+static bool
+rtnl_ifindex(const char *iface, int *ifindex)
+{
+    *ifindex = (int) if_nametoindex(iface);
+    if (!*ifindex)
+    {
+        msg(D_ROUTE|M_ERRNO, "RTNL: cannot find interface %s", iface);
+        return false;
+    }
+    return true;
+}
+
+bool
+rtnl_route(struct rtnl_batch *b, bool add, int family,
+           const void *dst, int prefixlen,
+           const void *gateway, const char *iface, int metric,
+           rtnl_result_fn fn, void *cookie)
+{
+    const int alen = rtnl_addr_len(family);
+    struct rtnl_req *req;
+    int ifindex = 0;
+
+    if (iface && !rtnl_ifindex(iface, &ifindex))
+    {
+        return false;
+    }
+
+    req = rtnl_req_new(add ? RTM_NEWROUTE : RTM_DELROUTE,
+                       add ? NLM_F_CREATE | NLM_F_EXCL : 0,
+                       sizeof(struct rtmsg), fn, cookie);
+    req->m.u.rtm.rtm_family = family;
+    req->m.u.rtm.rtm_dst_len = prefixlen;
+    req->m.u.rtm.rtm_table = RT_TABLE_MAIN;
+    if (add)
+    {
+        /* what "ip route add" does */
+        req->m.u.rtm.rtm_protocol = RTPROT_BOOT;
+        req->m.u.rtm.rtm_scope = gateway ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+        req->m.u.rtm.rtm_type = RTN_UNICAST;
+    }
+    else
+    {
+        req->m.u.rtm.rtm_scope = RT_SCOPE_NOWHERE;
+    }
+
+    rtnl_addattr(req, RTA_DST, dst, alen);
+    if (gateway)
+    {
+        rtnl_addattr(req, RTA_GATEWAY, gateway, alen);
+    }
+    if (ifindex)
+    {
+        rtnl_addattr(req, RTA_OIF, &ifindex, sizeof(ifindex));
+    }
+    if (metric >= 0)
+    {
+        const uint32_t priority = metric;
+        rtnl_addattr(req, RTA_PRIORITY, &priority, sizeof(priority));
+    }
+
+    rtnl_req_queue(b, req);
+    return true;
+}
+
+bool
+rtnl_addr(struct rtnl_batch *b, bool add, int family, const char *iface,
+          const void *local, int prefixlen,
+          const void *peer, const void *broadcast,
+          rtnl_result_fn fn, void *cookie)
+{
+    const int alen = rtnl_addr_len(family);
+    struct rtnl_req *req;
+    int ifindex;
+
+    if (!rtnl_ifindex(iface, &ifindex))
+    {
+        return false;
+    }
+
+    req = rtnl_req_new(add ? RTM_NEWADDR : RTM_DELADDR,
+                       add ? NLM_F_CREATE | NLM_F_EXCL : 0,
+                       sizeof(struct ifaddrmsg), fn, cookie);
+    req->m.u.ifa.ifa_family = family;
+    req->m.u.ifa.ifa_prefixlen = prefixlen;
+    req->m.u.ifa.ifa_index = ifindex;
+
+    rtnl_addattr(req, IFA_LOCAL, local, alen);
+    rtnl_addattr(req, IFA_ADDRESS, peer ? peer : local, alen);
+    if (broadcast)
+    {
+        rtnl_addattr(req, IFA_BROADCAST, broadcast, alen);
+    }
+
+    rtnl_req_queue(b, req);
+    return true;
+}
+
+bool
+rtnl_link_up(struct rtnl_batch *b, const char *iface, int mtu,
+             rtnl_result_fn fn, void *cookie)
+{
+    const uint32_t mtu32 = mtu;
+    struct rtnl_req *req;
+    int ifindex;
+
+    if (!rtnl_ifindex(iface, &ifindex))
+    {
+        return false;
+    }
+
+    req = rtnl_req_new(RTM_NEWLINK, 0, sizeof(struct ifinfomsg), fn, cookie);
+    req->m.u.ifi.ifi_family = AF_UNSPEC;
+    req->m.u.ifi.ifi_index = ifindex;
+    req->m.u.ifi.ifi_flags = IFF_UP;
+    req->m.u.ifi.ifi_change = IFF_UP;
+
+    rtnl_addattr(req, IFLA_MTU, &mtu32, sizeof(mtu32));
+
+    rtnl_req_queue(b, req);
+    return true;
+}
+
+/*
+ * Send n requests starting at first with one sendmsg() and collect the
+ * answers.  Requests left unanswered get an error.
+ */
+static void
+rtnl_send_chunk(struct rtnl_batch *b, struct rtnl_req *first, int n)
+{
+    struct sockaddr_nl nladdr;
+    struct iovec iov[RTNL_CHUNK];
+    struct rtnl_req *reqs[RTNL_CHUNK];
+    struct msghdr mh;
+    const unsigned int seq0 = b->seq;
+    int pending = n;
+    int i;
+
+    for (i = 0; i < n; ++i, first = first->next)
+    {
+        reqs[i] = first;
+        first->m.nh.nlmsg_seq = b->seq++;
+        iov[i].iov_base = &first->m;
+        iov[i].iov_len = NLMSG_ALIGN(first->m.nh.nlmsg_len);
+    }
+
+    CLEAR(nladdr);
+    nladdr.nl_family = AF_NETLINK;
+    CLEAR(mh);
+    mh.msg_name = &nladdr;
+    mh.msg_namelen = sizeof(nladdr);
+    mh.msg_iov = iov;
+    mh.msg_iovlen = n;
+
+    if (sendmsg(b->fd, &mh, 0) < 0)
+    {
+        const int err = errno;
+        msg(D_ROUTE|M_ERRNO, "RTNL: sendmsg() failed");
+        for (i = 0; i < n; ++i)
+        {
+            reqs[i]->error = err;
+        }
+        return;
+    }
+
+    while (pending > 0)
+    {
+        char buf[8192];
+        struct nlmsghdr *nh;
+        ssize_t len = recv(b->fd, buf, sizeof(buf), 0);
+
+        if (len < 0)
+        {
+            const int err = errno;
+            msg(D_ROUTE|M_ERRNO, "RTNL: recv() failed, %d requests unanswered", pending);
+            for (i = 0; i < n; ++i)
+            {
+                if (reqs[i]->error < 0)
+                {
+                    reqs[i]->error = err;
+                }
+            }
+            return;
+        }
+
+        for (nh = (struct nlmsghdr *) buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len))
+        {
+            const unsigned int idx = nh->nlmsg_seq - seq0;
+            const struct nlmsgerr *err = NLMSG_DATA(nh);
+
+            if (nh->nlmsg_type != NLMSG_ERROR || idx >= (unsigned int) n
+                || nh->nlmsg_len < NLMSG_LENGTH(sizeof(*err)))
+            {
+                continue;
+            }
+            if (reqs[idx]->error < 0)
+            {
+                reqs[idx]->error = -err->error;
+                --pending;
+            }
+        }
+    }
+}
+
+int
+rtnl_batch_commit(struct rtnl_batch *b, void *arg)
+{
+    struct rtnl_req *req;
+    int failed = 0;
+
+    req = b->head;
+    while (req)
+    {
+        struct rtnl_req *first = req;
+        int n = 0;
+
+        while (req && n < RTNL_CHUNK)
+        {
+            req = req->next;
+            ++n;
+        }
+        rtnl_send_chunk(b, first, n);
+    }
+
+    for (req = b->head; req; req = req->next)
+    {
+        if (req->error)
+        {
+            ++failed;
+        }
+        if (req->fn)
+        {
+            (*req->fn)(arg, req->cookie, req->error);
+        }
+    }
+
+    rtnl_batch_reset(b);
+    return failed;
+}
+
+#endif /* ENABLE_RTNL */
@@ -0,0 +1,112 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Route, address and link programming through rtnetlink on Linux.
+ *
+ * Requests are collected in a batch and sent to the kernel together
+ * when the batch is committed, instead of running ip/route/ifconfig
+ * once per change.  The kernel answers every request separately, and
+ * each answer is handed to the callback given when the request was
+ * queued, so that failures can be reported (and retried another way)
+ * per route.
+ */
+
+#ifndef RTNL_H
+#define RTNL_H
+
+#ifdef ENABLE_RTNL
+
+#include "basic.h"
+
+struct rtnl_batch;
+
+/**
+ * Called by rtnl_batch_commit() for each request.
+ *
+ * @param arg     argument passed to rtnl_batch_commit()
+ * @param cookie  argument passed when queueing the request
+ * @param error   0 on success, otherwise an errno value
+ */
+typedef void (*rtnl_result_fn)(void *arg, void *cookie, int error);
+
+/**
+ * Open a netlink socket for a new batch.
+ *
+ * @return the batch, or NULL if rtnetlink is not available
+ */
+struct rtnl_batch *rtnl_batch_new(void);
+
+/**
+ * Close the socket and free all requests which were not committed.
+ */
+void rtnl_batch_free(struct rtnl_batch *b);
+
+/**
+ * Queue adding or deleting a route in the main table.
+ *
+ * @param add        true for RTM_NEWROUTE, false for RTM_DELROUTE
+ * @param family     AF_INET or AF_INET6
+ * @param dst        network, in network byte order
+ * @param prefixlen  netmask bits
+ * @param gateway    gateway in network byte order, or NULL
+ * @param iface      output interface, or NULL
+ * @param metric     route metric, or -1 for none
+ *
+ * @return false if the request could not be queued, e.g. because iface
+ *         does not exist
+ */
+bool rtnl_route(struct rtnl_batch *b, bool add, int family,
+                const void *dst, int prefixlen,
+                const void *gateway, const char *iface, int metric,
+                rtnl_result_fn fn, void *cookie);
+
+/**
+ * Queue adding or deleting an interface address.
+ *
+ * @param local      address in network byte order
+ * @param peer       point-to-point peer address, or NULL
+ * @param broadcast  IPv4 broadcast address, or NULL
+ */
+bool rtnl_addr(struct rtnl_batch *b, bool add, int family, const char *iface,
+               const void *local, int prefixlen,
+               const void *peer, const void *broadcast,
+               rtnl_result_fn fn, void *cookie);
+
+/**
+ * Queue bringing an interface up and setting its MTU.
+ */
+bool rtnl_link_up(struct rtnl_batch *b, const char *iface, int mtu,
+                  rtnl_result_fn fn, void *cookie);
+
+/**
+ * Send all queued requests and report the kernel's answer for each of
+ * them, in the order they were queued.  The batch is empty afterwards
+ * and may be reused.
+ *
+ * @return the number of failed requests
+ */
+int rtnl_batch_commit(struct rtnl_batch *b, void *arg);
+
+#endif /* ENABLE_RTNL */
+#endif /* RTNL_H */
@@ -156,6 +156,61 @@ shaper_wrote_bytes(struct shaper *s, int nbytes)
     }
 }
 
+/*
+ * Token bucket policer.  Unlike the shaper it never delays
+ * output, it only tells the caller whether a packet fits
+ * into the configured rate.
+ */
+
+#define TOKEN_BUCKET_MIN_BURST 16384 /* bytes */
+
+struct token_bucket
+{
+    int bytes_per_second;
+    int burst;
+    int tokens;
+    struct timeval last;
+};
+
+static inline void
+token_bucket_init(struct token_bucket *tb, int bytes_per_second)
+{
+    tb->bytes_per_second = constrain_int(bytes_per_second, SHAPER_MIN, SHAPER_MAX);
+    tb->burst = max_int(tb->bytes_per_second / 4, TOKEN_BUCKET_MIN_BURST);
+    tb->tokens = tb->burst;
+    ASSERT(!openvpn_gettimeofday(&tb->last, NULL));
+}
+
+/*
+ * Return true and charge the bucket if nbytes may be sent now.
+ */
+static inline bool
+token_bucket_consume(struct token_bucket *tb, int nbytes)
+{
+    struct timeval tv;
+    int elapsed;
+
+    ASSERT(!openvpn_gettimeofday(&tv, NULL));
+    elapsed = tv_subtract(&tv, &tb->last, SHAPER_MAX_TIMEOUT);
+    if (elapsed > 0)
+    {
+        const int refill = (int)((int64_t)elapsed * tb->bytes_per_second / 1000000);
+        /* only advance the clock once at least one token was earned */
+        if (refill > 0)
+        {
+            tb->tokens = min_int(tb->tokens + refill, tb->burst);
+            tb->last = tv;
+        }
+    }
+
+    if (tb->tokens >= nbytes)
+    {
+        tb->tokens -= nbytes;
+        return true;
+    }
+    return false;
+}
+
 #if 0
 /*
  * Increase/Decrease bandwidth by a percentage.
@@ -718,6 +718,14 @@ init_ssl(const struct options *options, struct tls_root_ctx *new_ctx)
         tls_ctx_load_ecdh_params(new_ctx, options->ecdh_curve);
     }
 
+#ifdef ENABLE_ASYNC_PK
+    /* Keep the expensive handshake steps off the event loop */
+    if (options->tls_server && options->handshake_workers > 0)
+    {
+        tls_ctx_async_pk(new_ctx, options->handshake_workers);
+    }
+#endif
+
 #ifdef ENABLE_CRYPTO_MBEDTLS
     /* Personalise the random by mixing in the certificate */
     tls_ctx_personalise_random(new_ctx);
@@ -936,10 +944,10 @@ key_state_init(struct tls_session *session, struct key_state *ks)
     ALLOC_OBJ_CLEAR(ks->rec_reliable, struct reliable);
     ALLOC_OBJ_CLEAR(ks->rec_ack, struct reliable_ack);
 
-    /* allocate buffers */
-    ks->plaintext_read_buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
-    ks->plaintext_write_buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
-    ks->ack_write_buf = alloc_buf(BUF_SIZE(&session->opt->frame));
+    /*
+     * The plaintext and ACK buffers, like the reliability layer buffers,
+     * are only allocated when first needed, see key_state_buf_get().
+     */
     reliable_init(ks->send_reliable, BUF_SIZE(&session->opt->frame),
                   FRAME_HEADROOM(&session->opt->frame), TLS_RELIABLE_N_SEND_BUFFERS,
                   ks->key_id ? false : session->opt->xmit_hold);
@@ -985,9 +993,9 @@ key_state_free(struct key_state *ks, bool clear)
     key_state_ssl_free(&ks->ks_ssl);
 
     free_key_ctx_bi(&ks->crypto_options.key_ctx_bi);
-    free_buf(&ks->plaintext_read_buf);
-    free_buf(&ks->plaintext_write_buf);
-    free_buf(&ks->ack_write_buf);
+    free_buf_pooled(&ks->plaintext_read_buf);
+    free_buf_pooled(&ks->plaintext_write_buf);
+    free_buf_pooled(&ks->ack_write_buf);
     buffer_list_free(ks->paybuf);
 
     if (ks->send_reliable)
@@ -1024,6 +1032,63 @@ key_state_free(struct key_state *ks, bool clear)
     }
 }
 
+/**
+ * Make sure that a control channel buffer of a \c key_state is allocated.
+ * @ingroup control_processor
+ *
+ * The control channel buffers of a key are only needed while its TLS
+ * handshake runs, or later when a control message or ACK passes.  They
+ * are taken from the buffer pool on first use and given back by \c
+ * key_state_release_buffers() once the key is active and idle.
+ *
+ * @param buf          - The buffer, one of the plaintext or ACK buffers of
+ *                       a \c key_state.
+ * @param size         - The size to allocate.
+ *
+ * @return The buffer.
+ */
+static struct buffer *
+key_state_buf_get(struct buffer *buf, size_t size)
+{
+    if (!buf->data)
+    {
+        *buf = alloc_buf_pooled(size);
+    }
+    return buf;
+}
+
+/**
+ * Give the idle control channel buffers of an active \c key_state back to
+ * the buffer pool.
+ * @ingroup control_processor
+ *
+ * Buffers holding data which has not been processed yet and reliability
+ * layer buffers of unacknowledged packets are kept.  Must not be called
+ * while an outgoing packet may still point into the ACK buffer.
+ *
+ * @param ks           - The \c key_state.
+ */
+static void
+key_state_release_buffers(struct key_state *ks)
+{
+    if (ks->state < S_ACTIVE)
+    {
+        return;
+    }
+
+    if (!BLEN(&ks->plaintext_read_buf))
+    {
+        free_buf_pooled(&ks->plaintext_read_buf);
+    }
+    if (!BLEN(&ks->plaintext_write_buf))
+    {
+        free_buf_pooled(&ks->plaintext_write_buf);
+    }
+    free_buf_pooled(&ks->ack_write_buf);
+    reliable_release_buffers(ks->send_reliable);
+    reliable_release_buffers(ks->rec_reliable);
+}
+
 /** @} name Functions for initialization and cleanup of key_state structures */
 
 /** @} addtogroup control_processor */
@@ -1390,69 +1455,6 @@ tls_multi_free(struct tls_multi *multi, bool clear)
 }
 
 
-/*
- * Move a packet authentication HMAC + related fields to or from the front
- * of the buffer so it can be processed by encrypt/decrypt.
- */
-
-/*
- * Dependent on hmac size, opcode size, and session_id size.
- * Will assert if too small.
- */
-#define SWAP_BUF_SIZE 256
-
-static bool
-swap_hmac(struct buffer *buf, const struct crypto_options *co, bool incoming)
-{
-    const struct key_ctx *ctx;
-
-    ASSERT(co);
-
-    ctx = (incoming ? &co->key_ctx_bi.decrypt : &co->key_ctx_bi.encrypt);
-    ASSERT(ctx->hmac);
-
-    {
-        /* hmac + packet_id (8 bytes) */
-        const int hmac_size = hmac_ctx_size(ctx->hmac) + packet_id_size(true);
-
-        /* opcode + session_id */
-        const int osid_size = 1 + SID_SIZE;
-
-        int e1, e2;
-        uint8_t *b = BPTR(buf);
-        uint8_t buf1[SWAP_BUF_SIZE];
-        uint8_t buf2[SWAP_BUF_SIZE];
-
-        if (incoming)
-        {
-            e1 = osid_size;
-            e2 = hmac_size;
-        }
-        else
-        {
-            e1 = hmac_size;
-            e2 = osid_size;
-        }
-
-        ASSERT(e1 <= SWAP_BUF_SIZE && e2 <= SWAP_BUF_SIZE);
-
-        if (buf->len >= e1 + e2)
-        {
-            memcpy(buf1, b, e1);
-            memcpy(buf2, b + e1, e2);
-            memcpy(b, buf2, e2);
-            memcpy(b + e2, buf1, e1);
-            return true;
-        }
-        else
-        {
-            return false;
-        }
-    }
-}
-
-#undef SWAP_BUF_SIZE
-
 /*
  * Write a control channel authentication record.
  */
@@ -1466,7 +1468,6 @@ write_control_auth(struct tls_session *session,
                    bool prepend_ack)
 {
     uint8_t header = ks->key_id | (opcode << P_OPCODE_SHIFT);
-    struct buffer null = clear_buf();
 
     ASSERT(link_socket_actual_defined(&ks->remote_addr));
     ASSERT(reliable_ack_write
@@ -1474,134 +1475,13 @@ write_control_auth(struct tls_session *session,
 
     msg(D_TLS_DEBUG, "%s(): %s", __func__, packet_opcode_name(opcode));
 
-    if (session->tls_wrap.mode == TLS_WRAP_AUTH
-        || session->tls_wrap.mode == TLS_WRAP_NONE)
-    {
-        ASSERT(session_id_write_prepend(&session->session_id, buf));
-        ASSERT(buf_write_prepend(buf, &header, sizeof(header)));
-    }
-    if (session->tls_wrap.mode == TLS_WRAP_AUTH)
+    if (!tls_wrap_control(&session->tls_wrap, header, &session->session_id, buf))
     {
-        /* no encryption, only write hmac */
-        openvpn_encrypt(buf, null, &session->tls_wrap.opt);
-        ASSERT(swap_hmac(buf, &session->tls_wrap.opt, false));
-    }
-    else if (session->tls_wrap.mode == TLS_WRAP_CRYPT)
-    {
-        ASSERT(buf_init(&session->tls_wrap.work, buf->offset));
-        ASSERT(buf_write(&session->tls_wrap.work, &header, sizeof(header)));
-        ASSERT(session_id_write(&session->session_id, &session->tls_wrap.work));
-        if (!tls_crypt_wrap(buf, &session->tls_wrap.work, &session->tls_wrap.opt))
-        {
-            buf->len = 0;
-            return;
-        }
-
-        if (opcode == P_CONTROL_HARD_RESET_CLIENT_V3)
-        {
-            if (!buf_copy(&session->tls_wrap.work,
-                          session->tls_wrap.tls_crypt_v2_wkc))
-            {
-                msg(D_TLS_ERRORS, "Could not append tls-crypt-v2 client key");
-                buf->len = 0;
-                return;
-            }
-        }
-
-        /* Don't change the original data in buf, it's used by the reliability
-         * layer to resend on failure. */
-        *buf = session->tls_wrap.work;
+        return;
     }
     *to_link_addr = &ks->remote_addr;
 }
 
-/*
- * Read a control channel authentication record.
- */
-static bool
-read_control_auth(struct buffer *buf,
-                  struct tls_wrap_ctx *ctx,
-                  const struct link_socket_actual *from,
-                  const struct tls_options *opt)
-{
-    struct gc_arena gc = gc_new();
-    bool ret = false;
-
-    const uint8_t opcode = *(BPTR(buf)) >> P_OPCODE_SHIFT;
-    if (opcode == P_CONTROL_HARD_RESET_CLIENT_V3
-        && !tls_crypt_v2_extract_client_key(buf, ctx, opt))
-    {
-        msg(D_TLS_ERRORS,
-            "TLS Error: can not extract tls-crypt-v2 client key from %s",
-            print_link_socket_actual(from, &gc));
-        goto cleanup;
-    }
-
-    if (ctx->mode == TLS_WRAP_AUTH)
-    {
-        struct buffer null = clear_buf();
-
-        /* move the hmac record to the front of the packet */
-        if (!swap_hmac(buf, &ctx->opt, true))
-        {
-            msg(D_TLS_ERRORS,
-                "TLS Error: cannot locate HMAC in incoming packet from %s",
-                print_link_socket_actual(from, &gc));
-            gc_free(&gc);
-            return false;
-        }
-
-        /* authenticate only (no decrypt) and remove the hmac record
-         * from the head of the buffer */
-        openvpn_decrypt(buf, null, &ctx->opt, NULL, BPTR(buf));
-        if (!buf->len)
-        {
-            msg(D_TLS_ERRORS,
-                "TLS Error: incoming packet authentication failed from %s",
-                print_link_socket_actual(from, &gc));
-            goto cleanup;
-        }
-
-    }
-    else if (ctx->mode == TLS_WRAP_CRYPT)
-    {
-        struct buffer tmp = alloc_buf_gc(buf_forward_capacity_total(buf), &gc);
-        if (!tls_crypt_unwrap(buf, &tmp, &ctx->opt))
-        {
-            msg(D_TLS_ERRORS, "TLS Error: tls-crypt unwrapping failed from %s",
-                print_link_socket_actual(from, &gc));
-            goto cleanup;
-        }
-        ASSERT(buf_init(buf, buf->offset));
-        ASSERT(buf_copy(buf, &tmp));
-        buf_clear(&tmp);
-    }
-    else if (ctx->tls_crypt_v2_server_key.cipher)
-    {
-        /* If tls-crypt-v2 is enabled, require *some* wrapping */
-        msg(D_TLS_ERRORS, "TLS Error: could not determine wrapping from %s",
-            print_link_socket_actual(from, &gc));
-        /* TODO Do we want to support using tls-crypt-v2 and no control channel
-         * wrapping at all simultaneously?  That would allow server admins to
-         * upgrade clients one-by-one without running a second instance, but we
-         * should not enable it by default because it breaks DoS-protection.
-         * So, add something like --tls-crypt-v2-allow-insecure-fallback ? */
-        goto cleanup;
-    }
-
-    if (ctx->mode == TLS_WRAP_NONE || ctx->mode == TLS_WRAP_AUTH)
-    {
-        /* advance buffer pointer past opcode & session_id since our caller
-         * already read it */
-        buf_advance(buf, SID_SIZE + 1);
-    }
-
-    ret = true;
-cleanup:
-    gc_free(&gc);
-    return ret;
-}
-
 /*
  * For debugging, print contents of key_source2 structure.
  */
@@ -2983,12 +2863,17 @@ tls_process(struct tls_multi *multi,
             }
         }
 
-        /* Read incoming plaintext from TLS object */
+        /*
+         * Read incoming plaintext from TLS object.  An active key only
+         * borrows the buffer if the TLS object has something to read.
+         */
         buf = &ks->plaintext_read_buf;
-        if (!buf->len)
+        if (!buf->len
+            && (ks->state < S_ACTIVE || key_state_plaintext_pending(&ks->ks_ssl)))
         {
             int status;
 
+            key_state_buf_get(buf, TLS_CHANNEL_BUF_SIZE);
             ASSERT(buf_init(buf, 0));
             status = key_state_read_plaintext(&ks->ks_ssl, buf, TLS_CHANNEL_BUF_SIZE);
             update_time();
@@ -3012,6 +2897,7 @@ tls_process(struct tls_multi *multi,
         if (!buf->len && ((ks->state == S_START && !session->opt->server)
                           || (ks->state == S_GOT_KEY && session->opt->server)))
         {
+            key_state_buf_get(buf, TLS_CHANNEL_BUF_SIZE);
             if (session->opt->key_method == 1)
             {
                 if (!key_method_1_write(buf, session))
@@ -3085,7 +2971,7 @@ tls_process(struct tls_multi *multi,
         }
 
         /* Outgoing Ciphertext to reliable buffer */
-        if (ks->state >= S_START)
+        if (ks->state >= S_START && key_state_ciphertext_pending(&ks->ks_ssl))
         {
             buf = reliable_get_buf_output_sequenced(ks->send_reliable);
             if (buf)
@@ -3114,7 +3000,8 @@ tls_process(struct tls_multi *multi,
     /* Send 1 or more ACKs (each received control packet gets one ACK) */
     if (!to_link->len && !reliable_ack_empty(ks->rec_ack))
     {
-        struct buffer buf = ks->ack_write_buf;
+        struct buffer buf = *key_state_buf_get(&ks->ack_write_buf,
+                                               BUF_SIZE(&multi->opt.frame));
         ASSERT(buf_init(&buf, FRAME_HEADROOM(&multi->opt.frame)));
         write_control_auth(session, ks, &buf, to_link_addr, P_ACK_V1,
                            RELIABLE_ACK_SIZE, false);
@@ -3315,6 +3202,22 @@ tls_multi_process(struct tls_multi *multi,
     }
 nohard:
 
+    /*
+     * Give back the control channel buffers of keys which are done with
+     * their handshake, unless the outgoing packet may be one of them.
+     */
+    if (!to_link->len)
+    {
+        for (i = 0; i < TM_SIZE; ++i)
+        {
+            int j;
+            for (j = 0; j < KS_SIZE; ++j)
+            {
+                key_state_release_buffers(&multi->session[i].key[j]);
+            }
+        }
+    }
+
 #ifdef ENABLE_DEBUG
     /* DEBUGGING -- flood peer with repeating connection attempts */
     {
@@ -3339,6 +3242,36 @@ nohard:
     return (tas == TLS_AUTHENTICATION_FAILED) ? TLSMP_KILL : active;
 }
 
+#ifdef ENABLE_ASYNC_PK
+enum async_pk_status
+tls_multi_async_pk_status(const struct tls_multi *multi)
+{
+    enum async_pk_status ret = ASYNC_PK_NONE;
+    int i, j;
+
+    for (i = 0; i < TM_SIZE; ++i)
+    {
+        for (j = 0; j < KS_SIZE; ++j)
+        {
+            const struct key_state *ks = &multi->session[i].key[j];
+            if (ks->state != S_UNDEF)
+            {
+                enum async_pk_status status = key_state_async_pk_status(&ks->ks_ssl);
+                if (status == ASYNC_PK_READY)
+                {
+                    return status;
+                }
+                if (status == ASYNC_PK_PENDING)
+                {
+                    ret = status;
+                }
+            }
+        }
+    }
+    return ret;
+}
+#endif /* ENABLE_ASYNC_PK */
+
 /*
  * Pre and post-process the encryption & decryption buffers in order
  * to implement a multiplexed TLS channel over the TCP/UDP port.
@@ -3840,117 +3773,78 @@ error_lite:
     goto done;
 }
 
-/*
- * This function is similar to tls_pre_decrypt, except it is called
- * when we are in server mode and receive an initial incoming
- * packet.  Note that we don't modify
- * any state in our parameter objects.  The purpose is solely to
- * determine whether we should generate a client instance
- * object, in which case true is returned.
- *
- * This function is essentially the first-line HMAC firewall
- * on the UDP port listener in --mode server mode.
- */
-bool
-tls_pre_decrypt_lite(const struct tls_auth_standalone *tas,
-                     const struct link_socket_actual *from,
-                     const struct buffer *buf)
-
+void
+tls_multi_accept_cookie(struct tls_multi *multi,
+                        const struct tls_pre_decrypt_state *state,
+                        const struct link_socket_actual *from)
 {
     struct gc_arena gc = gc_new();
-    bool ret = false;
+    struct tls_session *session = &multi->session[TM_ACTIVE];
+    struct key_state *ks = &session->key[KS_PRIMARY];
 
-    if (buf->len > 0)
-    {
-        int op;
-        int key_id;
+    ASSERT(ks->state == S_INITIAL);
 
-        /* get opcode and key ID */
-        {
-            uint8_t c = *BPTR(buf);
-            op = c >> P_OPCODE_SHIFT;
-            key_id = c & P_KEY_ID_MASK;
-        }
+    session->session_id = state->server_session_id;
+    session->untrusted_addr = *from;
+    ks->session_id_remote = state->peer_session_id;
+    ks->remote_addr = *from;
+    ++multi->n_sessions;
 
-        /* this packet is from an as-yet untrusted source, so
-         * scrutinize carefully */
+    /*
+     * The reset exchange took place in tls_reset_standalone(), so the
+     * peer's reset and our reply have used up the first packet IDs.
+     * A client's reset is always its packet 0; the packet echoing the
+     * cookie may already be its packet 1 (OpenVPN 3 piggybacks the ACK
+     * on the ClientHello), which must still be accepted.
+     */
+    ks->rec_reliable->packet_id = 1;
+    ks->send_reliable->packet_id = 1;
+    session->tls_wrap.opt.packet_id.send.id = 1;
 
-        if (op != P_CONTROL_HARD_RESET_CLIENT_V2
-            && op != P_CONTROL_HARD_RESET_CLIENT_V3)
-        {
-            /*
-             * This can occur due to bogus data or DoS packets.
-             */
-            dmsg(D_TLS_STATE_ERRORS,
-                 "TLS State Error: No TLS state for client %s, opcode=%d",
-                 print_link_socket_actual(from, &gc),
-                 op);
-            goto error;
-        }
+    ks->must_negotiate = now + session->opt->handshake_window;
+    ks->auth_deferred_expire = now + auth_deferred_expire_window(session->opt);
+    ks->state = S_PRE_START;
 
-        if (key_id != 0)
-        {
-            dmsg(D_TLS_STATE_ERRORS,
-                 "TLS State Error: Unknown key ID (%d) received from %s -- 0 was expected",
-                 key_id,
-                 print_link_socket_actual(from, &gc));
-            goto error;
-        }
+    reliable_schedule_now(ks->send_reliable);
+    session->burst = true;
 
-        if (buf->len > EXPANDED_SIZE_DYNAMIC(&tas->frame))
-        {
-            dmsg(D_TLS_STATE_ERRORS,
-                 "TLS State Error: Large packet (size %d) received from %s -- a packet no larger than %d bytes was expected",
-                 buf->len,
-                 print_link_socket_actual(from, &gc),
-                 EXPANDED_SIZE_DYNAMIC(&tas->frame));
-            goto error;
-        }
+    msg(D_TLS_DEBUG_LOW,
+        "TLS: Initial packet from %s with valid handshake cookie, sid=%s",
+        print_link_socket_actual(from, &gc),
+        session_id_print(&state->peer_session_id, &gc));
 
+    gc_free(&gc);
+}
+
+struct key_state *
+tls_select_encryption_key(struct tls_multi *multi)
+{
+    struct key_state *ks_select = NULL;
+    int i;
+
+    for (i = 0; i < KEY_SCAN_SIZE; ++i)
+    {
+        struct key_state *ks = multi->key_scan[i];
+        if (ks->state >= S_ACTIVE
+            && ks->authenticated
+            && ks->crypto_options.key_ctx_bi.initialized
+#ifdef ENABLE_DEF_AUTH
+            && !ks->auth_deferred
+#endif
+            )
         {
-            struct buffer newbuf = clone_buf(buf);
-            struct tls_wrap_ctx tls_wrap_tmp = tas->tls_wrap;
-            bool status;
-
-            /* HMAC test, if --tls-auth was specified */
-            status = read_control_auth(&newbuf, &tls_wrap_tmp, from, NULL);
-            free_buf(&newbuf);
-            free_buf(&tls_wrap_tmp.tls_crypt_v2_metadata);
-            if (tls_wrap_tmp.cleanup_key_ctx)
+            if (!ks_select)
             {
-                free_key_ctx_bi(&tls_wrap_tmp.opt.key_ctx_bi);
+                ks_select = ks;
             }
-            if (!status)
+            if (now >= ks->auth_deferred_expire)
             {
-                goto error;
+                ks_select = ks;
+                break;
             }
-
-            /*
-             * At this point, if --tls-auth is being used, we know that
-             * the packet has passed the HMAC test, but we don't know if
-             * it is a replay yet.  We will attempt to defeat replays
-             * by not advancing to the S_START state until we
-             * receive an ACK from our first reply to the client
-             * that includes an HMAC of our randomly generated 64 bit
-             * session ID.
-             *
-             * On the other hand if --tls-auth is not being used, we
-             * will proceed to begin the TLS authentication
-             * handshake with only cursory integrity checks having
-             * been performed, since we will be leaving the task
-             * of authentication solely up to TLS.
-             */
-
-            ret = true;
         }
     }
-    gc_free(&gc);
-    return ret;
-
-error:
-    tls_clear_error();
-    gc_free(&gc);
-    return ret;
+    return ks_select;
 }
 
 /* Choose the key with which to encrypt a data packet */
@@ -3961,30 +3855,7 @@ tls_pre_encrypt(struct tls_multi *multi,
     multi->save_ks = NULL;
     if (buf->len > 0)
     {
-        int i;
-        struct key_state *ks_select = NULL;
-        for (i = 0; i < KEY_SCAN_SIZE; ++i)
-        {
-            struct key_state *ks = multi->key_scan[i];
-            if (ks->state >= S_ACTIVE
-                && ks->authenticated
-                && ks->crypto_options.key_ctx_bi.initialized
-#ifdef ENABLE_DEF_AUTH
-                && !ks->auth_deferred
-#endif
-                )
-            {
-                if (!ks_select)
-                {
-                    ks_select = ks;
-                }
-                if (now >= ks->auth_deferred_expire)
-                {
-                    ks_select = ks;
-                    break;
-                }
-            }
-        }
+        struct key_state *ks_select = tls_select_encryption_key(multi);
 
         if (ks_select)
         {
@@ -4123,6 +3994,34 @@ tls_rec_payload(struct tls_multi *multi,
     return ret;
 }
 
+size_t
+tls_multi_buffer_bytes(const struct tls_multi *multi)
+{
+    size_t bytes = 0;
+    int i, j;
+
+    for (i = 0; i < TM_SIZE; ++i)
+    {
+        for (j = 0; j < KS_SIZE; ++j)
+        {
+            const struct key_state *ks = &multi->session[i].key[j];
+
+            bytes += ks->plaintext_read_buf.capacity;
+            bytes += ks->plaintext_write_buf.capacity;
+            bytes += ks->ack_write_buf.capacity;
+            if (ks->send_reliable)
+            {
+                bytes += reliable_buffer_bytes(ks->send_reliable);
+            }
+            if (ks->rec_reliable)
+            {
+                bytes += reliable_buffer_bytes(ks->rec_reliable);
+            }
+        }
+    }
+    return bytes;
+}
+
 void
 tls_update_remote_addr(struct tls_multi *multi, const struct link_socket_actual *addr)
 {
@@ -42,6 +42,7 @@
 
 #include "ssl_common.h"
 #include "ssl_backend.h"
+#include "ssl_pkt.h"
 
 /* Used in the TLS PRF function */
 #define KEY_EXPANSION_ID "OpenVPN"
@@ -243,6 +244,16 @@ int tls_multi_process(struct tls_multi *multi,
                       struct link_socket_info *to_link_socket_info,
                       interval_t *wakeup);
 
+#ifdef ENABLE_ASYNC_PK
+/*
+ * Tell whether one of the handshakes of this VPN tunnel is paused on
+ * an offloaded private key operation.  ASYNC_PK_READY takes precedence,
+ * it means that tls_multi_process should be called again.
+ */
+enum async_pk_status tls_multi_async_pk_status(const struct tls_multi *multi);
+
+#endif
+
 
 /**************************************************************************/
 /**
@@ -309,40 +320,23 @@ bool tls_pre_decrypt(struct tls_multi *multi,
  *  @{ */
 
 /**
- * Inspect an incoming packet for which no VPN tunnel is active, and
- * determine whether a new VPN tunnel should be created.
+ * Set up the initial session of a new VPN tunnel as if it had gone
+ * through the reset exchange, after the peer's packet validated the
+ * handshake cookie in \a state->server_session_id.
+ */
+void tls_multi_accept_cookie(struct tls_multi *multi,
+                             const struct tls_pre_decrypt_state *state,
+                             const struct link_socket_actual *from);
+
+
+/**
+ * Return the key state whose data channel key outgoing packets are
+ * encrypted with, or NULL if none is available.
  * @ingroup data_crypto
  *
- * This function receives the initial incoming packet from a client that
- * wishes to establish a new VPN tunnel, and determines the packet is a
- * valid initial packet.  It is only used when OpenVPN is running in
- * server mode.
- *
- * The tests performed by this function are whether the packet's opcode is
- * correct for establishing a new VPN tunnel, whether its key ID is 0, and
- * whether its size is not too large.  This function also performs the
- * initial HMAC firewall test, if configured to do so.
- *
- * The incoming packet and the local VPN tunnel state are not modified by
- * this function.  Its sole purpose is to inspect the packet and determine
- * whether a new VPN tunnel should be created.  If so, that new VPN tunnel
- * instance will handle processing of the packet.
- *
- * @param tas - The standalone TLS authentication setting structure for
- *     this process.
- * @param from - The source address of the packet.
- * @param buf - A buffer structure containing the incoming packet.
- *
- * @return
- * @li True if the packet is valid and a new VPN tunnel should be created
- *     for this client.
- * @li False if the packet is not valid, did not pass the HMAC firewall
- *     test, or some other error occurred.
+ * @param multi - The TLS state for this packet's destination VPN tunnel.
  */
-bool tls_pre_decrypt_lite(const struct tls_auth_standalone *tas,
-                          const struct link_socket_actual *from,
-                          const struct buffer *buf);
-
+struct key_state *tls_select_encryption_key(struct tls_multi *multi);
 
 /**
  * Choose the appropriate security parameters with which to process an
@@ -463,6 +457,12 @@ bool tls_send_payload(struct tls_multi *multi,
 bool tls_rec_payload(struct tls_multi *multi,
                      struct buffer *buf);
 
+/*
+ * Number of bytes of control channel buffers currently held by
+ * the keys of a tunnel
+ */
+size_t tls_multi_buffer_bytes(const struct tls_multi *multi);
+
 /**
  * Updates remote address in TLS sessions.
  *
@@ -338,6 +338,46 @@ void tls_ctx_personalise_random(struct tls_root_ctx *ctx);
 
 #endif
 
+#ifdef ENABLE_ASYNC_PK
+/**
+ * Offload the private key operations of server handshakes using the given
+ * TLS context to a pool of worker threads.  The pool is shared by all
+ * contexts and started on first use.
+ *
+ * @param ctx                   TLS context to use, with its key loaded
+ * @param n_threads             Number of worker threads
+ */
+void tls_ctx_async_pk(struct tls_root_ctx *ctx, int n_threads);
+
+/**
+ * Return the descriptor which becomes readable when an offloaded private
+ * key operation has finished, or -1 if no operations are offloaded.
+ */
+int tls_async_pk_event_fd(void);
+
+/**
+ * Consume the pending notifications of tls_async_pk_event_fd().
+ */
+void tls_async_pk_event_clear(void);
+
+/** Status of a handshake with regard to offloaded key operations */
+enum async_pk_status {
+    ASYNC_PK_NONE,              /**< Handshake is not paused */
+    ASYNC_PK_PENDING,           /**< Paused, operation still running */
+    ASYNC_PK_READY              /**< Paused, operation finished, the next
+                                 *   read from the SSL channel resumes */
+};
+
+/**
+ * Tell whether the handshake of the given SSL channel is paused on an
+ * offloaded private key operation.
+ *
+ * @param ks_ssl        The SSL channel's state info
+ */
+enum async_pk_status key_state_async_pk_status(const struct key_state_ssl *ks_ssl);
+
+#endif /* ENABLE_ASYNC_PK */
+
 /* **************************************
  *
  * Key-state specific functions
@@ -452,6 +492,17 @@ int key_state_write_plaintext_const(struct key_state_ssl *ks_ssl,
 int key_state_read_ciphertext(struct key_state_ssl *ks_ssl, struct buffer *buf,
                               int maxlen);
 
+/**
+ * Tell whether the TLS module holds ciphertext which \c
+ * key_state_read_ciphertext() would return.
+ *
+ * @param ks_ssl       - The security parameter state for this %key
+ *                       session.
+ *
+ * @return true if outgoing ciphertext is waiting.
+ */
+bool key_state_ciphertext_pending(struct key_state_ssl *ks_ssl);
+
 /** @} name Functions for packets to be sent to a remote OpenVPN peer */
 
 
@@ -499,6 +550,21 @@ int key_state_write_ciphertext(struct key_state_ssl *ks_ssl,
 int key_state_read_plaintext(struct key_state_ssl *ks_ssl, struct buffer *buf,
                              int maxlen);
 
+/**
+ * Tell whether the TLS module holds incoming ciphertext which has not
+ * been processed yet, or decrypted plaintext which \c
+ * key_state_read_plaintext() would return.
+ *
+ * Once the handshake has finished, nothing can be read from the TLS
+ * module unless this returns true.
+ *
+ * @param ks_ssl       - The security parameter state for this %key
+ *                       session.
+ *
+ * @return true if incoming data is waiting.
+ */
+bool key_state_plaintext_pending(struct key_state_ssl *ks_ssl);
+
 /** @} name Functions for packets received from a remote OpenVPN peer */
 
 /** @} addtogroup control_tls */
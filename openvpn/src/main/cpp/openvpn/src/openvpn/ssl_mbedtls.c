@@ -1215,6 +1215,12 @@ key_state_read_ciphertext(struct key_state_ssl *ks, struct buffer *buf,
     return 1;
 }
 
+bool
+key_state_ciphertext_pending(struct key_state_ssl *ks)
+{
+    return ks->bio_ctx.out.first_block != NULL;
+}
+
 int
 key_state_write_ciphertext(struct key_state_ssl *ks, struct buffer *buf)
 {
@@ -1319,6 +1325,13 @@ key_state_read_plaintext(struct key_state_ssl *ks, struct buffer *buf,
     return 1;
 }
 
+bool
+key_state_plaintext_pending(struct key_state_ssl *ks)
+{
+    return ks->bio_ctx.in.first_block != NULL
+           || mbedtls_ssl_get_bytes_avail(ks->ctx) > 0;
+}
+
 /* **************************************
  *
  * Information functions
@@ -52,6 +52,10 @@
 
 #include "ssl_verify_openssl.h"
 
+#ifdef ENABLE_ASYNC_PK
+#include "fdmisc.h"
+#endif
+
 #include <openssl/bn.h>
 #include <openssl/crypto.h>
 #include <openssl/dh.h>
@@ -64,6 +68,11 @@
 #ifndef OPENSSL_NO_EC
 #include <openssl/ec.h>
 #endif
+#ifdef ENABLE_ASYNC_PK
+#include <openssl/async.h>
+#include <pthread.h>
+#include <signal.h>
+#endif
 
 /*
  * Allocate space in SSL objects in which to store a struct tls_session
@@ -73,6 +82,17 @@
 
 int mydata_index; /* GLOBAL */
 
+#ifdef ENABLE_ASYNC_PK
+static void async_pk_stop(void);
+
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+#define ENABLE_CT_OUT_QUEUE
+static BIO_METHOD *ct_out_method; /* GLOBAL */
+
+#endif
+
 void
 tls_init_lib(void)
 {
@@ -89,6 +109,13 @@ tls_init_lib(void)
 void
 tls_free_lib(void)
 {
+#ifdef ENABLE_ASYNC_PK
+    async_pk_stop();
+#endif
+#ifdef ENABLE_CT_OUT_QUEUE
+    BIO_meth_free(ct_out_method);
+    ct_out_method = NULL;
+#endif
     EVP_cleanup();
 #ifndef ENABLE_SMALL
     ERR_free_strings();
@@ -1667,6 +1694,856 @@ bio_debug_oc(const char *mode, BIO *bio)
 
 #endif /* ifdef BIO_DEBUG */
 
+#ifdef ENABLE_ASYNC_PK
+
+/*
+ * Private key operation offload (--handshake-workers).
+ *
+ * Server handshakes run with SSL_MODE_ASYNC, so each SSL call made for
+ * them runs inside an OpenSSL ASYNC job.  The methods of the server's
+ * private key and the default DH method are wrapped.  When a wrapper is
+ * called from within a job, it queues the real operation for a worker
+ * thread and pauses the job.  The SSL call then returns to tls_process()
+ * as if no data was available yet, and the event loop carries on
+ * forwarding packets.  When a worker finishes, it writes to a pipe which
+ * the event loop watches.  The event loop then wakes up the instance,
+ * and its next tls_process() resumes the job.
+ *
+ * Outside of a job the wrappers call the original method directly.
+ * That covers the worker threads and contexts without SSL_MODE_ASYNC.
+ */
+
+struct async_pk_job
+{
+    struct async_pk_job *next;
+    int (*func)(struct async_pk_job *job);
+    void *key;                  /* RSA, EC_KEY or DH */
+    const unsigned char *in;
+    int inlen;
+    unsigned char *out;
+    unsigned int *outlen;
+    int param;                  /* RSA padding or ECDSA digest type */
+    const BIGNUM *peer;         /* DH public value of the peer */
+    int ret;
+    bool done;                  /* protected by async_pk.lock */
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* signalled when a job is queued */
+    pthread_cond_t done;        /* broadcast when a job has finished */
+    struct async_pk_job *head;
+    struct async_pk_job *tail;
+    bool halt;
+    pthread_t *threads;
+    int n_threads;
+    int notify[2];              /* written by workers, read by the event loop */
+    SSL *ssl;                   /* SSL object the event loop is driving */
+    int ex_index;               /* SSL ex_data slot of the paused job */
+    int (*ec_sign)(int type, const unsigned char *dgst, int dlen,
+                   unsigned char *sig, unsigned int *siglen,
+                   const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey);
+    const DH_METHOD *dh_orig;
+    DH_METHOD *dh_meth;
+} async_pk; /* GLOBAL */
+
+static void *
+async_pk_worker(void *arg)
+{
+    pthread_mutex_lock(&async_pk.lock);
+    while (true)
+    {
+        struct async_pk_job *job = async_pk.head;
+        int ret;
+
+        if (!job)
+        {
+            if (async_pk.halt)
+            {
+                break;
+            }
+            pthread_cond_wait(&async_pk.work, &async_pk.lock);
+            continue;
+        }
+        async_pk.head = job->next;
+        if (!async_pk.head)
+        {
+            async_pk.tail = NULL;
+        }
+        pthread_mutex_unlock(&async_pk.lock);
+
+        ret = job->func(job);
+
+        pthread_mutex_lock(&async_pk.lock);
+        job->ret = ret;
+        job->done = true;
+        pthread_cond_broadcast(&async_pk.done);
+        if (write(async_pk.notify[1], "x", 1) < 0)
+        {
+            /* pipe is full, the event loop has a wakeup pending */
+        }
+    }
+    pthread_mutex_unlock(&async_pk.lock);
+    gc_free_chunk_cache();
+    return NULL;
+}
+
+static bool
+async_pk_job_done(struct async_pk_job *job)
+{
+    bool done;
+
+    pthread_mutex_lock(&async_pk.lock);
+    done = job->done;
+    pthread_mutex_unlock(&async_pk.lock);
+    return done;
+}
+
+static void
+async_pk_job_wait(struct async_pk_job *job)
+{
+    pthread_mutex_lock(&async_pk.lock);
+    while (!job->done)
+    {
+        pthread_cond_wait(&async_pk.done, &async_pk.lock);
+    }
+    pthread_mutex_unlock(&async_pk.lock);
+}
+
+/*
+ * Run job->func on a worker thread and pause the current ASYNC job
+ * until it has finished.  If we are not running in a handshake's job,
+ * run it right here.
+ */
+static int
+async_pk_run(struct async_pk_job *job)
+{
+    SSL *ssl = async_pk.ssl;
+
+    if (!ssl || !ASYNC_get_current_job())
+    {
+        return job->func(job);
+    }
+
+    job->next = NULL;
+    job->done = false;
+
+    pthread_mutex_lock(&async_pk.lock);
+    if (async_pk.tail)
+    {
+        async_pk.tail->next = job;
+    }
+    else
+    {
+        async_pk.head = job;
+    }
+    async_pk.tail = job;
+    pthread_cond_signal(&async_pk.work);
+    pthread_mutex_unlock(&async_pk.lock);
+
+    /* the job lives on the paused job's stack, see key_state_async_pk_status() */
+    SSL_set_ex_data(ssl, async_pk.ex_index, job);
+    while (!async_pk_job_done(job))
+    {
+        if (!ASYNC_pause_job())
+        {
+            async_pk_job_wait(job);
+        }
+    }
+    SSL_set_ex_data(ssl, async_pk.ex_index, NULL);
+
+    return job->ret;
+}
+
+static int
+async_pk_rsa_priv_enc_func(struct async_pk_job *job)
+{
+    const RSA_METHOD *orig = RSA_meth_get0_app_data(RSA_get_method(job->key));
+    return RSA_meth_get_priv_enc(orig)(job->inlen, job->in, job->out, job->key, job->param);
+}
+
+static int
+async_pk_rsa_priv_enc(int flen, const unsigned char *from, unsigned char *to,
+                      RSA *rsa, int padding)
+{
+    struct async_pk_job job = {
+        .func = async_pk_rsa_priv_enc_func,
+        .key = rsa, .in = from, .inlen = flen, .out = to, .param = padding
+    };
+    return async_pk_run(&job);
+}
+
+static int
+async_pk_rsa_priv_dec_func(struct async_pk_job *job)
+{
+    const RSA_METHOD *orig = RSA_meth_get0_app_data(RSA_get_method(job->key));
+    return RSA_meth_get_priv_dec(orig)(job->inlen, job->in, job->out, job->key, job->param);
+}
+
+static int
+async_pk_rsa_priv_dec(int flen, const unsigned char *from, unsigned char *to,
+                      RSA *rsa, int padding)
+{
+    struct async_pk_job job = {
+        .func = async_pk_rsa_priv_dec_func,
+        .key = rsa, .in = from, .inlen = flen, .out = to, .param = padding
+    };
+    return async_pk_run(&job);
+}
+
+/* called at RSA_free */
+static int
+async_pk_rsa_finish(RSA *rsa)
+{
+    const RSA_METHOD *meth = RSA_get_method(rsa);
+    const RSA_METHOD *orig = RSA_meth_get0_app_data(meth);
+    int ret = 1;
+
+    if (RSA_meth_get_finish(orig))
+    {
+        ret = RSA_meth_get_finish(orig)(rsa);
+    }
+    RSA_meth_free((RSA_METHOD *) meth);
+    return ret;
+}
+
+/*
+ * Replace the RSA key of ctx by a copy whose private key operations
+ * are offloaded.  Keys with a method of their own, such as external
+ * keys, are left alone.
+ */
+static bool
+async_pk_wrap_rsa_key(struct tls_root_ctx *ctx, EVP_PKEY *pkey)
+{
+    RSA *rsa = EVP_PKEY_get0_RSA(pkey);
+    const RSA_METHOD *orig;
+    RSA_METHOD *meth;
+    EVP_PKEY *wrapped;
+    bool ret;
+
+    if (!rsa || RSA_get_method(rsa) != RSA_get_default_method())
+    {
+        return false;
+    }
+
+    rsa = RSAPrivateKey_dup(rsa);
+    check_malloc_return(rsa);
+    orig = RSA_get_method(rsa);
+
+    meth = RSA_meth_dup(orig);
+    check_malloc_return(meth);
+    RSA_meth_set1_name(meth, "OpenVPN offloaded RSA method");
+    RSA_meth_set_priv_enc(meth, async_pk_rsa_priv_enc);
+    RSA_meth_set_priv_dec(meth, async_pk_rsa_priv_dec);
+    RSA_meth_set_finish(meth, async_pk_rsa_finish);
+    RSA_meth_set0_app_data(meth, (void *) orig);
+    RSA_set_method(rsa, meth);
+    /* from this point meth will get freed with rsa */
+
+    wrapped = EVP_PKEY_new();
+    check_malloc_return(wrapped);
+    EVP_PKEY_assign_RSA(wrapped, rsa);
+    ret = SSL_CTX_use_PrivateKey(ctx->ctx, wrapped) == 1;
+    EVP_PKEY_free(wrapped);
+    return ret;
+}
+
+#ifndef OPENSSL_NO_EC
+
+static int
+async_pk_ecdsa_sign_func(struct async_pk_job *job)
+{
+    return async_pk.ec_sign(job->param, job->in, job->inlen, job->out, job->outlen,
+                            NULL, NULL, job->key);
+}
+
+static int
+async_pk_ecdsa_sign(int type, const unsigned char *dgst, int dlen,
+                    unsigned char *sig, unsigned int *siglen,
+                    const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey)
+{
+    struct async_pk_job job = {
+        .func = async_pk_ecdsa_sign_func,
+        .key = eckey, .in = dgst, .inlen = dlen, .out = sig, .outlen = siglen,
+        .param = type
+    };
+
+    /* precomputed values are only passed in by explicit ECDSA calls */
+    if (kinv || r)
+    {
+        return async_pk.ec_sign(type, dgst, dlen, sig, siglen, kinv, r, eckey);
+    }
+    return async_pk_run(&job);
+}
+
+/* called when EC_KEY is destroyed */
+static void
+async_pk_ec_finish(EC_KEY *ec)
+{
+    EC_KEY_METHOD_free((EC_KEY_METHOD *) EC_KEY_get_method(ec));
+}
+
+/*
+ * Same as async_pk_wrap_rsa_key(), for ECDSA.  Only signing is offloaded,
+ * the EC key is not used for key exchange.
+ */
+static bool
+async_pk_wrap_ec_key(struct tls_root_ctx *ctx, EVP_PKEY *pkey)
+{
+    EC_KEY *ec = EVP_PKEY_get0_EC_KEY(pkey);
+    int (*sign_setup)(EC_KEY *eckey, BN_CTX *ctx_in, BIGNUM **kinvp, BIGNUM **rp);
+    ECDSA_SIG *(*sign_sig)(const unsigned char *dgst, int dgst_len,
+                           const BIGNUM *in_kinv, const BIGNUM *in_r, EC_KEY *eckey);
+    EC_KEY_METHOD *meth;
+    EVP_PKEY *wrapped;
+    bool ret;
+
+    if (!ec || EC_KEY_get_method(ec) != EC_KEY_get_default_method())
+    {
+        return false;
+    }
+
+    meth = EC_KEY_METHOD_new(EC_KEY_get_method(ec));
+    check_malloc_return(meth);
+    EC_KEY_METHOD_get_sign(meth, &async_pk.ec_sign, &sign_setup, &sign_sig);
+    EC_KEY_METHOD_set_init(meth, NULL, async_pk_ec_finish, NULL, NULL, NULL, NULL);
+    EC_KEY_METHOD_set_sign(meth, async_pk_ecdsa_sign, sign_setup, sign_sig);
+
+    ec = EC_KEY_dup(ec);
+    check_malloc_return(ec);
+    if (!EC_KEY_set_method(ec, meth))
+    {
+        EC_KEY_METHOD_free(meth);
+        EC_KEY_free(ec);
+        return false;
+    }
+    /* from this point meth will get freed with ec */
+
+    wrapped = EVP_PKEY_new();
+    check_malloc_return(wrapped);
+    EVP_PKEY_assign_EC_KEY(wrapped, ec);
+    ret = SSL_CTX_use_PrivateKey(ctx->ctx, wrapped) == 1;
+    EVP_PKEY_free(wrapped);
+    return ret;
+}
+
+#endif /* ifndef OPENSSL_NO_EC */
+
+static int
+async_pk_dh_generate_key_func(struct async_pk_job *job)
+{
+    return DH_meth_get_generate_key(async_pk.dh_orig)(job->key);
+}
+
+static int
+async_pk_dh_generate_key(DH *dh)
+{
+    struct async_pk_job job = {
+        .func = async_pk_dh_generate_key_func, .key = dh
+    };
+    return async_pk_run(&job);
+}
+
+static int
+async_pk_dh_compute_key_func(struct async_pk_job *job)
+{
+    return DH_meth_get_compute_key(async_pk.dh_orig)(job->out, job->peer, job->key);
+}
+
+static int
+async_pk_dh_compute_key(unsigned char *key, const BIGNUM *pub_key, DH *dh)
+{
+    struct async_pk_job job = {
+        .func = async_pk_dh_compute_key_func, .key = dh, .out = key, .peer = pub_key
+    };
+    return async_pk_run(&job);
+}
+
+/*
+ * Start the worker threads.  The ephemeral DH keys of the handshake are
+ * created with the default method, so that one is wrapped as well.
+ */
+static bool
+async_pk_start(int n_threads)
+{
+    sigset_t all, old;
+    int i;
+
+    if (async_pk.n_threads)
+    {
+        return true;
+    }
+    if (!ASYNC_is_capable())
+    {
+        msg(M_WARN, "WARNING: this OpenSSL library cannot pause handshakes, "
+            "--handshake-workers is ignored");
+        return false;
+    }
+
+    async_pk.ex_index = SSL_get_ex_new_index(0, "struct async_pk_job *", NULL, NULL, NULL);
+    ASSERT(async_pk.ex_index >= 0);
+
+    if (pipe(async_pk.notify))
+    {
+        msg(M_ERR, "Cannot create the --handshake-workers notification pipe");
+    }
+    for (i = 0; i < 2; ++i)
+    {
+        set_nonblock(async_pk.notify[i]);
+        set_cloexec(async_pk.notify[i]);
+    }
+
+    pthread_mutex_init(&async_pk.lock, NULL);
+    pthread_cond_init(&async_pk.work, NULL);
+    pthread_cond_init(&async_pk.done, NULL);
+    async_pk.halt = false;
+    ALLOC_ARRAY_CLEAR(async_pk.threads, pthread_t, n_threads);
+
+    /* signals must keep going to the event loop thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < n_threads; ++i)
+    {
+        if (pthread_create(&async_pk.threads[i], NULL, async_pk_worker, NULL))
+        {
+            msg(M_FATAL, "Cannot start --handshake-workers thread");
+        }
+        ++async_pk.n_threads;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    async_pk.dh_orig = DH_get_default_method();
+    async_pk.dh_meth = DH_meth_dup(async_pk.dh_orig);
+    check_malloc_return(async_pk.dh_meth);
+    DH_meth_set_generate_key(async_pk.dh_meth, async_pk_dh_generate_key);
+    DH_meth_set_compute_key(async_pk.dh_meth, async_pk_dh_compute_key);
+    DH_set_default_method(async_pk.dh_meth);
+
+    msg(M_INFO, "Offloading TLS private key operations to %d worker threads",
+        async_pk.n_threads);
+    return true;
+}
+
+static void
+async_pk_stop(void)
+{
+    int i;
+
+    if (!async_pk.n_threads)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&async_pk.lock);
+    async_pk.halt = true;
+    pthread_cond_broadcast(&async_pk.work);
+    pthread_mutex_unlock(&async_pk.lock);
+
+    for (i = 0; i < async_pk.n_threads; ++i)
+    {
+        pthread_join(async_pk.threads[i], NULL);
+    }
+    free(async_pk.threads);
+    async_pk.threads = NULL;
+    async_pk.n_threads = 0;
+
+    DH_set_default_method(async_pk.dh_orig);
+    DH_meth_free(async_pk.dh_meth);
+    async_pk.dh_meth = NULL;
+
+    close(async_pk.notify[0]);
+    close(async_pk.notify[1]);
+    pthread_cond_destroy(&async_pk.done);
+    pthread_cond_destroy(&async_pk.work);
+    pthread_mutex_destroy(&async_pk.lock);
+}
+
+void
+tls_ctx_async_pk(struct tls_root_ctx *ctx, int n_threads)
+{
+    EVP_PKEY *pkey;
+    bool wrapped = false;
+
+    ASSERT(NULL != ctx);
+
+    if (!async_pk_start(n_threads))
+    {
+        return;
+    }
+
+    pkey = SSL_CTX_get0_privatekey(ctx->ctx);
+    if (pkey && EVP_PKEY_id(pkey) == EVP_PKEY_RSA)
+    {
+        wrapped = async_pk_wrap_rsa_key(ctx, pkey);
+    }
+#ifndef OPENSSL_NO_EC
+    else if (pkey && EVP_PKEY_id(pkey) == EVP_PKEY_EC)
+    {
+        wrapped = async_pk_wrap_ec_key(ctx, pkey);
+    }
+#endif
+    if (!wrapped)
+    {
+        msg(M_WARN, "WARNING: --handshake-workers cannot offload operations of this "
+            "private key, only DH key exchange will be offloaded");
+    }
+
+    SSL_CTX_set_mode(ctx->ctx, SSL_MODE_ASYNC);
+}
+
+int
+tls_async_pk_event_fd(void)
+{
+    return async_pk.n_threads ? async_pk.notify[0] : -1;
+}
+
+void
+tls_async_pk_event_clear(void)
+{
+    char buf[64];
+
+    while (read(async_pk.notify[0], buf, sizeof(buf)) > 0)
+    {
+    }
+}
+
+enum async_pk_status
+key_state_async_pk_status(const struct key_state_ssl *ks_ssl)
+{
+    struct async_pk_job *job;
+
+    if (!ks_ssl->ssl || !async_pk.n_threads || !SSL_waiting_for_async(ks_ssl->ssl))
+    {
+        return ASYNC_PK_NONE;
+    }
+    job = SSL_get_ex_data(ks_ssl->ssl, async_pk.ex_index);
+    return (job && !async_pk_job_done(job)) ? ASYNC_PK_PENDING : ASYNC_PK_READY;
+}
+
+/*
+ * Handshake steps run by the event loop on ks_ssl may pause.  The
+ * wrappers need to know which SSL object the paused job belongs to.
+ */
+static inline void
+async_pk_enter(struct key_state_ssl *ks_ssl)
+{
+    async_pk.ssl = ks_ssl->ssl;
+}
+
+static inline void
+async_pk_leave(void)
+{
+    async_pk.ssl = NULL;
+}
+
+/*
+ * SSL BIOs do not turn SSL_ERROR_WANT_ASYNC into a retry.  Without this
+ * check, a paused handshake would look like a BIO error.
+ */
+static bool
+bio_async_paused(BIO *bio)
+{
+    SSL *ssl = NULL;
+
+    return BIO_method_type(bio) == BIO_TYPE_SSL
+           && BIO_get_ssl(bio, &ssl) > 0 && ssl
+           && SSL_waiting_for_async(ssl);
+}
+
+/*
+ * A paused job refers to memory owned by its SSL object.  Before the
+ * object is freed, wait for the worker and let the handshake step run
+ * to completion.
+ */
+static void
+async_pk_finish(struct key_state_ssl *ks_ssl)
+{
+    async_pk_enter(ks_ssl);
+    while (SSL_waiting_for_async(ks_ssl->ssl))
+    {
+        struct async_pk_job *job = SSL_get_ex_data(ks_ssl->ssl, async_pk.ex_index);
+        if (!job)
+        {
+            break;
+        }
+        async_pk_job_wait(job);
+        SSL_do_handshake(ks_ssl->ssl);
+    }
+    async_pk_leave();
+    ERR_clear_error();
+}
+
+#else  /* ifdef ENABLE_ASYNC_PK */
+
+static inline void
+async_pk_enter(struct key_state_ssl *ks_ssl)
+{
+}
+
+static inline void
+async_pk_leave(void)
+{
+}
+
+#define bio_async_paused(bio) false
+
+#endif /* ENABLE_ASYNC_PK */
+
+#ifdef ENABLE_CT_OUT_QUEUE
+
+/*
+ * Ciphertext output BIO.
+ *
+ * OpenSSL writes its records straight into buffers which are laid out
+ * like those of the reliability layer: frame headroom in front for the
+ * opcode, session ID, ACKs and tls-auth/tls-crypt wrapping, and at most
+ * one control channel payload of data.  key_state_read_ciphertext()
+ * then swaps a filled buffer with the empty one of the reliability
+ * layer, so that records reach the link without another copy.
+ */
+
+struct ct_out_node
+{
+    struct ct_out_node *next;
+    struct buffer buf;
+};
+
+struct ct_out_queue
+{
+    const struct frame *frame;
+    struct ct_out_node *head;
+    struct ct_out_node *tail;
+    struct ct_out_node *spare;  /* nodes without a buffer, for reuse */
+    int pending;                /* bytes queued */
+};
+
+static struct ct_out_node *
+ct_out_append(struct ct_out_queue *q)
+{
+    struct ct_out_node *n = q->spare;
+
+    if (n)
+    {
+        q->spare = n->next;
+    }
+    else
+    {
+        ALLOC_OBJ(n, struct ct_out_node);
+    }
+    n->next = NULL;
+    n->buf = alloc_buf_pooled(BUF_SIZE(q->frame));
+    ASSERT(buf_init(&n->buf, FRAME_HEADROOM(q->frame)));
+
+    if (q->tail)
+    {
+        q->tail->next = n;
+    }
+    else
+    {
+        q->head = n;
+    }
+    q->tail = n;
+    return n;
+}
+
+/* remove the head node, its buffer must have been freed or handed out */
+static void
+ct_out_pop(struct ct_out_queue *q)
+{
+    struct ct_out_node *n = q->head;
+
+    q->head = n->next;
+    if (!q->head)
+    {
+        q->tail = NULL;
+    }
+    n->next = q->spare;
+    q->spare = n;
+}
+
+static void
+ct_out_clear(struct ct_out_queue *q)
+{
+    while (q->head)
+    {
+        free_buf_pooled(&q->head->buf);
+        ct_out_pop(q);
+    }
+    q->pending = 0;
+}
+
+static int
+ct_out_write(BIO *b, const char *in, int inl)
+{
+    struct ct_out_queue *q = BIO_get_data(b);
+    const int payload = PAYLOAD_SIZE_DYNAMIC(q->frame);
+    int done = 0;
+
+    BIO_clear_retry_flags(b);
+    while (done < inl)
+    {
+        struct ct_out_node *n = q->tail;
+        int len;
+
+        if (!n || BLEN(&n->buf) >= payload || !buf_forward_capacity(&n->buf))
+        {
+            n = ct_out_append(q);
+        }
+        len = min_int(inl - done, payload - BLEN(&n->buf));
+        len = min_int(len, buf_forward_capacity(&n->buf));
+        ASSERT(buf_write(&n->buf, in + done, len));
+        done += len;
+    }
+    q->pending += done;
+    return done;
+}
+
+/* copying read, used when a buffer cannot be handed out as is */
+static int
+ct_out_read(BIO *b, char *out, int outl)
+{
+    struct ct_out_queue *q = BIO_get_data(b);
+    int done = 0;
+
+    BIO_clear_retry_flags(b);
+    while (done < outl && q->head)
+    {
+        struct buffer *buf = &q->head->buf;
+        const int len = min_int(outl - done, BLEN(buf));
+
+        memcpy(out + done, BPTR(buf), len);
+        buf_advance(buf, len);
+        done += len;
+        if (!BLEN(buf))
+        {
+            free_buf_pooled(buf);
+            ct_out_pop(q);
+        }
+    }
+    q->pending -= done;
+
+    if (!done && outl > 0)
+    {
+        BIO_set_retry_read(b);
+        return -1;
+    }
+    return done;
+}
+
+static long
+ct_out_ctrl(BIO *b, int cmd, long num, void *ptr)
+{
+    struct ct_out_queue *q = BIO_get_data(b);
+
+    switch (cmd)
+    {
+        case BIO_CTRL_PENDING:
+            return q->pending;
+
+        case BIO_CTRL_EOF:
+            return q->pending == 0;
+
+        case BIO_CTRL_RESET:
+            ct_out_clear(q);
+            return 1;
+
+        case BIO_CTRL_FLUSH:
+        case BIO_CTRL_DUP:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static int
+ct_out_create(BIO *b)
+{
+    struct ct_out_queue *q;
+
+    ALLOC_OBJ_CLEAR(q, struct ct_out_queue);
+    BIO_set_data(b, q);
+    BIO_set_init(b, 1);
+    return 1;
+}
+
+static int
+ct_out_destroy(BIO *b)
+{
+    struct ct_out_queue *q = BIO_get_data(b);
+
+    if (q)
+    {
+        ct_out_clear(q);
+        while (q->spare)
+        {
+            struct ct_out_node *n = q->spare;
+            q->spare = n->next;
+            free(n);
+        }
+        free(q);
+        BIO_set_data(b, NULL);
+    }
+    return 1;
+}
+
+static BIO *
+ct_out_new(const struct frame *frame)
+{
+    BIO *b;
+
+    if (!ct_out_method)
+    {
+        ct_out_method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK,
+                                     "control channel ciphertext");
+        ASSERT(ct_out_method);
+        BIO_meth_set_write(ct_out_method, ct_out_write);
+        BIO_meth_set_read(ct_out_method, ct_out_read);
+        BIO_meth_set_ctrl(ct_out_method, ct_out_ctrl);
+        BIO_meth_set_create(ct_out_method, ct_out_create);
+        BIO_meth_set_destroy(ct_out_method, ct_out_destroy);
+    }
+
+    b = BIO_new(ct_out_method);
+    if (b)
+    {
+        ((struct ct_out_queue *) BIO_get_data(b))->frame = frame;
+    }
+    return b;
+}
+
+/*
+ * Hand the oldest queued record buffer to the caller by swapping it
+ * with buf, which must be empty and have the same layout.
+ *
+ * @return true if buf now holds ciphertext
+ */
+static bool
+ct_out_swap(BIO *b, struct buffer *buf, int maxlen)
+{
+    struct ct_out_queue *q = BIO_get_data(b);
+    struct ct_out_node *n = q->head;
+    struct buffer empty;
+
+    if (!n || buf->len != 0 || BLEN(&n->buf) > maxlen
+        || buf->capacity != n->buf.capacity || buf->offset != n->buf.offset)
+    {
+        return false;
+    }
+
+    empty = *buf;
+    *buf = n->buf;
+    free_buf_pooled(&empty);
+    q->pending -= BLEN(buf);
+    ct_out_pop(q);
+
+    dmsg(D_HANDSHAKE_VERBOSE, "BIO read tls_read_ciphertext %d bytes", BLEN(buf));
+    return true;
+}
+
+#endif /* ENABLE_CT_OUT_QUEUE */
+
 /*
  * Write to an OpenSSL BIO in non-blocking mode.
  */
@@ -1687,11 +2564,17 @@ bio_write(BIO *bio, const uint8_t *data, int size, const char *desc)
 #ifdef BIO_DEBUG
         bio_debug_data("write", bio, data, size, desc);
 #endif
+        /* a paused handshake step may only be resumed by its own call */
+        if (bio_async_paused(bio))
+        {
+            return 0;
+        }
+
         i = BIO_write(bio, data, size);
 
         if (i < 0)
         {
-            if (BIO_should_retry(bio))
+            if (BIO_should_retry(bio) || bio_async_paused(bio))
             {
             }
             else
@@ -1765,7 +2648,7 @@ bio_read(BIO *bio, struct buffer *buf, int maxlen, const char *desc)
 #endif
         if (i < 0)
         {
-            if (BIO_should_retry(bio))
+            if (BIO_should_retry(bio) || bio_async_paused(bio))
             {
             }
             else
@@ -1810,7 +2693,11 @@ key_state_ssl_init(struct key_state_ssl *ks_ssl, const struct tls_root_ctx *ssl_
 
     ASSERT((ks_ssl->ssl_bio = BIO_new(BIO_f_ssl())));
     ASSERT((ks_ssl->ct_in = BIO_new(BIO_s_mem())));
+#ifdef ENABLE_CT_OUT_QUEUE
+    ASSERT((ks_ssl->ct_out = ct_out_new(&session->opt->frame)));
+#else
     ASSERT((ks_ssl->ct_out = BIO_new(BIO_s_mem())));
+#endif
 
 #ifdef BIO_DEBUG
     bio_debug_oc("open ssl_bio", ks_ssl->ssl_bio);
@@ -1840,6 +2727,9 @@ key_state_ssl_free(struct key_state_ssl *ks_ssl)
         bio_debug_oc("close ssl_bio", ks_ssl->ssl_bio);
         bio_debug_oc("close ct_in", ks_ssl->ct_in);
         bio_debug_oc("close ct_out", ks_ssl->ct_out);
+#endif
+#ifdef ENABLE_ASYNC_PK
+        async_pk_finish(ks_ssl);
 #endif
         BIO_free_all(ks_ssl->ssl_bio);
         SSL_free(ks_ssl->ssl);
@@ -1855,8 +2745,10 @@ key_state_write_plaintext(struct key_state_ssl *ks_ssl, struct buffer *buf)
 #ifdef ENABLE_CRYPTO_OPENSSL
     ASSERT(NULL != ks_ssl);
 
+    async_pk_enter(ks_ssl);
     ret = bio_write(ks_ssl->ssl_bio, BPTR(buf), BLEN(buf),
                     "tls_write_plaintext");
+    async_pk_leave();
     bio_write_post(ret, buf);
 #endif /* ENABLE_CRYPTO_OPENSSL */
 
@@ -1872,7 +2764,9 @@ key_state_write_plaintext_const(struct key_state_ssl *ks_ssl, const uint8_t *dat
 
     ASSERT(NULL != ks_ssl);
 
+    async_pk_enter(ks_ssl);
     ret = bio_write(ks_ssl->ssl_bio, data, len, "tls_write_plaintext_const");
+    async_pk_leave();
 
     perf_pop();
     return ret;
@@ -1887,12 +2781,27 @@ key_state_read_ciphertext(struct key_state_ssl *ks_ssl, struct buffer *buf,
 
     ASSERT(NULL != ks_ssl);
 
-    ret = bio_read(ks_ssl->ct_out, buf, maxlen, "tls_read_ciphertext");
+#ifdef ENABLE_CT_OUT_QUEUE
+    if (ct_out_swap(ks_ssl->ct_out, buf, maxlen))
+    {
+        ret = 1;
+    }
+    else
+#endif
+    {
+        ret = bio_read(ks_ssl->ct_out, buf, maxlen, "tls_read_ciphertext");
+    }
 
     perf_pop();
     return ret;
 }
 
+bool
+key_state_ciphertext_pending(struct key_state_ssl *ks_ssl)
+{
+    return BIO_pending(ks_ssl->ct_out) > 0;
+}
+
 int
 key_state_write_ciphertext(struct key_state_ssl *ks_ssl, struct buffer *buf)
 {
@@ -1917,12 +2826,20 @@ key_state_read_plaintext(struct key_state_ssl *ks_ssl, struct buffer *buf,
 
     ASSERT(NULL != ks_ssl);
 
+    async_pk_enter(ks_ssl);
     ret = bio_read(ks_ssl->ssl_bio, buf, maxlen, "tls_read_plaintext");
+    async_pk_leave();
 
     perf_pop();
     return ret;
 }
 
+bool
+key_state_plaintext_pending(struct key_state_ssl *ks_ssl)
+{
+    return BIO_pending(ks_ssl->ct_in) > 0 || SSL_pending(ks_ssl->ssl) > 0;
+}
+
 /* **************************************
  *
  * Information functions
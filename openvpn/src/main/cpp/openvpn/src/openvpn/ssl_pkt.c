@@ -0,0 +1,510 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *  Copyright (C) 2010-2018 Fox Crypto B.V. <openvpn@fox-it.com>
+ *  Copyright (C) 2008-2013 David Sommerseth <dazo@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * @file Control channel packets of peers without a VPN tunnel, and the
+ *       tls-auth/tls-crypt wrapping of control channel packets
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "error.h"
+#include "socket.h"
+#include "tls_crypt.h"
+
+#include "ssl.h"
+#include "ssl_pkt.h"
+#include "ssl_backend.h"
+
+#include "memdbg.h"
+
+/*
+ * Move a packet authentication HMAC + related fields to or from the front
+ * of the buffer so it can be processed by encrypt/decrypt.
+ */
+
+/*
+ * Dependent on hmac size, opcode size, and session_id size.
+ * Will assert if too small.
+ */
+#define SWAP_BUF_SIZE 256
+
+static bool
+swap_hmac(struct buffer *buf, const struct crypto_options *co, bool incoming)
+{
+    const struct key_ctx *ctx;
+
+    ASSERT(co);
+
+    ctx = (incoming ? &co->key_ctx_bi.decrypt : &co->key_ctx_bi.encrypt);
+    ASSERT(ctx->hmac);
+
+    {
+        /* hmac + packet_id (8 bytes) */
+        const int hmac_size = hmac_ctx_size(ctx->hmac) + packet_id_size(true);
+
+        /* opcode + session_id */
+        const int osid_size = 1 + SID_SIZE;
+
+        int e1, e2;
+        uint8_t *b = BPTR(buf);
+        uint8_t buf1[SWAP_BUF_SIZE];
+        uint8_t buf2[SWAP_BUF_SIZE];
+
+        if (incoming)
+        {
+            e1 = osid_size;
+            e2 = hmac_size;
+        }
+        else
+        {
+            e1 = hmac_size;
+            e2 = osid_size;
+        }
+
+        ASSERT(e1 <= SWAP_BUF_SIZE && e2 <= SWAP_BUF_SIZE);
+
+        if (buf->len >= e1 + e2)
+        {
+            memcpy(buf1, b, e1);
+            memcpy(buf2, b + e1, e2);
+            memcpy(b, buf2, e2);
+            memcpy(b + e2, buf1, e1);
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+}
+
+#undef SWAP_BUF_SIZE
+
+/*
+ * Prepend the opcode and session ID to a control channel packet and wrap
+ * it with --tls-auth or --tls-crypt.  For --tls-crypt, buf is left
+ * unchanged and pointed at the wrapped packet in ctx->work.
+ */
+bool
+tls_wrap_control(struct tls_wrap_ctx *ctx, uint8_t header,
+                 const struct session_id *session_id, struct buffer *buf)
+{
+    struct buffer null = clear_buf();
+
+    if (ctx->mode == TLS_WRAP_AUTH
+        || ctx->mode == TLS_WRAP_NONE)
+    {
+        ASSERT(session_id_write_prepend(session_id, buf));
+        ASSERT(buf_write_prepend(buf, &header, sizeof(header)));
+    }
+    if (ctx->mode == TLS_WRAP_AUTH)
+    {
+        /* no encryption, only write hmac */
+        openvpn_encrypt(buf, null, &ctx->opt);
+        ASSERT(swap_hmac(buf, &ctx->opt, false));
+    }
+    else if (ctx->mode == TLS_WRAP_CRYPT)
+    {
+        ASSERT(buf_init(&ctx->work, buf->offset));
+        ASSERT(buf_write(&ctx->work, &header, sizeof(header)));
+        ASSERT(session_id_write(session_id, &ctx->work));
+        if (!tls_crypt_wrap(buf, &ctx->work, &ctx->opt))
+        {
+            buf->len = 0;
+            return false;
+        }
+
+        if ((header >> P_OPCODE_SHIFT) == P_CONTROL_HARD_RESET_CLIENT_V3)
+        {
+            if (!buf_copy(&ctx->work, ctx->tls_crypt_v2_wkc))
+            {
+                msg(D_TLS_ERRORS, "Could not append tls-crypt-v2 client key");
+                buf->len = 0;
+                return false;
+            }
+        }
+
+        /* Don't change the original data in buf, it's used by the reliability
+         * layer to resend on failure. */
+        *buf = ctx->work;
+    }
+    return true;
+}
+
+/*
+ * Read a control channel authentication record.
+ */
+bool
+read_control_auth(struct buffer *buf,
+                  struct tls_wrap_ctx *ctx,
+                  const struct link_socket_actual *from,
+                  const struct tls_options *opt)
+{
+    struct gc_arena gc = gc_new();
+    bool ret = false;
+
+    const uint8_t opcode = *(BPTR(buf)) >> P_OPCODE_SHIFT;
+    if (opcode == P_CONTROL_HARD_RESET_CLIENT_V3
+        && !tls_crypt_v2_extract_client_key(buf, ctx, opt))
+    {
+        msg(D_TLS_ERRORS,
+            "TLS Error: can not extract tls-crypt-v2 client key from %s",
+            print_link_socket_actual(from, &gc));
+        goto cleanup;
+    }
+
+    if (ctx->mode == TLS_WRAP_AUTH)
+    {
+        struct buffer null = clear_buf();
+
+        /* move the hmac record to the front of the packet */
+        if (!swap_hmac(buf, &ctx->opt, true))
+        {
+            msg(D_TLS_ERRORS,
+                "TLS Error: cannot locate HMAC in incoming packet from %s",
+                print_link_socket_actual(from, &gc));
+            gc_free(&gc);
+            return false;
+        }
+
+        /* authenticate only (no decrypt) and remove the hmac record
+         * from the head of the buffer */
+        openvpn_decrypt(buf, null, &ctx->opt, NULL, BPTR(buf));
+        if (!buf->len)
+        {
+            msg(D_TLS_ERRORS,
+                "TLS Error: incoming packet authentication failed from %s",
+                print_link_socket_actual(from, &gc));
+            goto cleanup;
+        }
+
+    }
+    else if (ctx->mode == TLS_WRAP_CRYPT)
+    {
+        struct buffer tmp = alloc_buf_gc(buf_forward_capacity_total(buf), &gc);
+        if (!tls_crypt_unwrap(buf, &tmp, &ctx->opt))
+        {
+            msg(D_TLS_ERRORS, "TLS Error: tls-crypt unwrapping failed from %s",
+                print_link_socket_actual(from, &gc));
+            goto cleanup;
+        }
+        ASSERT(buf_init(buf, buf->offset));
+        ASSERT(buf_copy(buf, &tmp));
+        buf_clear(&tmp);
+    }
+    else if (ctx->tls_crypt_v2_server_key.cipher)
+    {
+        /* If tls-crypt-v2 is enabled, require *some* wrapping */
+        msg(D_TLS_ERRORS, "TLS Error: could not determine wrapping from %s",
+            print_link_socket_actual(from, &gc));
+        /* TODO Do we want to support using tls-crypt-v2 and no control channel
+         * wrapping at all simultaneously?  That would allow server admins to
+         * upgrade clients one-by-one without running a second instance, but we
+         * should not enable it by default because it breaks DoS-protection.
+         * So, add something like --tls-crypt-v2-allow-insecure-fallback ? */
+        goto cleanup;
+    }
+
+    if (ctx->mode == TLS_WRAP_NONE || ctx->mode == TLS_WRAP_AUTH)
+    {
+        /* advance buffer pointer past opcode & session_id since our caller
+         * already read it */
+        buf_advance(buf, SID_SIZE + 1);
+    }
+
+    ret = true;
+cleanup:
+    gc_free(&gc);
+    return ret;
+}
+
+/*
+ * This function is similar to tls_pre_decrypt, except it is called
+ * when we are in server mode and receive an initial incoming
+ * packet.  Note that we don't modify
+ * any state in our parameter objects.  The purpose is solely to
+ * determine whether we should generate a client instance
+ * object, or answer with a handshake cookie.
+ *
+ * This function is essentially the first-line HMAC firewall
+ * on the UDP port listener in --mode server mode.
+ */
+enum first_packet_verdict
+tls_pre_decrypt_lite(const struct tls_auth_standalone *tas,
+                     struct tls_pre_decrypt_state *state,
+                     const struct link_socket_actual *from,
+                     const struct buffer *buf)
+
+{
+    struct gc_arena gc = gc_new();
+    enum first_packet_verdict ret = VERDICT_INVALID;
+
+    CLEAR(*state);
+
+    if (buf->len > 0)
+    {
+        int op;
+        int key_id;
+
+        /* get opcode and key ID */
+        {
+            uint8_t c = *BPTR(buf);
+            op = c >> P_OPCODE_SHIFT;
+            key_id = c & P_KEY_ID_MASK;
+        }
+
+        /* this packet is from an as-yet untrusted source, so
+         * scrutinize carefully */
+
+        if (op != P_CONTROL_HARD_RESET_CLIENT_V2
+            && op != P_CONTROL_HARD_RESET_CLIENT_V3
+            && op != P_CONTROL_V1
+            && op != P_ACK_V1)
+        {
+            /*
+             * This can occur due to bogus data or DoS packets.
+             */
+            dmsg(D_TLS_STATE_ERRORS,
+                 "TLS State Error: No TLS state for client %s, opcode=%d",
+                 print_link_socket_actual(from, &gc),
+                 op);
+            goto error;
+        }
+
+        if (key_id != 0)
+        {
+            dmsg(D_TLS_STATE_ERRORS,
+                 "TLS State Error: Unknown key ID (%d) received from %s -- 0 was expected",
+                 key_id,
+                 print_link_socket_actual(from, &gc));
+            goto error;
+        }
+
+        if (buf->len > EXPANDED_SIZE_DYNAMIC(&tas->frame))
+        {
+            dmsg(D_TLS_STATE_ERRORS,
+                 "TLS State Error: Large packet (size %d) received from %s -- a packet no larger than %d bytes was expected",
+                 buf->len,
+                 print_link_socket_actual(from, &gc),
+                 EXPANDED_SIZE_DYNAMIC(&tas->frame));
+            goto error;
+        }
+
+        /* get remote session-id */
+        {
+            struct buffer tmp = *buf;
+            buf_advance(&tmp, 1);
+            if (!session_id_read(&state->peer_session_id, &tmp)
+                || !session_id_defined(&state->peer_session_id))
+            {
+                goto error;
+            }
+        }
+
+        {
+            struct buffer newbuf = clone_buf(buf);
+            struct tls_wrap_ctx tls_wrap_tmp = tas->tls_wrap;
+            bool status;
+
+            /* strip the --tls-auth packet ID, without replay checks */
+            tls_wrap_tmp.opt.packet_id.rec.initialized = true;
+
+            /* HMAC test, if --tls-auth was specified */
+            status = read_control_auth(&newbuf, &tls_wrap_tmp, from, NULL);
+            free_buf(&tls_wrap_tmp.tls_crypt_v2_metadata);
+            if (tls_wrap_tmp.cleanup_key_ctx)
+            {
+                free_key_ctx_bi(&tls_wrap_tmp.opt.key_ctx_bi);
+            }
+
+            /*
+             * Pick up the ACK record, whose session ID is ours if the
+             * peer is acknowledging a handshake cookie.
+             */
+            if (status)
+            {
+                uint8_t count;
+
+                status = buf_read(&newbuf, &count, sizeof(count))
+                         && count <= RELIABLE_ACK_SIZE
+                         && buf_advance(&newbuf, count * sizeof(packet_id_type))
+                         && (!count || session_id_read(&state->server_session_id, &newbuf));
+            }
+            free_buf(&newbuf);
+            if (!status)
+            {
+                goto error;
+            }
+
+            /*
+             * At this point, if --tls-auth is being used, we know that
+             * the packet has passed the HMAC test, but we don't know if
+             * it is a replay yet.  A reset is answered with a reply
+             * carrying a handshake cookie as our session ID, and we
+             * only create a client instance once the peer echoes the
+             * cookie back, which a replayed or spoofed reset cannot do.
+             *
+             * On the other hand if --tls-auth is not being used, we
+             * will proceed to begin the TLS authentication
+             * handshake with only cursory integrity checks having
+             * been performed, since we will be leaving the task
+             * of authentication solely up to TLS.
+             */
+
+            if (op == P_CONTROL_HARD_RESET_CLIENT_V2)
+            {
+                ret = VERDICT_VALID_RESET_V2;
+            }
+            else if (op == P_CONTROL_HARD_RESET_CLIENT_V3)
+            {
+                ret = VERDICT_VALID_RESET_V3;
+            }
+            else
+            {
+                ret = VERDICT_VALID_CONTROL;
+            }
+        }
+    }
+    gc_free(&gc);
+    return ret;
+
+error:
+    tls_clear_error();
+    gc_free(&gc);
+    return ret;
+}
+
+struct session_id
+tls_cookie_session_id(hmac_ctx_t *hmac,
+                      const struct session_id *peer_sid,
+                      const struct openvpn_sockaddr *from,
+                      int handshake_window, int offset)
+{
+    uint8_t digest[MAX_HMAC_KEY_LENGTH];
+    struct session_id ret;
+    const uint32_t slot = htonl((uint32_t)(now / max_int(handshake_window, 1) + offset));
+
+    ASSERT(hmac_ctx_size(hmac) <= sizeof(digest));
+
+    hmac_ctx_reset(hmac);
+    hmac_ctx_update(hmac, peer_sid->id, SID_SIZE);
+    hmac_ctx_update(hmac, (const uint8_t *) &slot, sizeof(slot));
+    switch (from->addr.sa.sa_family)
+    {
+        case AF_INET:
+            hmac_ctx_update(hmac, (const uint8_t *) &from->addr.in4.sin_addr,
+                            sizeof(from->addr.in4.sin_addr));
+            hmac_ctx_update(hmac, (const uint8_t *) &from->addr.in4.sin_port,
+                            sizeof(from->addr.in4.sin_port));
+            break;
+
+        case AF_INET6:
+            hmac_ctx_update(hmac, (const uint8_t *) &from->addr.in6.sin6_addr,
+                            sizeof(from->addr.in6.sin6_addr));
+            hmac_ctx_update(hmac, (const uint8_t *) &from->addr.in6.sin6_port,
+                            sizeof(from->addr.in6.sin6_port));
+            break;
+    }
+    hmac_ctx_final(hmac, digest);
+
+    memcpy(ret.id, digest, SID_SIZE);
+    return ret;
+}
+
+bool
+tls_cookie_check(hmac_ctx_t *hmac,
+                 const struct tls_pre_decrypt_state *state,
+                 const struct openvpn_sockaddr *from,
+                 int handshake_window)
+{
+    int offset;
+
+    if (!session_id_defined(&state->server_session_id))
+    {
+        return false;
+    }
+
+    /* the reset may have been answered in the previous time slot */
+    for (offset = 0; offset >= -1; --offset)
+    {
+        const struct session_id cookie =
+            tls_cookie_session_id(hmac, &state->peer_session_id, from,
+                                  handshake_window, offset);
+        if (session_id_equal(&cookie, &state->server_session_id))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+tls_reset_standalone(const struct tls_auth_standalone *tas,
+                     const struct tls_pre_decrypt_state *state,
+                     const struct session_id *cookie,
+                     struct buffer *out)
+{
+    struct gc_arena gc = gc_new();
+    struct tls_wrap_ctx tls_wrap_tmp = tas->tls_wrap;
+    const uint8_t header = 0 | (P_CONTROL_HARD_RESET_SERVER_V2 << P_OPCODE_SHIFT);
+    const packet_id_type net_pid = htonpid(0);
+    struct reliable_ack ack;
+    struct buffer buf;
+    bool ret = false;
+
+    /*
+     * Our reply is the first packet of the session in both the
+     * reliability layer and the --tls-auth/--tls-crypt packet ID
+     * sequence, see tls_multi_accept_cookie().
+     */
+    tls_wrap_tmp.opt.flags &= ~CO_IGNORE_PACKET_ID;
+    CLEAR(tls_wrap_tmp.opt.packet_id.send);
+    tls_wrap_tmp.opt.packet_id.rec.initialized = true;
+    tls_wrap_tmp.work = alloc_buf_gc(BUF_SIZE(&tas->frame), &gc);
+
+    buf = alloc_buf_gc(BUF_SIZE(&tas->frame), &gc);
+    ASSERT(buf_init(&buf, FRAME_HEADROOM(&tas->frame)));
+    ASSERT(buf_write(&buf, &net_pid, sizeof(net_pid)));
+
+    /* a client's reset is always its packet 0 */
+    ack.len = 1;
+    ack.packet_id[0] = 0;
+    ASSERT(reliable_ack_write(&ack, &buf, &state->peer_session_id, 1, true));
+
+    if (tls_wrap_control(&tls_wrap_tmp, header, cookie, &buf))
+    {
+        ret = buf_init(out, 0) && buf_copy(out, &buf);
+    }
+
+    gc_free(&gc);
+    return ret;
+}
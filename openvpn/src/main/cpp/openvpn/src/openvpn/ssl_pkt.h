@@ -0,0 +1,191 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *  Copyright (C) 2010-2018 Fox Crypto B.V. <openvpn@fox-it.com>
+ *  Copyright (C) 2008-2013 David Sommerseth <dazo@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * @file Control channel packets of peers without a VPN tunnel, and the
+ *       tls-auth/tls-crypt wrapping of control channel packets
+ */
+
+#ifndef OPENVPN_SSL_PKT_H
+#define OPENVPN_SSL_PKT_H
+
+#include "buffer.h"
+#include "crypto.h"
+#include "session_id.h"
+
+struct link_socket_actual;
+struct openvpn_sockaddr;
+struct tls_auth_standalone;
+struct tls_options;
+struct tls_wrap_ctx;
+
+/**
+ * Prepend the opcode and session ID to a control channel packet and
+ * wrap it with --tls-auth or --tls-crypt.
+ *
+ * @param ctx - The tls-auth/tls-crypt wrapping of the session.
+ * @param header - Opcode and key ID of the packet.
+ * @param session_id - Our session ID.
+ * @param buf - The packet, from the ACK record on.  For --tls-crypt it
+ *     is left unchanged and pointed at the wrapped packet in
+ *     \c ctx->work.
+ *
+ * @return False if the packet could not be wrapped.
+ */
+bool tls_wrap_control(struct tls_wrap_ctx *ctx, uint8_t header,
+                      const struct session_id *session_id, struct buffer *buf);
+
+/**
+ * Check and remove the tls-auth/tls-crypt wrapping of a control channel
+ * packet, and advance \a buf past the opcode and session ID.
+ *
+ * @param buf - The packet.
+ * @param ctx - The tls-auth/tls-crypt wrapping of the session.
+ * @param from - The source address of the packet, for logging.
+ * @param opt - The TLS options, or NULL for a peer without a VPN
+ *     tunnel.
+ *
+ * @return False if the packet failed authentication.
+ */
+bool read_control_auth(struct buffer *buf,
+                       struct tls_wrap_ctx *ctx,
+                       const struct link_socket_actual *from,
+                       const struct tls_options *opt);
+
+/**
+ * Verdict of \c tls_pre_decrypt_lite() on a packet from a peer for
+ * which no VPN tunnel is active.
+ */
+enum first_packet_verdict {
+    /** The packet is not a valid initial packet and is dropped. */
+    VERDICT_INVALID,
+    /** A valid \c P_CONTROL_HARD_RESET_CLIENT_V2, which is answered
+     *  with a handshake cookie instead of creating a tunnel. */
+    VERDICT_VALID_RESET_V2,
+    /** A valid \c P_CONTROL_HARD_RESET_CLIENT_V3.  Later packets of
+     *  the peer cannot be unwrapped without its tls-crypt-v2 client key,
+     *  so the tunnel is created right away. */
+    VERDICT_VALID_RESET_V3,
+    /** A valid \c P_CONTROL_V1 or \c P_ACK_V1, which creates a tunnel
+     *  if it acknowledges our reset with a valid handshake cookie. */
+    VERDICT_VALID_CONTROL
+};
+
+/**
+ * Session IDs extracted from a packet by \c tls_pre_decrypt_lite().
+ */
+struct tls_pre_decrypt_state {
+    struct session_id peer_session_id;   /**< Session ID of the peer. */
+    struct session_id server_session_id; /**< Our session ID, as echoed
+                                          *   in the peer's ACK record,
+                                          *   if the packet had one. */
+};
+
+/**
+ * Inspect an incoming packet for which no VPN tunnel is active, and
+ * determine whether a new VPN tunnel should be created.
+ * @ingroup data_crypto
+ *
+ * This function receives the initial incoming packet from a client that
+ * wishes to establish a new VPN tunnel, and determines the packet is a
+ * valid initial packet.  It is only used when OpenVPN is running in
+ * server mode.
+ *
+ * The tests performed by this function are whether the packet's opcode is
+ * correct for establishing a new VPN tunnel, whether its key ID is 0, and
+ * whether its size is not too large.  This function also performs the
+ * initial HMAC firewall test, if configured to do so.
+ *
+ * The incoming packet and the local VPN tunnel state are not modified by
+ * this function.  Its sole purpose is to inspect the packet and determine
+ * whether a new VPN tunnel should be created.  If so, that new VPN tunnel
+ * instance will handle processing of the packet.
+ *
+ * @param tas - The standalone TLS authentication setting structure for
+ *     this process.
+ * @param state - Filled with the session IDs found in the packet.
+ * @param from - The source address of the packet.
+ * @param buf - A buffer structure containing the incoming packet.
+ *
+ * @return The verdict on the packet, \c VERDICT_INVALID if it is not
+ *     valid, did not pass the HMAC firewall test, or some other error
+ *     occurred.
+ */
+enum first_packet_verdict
+tls_pre_decrypt_lite(const struct tls_auth_standalone *tas,
+                     struct tls_pre_decrypt_state *state,
+                     const struct link_socket_actual *from,
+                     const struct buffer *buf);
+
+/**
+ * Calculate the handshake cookie which the server uses as its session
+ * ID towards a peer, before it keeps any state for that peer.
+ *
+ * The cookie is an HMAC over the peer's session ID, its address and
+ * the current time slot of \a handshake_window seconds, so that only a
+ * peer which received our reply can echo it back within the slot.
+ *
+ * @param hmac - HMAC context keyed with the server's cookie secret.
+ * @param peer_sid - Session ID of the peer.
+ * @param from - Address of the peer.
+ * @param handshake_window - Length of a time slot in seconds.
+ * @param offset - Time slot relative to the current one.
+ *
+ * @return The session ID to use in the reply.
+ */
+struct session_id tls_cookie_session_id(hmac_ctx_t *hmac,
+                                        const struct session_id *peer_sid,
+                                        const struct openvpn_sockaddr *from,
+                                        int handshake_window, int offset);
+
+/**
+ * Check whether a packet acknowledges a reset which we answered with
+ * \c tls_reset_standalone() in the current or the previous time slot.
+ */
+bool tls_cookie_check(hmac_ctx_t *hmac,
+                      const struct tls_pre_decrypt_state *state,
+                      const struct openvpn_sockaddr *from,
+                      int handshake_window);
+
+/**
+ * Build a \c P_CONTROL_HARD_RESET_SERVER_V2 reply to the peer's reset,
+ * which acknowledges it and carries the handshake cookie as our session
+ * ID, without creating any state for the peer.
+ *
+ * @param tas - The standalone TLS authentication setting structure for
+ *     this process.
+ * @param state - The state returned by \c tls_pre_decrypt_lite() for
+ *     the peer's reset.
+ * @param cookie - Our session ID towards the peer.
+ * @param out - Buffer which receives the wrapped packet.
+ *
+ * @return True if the packet was built.
+ */
+bool tls_reset_standalone(const struct tls_auth_standalone *tas,
+                          const struct tls_pre_decrypt_state *state,
+                          const struct session_id *cookie,
+                          struct buffer *out);
+
+#endif /* ifndef OPENVPN_SSL_PKT_H */
@@ -535,6 +535,15 @@ socket_defined(const socket_descriptor_t sd)
 #define PORT_SHARE 0
 #endif
 
+/*
+ * Zero-copy forwarding of port share proxy traffic via splice()
+ */
+#if PORT_SHARE && defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE) && defined(SPLICE_F_NONBLOCK)
+#define PORT_SHARE_SPLICE 1
+#else
+#define PORT_SHARE_SPLICE 0
+#endif
+
 /*
  * Enable deferred authentication?
  */
@@ -566,6 +575,20 @@ socket_defined(const socket_descriptor_t sd)
 #undef ENABLE_PF
 #endif
 
+/*
+ * Offload TLS private key operations to worker threads?
+ */
+#if defined(ENABLE_ASYNC_PK) && (!P2MP_SERVER || !defined(ENABLE_CRYPTO_OPENSSL))
+#undef ENABLE_ASYNC_PK
+#endif
+
+/*
+ * Serve a multi-queue tun device from worker threads?
+ */
+#if defined(ENABLE_TUN_MQ) && (!defined(TARGET_LINUX) || !defined(ENABLE_CRYPTO_OPENSSL))
+#undef ENABLE_TUN_MQ
+#endif
+
 /*
  * Do we support Unix domain sockets?
  */
@@ -658,4 +681,11 @@ socket_defined(const socket_descriptor_t sd)
 #define ENABLE_MEMSTATS
 #endif
 
+/*
+ * Program routes and interface addresses through rtnetlink
+ */
+#ifdef TARGET_LINUX
+#define ENABLE_RTNL
+#endif
+
 #endif /* ifndef SYSHEAD_H */
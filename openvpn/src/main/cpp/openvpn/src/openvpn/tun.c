@@ -46,6 +46,7 @@
 #include "route.h"
 #include "win32.h"
 #include "block_dns.h"
+#include "rtnl.h"
 
 #include "memdbg.h"
 
@@ -871,6 +872,62 @@ create_arbitrary_remote( struct tuntap *tt )
  * @param mtu       the MTU value to set the interface to
  * @param es        the environment to be used when executing the commands
  */
+#ifdef ENABLE_RTNL
+static void
+ifconfig_rtnl_result(void *arg, void *cookie, int error)
+{
+    int *failed = (int *) arg;
+
+    /* EADDRNOTAVAIL: the address is gone already, e.g. with --ifconfig-noexec */
+    if (error && !(error == EADDRNOTAVAIL && !strcmp((const char *) cookie, "addr del")))
+    {
+        msg(M_WARN, "ERROR: netlink %s failed: %s", (const char *) cookie, strerror(error));
+        ++*failed;
+    }
+}
+
+/*
+ * Bring the interface up with the given MTU and add or delete one
+ * address, with a single rtnetlink transaction.  Returns false if this
+ * did not work, so that the caller can fall back to ip/ifconfig.
+ */
+static bool
+ifconfig_rtnl(const struct tuntap *tt, bool add, const char *ifname, int tun_mtu,
+              int family, const void *local, int prefixlen,
+              const void *peer, const void *broadcast)
+{
+    struct rtnl_batch *b;
+    int failed = 0;
+    bool ret = false;
+
+    if (tt->options.route_method == ROUTE_METHOD_EXE)
+    {
+        return false;
+    }
+
+    b = rtnl_batch_new();
+    if (b)
+    {
+        ret = (!add || rtnl_link_up(b, ifname, tun_mtu, ifconfig_rtnl_result, "link set"))
+              && rtnl_addr(b, add, family, ifname, local, prefixlen, peer, broadcast,
+                           ifconfig_rtnl_result, add ? "addr add" : "addr del")
+              && (rtnl_batch_commit(b, &failed), failed == 0);
+        rtnl_batch_free(b);
+    }
+    if (!ret)
+    {
+        msg(D_ROUTE, "Interface configuration fallback to %s",
+#ifdef ENABLE_IPROUTE
+            "ip"
+#else
+            "ifconfig"
+#endif
+            );
+    }
+    return ret;
+}
+#endif /* ENABLE_RTNL */
+
 static void
 do_ifconfig_ipv6(struct tuntap *tt, const char *ifname, int tun_mtu,
                  const struct env_set *es)
@@ -882,6 +939,17 @@ do_ifconfig_ipv6(struct tuntap *tt, const char *ifname, int tun_mtu,
     ifconfig_ipv6_local = print_in6_addr(tt->local_ipv6, 0, &gc);
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNL
+    if (ifconfig_rtnl(tt, true, ifname, tun_mtu, AF_INET6, &tt->local_ipv6,
+                      tt->netbits_ipv6, NULL, NULL))
+    {
+        msg(M_INFO, "netlink: %s up mtu %d, address %s/%d", ifname, tun_mtu,
+            ifconfig_ipv6_local, tt->netbits_ipv6);
+        gc_free(&gc);
+        argv_reset(&argv);
+        return;
+    }
+#endif
 #ifdef ENABLE_IPROUTE
     /* set the MTU for the device and bring it up */
     argv_printf(&argv, "%s link set dev %s up mtu %d", iproute_path, ifname,
@@ -1054,6 +1122,24 @@ do_ifconfig_ipv4(struct tuntap *tt, const char *ifname, int tun_mtu,
     }
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNL
+    {
+        const in_addr_t local = htonl(tt->local);
+        const in_addr_t remote = htonl(tt->remote_netmask);
+        const in_addr_t broadcast = htonl(tt->broadcast);
+
+        if (ifconfig_rtnl(tt, true, ifname, tun_mtu, AF_INET, &local,
+                          tun ? 32 : netmask_to_netbits2(tt->remote_netmask),
+                          tun ? &remote : NULL, tun ? NULL : &broadcast))
+        {
+            msg(M_INFO, "netlink: %s up mtu %d, address %s %s %s", ifname, tun_mtu,
+                ifconfig_local, tun ? "peer" : "netmask", ifconfig_remote_netmask);
+            gc_free(&gc);
+            argv_reset(&argv);
+            return;
+        }
+    }
+#endif
 #ifdef ENABLE_IPROUTE
     /*
      * Set the MTU for the device
@@ -1812,6 +1898,17 @@ open_tun(const char *dev, const char *dev_type, const char *dev_node, struct tun
         ifr.ifr_flags |= IFF_ONE_QUEUE;
 #endif
 
+#ifdef ENABLE_TUN_MQ
+        if (tt->options.queues > 1)
+        {
+#ifdef IFF_MULTI_QUEUE
+            ifr.ifr_flags |= IFF_MULTI_QUEUE;
+#else
+            msg(M_FATAL, "--tun-queues: IFF_MULTI_QUEUE not supported by the tun driver headers");
+#endif
+        }
+#endif
+
         /*
          * Figure out if tun or tap device
          */
@@ -1882,6 +1979,38 @@ open_tun(const char *dev, const char *dev_type, const char *dev_node, struct tun
         set_nonblock(tt->fd);
         set_cloexec(tt->fd);
         tt->actual_name = string_alloc(ifr.ifr_name, NULL);
+
+#ifdef ENABLE_TUN_MQ
+        /*
+         * Attach the remaining queues to the device we just created,
+         * queue 0 is tt->fd
+         */
+        if (tt->options.queues > 1)
+        {
+            int i;
+
+            tt->n_queues = tt->options.queues;
+            ALLOC_ARRAY_CLEAR(tt->queue_fds, int, tt->n_queues);
+            tt->queue_fds[0] = tt->fd;
+            for (i = 1; i < tt->n_queues; ++i)
+            {
+                if ((tt->queue_fds[i] = open(node, O_RDWR)) < 0)
+                {
+                    msg(M_ERR, "ERROR: Cannot open TUN/TAP dev %s", node);
+                }
+                if (ioctl(tt->queue_fds[i], TUNSETIFF, (void *) &ifr) < 0)
+                {
+                    msg(M_ERR, "ERROR: Cannot attach queue %d to %s", i, ifr.ifr_name);
+                }
+                set_nonblock(tt->queue_fds[i]);
+                set_cloexec(tt->queue_fds[i]);
+            }
+            msg(M_INFO, "TUN/TAP device %s: %d queues", ifr.ifr_name, tt->n_queues);
+
+            /* until worker threads serve them */
+            tun_set_queues_attached(tt, false);
+        }
+#endif
     }
     return;
 }
@@ -1949,6 +2078,23 @@ undo_ifconfig_ipv4(struct tuntap *tt, struct gc_arena *gc)
 {
     struct argv argv = argv_new();
 
+#ifdef ENABLE_RTNL
+    {
+        const bool tun = is_tun_p2p(tt);
+        const in_addr_t local = htonl(tt->local);
+        const in_addr_t remote = htonl(tt->remote_netmask);
+
+        if (ifconfig_rtnl(tt, false, tt->actual_name, 0, AF_INET, &local,
+                          tun ? 32 : netmask_to_netbits2(tt->remote_netmask),
+                          tun ? &remote : NULL, NULL))
+        {
+            msg(M_INFO, "netlink: %s address %s deleted", tt->actual_name,
+                print_in_addr_t(tt->local, 0, gc));
+            return;
+        }
+    }
+#endif
+
 #ifdef ENABLE_IPROUTE
     if (is_tun_p2p(tt))
     {
@@ -1978,6 +2124,16 @@ undo_ifconfig_ipv6(struct tuntap *tt, struct gc_arena *gc)
     const char *ifconfig_ipv6_local = print_in6_addr(tt->local_ipv6, 0, gc);
     struct argv argv = argv_new();
 
+#ifdef ENABLE_RTNL
+    if (ifconfig_rtnl(tt, false, tt->actual_name, 0, AF_INET6, &tt->local_ipv6,
+                      tt->netbits_ipv6, NULL, NULL))
+    {
+        msg(M_INFO, "netlink: %s address %s/%d deleted", tt->actual_name,
+            ifconfig_ipv6_local, tt->netbits_ipv6);
+        return;
+    }
+#endif
+
 #ifdef ENABLE_IPROUTE
     argv_printf(&argv, "%s -6 addr del %s/%d dev %s", iproute_path,
                 ifconfig_ipv6_local, tt->netbits_ipv6, tt->actual_name);
@@ -2014,13 +2170,64 @@ close_tun(struct tuntap *tt)
         gc_free(&gc);
     }
 
+#ifdef ENABLE_TUN_MQ
+    if (tt->queue_fds)
+    {
+        int i;
+
+        for (i = 1; i < tt->n_queues; ++i)
+        {
+            if (tt->queue_fds[i] >= 0)
+            {
+                close(tt->queue_fds[i]);
+            }
+        }
+        free(tt->queue_fds);
+    }
+#endif
+
     close_tun_generic(tt);
     free(tt);
 }
 
+#ifdef ENABLE_TUN_MQ
+void
+tun_set_queues_attached(struct tuntap *tt, bool attached)
+{
+#ifdef IFF_MULTI_QUEUE
+    struct ifreq ifr;
+    int i;
+
+    CLEAR(ifr);
+    ifr.ifr_flags = attached ? IFF_ATTACH_QUEUE : IFF_DETACH_QUEUE;
+    for (i = 1; i < tt->n_queues; ++i)
+    {
+        if (ioctl(tt->queue_fds[i], TUNSETQUEUE, (void *) &ifr) < 0)
+        {
+            msg(M_ERR, "ERROR: Cannot %s queue %d of %s",
+                attached ? "attach" : "detach", i, tt->actual_name);
+        }
+    }
+    tt->queues_attached = attached;
+#endif
+}
+#endif /* ifdef ENABLE_TUN_MQ */
+
 int
 write_tun(struct tuntap *tt, uint8_t *buf, int len)
 {
+#ifdef ENABLE_TUN_MQ
+    /*
+     * The kernel remembers on which queue a flow was last written
+     * and steers the reverse direction of that flow to the same
+     * queue, so hashing both directions alike pins each flow to
+     * one queue.
+     */
+    if (tt->queues_attached)
+    {
+        return write(tt->queue_fds[ip_flow_hash(buf, len) % tt->n_queues], buf, len);
+    }
+#endif
     return write(tt->fd, buf, len);
 }
 
@@ -114,6 +114,12 @@ struct tuntap_options {
 
 struct tuntap_options {
     int txqueuelen;
+#ifdef ENABLE_RTNL
+    int route_method; /* --route-method, also applies to ifconfig */
+#endif
+#ifdef ENABLE_TUN_MQ
+    int queues; /* --tun-queues */
+#endif
 };
 
 #else  /* if defined(_WIN32) || defined(TARGET_ANDROID) */
@@ -179,6 +185,15 @@ struct tuntap
     int fd; /* file descriptor for TUN/TAP dev */
 #endif
 
+#ifdef ENABLE_TUN_MQ
+    /* IFF_MULTI_QUEUE tun: queue_fds[0] == fd, the other
+     * queues are served by tunmq.c worker threads while
+     * they are attached */
+    int n_queues;
+    int *queue_fds;
+    bool queues_attached;
+#endif
+
 #ifdef TARGET_SOLARIS
     int ip_fd;
 #endif
@@ -217,6 +232,16 @@ int write_tun(struct tuntap *tt, uint8_t *buf, int len);
 
 int read_tun(struct tuntap *tt, uint8_t *buf, int len);
 
+#ifdef ENABLE_TUN_MQ
+/*
+ * Attach or detach queues 1..n_queues-1 of a multi-queue tun.  The
+ * kernel only hands packets to, and accepts packets from, attached
+ * queues, so they are detached whenever no worker serves them.
+ */
+void tun_set_queues_attached(struct tuntap *tt, bool attached);
+
+#endif
+
 void tuncfg(const char *dev, const char *dev_type, const char *dev_node,
             int persist_mode, const char *username,
             const char *groupname, const struct tuntap_options *options);
@@ -0,0 +1,665 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#ifdef ENABLE_TUN_MQ
+
+#include <pthread.h>
+#include <poll.h>
+
+#include "openvpn.h"
+#include "forward.h"
+#include "fdmisc.h"
+#include "mss.h"
+#include "ssl.h"
+#include "tunmq.h"
+
+#include "memdbg.h"
+
+/* packets read from a queue before the halt pipe is checked again */
+#define TUN_MQ_BATCH 64
+
+struct tun_mq_worker
+{
+    struct tun_mq *mq;
+    pthread_t thread;
+
+    /*
+     * Held by the worker while it processes a packet, and by the event
+     * loop while it changes the fields of struct tun_mq marked below
+     * and the key in co.
+     */
+    pthread_mutex_t lock;
+
+    int fd;                     /* tun queue */
+    struct crypto_options co;   /* private copy of the send key */
+    struct buffer in;
+    struct buffer out;
+
+    /* accessed atomically */
+    counter_type tun_read_bytes;
+    counter_type link_write_bytes;
+    counter_type packets;
+};
+
+struct tun_mq
+{
+    bool running;
+    bool warned;
+
+    struct tun_mq_worker *workers;
+    int n_workers;
+    int halt[2];                /* closed write end stops the workers */
+
+    struct frame frame;
+    struct link_socket *sock;
+    bool check_recursive_routing;
+
+    /* written by the event loop holding all worker locks */
+    bool key_valid;
+    int key_id;
+    const cipher_ctx_t *key_cipher; /* identifies the key state in use */
+    bool use_peer_id;
+    uint32_t peer_id;
+    struct link_socket_actual dest;
+    int maxmss;                 /* 0 if --mssfix is off */
+
+    /* last packet ID sent with key_cipher, accessed atomically */
+    uint64_t packet_id;
+
+    /* worker statistics already added to the context */
+    counter_type tun_read_bytes;
+    counter_type link_write_bytes;
+    counter_type packets;
+};
+
+static void
+tun_mq_lock_all(struct tun_mq *mq)
+{
+    int i;
+
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        pthread_mutex_lock(&mq->workers[i].lock);
+    }
+}
+
+static void
+tun_mq_unlock_all(struct tun_mq *mq)
+{
+    int i;
+
+    for (i = mq->n_workers - 1; i >= 0; --i)
+    {
+        pthread_mutex_unlock(&mq->workers[i].lock);
+    }
+}
+
+/*
+ * Same as drop_if_recursive_routing() in forward.c, without the log
+ * message, to keep msg() off the packet path of the workers.
+ */
+static bool
+tun_mq_recursive(const struct tun_mq *mq, const struct buffer *buf)
+{
+    const struct openvpn_sockaddr *sa = &mq->dest.dest;
+    const int ver = OPENVPN_IPH_GET_VER(*BPTR(buf));
+
+    if (ver == 4 && sa->addr.sa.sa_family == AF_INET
+        && BLEN(buf) >= (int) sizeof(struct openvpn_iphdr))
+    {
+        const struct openvpn_iphdr *pip = (const struct openvpn_iphdr *) BPTR(buf);
+        return sa->addr.in4.sin_addr.s_addr == pip->daddr;
+    }
+    else if (ver == 6 && sa->addr.sa.sa_family == AF_INET6
+             && BLEN(buf) >= (int) sizeof(struct openvpn_ipv6hdr))
+    {
+        const struct openvpn_ipv6hdr *pip6 = (const struct openvpn_ipv6hdr *) BPTR(buf);
+        return IN6_ARE_ADDR_EQUAL(&sa->addr.in6.sin6_addr, &pip6->daddr);
+    }
+    return false;
+}
+
+/*
+ * The tun -> link path of process_incoming_tun(), encrypt_sign() and
+ * process_outgoing_link() for one packet.  msg() is not thread safe,
+ * so everything called from here must not log: the MSS fixup and the
+ * encryption use their quiet variants.
+ */
+static void
+tun_mq_send(struct tun_mq_worker *w, struct buffer *buf)
+{
+    struct tun_mq *mq = w->mq;
+    struct link_socket_actual dest;
+    struct buffer work;
+    uint64_t id;
+    int size;
+
+    pthread_mutex_lock(&w->lock);
+
+    if (!mq->key_valid)
+    {
+        goto drop;
+    }
+
+    if (mq->maxmss)
+    {
+        mss_fixup_ip_quiet(buf, mq->maxmss);
+    }
+
+    if (mq->check_recursive_routing && tun_mq_recursive(mq, buf))
+    {
+        goto drop;
+    }
+
+    id = __atomic_fetch_add(&mq->packet_id, 1, __ATOMIC_RELAXED);
+    if (id >= PACKET_ID_MAX)
+    {
+        /* the key should have been renegotiated long ago */
+        goto drop;
+    }
+    w->co.packet_id.send.id = (packet_id_type) id;
+
+    work = w->out;
+    ASSERT(buf_init(&work, FRAME_HEADROOM(&mq->frame)));
+    if (mq->use_peer_id)
+    {
+        const uint32_t peer = htonl(((P_DATA_V2 << P_OPCODE_SHIFT) | mq->key_id) << 24
+                                    | (mq->peer_id & 0xFFFFFF));
+        ASSERT(buf_write_prepend(&work, &peer, 4));
+    }
+
+    openvpn_encrypt(buf, work, &w->co);
+
+    if (buf->len > 0 && !mq->use_peer_id)
+    {
+        const uint8_t op = (P_DATA_V1 << P_OPCODE_SHIFT) | mq->key_id;
+        ASSERT(buf_write_prepend(buf, &op, 1));
+    }
+    dest = mq->dest;
+
+    pthread_mutex_unlock(&w->lock);
+
+    if (buf->len > 0)
+    {
+        /* a full socket buffer drops the packet, like a full link would */
+        size = link_socket_write(mq->sock, buf, &dest);
+        if (size > 0)
+        {
+            __atomic_add_fetch(&w->link_write_bytes, size, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&w->packets, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return;
+
+drop:
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void *
+tun_mq_worker_run(void *arg)
+{
+    struct tun_mq_worker *w = arg;
+    struct tun_mq *mq = w->mq;
+    struct pollfd pfd[2];
+
+    pfd[0].fd = w->fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = mq->halt[0];
+    pfd[1].events = POLLIN;
+
+    while (true)
+    {
+        int i;
+
+        if (poll(pfd, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if (pfd[1].revents)
+        {
+            break;
+        }
+
+        for (i = 0; i < TUN_MQ_BATCH; ++i)
+        {
+            struct buffer buf = w->in;
+            int len;
+
+            ASSERT(buf_init(&buf, FRAME_HEADROOM(&mq->frame)));
+            len = read(w->fd, BPTR(&buf), MAX_RW_SIZE_TUN(&mq->frame));
+            if (len <= 0)
+            {
+                break;
+            }
+            buf.len = len;
+            __atomic_add_fetch(&w->tun_read_bytes, len, __ATOMIC_RELAXED);
+            tun_mq_send(w, &buf);
+        }
+    }
+
+    gc_free_chunk_cache();
+    return NULL;
+}
+
+/* the key state using the key published to the workers, if still around */
+static struct key_state *
+tun_mq_find_key(const struct tun_mq *mq, struct tls_multi *multi)
+{
+    int i;
+
+    for (i = 0; i < KEY_SCAN_SIZE; ++i)
+    {
+        struct key_state *ks = multi->key_scan[i];
+        if (ks->key_id == mq->key_id
+            && ks->crypto_options.key_ctx_bi.encrypt.cipher == mq->key_cipher)
+        {
+            return ks;
+        }
+    }
+    return NULL;
+}
+
+/* let the key state see the packet IDs used by all queues */
+static void
+tun_mq_sync_packet_id(struct tun_mq *mq, struct key_state *ks)
+{
+    const uint64_t id = __atomic_load_n(&mq->packet_id, __ATOMIC_RELAXED);
+    ks->crypto_options.packet_id.send.id = id < PACKET_ID_MAX ? (packet_id_type) id : PACKET_ID_MAX;
+}
+
+/*
+ * Publish the key of ks, or no key if ks is NULL, to the workers.
+ * Called holding all worker locks.
+ */
+static bool
+tun_mq_set_key(struct context *c, struct tun_mq *mq, struct key_state *ks)
+{
+    int i;
+
+    if (mq->key_valid)
+    {
+        struct key_state *old = tun_mq_find_key(mq, c->c2.tls_multi);
+        if (old)
+        {
+            tun_mq_sync_packet_id(mq, old);
+        }
+    }
+    mq->key_valid = false;
+    mq->key_cipher = NULL;
+
+    if (!ks)
+    {
+        return true;
+    }
+
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        struct key_ctx *dst = &mq->workers[i].co.key_ctx_bi.encrypt;
+        const struct key_ctx *src = &ks->crypto_options.key_ctx_bi.encrypt;
+
+        if (!cipher_ctx_copy(dst->cipher, src->cipher))
+        {
+            return false;
+        }
+        memcpy(dst->implicit_iv, src->implicit_iv, sizeof(dst->implicit_iv));
+        dst->implicit_iv_len = src->implicit_iv_len;
+    }
+
+    mq->key_id = ks->key_id;
+    mq->key_cipher = ks->crypto_options.key_ctx_bi.encrypt.cipher;
+    mq->use_peer_id = c->c2.tls_multi->use_peer_id;
+    mq->peer_id = c->c2.tls_multi->peer_id;
+    __atomic_store_n(&mq->packet_id, ks->crypto_options.packet_id.send.id, __ATOMIC_RELAXED);
+    mq->key_valid = true;
+    return true;
+}
+
+/* add what the workers sent since the last call to the context */
+static void
+tun_mq_account(struct context *c, struct tun_mq *mq, struct key_state *ks)
+{
+    counter_type tun_read_bytes = 0;
+    counter_type link_write_bytes = 0;
+    counter_type packets = 0;
+    int i;
+
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        struct tun_mq_worker *w = &mq->workers[i];
+        tun_read_bytes += __atomic_load_n(&w->tun_read_bytes, __ATOMIC_RELAXED);
+        link_write_bytes += __atomic_load_n(&w->link_write_bytes, __ATOMIC_RELAXED);
+        packets += __atomic_load_n(&w->packets, __ATOMIC_RELAXED);
+    }
+
+    c->c2.tun_read_bytes += tun_read_bytes - mq->tun_read_bytes;
+    if (link_write_bytes > mq->link_write_bytes)
+    {
+        const counter_type size = link_write_bytes - mq->link_write_bytes;
+
+        c->c2.link_write_bytes += size;
+        link_write_bytes_global += size;
+#ifdef ENABLE_MANAGEMENT
+        if (management)
+        {
+            management_bytes_out(management, (int) size);
+        }
+#endif
+        if (ks)
+        {
+            ks->n_bytes += size;
+            ks->n_packets += packets - mq->packets;
+        }
+        if (c->options.ping_send_timeout)
+        {
+            event_timeout_reset(&c->c2.ping_send_interval);
+        }
+        register_activity(c, (int) size);
+    }
+
+    mq->tun_read_bytes = tun_read_bytes;
+    mq->link_write_bytes = link_write_bytes;
+    mq->packets = packets;
+}
+
+static void
+tun_mq_stop(struct context *c, struct tun_mq *mq)
+{
+    struct key_state *ks = NULL;
+    int i;
+
+    close(mq->halt[1]);
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        pthread_join(mq->workers[i].thread, NULL);
+    }
+    close(mq->halt[0]);
+
+    if (c->c1.tuntap)
+    {
+        tun_set_queues_attached(c->c1.tuntap, false);
+    }
+
+    if (mq->key_valid && c->c2.tls_multi)
+    {
+        ks = tun_mq_find_key(mq, c->c2.tls_multi);
+        if (ks)
+        {
+            tun_mq_sync_packet_id(mq, ks);
+        }
+    }
+    tun_mq_account(c, mq, ks);
+
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        struct tun_mq_worker *w = &mq->workers[i];
+        cipher_ctx_free(w->co.key_ctx_bi.encrypt.cipher);
+        free_buf(&w->in);
+        free_buf(&w->out);
+        pthread_mutex_destroy(&w->lock);
+    }
+    free(mq->workers);
+    mq->workers = NULL;
+    mq->n_workers = 0;
+    mq->key_valid = false;
+    mq->running = false;
+    mq->tun_read_bytes = mq->link_write_bytes = mq->packets = 0;
+
+    msg(D_LOW, "Stopped tun queue workers");
+}
+
+static bool
+tun_mq_start(struct context *c, struct tun_mq *mq, struct key_state *ks)
+{
+    struct tuntap *tt = c->c1.tuntap;
+    sigset_t all, old;
+    int i;
+
+    mq->frame = c->c2.frame;
+    mq->sock = c->c2.link_socket;
+    mq->check_recursive_routing = c->options.mode == MODE_POINT_TO_POINT
+                                  && !c->options.allow_recursive_routing;
+    mq->dest = get_link_socket_info(c)->lsa->actual;
+    mq->maxmss = c->options.ce.mssfix ? MTU_TO_MSS(TUN_MTU_SIZE_DYNAMIC(&c->c2.frame)) : 0;
+
+    mq->n_workers = tt->n_queues - 1;
+    ALLOC_ARRAY_CLEAR(mq->workers, struct tun_mq_worker, mq->n_workers);
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        struct tun_mq_worker *w = &mq->workers[i];
+
+        w->mq = mq;
+        w->fd = tt->queue_fds[i + 1];
+        pthread_mutex_init(&w->lock, NULL);
+        w->co.key_ctx_bi.encrypt.cipher = cipher_ctx_new();
+        w->co.key_ctx_bi.initialized = true;
+        w->co.flags = CO_NO_LOG;
+        w->co.packet_id.rec.initialized = true;
+        /* nonzero, so that packet_id_write() never reads now */
+        w->co.packet_id.send.time = 1;
+        w->in = alloc_buf(BUF_SIZE(&mq->frame));
+        w->out = alloc_buf(BUF_SIZE(&mq->frame));
+    }
+
+    if (!tun_mq_set_key(c, mq, ks))
+    {
+        for (i = 0; i < mq->n_workers; ++i)
+        {
+            struct tun_mq_worker *w = &mq->workers[i];
+            cipher_ctx_free(w->co.key_ctx_bi.encrypt.cipher);
+            free_buf(&w->in);
+            free_buf(&w->out);
+            pthread_mutex_destroy(&w->lock);
+        }
+        free(mq->workers);
+        mq->workers = NULL;
+        mq->n_workers = 0;
+        return false;
+    }
+
+    if (pipe(mq->halt))
+    {
+        msg(M_ERR, "Cannot create the --tun-queues halt pipe");
+    }
+    set_cloexec(mq->halt[0]);
+    set_cloexec(mq->halt[1]);
+
+    tun_set_queues_attached(tt, true);
+
+    /* signals must keep going to the event loop thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < mq->n_workers; ++i)
+    {
+        if (pthread_create(&mq->workers[i].thread, NULL, tun_mq_worker_run, &mq->workers[i]))
+        {
+            msg(M_FATAL, "Cannot start --tun-queues thread");
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    mq->running = true;
+    msg(M_INFO, "Serving %d of %d tun queues from worker threads",
+        mq->n_workers, tt->n_queues);
+    return true;
+}
+
+/* why the workers cannot encrypt for this tunnel, or NULL */
+static const char *
+tun_mq_unusable(struct context *c, struct key_state *ks)
+{
+#ifdef USE_COMP
+    if (c->c2.comp_context)
+    {
+        return "compression is enabled";
+    }
+#endif
+    if (!cipher_kt_mode_aead(cipher_ctx_get_cipher_kt(ks->crypto_options.key_ctx_bi.encrypt.cipher)))
+    {
+        return "the data channel cipher is not an AEAD cipher";
+    }
+    return NULL;
+}
+
+void
+tun_mq_update(struct context *c)
+{
+    struct tun_mq *mq = c->c2.tun_mq;
+    struct key_state *ks;
+
+    if (!c->c1.tuntap || c->c1.tuntap->n_queues < 2
+        || !c->c2.tls_multi || !c->c2.link_socket)
+    {
+        return;
+    }
+    if (!mq)
+    {
+        ALLOC_OBJ_CLEAR(c->c2.tun_mq, struct tun_mq);
+        mq = c->c2.tun_mq;
+    }
+
+    ks = tls_select_encryption_key(c->c2.tls_multi);
+
+    if (!mq->running)
+    {
+        const char *why;
+
+        if (!ks || !link_socket_actual_defined(&get_link_socket_info(c)->lsa->actual))
+        {
+            return;
+        }
+        why = tun_mq_unusable(c, ks);
+        if (!why && !tun_mq_start(c, mq, ks))
+        {
+            why = "the crypto library cannot copy the cipher context";
+        }
+        if (why && !mq->warned)
+        {
+            msg(M_WARN, "WARNING: --tun-queues: %s, all packets go through the first queue", why);
+            mq->warned = true;
+        }
+        return;
+    }
+
+    if (ks && tun_mq_unusable(c, ks))
+    {
+        /* e.g. a cipher change on reconnect, back to queue 0 */
+        tun_mq_stop(c, mq);
+        tun_mq_update(c);
+        return;
+    }
+
+    /* publish changes */
+    {
+        const struct link_socket_actual *dest = &get_link_socket_info(c)->lsa->actual;
+        const int maxmss = c->options.ce.mssfix ? MTU_TO_MSS(TUN_MTU_SIZE_DYNAMIC(&c->c2.frame)) : 0;
+        const bool key_changed = ks ? (!mq->key_valid || ks->key_id != mq->key_id
+                                       || ks->crypto_options.key_ctx_bi.encrypt.cipher != mq->key_cipher)
+                                 : mq->key_valid;
+
+        if (key_changed || maxmss != mq->maxmss
+            || memcmp(dest, &mq->dest, sizeof(mq->dest)))
+        {
+            bool ok;
+
+            tun_mq_lock_all(mq);
+            ok = !key_changed || tun_mq_set_key(c, mq, ks);
+            mq->dest = *dest;
+            mq->maxmss = maxmss;
+            tun_mq_unlock_all(mq);
+            if (!ok)
+            {
+                tun_mq_stop(c, mq);
+                return;
+            }
+        }
+        else if (ks)
+        {
+            tun_mq_sync_packet_id(mq, ks);
+        }
+    }
+
+    tun_mq_account(c, mq, mq->key_valid ? ks : NULL);
+}
+
+void
+tun_mq_free(struct context *c)
+{
+    struct tun_mq *mq = c->c2.tun_mq;
+
+    if (mq)
+    {
+        if (mq->running)
+        {
+            tun_mq_stop(c, mq);
+        }
+        free(mq);
+        c->c2.tun_mq = NULL;
+    }
+}
+
+struct crypto_options *
+tun_mq_pre_encrypt(struct context *c, struct crypto_options *co,
+                   struct crypto_options *tmp)
+{
+    struct tun_mq *mq = c->c2.tun_mq;
+    struct key_state *ks = c->c2.tls_multi->save_ks;
+    uint64_t id;
+
+    if (!mq || !mq->running || !ks)
+    {
+        return co;
+    }
+    if (!mq->key_valid || ks->key_id != mq->key_id
+        || ks->crypto_options.key_ctx_bi.encrypt.cipher != mq->key_cipher)
+    {
+        /* the key changed since pre_select() */
+        tun_mq_update(c);
+        if (!mq->running)
+        {
+            return co;
+        }
+    }
+
+    id = __atomic_fetch_add(&mq->packet_id, 1, __ATOMIC_RELAXED);
+    if (id >= PACKET_ID_MAX)
+    {
+        return NULL;
+    }
+    *tmp = *co;
+    tmp->packet_id.send.id = (packet_id_type) id;
+    return tmp;
+}
+
+#endif /* ENABLE_TUN_MQ */
@@ -0,0 +1,72 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Multi-queue tun (--tun-queues).  Queue 0 of the tun device is served
+ * by the event loop as before.  Every other queue gets a worker thread
+ * which reads packets from it, encrypts them with a private copy of the
+ * current data channel send key and writes them to the UDP socket.  The
+ * kernel spreads flows over the queues, and write_tun() steers the
+ * return traffic of a flow to the queue which the flow is read from.
+ *
+ * All queues draw their packet IDs from one shared counter.  Decryption
+ * and everything else stays on the event loop thread, which publishes
+ * key changes to the workers from pre_select().
+ */
+
+#ifndef TUNMQ_H
+#define TUNMQ_H
+
+#ifdef ENABLE_TUN_MQ
+
+struct context;
+struct crypto_options;
+
+/**
+ * Start, update or stop the worker threads of a multi-queue tun.  Called
+ * once per event loop iteration: publishes a changed send key, remote
+ * address or MSS limit to the workers and adds their traffic to the
+ * context statistics.  Workers only run while the data channel uses an
+ * AEAD cipher without compression; otherwise their queues are detached
+ * and all traffic goes through queue 0.
+ */
+void tun_mq_update(struct context *c);
+
+/**
+ * Stop the worker threads and detach their queues.
+ */
+void tun_mq_free(struct context *c);
+
+/**
+ * Called by encrypt_sign() after tls_pre_encrypt() chose the crypto
+ * options co.  While workers run, the packet ID must come from the
+ * counter shared with them, so a copy of co using the next ID is
+ * returned in *tmp.  Returns co if no workers run, and NULL if the
+ * packet must be dropped because the packet ID space is exhausted.
+ */
+struct crypto_options *tun_mq_pre_encrypt(struct context *c,
+                                          struct crypto_options *co,
+                                          struct crypto_options *tmp);
+
+#endif /* ENABLE_TUN_MQ */
+#endif /* TUNMQ_H */
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+#
+# android_mgmt_standin.py - stand-in for the Android UI side of the
+# management interface, see doc/android.txt
+#
+# Runs an OpenVPN binary built with TARGET_ANDROID (e.g. a host build with
+# TARGET_ANDROID defined in config.h) against a local management stand-in,
+# once as a version 3 client, which confirms every tun configuration item
+# with its own NEED-OK, and once as a version 4 client, which receives them
+# as one CONFIG_BATCH.  Checks that both see the same items in the same
+# order, that the batch is framed as documented, and reports the number of
+# management round trips and the time until OPENTUN.  On failure the
+# temporary directory with the openvpn log is kept.
+#
+# The configuration is static (--ifconfig, --route, --dhcp-option) and
+# needs no peer: the tun setup runs before the first packet is sent.
+#
+# Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2
+# as published by the Free Software Foundation.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+import argparse
+import array
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+CONFIG_ITEMS = ("IFCONFIG", "IFCONFIG6", "ROUTE", "ROUTE6",
+                "DNSSERVER", "DNS6SERVER", "DNSDOMAIN")
+
+
+class StandinError(Exception):
+    pass
+
+
+def write_config(path, sock, routes):
+    with open(path, "w") as f:
+        f.write("dev tun\n"
+                "topology subnet\n"
+                "ifconfig 10.8.0.2 255.255.255.0\n"
+                "ifconfig-ipv6 fd00:8::2/64 fd00:8::1\n"
+                "route-gateway 10.8.0.1\n"
+                "remote 127.0.0.1 1194\n"
+                "nobind\n"
+                "verb 3\n"
+                "management %s unix\n"
+                "management-client\n"
+                "management-hold\n"
+                "dhcp-option DNS 10.8.0.53\n"
+                "dhcp-option DOMAIN example.org\n" % sock)
+        for i in range(routes):
+            f.write("route 10.%d.%d.0 255.255.255.0\n" % (100 + i // 256, i % 256))
+        f.write("route-ipv6 fd00:100::/48\n")
+
+
+def run(openvpn, version, routes, timeout):
+    """
+    Run one tun setup against the stand-in and return the configuration
+    items in the order they were received, the number of NEED-OK requests
+    answered, and the times in seconds from hold release and from the
+    first configuration request to OPENTUN.
+    """
+    tmp = tempfile.mkdtemp(prefix="mgmt-standin.")
+    sock = os.path.join(tmp, "mgmt.sock")
+    conf = os.path.join(tmp, "client.conf")
+    write_config(conf, sock, routes)
+
+    srv = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    srv.bind(sock)
+    srv.listen(1)
+    srv.settimeout(timeout)
+
+    log = open(os.path.join(tmp, "openvpn.log"), "w")
+    proc = subprocess.Popen([openvpn, "--config", conf], stdout=log,
+                            stderr=subprocess.STDOUT)
+    tunpair = socket.socketpair(socket.AF_UNIX, socket.SOCK_DGRAM)
+    items = []
+    batches = 0
+    queries = 0
+    t0 = t_config = elapsed = None
+
+    try:
+        try:
+            conn, _ = srv.accept()
+        except socket.timeout:
+            raise StandinError("openvpn did not connect to the management socket")
+        conn.settimeout(timeout)
+        f = conn.makefile("rb")
+
+        def send(s, fd=None):
+            if fd is None:
+                conn.sendall(s.encode())
+            else:
+                conn.sendmsg([s.encode()], [(socket.SOL_SOCKET, socket.SCM_RIGHTS,
+                                             array.array("i", [fd]))])
+
+        def readline():
+            try:
+                line = f.readline()
+            except socket.timeout:
+                line = None
+            if not line:
+                raise StandinError("no OPENTUN request from openvpn "
+                                   "(is %s built with TARGET_ANDROID?)" % openvpn)
+            return line.decode().rstrip("\r\n")
+
+        send("version %d\n" % version)
+        while elapsed is None:
+            line = readline()
+            if line.startswith(">HOLD:"):
+                t0 = time.time()
+                send("hold release\n")
+                continue
+            if not line.startswith(">NEED-OK:"):
+                continue
+
+            needed = line.split("'")[1]
+            extra = line.split("MSG:", 1)[1]
+            queries += 1
+            if t_config is None and (needed == "CONFIG_BATCH" or needed in CONFIG_ITEMS):
+                t_config = time.time()
+            status = "ok"
+            if needed == "CONFIG_BATCH":
+                count, length = map(int, extra.split())
+                batch = [readline() for _ in range(count)]
+                if sum(len(b.encode()) + 2 for b in batch) != length:
+                    raise StandinError("CONFIG_BATCH length %d does not match its items"
+                                       % length)
+                batches += 1
+                items += batch
+            elif needed in CONFIG_ITEMS:
+                items.append("%s %s" % (needed, extra))
+            elif needed == "OPENTUN":
+                elapsed = time.time()
+                send("needok 'OPENTUN' ok\n", tunpair[0].fileno())
+                send("signal SIGTERM\n")
+                continue
+            elif needed == "PERSIST_TUN_ACTION":
+                status = "OPEN_BEFORE_CLOSE"
+            send("needok '%s' %s\n" % (needed, status))
+
+        if version >= 4 and batches != 1:
+            raise StandinError("version %d client got %d CONFIG_BATCH requests, expected 1"
+                               % (version, batches))
+        if version < 4 and batches:
+            raise StandinError("version %d client got a CONFIG_BATCH request" % version)
+    except StandinError as e:
+        raise StandinError("%s, see %s" % (e, tmp))
+    finally:
+        try:
+            proc.wait(timeout)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+        log.close()
+        srv.close()
+        tunpair[0].close()
+        tunpair[1].close()
+
+    for name in os.listdir(tmp):
+        os.unlink(os.path.join(tmp, name))
+    os.rmdir(tmp)
+    return items, queries, elapsed - t0, elapsed - t_config
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compare per-item and CONFIG_BATCH tun configuration "
+        "over the Android management protocol.")
+    parser.add_argument("openvpn", help="openvpn binary built with TARGET_ANDROID")
+    parser.add_argument("--routes", type=int, default=2000,
+                        help="number of IPv4 routes to configure (default 2000)")
+    parser.add_argument("--timeout", type=float, default=30,
+                        help="seconds to wait for each step (default 30)")
+    args = parser.parse_args()
+
+    try:
+        single = run(args.openvpn, 3, args.routes, args.timeout)
+        batch = run(args.openvpn, 4, args.routes, args.timeout)
+    except StandinError as e:
+        print("FAIL: %s" % e)
+        return 1
+
+    if single[0] != batch[0]:
+        print("FAIL: CONFIG_BATCH items differ from the per-item requests")
+        for i, (a, b) in enumerate(zip(single[0], batch[0])):
+            if a != b:
+                print("  item %d: %r != %r" % (i, a, b))
+                break
+        else:
+            print("  %d per-item vs %d batched items" % (len(single[0]), len(batch[0])))
+        return 1
+
+    print("%d configuration items" % len(single[0]))
+    print("           NEED-OK   ms from hold release   ms from first item")
+    print("           requests  to OPENTUN             to OPENTUN")
+    for version, (items, queries, total, config) in ((3, single), (4, batch)):
+        print("version %d  %8d  %21.1f  %17.1f"
+              % (version, queries, total * 1000, config * 1000))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
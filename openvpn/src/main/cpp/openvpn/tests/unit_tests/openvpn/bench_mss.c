@@ -0,0 +1,108 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * MSS clamping benchmark, not part of "make check".  It times
+ * mss_fixup_ipv4/ipv6 over a synthetic trace of tun packets and
+ * compares them with the option-by-option parser which ip_classify()
+ * replaced; test_mss.c checks that both clamp the same packets.
+ *
+ *   make -C tests/unit_tests/openvpn mss_bench
+ *   tests/unit_tests/openvpn/mss_bench [passes]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <time.h>
+
+#include "mss.h"
+#include "mss_trace.h"
+
+#define TRACE_PACKETS 4000
+#define TRACE_PASSES  500
+#define MAXMSS        1360 /* MTU_TO_MSS(1400) */
+
+/*
+ * Call both through volatile pointers to keep the compiler from
+ * inlining mss_fixup_ipv4/ipv6 into the loop.
+ */
+static double
+time_trace(uint8_t (*trace)[PACKET_SIZE], const int *lens, int passes,
+           mss_fixup_fn fixup4, mss_fixup_fn fixup6)
+{
+    volatile mss_fixup_fn v4 = fixup4, v6 = fixup6;
+    struct timespec start, end;
+    int pass, n;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (pass = 0; pass < passes; ++pass)
+    {
+        for (n = 0; n < TRACE_PACKETS; ++n)
+        {
+            struct buffer buf;
+            buf_set_read(&buf, trace[n], lens[n]);
+            mss_fixup_ip(&buf, MAXMSS, v4, v6);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec))
+           / ((double) passes * TRACE_PACKETS);
+}
+
+int
+main(int argc, char **argv)
+{
+    const int passes = argc > 1 ? atoi(argv[1]) : TRACE_PASSES;
+    uint8_t (*trace)[PACKET_SIZE] = malloc(TRACE_PACKETS * PACKET_SIZE);
+    int *lens = malloc(TRACE_PACKETS * sizeof(int));
+    double legacy, current;
+    int n;
+
+    if (!trace || !lens || passes <= 0)
+    {
+        fprintf(stderr, "usage: %s [passes]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    for (n = 0; n < TRACE_PACKETS; ++n)
+    {
+        lens[n] = make_trace_packet(trace[n]);
+    }
+
+    /* the first pass clamps the SYNs, later passes see them clamped */
+    legacy = time_trace(trace, lens, passes, mss_fixup_ipv4_legacy, mss_fixup_ipv6_legacy);
+    current = time_trace(trace, lens, passes, mss_fixup_ipv4, mss_fixup_ipv6);
+    printf("%d packets x %d: legacy %.2f ns/packet, ip_classify %.2f ns/packet\n",
+           TRACE_PACKETS, passes, legacy, current);
+
+    free(lens);
+    free(trace);
+    return 0;
+}
@@ -0,0 +1,309 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include "mss_trace.h"
+
+/*
+ * mss_fixup_ipv4/ipv6 as they were before ip_classify(), parsing
+ * every SYN option by option.  The current code must clamp the
+ * same packets to the same MSS.
+ */
+static void
+mss_fixup_dowork_legacy(struct buffer *buf, uint16_t maxmss)
+{
+    int hlen, olen, optlen;
+    uint8_t *opt;
+    uint16_t mssval;
+    int accumulate;
+    struct openvpn_tcphdr *tc;
+
+    if (BLEN(buf) < (int) sizeof(struct openvpn_tcphdr))
+    {
+        return;
+    }
+
+    tc = (struct openvpn_tcphdr *) BPTR(buf);
+    hlen = OPENVPN_TCPH_GET_DOFF(tc->doff_res);
+
+    if (hlen <= (int) sizeof(struct openvpn_tcphdr)
+        || hlen > BLEN(buf))
+    {
+        return;
+    }
+
+    for (olen = hlen - sizeof(struct openvpn_tcphdr),
+         opt = (uint8_t *)(tc + 1);
+         olen > 1;
+         olen -= optlen, opt += optlen)
+    {
+        if (*opt == OPENVPN_TCPOPT_EOL)
+        {
+            break;
+        }
+        else if (*opt == OPENVPN_TCPOPT_NOP)
+        {
+            optlen = 1;
+        }
+        else
+        {
+            optlen = *(opt + 1);
+            if (optlen <= 0 || optlen > olen)
+            {
+                break;
+            }
+            if (*opt == OPENVPN_TCPOPT_MAXSEG)
+            {
+                if (optlen != OPENVPN_TCPOLEN_MAXSEG)
+                {
+                    continue;
+                }
+                mssval = (opt[2]<<8)+opt[3];
+                if (mssval > maxmss)
+                {
+                    accumulate = htons(mssval);
+                    opt[2] = (maxmss>>8)&0xff;
+                    opt[3] = maxmss&0xff;
+                    accumulate -= htons(maxmss);
+                    ADJUST_CHECKSUM(accumulate, tc->check);
+                }
+            }
+        }
+    }
+}
+
+void
+mss_fixup_ipv4_legacy(struct buffer *buf, int maxmss)
+{
+    const struct openvpn_iphdr *pip = (const struct openvpn_iphdr *) BPTR(buf);
+    const int hlen = OPENVPN_IPH_GET_LEN(pip->version_len);
+    struct buffer newbuf = *buf;
+
+    if (BLEN(buf) >= (int) sizeof(struct openvpn_iphdr)
+        && pip->protocol == OPENVPN_IPPROTO_TCP
+        && ntohs(pip->tot_len) == BLEN(buf)
+        && (ntohs(pip->frag_off) & OPENVPN_IP_OFFMASK) == 0
+        && hlen <= BLEN(buf)
+        && BLEN(buf) - hlen >= (int) sizeof(struct openvpn_tcphdr)
+        && buf_advance(&newbuf, hlen)
+        && (((struct openvpn_tcphdr *) BPTR(&newbuf))->flags & OPENVPN_TCPH_SYN_MASK))
+    {
+        mss_fixup_dowork_legacy(&newbuf, (uint16_t) maxmss);
+    }
+}
+
+void
+mss_fixup_ipv6_legacy(struct buffer *buf, int maxmss)
+{
+    const struct openvpn_ipv6hdr *pip6 = (const struct openvpn_ipv6hdr *) BPTR(buf);
+    struct buffer newbuf = *buf;
+
+    if (BLEN(buf) >= (int) sizeof(struct openvpn_ipv6hdr)
+        && BLEN(buf) == (int) ntohs(pip6->payload_len) + 40
+        && pip6->nexthdr == OPENVPN_IPPROTO_TCP
+        && buf_advance(&newbuf, 40)
+        && BLEN(&newbuf) >= (int) sizeof(struct openvpn_tcphdr)
+        && (((struct openvpn_tcphdr *) BPTR(&newbuf))->flags & OPENVPN_TCPH_SYN_MASK))
+    {
+        mss_fixup_dowork_legacy(&newbuf, (uint16_t) maxmss-20);
+    }
+}
+
+/* TCP checksum over the pseudo header and segment, 0 if valid */
+uint16_t
+tcp_checksum(const uint8_t *p, int len, int l4_offset)
+{
+    uint32_t sum = OPENVPN_IPPROTO_TCP + (len - l4_offset);
+    const uint8_t *addr = OPENVPN_IPH_GET_VER(p[0]) == 4 ? p + 12 : p + 8;
+    const int addr_len = OPENVPN_IPH_GET_VER(p[0]) == 4 ? 8 : 32;
+    int i;
+
+    for (i = 0; i < addr_len; i += 2)
+    {
+        sum += (addr[i] << 8) | addr[i + 1];
+    }
+    for (i = l4_offset; i + 1 < len; i += 2)
+    {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    if ((len - l4_offset) & 1)
+    {
+        sum += p[len - 1] << 8;
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t) ~sum;
+}
+
+static void
+set_tcp_checksum(uint8_t *p, int len, int l4_offset)
+{
+    uint16_t c;
+
+    p[l4_offset + 16] = p[l4_offset + 17] = 0;
+    c = tcp_checksum(p, len, l4_offset);
+    p[l4_offset + 16] = (uint8_t) (c >> 8);
+    p[l4_offset + 17] = (uint8_t) c;
+}
+
+/*
+ * Write an IPv4 or IPv6 header followed by a TCP header with the
+ * given options and payload; returns the packet length.
+ */
+int
+make_tcp(uint8_t *p, bool v6, uint8_t flags,
+         const uint8_t *opts, int opts_len, int payload)
+{
+    const int ihl = v6 ? 40 : 20;
+    const int thl = 20 + opts_len;
+    const int len = ihl + thl + payload;
+    int i;
+
+    memset(p, 0, ihl + thl);
+    if (v6)
+    {
+        p[0] = 0x60;
+        p[4] = (uint8_t) ((thl + payload) >> 8);
+        p[5] = (uint8_t) (thl + payload);
+        p[6] = OPENVPN_IPPROTO_TCP;
+        p[7] = 64;
+        p[8] = 0xfd;
+        p[23] = 2;
+        p[24] = 0x20;
+        p[25] = 0x01;
+        p[39] = (uint8_t) rand();
+    }
+    else
+    {
+        p[0] = 0x45;
+        p[2] = (uint8_t) (len >> 8);
+        p[3] = (uint8_t) len;
+        p[6] = 0x40; /* DF */
+        p[8] = 64;
+        p[9] = OPENVPN_IPPROTO_TCP;
+        p[12] = 10;
+        p[13] = 8;
+        p[15] = 2;
+        p[16] = 93;
+        p[19] = (uint8_t) rand();
+    }
+    p[ihl] = 0xc3;
+    p[ihl + 1] = (uint8_t) rand();
+    p[ihl + 3] = 80;
+    for (i = 4; i < 12; ++i)
+    {
+        p[ihl + i] = (uint8_t) rand();
+    }
+    p[ihl + 12] = (uint8_t) ((thl / 4) << 4);
+    p[ihl + 13] = flags;
+    p[ihl + 14] = 0xff;
+    p[ihl + 15] = 0xff;
+    memcpy(p + ihl + 20, opts, opts_len);
+    for (i = 0; i < payload; ++i)
+    {
+        p[ihl + thl + i] = (uint8_t) i;
+    }
+    set_tcp_checksum(p, len, ihl);
+    return len;
+}
+
+int
+make_udp(uint8_t *p, bool v6, int sport, int dport, int payload)
+{
+    const int ihl = v6 ? 40 : 20;
+    /* same addresses and lengths as a TCP segment 12 bytes shorter */
+    const int len = make_tcp(p, v6, 0, NULL, 0, payload - 12);
+
+    p[v6 ? 6 : 9] = OPENVPN_IPPROTO_UDP;
+    p[ihl] = (uint8_t) (sport >> 8);
+    p[ihl + 1] = (uint8_t) sport;
+    p[ihl + 2] = (uint8_t) (dport >> 8);
+    p[ihl + 3] = (uint8_t) dport;
+    p[ihl + 4] = (uint8_t) ((len - ihl) >> 8);
+    p[ihl + 5] = (uint8_t) (len - ihl);
+    p[ihl + 6] = p[ihl + 7] = 0;
+    return len;
+}
+
+const uint8_t opt_ts[] = { 1, 1, 8, 10, 0, 0, 0, 1, 0, 0, 0, 2 };
+const uint8_t opt_linux[] = { 2, 4, 0x05, 0xb4, 4, 2, 8, 10, 0, 0, 0, 1, 0, 0, 0, 0, 1, 3, 3, 7 };
+const uint8_t opt_windows[] = { 2, 4, 0x05, 0xb4, 1, 3, 3, 8, 1, 1, 4, 2 };
+const uint8_t opt_ts_first[] = { 1, 1, 8, 10, 0, 0, 0, 1, 0, 0, 0, 0, 2, 4, 0x05, 0xb4 };
+
+/*
+ * A typical tun traffic mix: mostly full size TCP segments and ACKs
+ * with timestamps, some QUIC and DNS, about 1.5% SYN and SYN-ACK with
+ * Linux and Windows option layouts, a third of it IPv6.
+ */
+int
+make_trace_packet(uint8_t *p)
+{
+    const int r = rand() % 1000;
+    const bool v6 = rand() % 1000 < 350;
+
+    if (r < 560)
+    {
+        return make_tcp(p, v6, OPENVPN_TCPH_ACK_MASK, opt_ts, sizeof(opt_ts), v6 ? 1416 : 1436);
+    }
+    else if (r < 810)
+    {
+        return make_tcp(p, v6, OPENVPN_TCPH_ACK_MASK, opt_ts, sizeof(opt_ts), 0);
+    }
+    else if (r < 910)
+    {
+        return make_udp(p, v6, 443, 50000, 1200 + rand() % 150);
+    }
+    else if (r < 950)
+    {
+        return make_udp(p, v6, 53, 40000, 40 + rand() % 80);
+    }
+    else if (r < 985)
+    {
+        return make_tcp(p, v6, OPENVPN_TCPH_ACK_MASK | OPENVPN_TCPH_FIN_MASK,
+                        opt_ts, sizeof(opt_ts), rand() % 600);
+    }
+    else
+    {
+        const uint8_t flags = OPENVPN_TCPH_SYN_MASK | (rand() % 2 ? OPENVPN_TCPH_ACK_MASK : 0);
+        switch (rand() % 3)
+        {
+            case 0:
+                return make_tcp(p, v6, flags, opt_linux, sizeof(opt_linux), 0);
+
+            case 1:
+                return make_tcp(p, v6, flags, opt_windows, sizeof(opt_windows), 0);
+
+            default:
+                return make_tcp(p, v6, flags, opt_ts_first, sizeof(opt_ts_first), 0);
+        }
+    }
+}
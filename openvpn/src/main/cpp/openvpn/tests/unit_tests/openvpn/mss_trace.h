@@ -0,0 +1,86 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Synthetic tun packets and the MSS clamping code that ip_classify()
+ * replaced, shared by test_mss.c and the bench_mss.c benchmark.
+ */
+
+#ifndef MSS_TRACE_H
+#define MSS_TRACE_H
+
+#include "buffer.h"
+#include "proto.h"
+
+#define PACKET_SIZE   1500
+
+extern const uint8_t opt_ts[12];
+extern const uint8_t opt_linux[20];
+extern const uint8_t opt_windows[12];
+extern const uint8_t opt_ts_first[16];
+
+void mss_fixup_ipv4_legacy(struct buffer *buf, int maxmss);
+
+void mss_fixup_ipv6_legacy(struct buffer *buf, int maxmss);
+
+typedef void (*mss_fixup_fn)(struct buffer *buf, int maxmss);
+
+/* dispatch on the IP version, as process_ip_header() does */
+static inline void
+mss_fixup_ip(struct buffer *buf, int maxmss, mss_fixup_fn fixup4, mss_fixup_fn fixup6)
+{
+    if (BLEN(buf) >= (int) sizeof(struct openvpn_iphdr))
+    {
+        if (OPENVPN_IPH_GET_VER(*BPTR(buf)) == 4)
+        {
+            fixup4(buf, maxmss);
+        }
+        else if (OPENVPN_IPH_GET_VER(*BPTR(buf)) == 6)
+        {
+            fixup6(buf, maxmss);
+        }
+    }
+}
+
+/* TCP checksum over the pseudo header and segment, 0 if valid */
+uint16_t tcp_checksum(const uint8_t *p, int len, int l4_offset);
+
+/*
+ * Write an IPv4 or IPv6 header followed by a TCP header with the
+ * given options and payload; returns the packet length.
+ */
+int make_tcp(uint8_t *p, bool v6, uint8_t flags,
+             const uint8_t *opts, int opts_len, int payload);
+
+/* a UDP datagram with the given ports; returns the packet length */
+int make_udp(uint8_t *p, bool v6, int sport, int dport, int payload);
+
+/*
+ * A typical tun traffic mix: mostly full size TCP segments and ACKs
+ * with timestamps, some QUIC and DNS, about 1.5% SYN and SYN-ACK with
+ * Linux and Windows option layouts, a third of it IPv6.  Returns the
+ * packet length.
+ */
+int make_trace_packet(uint8_t *p);
+
+#endif /* MSS_TRACE_H */
@@ -35,6 +35,18 @@
 #include "buffer.h"
 #include "buffer.c"
 
+/* counts the malloc() calls made by the code under test */
+static unsigned int malloc_calls;
+
+void *__real_malloc(size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+    ++malloc_calls;
+    return __real_malloc(size);
+}
+
 static void
 test_buffer_strprefix(void **state)
 {
@@ -240,6 +252,124 @@ test_buffer_free_gc_two(void **state)
     gc_free(&gc);
 }
 
+static void
+test_buffer_gc_chunks(void **state)
+{
+    struct gc_arena gc = gc_new();
+    struct gc_arena sub = gc_new();
+    struct buffer big = alloc_buf_gc(1024, &gc);
+    struct buffer small = alloc_buf_gc(64, &gc);
+    char *str;
+    char *sub_str;
+    int i;
+
+    /* large allocations are tracked individually, small ones are not */
+    assert_ptr_equal(gc.list + 1, big.data);
+    assert_null(gc.list->next);
+    assert_non_null(gc.chunks);
+    assert_int_equal((uintptr_t)small.data % GC_ALIGN, 0);
+
+    /* freeing the last small allocation hands its space back */
+    free_buf_gc(&small, &gc);
+    str = string_alloc("test", &gc);
+    assert_ptr_equal(str + GC_ALIGN_SIZE(5), gc.ptr);
+
+    /* filling a chunk moves on to the next one */
+    for (i = 0; i < 2 * GC_CHUNK_SIZE / 256; ++i)
+    {
+        alloc_buf_gc(256, &gc);
+    }
+    assert_non_null(gc.chunks->next);
+    assert_string_equal(str, "test");
+
+    /* transferred chunks are owned by the destination */
+    sub_str = string_alloc("sub", &sub);
+    gc_transfer(&gc, &sub);
+    assert_null(sub.chunks);
+    gc_free(&sub);
+    assert_string_equal(sub_str, "sub");
+
+    gc_free(&gc);
+    assert_false(gc_defined(&gc));
+}
+
+#define GC_BENCH_PACKETS 10000
+
+/*
+ * Allocation pattern of the per-packet gc_arena objects, which format
+ * an address and a few bytes of the packet when logging.
+ */
+static void
+test_buffer_gc_malloc_calls(void **state)
+{
+    const uint8_t data[16] = { 0x45 };
+    unsigned int allocs = 0;
+    unsigned int calls;
+    int i;
+
+    gc_free_chunk_cache();
+    malloc_calls = 0;
+    for (i = 0; i < GC_BENCH_PACKETS; ++i)
+    {
+        struct gc_arena gc = gc_new();
+        struct buffer out = alloc_buf_gc(64, &gc);
+
+        buf_printf(&out, "10.8.%d.%d:1194", (i >> 8) & 0xff, i & 0xff);
+        string_alloc(BSTR(&out), &gc);
+        format_hex(data, sizeof(data), 0, &gc);
+        allocs += 3;
+
+        gc_free(&gc);
+    }
+    calls = malloc_calls;
+
+    print_message("%d packets: %u gc allocations, %u malloc calls (%.4f per packet)\n",
+                  GC_BENCH_PACKETS, allocs, calls, (double)calls / GC_BENCH_PACKETS);
+
+    /* only the first arena has to allocate a chunk */
+    assert_int_equal(calls, 1);
+    gc_free_chunk_cache();
+}
+
+static void
+test_buffer_pooled(void **state)
+{
+    struct buffer a = alloc_buf_pooled(1500);
+    struct buffer b = alloc_buf_pooled(1500);
+    struct buffer c;
+    uint8_t *data = a.data;
+
+    free_buf_pool();
+    assert_int_equal(buf_pool_bytes(), 0);
+
+    /* a freed buffer is wiped and handed out again for the same size */
+    buf_printf(&a, "secret");
+    free_buf_pooled(&a);
+    assert_null(a.data);
+    assert_int_equal(buf_pool_bytes(), 1500);
+
+    c = alloc_buf_pooled(2048);
+    assert_ptr_not_equal(c.data, data);
+    free_buf_pooled(&c);
+
+    c = alloc_buf_pooled(1500);
+    assert_ptr_equal(c.data, data);
+    assert_int_equal(c.capacity, 1500);
+    assert_int_equal(BLEN(&c), 0);
+    assert_int_equal(buf_pool_bytes(), 2048);
+    for (int i = 0; i < c.capacity; ++i)
+    {
+        assert_int_equal(c.data[i], 0);
+    }
+
+    free_buf_pooled(&b);
+    free_buf_pooled(&c);
+    assert_int_equal(buf_pool_bytes(), 2 * 1500 + 2048);
+
+    free_buf_pool();
+    assert_int_equal(buf_pool_bytes(), 0);
+}
+
 int
 main(void)
 {
@@ -271,6 +401,9 @@ main(void)
                                         test_buffer_list_teardown),
         cmocka_unit_test(test_buffer_free_gc_one),
         cmocka_unit_test(test_buffer_free_gc_two),
+        cmocka_unit_test(test_buffer_gc_chunks),
+        cmocka_unit_test(test_buffer_gc_malloc_calls),
+        cmocka_unit_test(test_buffer_pooled),
     };
 
     return cmocka_run_group_tests_name("buffer", tests, NULL, NULL);
@@ -0,0 +1,277 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "clinat.h"
+#include "proto.h"
+
+#include "mock_msg.h"
+
+#define FUZZ_LISTS   500
+#define FUZZ_PACKETS 200
+
+/* clinat.c only needs these from socket.c for parsing and printing */
+in_addr_t
+getaddr(unsigned int flags, const char *hostname, int resolve_retry_seconds,
+        bool *succeeded, volatile int *signal_received)
+{
+    struct in_addr a;
+    *succeeded = inet_pton(AF_INET, hostname, &a) == 1;
+    return a.s_addr;
+}
+
+const char *
+print_in_addr_t(in_addr_t addr, unsigned int flags, struct gc_arena *gc)
+{
+    return "";
+}
+
+/*
+ * The linear rule scan which client_nat_transform used before the
+ * rule table was indexed.  Every indexed transform must produce the
+ * same packet bytes as this one.
+ */
+static void
+client_nat_transform_linear(const struct client_nat_option_list *list,
+                            struct buffer *ipbuf,
+                            const int direction)
+{
+    struct ip_tcp_udp_hdr *h = (struct ip_tcp_udp_hdr *) BPTR(ipbuf);
+    int i;
+    uint32_t addr, *addr_ptr;
+    const uint32_t *from, *to;
+    int accumulate = 0;
+    unsigned int amask;
+    unsigned int alog = 0;
+
+    for (i = 0; i < list->n; ++i)
+    {
+        const struct client_nat_entry *e = &list->entries[i];
+        if (e->type ^ direction)
+        {
+            addr = *(addr_ptr = &h->ip.daddr);
+            amask = 2;
+        }
+        else
+        {
+            addr = *(addr_ptr = &h->ip.saddr);
+            amask = 1;
+        }
+        if (direction)
+        {
+            from = &e->foreign_network;
+            to = &e->network;
+        }
+        else
+        {
+            from = &e->network;
+            to = &e->foreign_network;
+        }
+
+        if (((addr & e->netmask) == *from) && !(amask & alog))
+        {
+            ADD_CHECKSUM_32(accumulate, addr);
+            addr = (addr & ~e->netmask) | *to;
+            SUB_CHECKSUM_32(accumulate, addr);
+            *addr_ptr = addr;
+            alog |= amask;
+        }
+    }
+    if (alog)
+    {
+        ADJUST_CHECKSUM(accumulate, h->ip.check);
+
+        if (h->ip.protocol == OPENVPN_IPPROTO_TCP)
+        {
+            if (BLEN(ipbuf) >= sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_tcphdr))
+            {
+                ADJUST_CHECKSUM(accumulate, h->u.tcp.check);
+            }
+        }
+        else if (h->ip.protocol == OPENVPN_IPPROTO_UDP)
+        {
+            if (BLEN(ipbuf) >= sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_udphdr))
+            {
+                ADJUST_CHECKSUM(accumulate, h->u.udp.check);
+            }
+        }
+    }
+}
+
+/* a few overlapping networks, so that rules shadow each other */
+static const in_addr_t test_networks[] = {
+    0x0a000000, 0x0a010000, 0x0a010100, 0x0a010101, 0xc0a80000, 0xc0a80100, 0xac100000
+};
+
+static const int test_netbits[] = { 0, 8, 16, 20, 24, 30, 32 };
+
+static in_addr_t
+random_addr(void)
+{
+    in_addr_t addr = test_networks[rand() % SIZE(test_networks)];
+    return addr | (rand() % 4 ? (rand() & 0x3ff) : (in_addr_t) rand());
+}
+
+static void
+random_list(struct client_nat_option_list *list)
+{
+    struct client_nat_option_list raw;
+    int n = 1 + rand() % MAX_CLIENT_NAT;
+    int i;
+
+    CLEAR(raw);
+    for (i = 0; i < n; ++i)
+    {
+        struct client_nat_entry *e = &raw.entries[raw.n++];
+        const int bits = test_netbits[rand() % SIZE(test_netbits)];
+
+        e->type = rand() % 2 ? CN_DNAT : CN_SNAT;
+        e->netmask = htonl(bits ? IPV4_NETMASK_HOST << (32 - bits) : 0);
+        e->network = htonl(random_addr());
+        e->foreign_network = htonl(random_addr());
+        /* usually masked, sometimes not, as a user may configure it */
+        if (rand() % 8)
+        {
+            e->network &= e->netmask;
+            e->foreign_network &= e->netmask;
+        }
+    }
+
+    CLEAR(*list);
+    copy_client_nat_option_list(list, &raw);
+}
+
+static void
+random_packet(uint8_t *data, int *len)
+{
+    struct ip_tcp_udp_hdr *h = (struct ip_tcp_udp_hdr *) data;
+    static const uint8_t protos[] = {
+        OPENVPN_IPPROTO_TCP, OPENVPN_IPPROTO_UDP, OPENVPN_IPPROTO_IGMP
+    };
+    int i;
+
+    for (i = 0; i < (int) sizeof(struct ip_tcp_udp_hdr); ++i)
+    {
+        data[i] = (uint8_t) rand();
+    }
+    h->ip.protocol = protos[rand() % SIZE(protos)];
+    h->ip.saddr = htonl(random_addr());
+    h->ip.daddr = htonl(random_addr());
+
+    /* sometimes too short to carry the TCP/UDP checksum */
+    *len = rand() % 4 ? (int) sizeof(struct ip_tcp_udp_hdr) : (int) sizeof(struct openvpn_iphdr) + 4;
+}
+
+static void
+clinat_matches_linear_scan(void **state)
+{
+    struct client_nat_option_list *list;
+    int l;
+
+    srand(0);
+    list = malloc(sizeof(*list));
+    assert_non_null(list);
+
+    for (l = 0; l < FUZZ_LISTS; ++l)
+    {
+        int p;
+
+        random_list(list);
+        for (p = 0; p < FUZZ_PACKETS; ++p)
+        {
+            const int direction = rand() % 2 ? CN_INCOMING : CN_OUTGOING;
+            uint8_t expect[sizeof(struct ip_tcp_udp_hdr)];
+            uint8_t actual[sizeof(struct ip_tcp_udp_hdr)];
+            struct buffer expect_buf, actual_buf;
+            int len;
+
+            random_packet(expect, &len);
+            memcpy(actual, expect, sizeof(actual));
+
+            buf_set_read(&expect_buf, expect, len);
+            buf_set_read(&actual_buf, actual, len);
+
+            client_nat_transform_linear(list, &expect_buf, direction);
+            client_nat_transform(list, &actual_buf, direction);
+
+            assert_memory_equal(expect, actual, sizeof(actual));
+        }
+    }
+
+    free(list);
+}
+
+static void
+clinat_first_rule_wins(void **state)
+{
+    struct client_nat_option_list *list;
+    uint8_t data[sizeof(struct ip_tcp_udp_hdr)];
+    struct ip_tcp_udp_hdr *h = (struct ip_tcp_udp_hdr *) data;
+    struct buffer buf;
+
+    list = malloc(sizeof(*list));
+    assert_non_null(list);
+    CLEAR(*list);
+
+    /* the /24 comes first, so it shadows the later /16 */
+    add_client_nat_to_option_list(list, "snat", "10.1.1.0", "255.255.255.0", "192.168.1.0", M_WARN);
+    add_client_nat_to_option_list(list, "snat", "10.1.0.0", "255.255.0.0", "172.16.0.0", M_WARN);
+    assert_int_equal(list->n, 2);
+
+    CLEAR(data);
+    h->ip.protocol = OPENVPN_IPPROTO_IGMP;
+
+    h->ip.saddr = htonl(0x0a010105);
+    buf_set_read(&buf, data, sizeof(data));
+    client_nat_transform(list, &buf, CN_OUTGOING);
+    assert_int_equal(ntohl(h->ip.saddr), 0xc0a80105);
+
+    h->ip.saddr = htonl(0x0a010205);
+    client_nat_transform(list, &buf, CN_OUTGOING);
+    assert_int_equal(ntohl(h->ip.saddr), 0xac100205);
+
+    free(list);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(clinat_matches_linear_scan),
+        cmocka_unit_test(clinat_first_rule_wins),
+    };
+
+    return cmocka_run_group_tests_name("clinat tests", tests, NULL, NULL);
+}
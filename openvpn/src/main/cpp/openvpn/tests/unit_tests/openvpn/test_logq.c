@@ -0,0 +1,259 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+#include <pthread.h>
+
+#include "errlevel.h"
+#include "logq.h"
+
+#include "mock_msg.h"
+
+#define N_PRODUCERS 4
+#define N_MESSAGES  20000
+#define N_TRICKLE   2000
+
+/* written by the log thread only */
+static int next_seq[N_PRODUCERS];
+static int n_written;
+static int n_notes;
+static int last_mark;
+static bool in_order;
+static bool writer_blocked;
+
+static void
+test_writer(const struct log_queue_entry *e)
+{
+    int producer, seq;
+
+    while (__atomic_load_n(&writer_blocked, __ATOMIC_ACQUIRE))
+    {
+        usleep(1000);
+    }
+
+    if (sscanf(e->text, "f %d", &seq) == 1)
+    {
+        __atomic_store_n(&last_mark, seq, __ATOMIC_RELEASE);
+    }
+    else if (sscanf(e->text, "p%d %d", &producer, &seq) == 2)
+    {
+        /* per producer order is kept, dropped messages leave gaps */
+        if (producer < 0 || producer >= N_PRODUCERS || seq < next_seq[producer])
+        {
+            in_order = false;
+        }
+        else
+        {
+            next_seq[producer] = seq + 1;
+        }
+        ++n_written;
+    }
+    else if (strncmp(e->text, "NOTE: ", 6) == 0)
+    {
+        ++n_notes;
+    }
+}
+
+static void
+reset_writer(void)
+{
+    CLEAR(next_seq);
+    n_written = 0;
+    n_notes = 0;
+    last_mark = -1;
+    in_order = true;
+    writer_blocked = false;
+}
+
+static void *
+producer(void *arg)
+{
+    const int id = (int) (intptr_t) arg;
+    char text[32];
+    int i;
+
+    for (i = 0; i < N_MESSAGES; ++i)
+    {
+        snprintf(text, sizeof(text), "%d %d", id, i);
+        assert_true(log_queue_push(M_INFO, "p", "", text));
+    }
+    return NULL;
+}
+
+static void
+logq_multi_producer(void **state)
+{
+    pthread_t threads[N_PRODUCERS];
+    int i;
+
+    reset_writer();
+    log_queue_start(256, test_writer);
+    for (i = 0; i < N_PRODUCERS; ++i)
+    {
+        assert_int_equal(pthread_create(&threads[i], NULL, producer, (void *) (intptr_t) i), 0);
+    }
+    for (i = 0; i < N_PRODUCERS; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    log_queue_flush();
+
+    /* every message is either written or counted as dropped */
+    assert_true(in_order);
+    assert_int_equal(n_written + log_queue_dropped(), N_PRODUCERS * N_MESSAGES);
+    log_queue_stop();
+    assert_int_equal(n_notes > 0, log_queue_dropped() > 0);
+}
+
+/* a producer that lets the log thread catch up and go to sleep */
+static void *
+trickle_producer(void *arg)
+{
+    const int id = (int) (intptr_t) arg;
+    char text[32];
+    int i;
+
+    for (i = 0; i < N_TRICKLE; ++i)
+    {
+        snprintf(text, sizeof(text), "%d %d", id, i);
+        assert_true(log_queue_push(M_INFO, "p", "", text));
+        usleep(20);
+    }
+    return NULL;
+}
+
+/*
+ * Flush over and over while producers keep the log thread busy, so that
+ * flushes race with the log thread writing out and going to sleep.  A
+ * lost wakeup hangs log_queue_flush(), the alarm turns that into a
+ * failure.
+ */
+static void
+logq_flush_while_draining(void **state)
+{
+    pthread_t threads[2];
+    char text[32];
+    int i;
+
+    reset_writer();
+    log_queue_start(8192, test_writer);
+    for (i = 0; i < 2; ++i)
+    {
+        assert_int_equal(pthread_create(&threads[i], NULL, trickle_producer, (void *) (intptr_t) i), 0);
+    }
+
+    alarm(60);
+    for (i = 0; i < N_MESSAGES; ++i)
+    {
+        snprintf(text, sizeof(text), "%d", i);
+        assert_true(log_queue_push(M_INFO, "f ", "", text));
+        log_queue_flush();
+        assert_int_equal(__atomic_load_n(&last_mark, __ATOMIC_ACQUIRE), i);
+    }
+    alarm(0);
+
+    for (i = 0; i < 2; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    log_queue_flush();
+    assert_true(in_order);
+    assert_int_equal(log_queue_dropped(), 0);
+    assert_int_equal(n_written, 2 * N_TRICKLE);
+    log_queue_stop();
+}
+
+static void
+logq_full_drops(void **state)
+{
+    char text[32];
+    int i;
+
+    reset_writer();
+    log_queue_start(8, test_writer);
+
+    /* slots are only released once the writer returns */
+    __atomic_store_n(&writer_blocked, true, __ATOMIC_RELEASE);
+    for (i = 0; i < 20; ++i)
+    {
+        snprintf(text, sizeof(text), "0 %d", i);
+        assert_true(log_queue_push(M_INFO, "p", "", text));
+    }
+    __atomic_store_n(&writer_blocked, false, __ATOMIC_RELEASE);
+    log_queue_flush();
+
+    assert_true(in_order);
+    assert_int_equal(n_written, 8);
+    assert_int_equal(n_written + log_queue_dropped(), 20);
+    log_queue_stop();
+    assert_int_equal(n_notes, 1);
+}
+
+static void
+logq_bypass(void **state)
+{
+    char text[LOG_QUEUE_TEXT_SIZE + 1];
+
+    reset_writer();
+
+    /* not running */
+    assert_false(log_queue_push(M_INFO, "p", "", "0 0"));
+    log_queue_flush();
+
+    /* too long */
+    log_queue_start(8, test_writer);
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+    assert_false(log_queue_push(M_INFO, "", "", text));
+    assert_false(log_queue_push(M_INFO, "p", " ", text + 2));
+    assert_true(log_queue_push(M_INFO, "p", " ", text + 3));
+    assert_true(log_queue_push(M_INFO, "p", "", "0 0"));
+    log_queue_stop();
+
+    /* stop writes out everything queued */
+    assert_int_equal(n_written, 1);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(logq_multi_producer),
+        cmocka_unit_test(logq_flush_while_draining),
+        cmocka_unit_test(logq_full_drops),
+        cmocka_unit_test(logq_bypass),
+    };
+
+    return cmocka_run_group_tests_name("logq tests", tests, NULL, NULL);
+}
@@ -0,0 +1,292 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "mss.h"
+#include "proto.h"
+
+#include "mock_msg.h"
+#include "mss_trace.h"
+
+#define FUZZ_PACKETS 20000
+#define MAXMSS        1360 /* MTU_TO_MSS(1400) */
+
+/*
+ * A SYN with a random, possibly malformed option list holding at most
+ * one MSS option, sometimes truncated or fragmented.
+ */
+static int
+make_fuzz_packet(uint8_t *p)
+{
+    static const uint8_t kinds[] = { 0, 1, 1, 2, 2, 3, 4, 8 };
+    uint8_t opts[40];
+    const int opts_len = 4 * (rand() % 11);
+    bool have_mss = false;
+    int i = 0, len;
+
+    while (i < opts_len)
+    {
+        const uint8_t kind = kinds[rand() % sizeof(kinds)];
+        int optlen = kind <= 1 ? 1 : (kind == 2 ? 4 : 2 + rand() % 9);
+
+        if (kind == 2 && have_mss)
+        {
+            continue;
+        }
+        if (rand() % 16 == 0)
+        {
+            optlen = rand() % 12; /* wrong length */
+        }
+        if (optlen == 0 || i + optlen > opts_len)
+        {
+            optlen = opts_len - i;
+        }
+        opts[i] = kind;
+        if (kind > 1 && optlen > 1)
+        {
+            opts[i + 1] = (uint8_t) optlen;
+            if (kind == 2 && optlen == 4)
+            {
+                opts[i + 2] = (uint8_t) (4 + rand() % 2);
+                opts[i + 3] = (uint8_t) rand();
+                have_mss = true;
+            }
+            else
+            {
+                memset(opts + i + 2, 0, optlen - 2);
+            }
+        }
+        else if (optlen > 1)
+        {
+            memset(opts + i + 1, kind, optlen - 1);
+        }
+        i += optlen;
+    }
+
+    len = make_tcp(p, rand() % 2, OPENVPN_TCPH_SYN_MASK, opts, opts_len, rand() % 4 ? 0 : 100);
+    switch (rand() % 16)
+    {
+        case 0:
+            len -= 1 + rand() % (len - 1); /* truncated */
+            break;
+
+        case 1:
+            if (OPENVPN_IPH_GET_VER(p[0]) == 4)
+            {
+                p[7] = 1; /* non-first fragment */
+            }
+            break;
+    }
+    return len;
+}
+
+static void
+mss_fixup_matches_legacy(void **state)
+{
+    uint8_t orig[PACKET_SIZE], expect[PACKET_SIZE], actual[PACKET_SIZE];
+    int n, clamped = 0;
+
+    srand(0);
+    for (n = 0; n < FUZZ_PACKETS; ++n)
+    {
+        const int len = n % 2 ? make_fuzz_packet(orig) : make_trace_packet(orig);
+        const int maxmss = 536 + rand() % 1000;
+        struct buffer expect_buf, actual_buf;
+        int l4_offset = 0;
+
+        memcpy(expect, orig, len);
+        memcpy(actual, orig, len);
+        buf_set_read(&expect_buf, expect, len);
+        buf_set_read(&actual_buf, actual, len);
+
+        mss_fixup_ip(&expect_buf, maxmss, mss_fixup_ipv4_legacy, mss_fixup_ipv6_legacy);
+        mss_fixup_ip(&actual_buf, maxmss, mss_fixup_ipv4, mss_fixup_ipv6);
+
+        if (memcmp(orig, actual, len) == 0)
+        {
+            assert_memory_equal(expect, actual, len);
+            continue;
+        }
+
+        /* RFC 1624 may pick the other zero, so compare the checksums
+         * by validity and everything else by value */
+        ip_classify(actual, len, &l4_offset);
+        assert_int_equal(tcp_checksum(actual, len, l4_offset), 0);
+        memset(expect + l4_offset + 16, 0, 2);
+        memset(actual + l4_offset + 16, 0, 2);
+        assert_memory_equal(expect, actual, len);
+        ++clamped;
+    }
+    assert_true(clamped > 0);
+}
+
+static void
+mss_fixup_clamps_syn(void **state)
+{
+    uint8_t p[PACKET_SIZE];
+    struct buffer buf;
+    int len;
+
+    /* IPv4: MSS 1460 -> 1360 */
+    len = make_tcp(p, false, OPENVPN_TCPH_SYN_MASK, opt_windows, sizeof(opt_windows), 0);
+    buf_set_read(&buf, p, len);
+    mss_fixup_ipv4(&buf, MAXMSS);
+    assert_int_equal((p[42] << 8) | p[43], MAXMSS);
+    assert_int_equal(tcp_checksum(p, len, 20), 0);
+
+    /* IPv6 leaves room for the larger header: 1460 -> 1340 */
+    len = make_tcp(p, true, OPENVPN_TCPH_SYN_MASK, opt_ts_first, sizeof(opt_ts_first), 0);
+    buf_set_read(&buf, p, len);
+    mss_fixup_ipv6(&buf, MAXMSS);
+    assert_int_equal((p[60 + 14] << 8) | p[60 + 15], MAXMSS - 20);
+    assert_int_equal(tcp_checksum(p, len, 40), 0);
+
+    /* the quiet variant of the --tun-queues workers picks the IP version */
+    len = make_tcp(p, false, OPENVPN_TCPH_SYN_MASK, opt_linux, sizeof(opt_linux), 0);
+    buf_set_read(&buf, p, len);
+    mss_fixup_ip_quiet(&buf, MAXMSS);
+    assert_int_equal((p[42] << 8) | p[43], MAXMSS);
+    assert_int_equal(tcp_checksum(p, len, 20), 0);
+
+    len = make_tcp(p, true, OPENVPN_TCPH_SYN_MASK, opt_windows, sizeof(opt_windows), 0);
+    buf_set_read(&buf, p, len);
+    mss_fixup_ip_quiet(&buf, MAXMSS);
+    assert_int_equal((p[62] << 8) | p[63], MAXMSS - 20);
+    assert_int_equal(tcp_checksum(p, len, 40), 0);
+
+    /* a smaller MSS is never raised */
+    len = make_tcp(p, false, OPENVPN_TCPH_SYN_MASK, opt_windows, sizeof(opt_windows), 0);
+    buf_set_read(&buf, p, len);
+    mss_fixup_ipv4(&buf, 1500);
+    assert_int_equal((p[42] << 8) | p[43], 1460);
+}
+
+static void
+ip_classify_flags(void **state)
+{
+    uint8_t p[PACKET_SIZE];
+    int len, l4_offset = -1;
+
+    len = make_tcp(p, false, OPENVPN_TCPH_SYN_MASK, opt_linux, sizeof(opt_linux), 0);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV4 | IPC_TCP_SYN);
+    assert_int_equal(l4_offset, 20);
+    assert_int_equal(ip_classify(p, len - 1, &l4_offset), IPC_IPV4);
+    p[7] = 1;
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV4);
+
+    /* SYN without options has nothing to clamp */
+    len = make_tcp(p, true, OPENVPN_TCPH_SYN_MASK, NULL, 0, 0);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV6);
+
+    len = make_tcp(p, true, OPENVPN_TCPH_SYN_MASK, opt_windows, sizeof(opt_windows), 0);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV6 | IPC_TCP_SYN);
+    assert_int_equal(l4_offset, 40);
+
+    len = make_tcp(p, false, OPENVPN_TCPH_ACK_MASK, opt_ts, sizeof(opt_ts), 100);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV4);
+
+    len = make_udp(p, false, 67, 68, 300);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV4 | IPC_DHCP_REPLY);
+    assert_int_equal(l4_offset, 20);
+    len = make_udp(p, false, 68, 67, 300);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV4);
+    len = make_udp(p, true, 67, 68, 300);
+    assert_int_equal(ip_classify(p, len, &l4_offset), IPC_IPV6);
+
+    assert_int_equal(ip_classify(p, 19, &l4_offset), 0);
+    p[0] = 0x55;
+    assert_int_equal(ip_classify(p, len, &l4_offset), 0);
+}
+
+/* exchange source and destination address and port */
+static void
+reverse_flow(uint8_t *p, bool v6)
+{
+    const int ihl = v6 ? 40 : 20;
+    const int alen = v6 ? 16 : 4;
+    const int aoff = v6 ? 8 : 12;
+    uint8_t tmp[16];
+
+    memcpy(tmp, p + aoff, alen);
+    memcpy(p + aoff, p + aoff + alen, alen);
+    memcpy(p + aoff + alen, tmp, alen);
+    memcpy(tmp, p + ihl, 2);
+    memcpy(p + ihl, p + ihl + 2, 2);
+    memcpy(p + ihl + 2, tmp, 2);
+}
+
+static void
+ip_flow_hash_symmetric(void **state)
+{
+    uint8_t p[PACKET_SIZE];
+    uint32_t h;
+    int len;
+
+    len = make_tcp(p, false, OPENVPN_TCPH_ACK_MASK, opt_ts, sizeof(opt_ts), 100);
+    h = ip_flow_hash(p, len);
+    reverse_flow(p, false);
+    assert_int_equal(ip_flow_hash(p, len), h);
+    p[20] ^= 1;
+    assert_int_not_equal(ip_flow_hash(p, len), h);
+
+    /* fragments of one datagram hash alike, whatever they carry */
+    len = make_udp(p, false, 4500, 4500, 1400);
+    p[6] = 0x20; /* MF */
+    h = ip_flow_hash(p, len);
+    p[6] = 0x00;
+    p[7] = 0xaf;
+    memset(p + 20, 0x55, 8);
+    assert_int_equal(ip_flow_hash(p, len), h);
+
+    len = make_udp(p, true, 443, 50123, 1200);
+    h = ip_flow_hash(p, len);
+    reverse_flow(p, true);
+    assert_int_equal(ip_flow_hash(p, len), h);
+    p[39] ^= 1;
+    assert_int_not_equal(ip_flow_hash(p, len), h);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(mss_fixup_matches_legacy),
+        cmocka_unit_test(mss_fixup_clamps_syn),
+        cmocka_unit_test(ip_classify_flags),
+        cmocka_unit_test(ip_flow_hash_symmetric),
+    };
+
+    return cmocka_run_group_tests_name("mss tests", tests, NULL, NULL);
+}
@@ -0,0 +1,461 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "ssl.h"
+#include "ssl_pkt.h"
+#include "tls_crypt.h"
+
+#include "mock_msg.h"
+
+/* the parts of ssl_pkt.c's dependencies which are not exercised here */
+const char *
+print_link_socket_actual(const struct link_socket_actual *act, struct gc_arena *gc)
+{
+    return "[test peer]";
+}
+
+void
+tls_clear_error(void)
+{
+}
+
+int
+parse_line(const char *line, char **p, const int n, const char *file,
+           const int line_num, int msglevel, struct gc_arena *gc)
+{
+    return 0;
+}
+
+#define WINDOW      60  /* --hand-window */
+
+/* a server answering resets, and a client sending them */
+struct test_pkt_context {
+    struct tls_auth_standalone tas;
+    struct tls_wrap_ctx client;
+    struct link_socket_actual from;
+    struct session_id client_sid;
+    hmac_ctx_t *cookie_hmac;
+};
+
+static int
+setup(void **state, int mode)
+{
+    struct test_pkt_context *ctx = calloc(1, sizeof(*ctx));
+    uint8_t secret[32];
+    struct key_type kt;
+    struct key2 key2;
+    int i;
+
+    assert_non_null(ctx);
+    *state = ctx;
+
+    CLEAR(key2);
+    key2.n = 2;
+    for (i = 0; i < (int) sizeof(key2.keys); ++i)
+    {
+        ((uint8_t *) key2.keys)[i] = (uint8_t) (i * 13);
+    }
+
+    ctx->tas.tls_wrap.mode = mode;
+    ctx->client.mode = mode;
+    if (mode == TLS_WRAP_AUTH)
+    {
+        init_key_type(&kt, "none", "SHA256", 0, true, false);
+        init_key_ctx_bi(&ctx->tas.tls_wrap.opt.key_ctx_bi, &key2,
+                        KEY_DIRECTION_NORMAL, &kt, "server");
+        init_key_ctx_bi(&ctx->client.opt.key_ctx_bi, &key2,
+                        KEY_DIRECTION_INVERSE, &kt, "client");
+    }
+    else if (mode == TLS_WRAP_CRYPT)
+    {
+        /* as tls_crypt_kt(), init_key_type() does not take CTR mode */
+        CLEAR(kt);
+        kt.cipher = cipher_kt_get("AES-256-CTR");
+        kt.digest = md_kt_get("SHA256");
+        kt.cipher_length = cipher_kt_key_size(kt.cipher);
+        kt.hmac_length = md_kt_size(kt.digest);
+        init_key_ctx(&ctx->tas.tls_wrap.opt.key_ctx_bi.encrypt, &key2.keys[0], &kt, true, "server");
+        init_key_ctx(&ctx->tas.tls_wrap.opt.key_ctx_bi.decrypt, &key2.keys[1], &kt, false, "server");
+        init_key_ctx(&ctx->client.opt.key_ctx_bi.encrypt, &key2.keys[1], &kt, true, "client");
+        init_key_ctx(&ctx->client.opt.key_ctx_bi.decrypt, &key2.keys[0], &kt, false, "client");
+    }
+
+    /* as set up by tls_auth_standalone_init() and tls_session_init() */
+    ctx->tas.tls_wrap.opt.flags = CO_PACKET_ID_LONG_FORM | CO_IGNORE_PACKET_ID;
+    ctx->client.opt.flags = CO_PACKET_ID_LONG_FORM;
+    packet_id_init(&ctx->client.opt.packet_id, 64, 15, "client", 0);
+    ctx->tas.frame.link_mtu = 1250;
+    ctx->tas.frame.link_mtu_dynamic = 1250;
+    ctx->tas.frame.extra_frame = 100;
+    ctx->client.work = alloc_buf(BUF_SIZE(&ctx->tas.frame));
+
+    ctx->from.dest.addr.in4.sin_family = AF_INET;
+    ctx->from.dest.addr.in4.sin_addr.s_addr = htonl(0xc0000205);
+    ctx->from.dest.addr.in4.sin_port = htons(51194);
+    memcpy(ctx->client_sid.id, "\x01\x02\x03\x04\x05\x06\x07\x08", SID_SIZE);
+
+    for (i = 0; i < (int) sizeof(secret); ++i)
+    {
+        secret[i] = (uint8_t) i;
+    }
+    ctx->cookie_hmac = hmac_ctx_new();
+    hmac_ctx_init(ctx->cookie_hmac, secret, sizeof(secret), md_kt_get("SHA256"));
+
+    now = 1600000000;
+    return 0;
+}
+
+static int
+setup_none(void **state)
+{
+    return setup(state, TLS_WRAP_NONE);
+}
+
+static int
+setup_auth(void **state)
+{
+    return setup(state, TLS_WRAP_AUTH);
+}
+
+static int
+setup_crypt(void **state)
+{
+    return setup(state, TLS_WRAP_CRYPT);
+}
+
+static int
+teardown(void **state)
+{
+    struct test_pkt_context *ctx = *state;
+
+    free_key_ctx_bi(&ctx->tas.tls_wrap.opt.key_ctx_bi);
+    free_key_ctx_bi(&ctx->client.opt.key_ctx_bi);
+    packet_id_free(&ctx->client.opt.packet_id);
+    free_buf(&ctx->client.work);
+    hmac_ctx_cleanup(ctx->cookie_hmac);
+    hmac_ctx_free(ctx->cookie_hmac);
+    free(ctx);
+    return 0;
+}
+
+/*
+ * Build a client packet with an ACK record acknowledging the server's
+ * packet 0 if ack_sid is given, and a reliability layer packet ID for
+ * all opcodes but P_ACK_V1.
+ */
+static struct buffer
+client_packet(struct test_pkt_context *ctx, int opcode,
+              const struct session_id *ack_sid, struct gc_arena *gc)
+{
+    const packet_id_type net_pid = htonpid(0);
+    struct buffer buf = alloc_buf_gc(BUF_SIZE(&ctx->tas.frame), gc);
+    struct reliable_ack ack;
+    struct session_id none;
+
+    CLEAR(ack);
+    CLEAR(none);
+    ASSERT(buf_init(&buf, FRAME_HEADROOM(&ctx->tas.frame)));
+    if (opcode != P_ACK_V1)
+    {
+        ASSERT(buf_write(&buf, &net_pid, sizeof(net_pid)));
+    }
+    if (ack_sid)
+    {
+        ack.len = 1;
+    }
+    ASSERT(reliable_ack_write(&ack, &buf, ack_sid ? ack_sid : &none, 1, true));
+    assert_true(tls_wrap_control(&ctx->client, opcode << P_OPCODE_SHIFT,
+                                 &ctx->client_sid, &buf));
+
+    /* the server reads from a buffer of its own */
+    {
+        struct buffer ret = alloc_buf_gc(BUF_SIZE(&ctx->tas.frame), gc);
+        ASSERT(buf_init(&ret, FRAME_HEADROOM(&ctx->tas.frame)));
+        ASSERT(buf_copy(&ret, &buf));
+        return ret;
+    }
+}
+
+static void
+pkt_reset_verdict(void **state)
+{
+    struct test_pkt_context *ctx = *state;
+    struct gc_arena gc = gc_new();
+    struct tls_pre_decrypt_state pds;
+    struct buffer buf;
+
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_RESET_V2);
+    assert_true(session_id_equal(&pds.peer_session_id, &ctx->client_sid));
+    assert_false(session_id_defined(&pds.server_session_id));
+
+    /* a reset does not acknowledge any cookie */
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &ctx->from.dest, WINDOW));
+
+    /* the packet itself is left alone, and may be checked again */
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_RESET_V2);
+
+    gc_free(&gc);
+}
+
+static void
+pkt_reset_reply(void **state)
+{
+    struct test_pkt_context *ctx = *state;
+    struct gc_arena gc = gc_new();
+    struct tls_pre_decrypt_state pds;
+    struct session_id cookie, sid;
+    struct buffer buf, reply;
+    packet_id_type net_pid;
+    uint8_t count;
+
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_RESET_V2);
+
+    cookie = tls_cookie_session_id(ctx->cookie_hmac, &pds.peer_session_id,
+                                   &ctx->from.dest, WINDOW, 0);
+    reply = alloc_buf_gc(BUF_SIZE(&ctx->tas.frame), &gc);
+    assert_true(tls_reset_standalone(&ctx->tas, &pds, &cookie, &reply));
+
+    /* the cookie is our session ID */
+    assert_int_equal(*BPTR(&reply), P_CONTROL_HARD_RESET_SERVER_V2 << P_OPCODE_SHIFT);
+    assert_memory_equal(BPTR(&reply) + 1, cookie.id, SID_SIZE);
+
+    /* which the client unwraps like any reply, the reset acknowledged */
+    assert_true(read_control_auth(&reply, &ctx->client, &ctx->from, NULL));
+    assert_true(buf_read(&reply, &count, sizeof(count)));
+    assert_int_equal(count, 1);
+    assert_true(buf_read(&reply, &net_pid, sizeof(net_pid)));
+    assert_int_equal(ntohpid(net_pid), 0);
+    assert_true(session_id_read(&sid, &reply));
+    assert_true(session_id_equal(&sid, &ctx->client_sid));
+    assert_true(buf_read(&reply, &net_pid, sizeof(net_pid)));
+    assert_int_equal(ntohpid(net_pid), 0);
+    assert_int_equal(BLEN(&reply), 0);
+
+    gc_free(&gc);
+}
+
+static void
+pkt_cookie_ack(void **state)
+{
+    struct test_pkt_context *ctx = *state;
+    struct gc_arena gc = gc_new();
+    struct tls_pre_decrypt_state pds;
+    struct session_id cookie, forged;
+    struct buffer buf;
+
+    cookie = tls_cookie_session_id(ctx->cookie_hmac, &ctx->client_sid,
+                                   &ctx->from.dest, WINDOW, 0);
+
+    /* a plain ACK echoing the cookie */
+    buf = client_packet(ctx, P_ACK_V1, &cookie, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_CONTROL);
+    assert_true(session_id_equal(&pds.peer_session_id, &ctx->client_sid));
+    assert_true(session_id_equal(&pds.server_session_id, &cookie));
+    assert_true(tls_cookie_check(ctx->cookie_hmac, &pds, &ctx->from.dest, WINDOW));
+
+    /* the ACK piggybacked on the first P_CONTROL_V1 */
+    buf = client_packet(ctx, P_CONTROL_V1, &cookie, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_CONTROL);
+    assert_true(tls_cookie_check(ctx->cookie_hmac, &pds, &ctx->from.dest, WINDOW));
+
+    /* a P_CONTROL_V1 without an ACK carries no cookie */
+    buf = client_packet(ctx, P_CONTROL_V1, NULL, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_CONTROL);
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &ctx->from.dest, WINDOW));
+
+    /* nor does a guessed one */
+    forged = cookie;
+    forged.id[0] ^= 1;
+    buf = client_packet(ctx, P_ACK_V1, &forged, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_VALID_CONTROL);
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &ctx->from.dest, WINDOW));
+
+    gc_free(&gc);
+}
+
+static void
+pkt_invalid(void **state)
+{
+    struct test_pkt_context *ctx = *state;
+    struct gc_arena gc = gc_new();
+    struct tls_pre_decrypt_state pds;
+    struct buffer buf;
+
+    /* data channel packets, and server opcodes */
+    buf = client_packet(ctx, P_DATA_V2, NULL, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_INVALID);
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_SERVER_V2, NULL, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_INVALID);
+
+    /* a key ID other than 0 */
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+    *BPTR(&buf) |= 1;
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_INVALID);
+
+    /* larger than a packet can be */
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+    buf.len = EXPANDED_SIZE_DYNAMIC(&ctx->tas.frame) + 1;
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_INVALID);
+
+    /* too short for a session ID */
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+    buf.len = SID_SIZE;
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_INVALID);
+
+    /* an undefined session ID */
+    CLEAR(ctx->client_sid);
+    buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+    assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                     VERDICT_INVALID);
+    ctx->client_sid.id[0] = 1;
+
+    /* a packet modified on the way, if it is authenticated */
+    if (ctx->tas.tls_wrap.mode != TLS_WRAP_NONE)
+    {
+        buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+        BPTR(&buf)[BLEN(&buf) - 1] ^= 1;
+        assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                         VERDICT_INVALID);
+        buf = client_packet(ctx, P_CONTROL_HARD_RESET_CLIENT_V2, NULL, &gc);
+        BPTR(&buf)[1] ^= 1;
+        assert_int_equal(tls_pre_decrypt_lite(&ctx->tas, &pds, &ctx->from, &buf),
+                         VERDICT_INVALID);
+    }
+
+    gc_free(&gc);
+}
+
+static void
+pkt_cookie_binding(void **state)
+{
+    struct test_pkt_context *ctx = *state;
+    struct tls_pre_decrypt_state pds;
+    struct openvpn_sockaddr from = ctx->from.dest;
+    struct openvpn_sockaddr from6;
+
+    CLEAR(pds);
+    pds.peer_session_id = ctx->client_sid;
+    pds.server_session_id = tls_cookie_session_id(ctx->cookie_hmac, &ctx->client_sid,
+                                                  &from, WINDOW, 0);
+    assert_true(session_id_defined(&pds.server_session_id));
+    assert_true(tls_cookie_check(ctx->cookie_hmac, &pds, &from, WINDOW));
+
+    /* valid until the end of the next time slot */
+    now += WINDOW;
+    assert_true(tls_cookie_check(ctx->cookie_hmac, &pds, &from, WINDOW));
+    now += WINDOW;
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &from, WINDOW));
+    now -= 2 * WINDOW;
+
+    /* for this peer only */
+    from.addr.in4.sin_port = htons(51195);
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &from, WINDOW));
+    from = ctx->from.dest;
+    from.addr.in4.sin_addr.s_addr ^= htonl(1);
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &from, WINDOW));
+    from = ctx->from.dest;
+    pds.peer_session_id.id[SID_SIZE - 1] ^= 1;
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &from, WINDOW));
+    pds.peer_session_id = ctx->client_sid;
+
+    /* and under this secret only */
+    {
+        uint8_t secret[32] = { 0 };
+        hmac_ctx_t *other = hmac_ctx_new();
+
+        hmac_ctx_init(other, secret, sizeof(secret), md_kt_get("SHA256"));
+        assert_false(tls_cookie_check(other, &pds, &from, WINDOW));
+        hmac_ctx_cleanup(other);
+        hmac_ctx_free(other);
+    }
+
+    /* IPv6 peers */
+    CLEAR(from6);
+    from6.addr.in6.sin6_family = AF_INET6;
+    from6.addr.in6.sin6_addr.s6_addr[0] = 0x20;
+    from6.addr.in6.sin6_addr.s6_addr[1] = 0x01;
+    from6.addr.in6.sin6_addr.s6_addr[15] = 0x05;
+    from6.addr.in6.sin6_port = htons(51194);
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &from6, WINDOW));
+    pds.server_session_id = tls_cookie_session_id(ctx->cookie_hmac, &ctx->client_sid,
+                                                  &from6, WINDOW, 0);
+    assert_true(tls_cookie_check(ctx->cookie_hmac, &pds, &from6, WINDOW));
+    from6.addr.in6.sin6_addr.s6_addr[15] = 0x06;
+    assert_false(tls_cookie_check(ctx->cookie_hmac, &pds, &from6, WINDOW));
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(pkt_reset_verdict, setup_none, teardown),
+        cmocka_unit_test_setup_teardown(pkt_reset_verdict, setup_auth, teardown),
+        cmocka_unit_test_setup_teardown(pkt_reset_verdict, setup_crypt, teardown),
+        cmocka_unit_test_setup_teardown(pkt_reset_reply, setup_none, teardown),
+        cmocka_unit_test_setup_teardown(pkt_reset_reply, setup_auth, teardown),
+        cmocka_unit_test_setup_teardown(pkt_reset_reply, setup_crypt, teardown),
+        cmocka_unit_test_setup_teardown(pkt_cookie_ack, setup_none, teardown),
+        cmocka_unit_test_setup_teardown(pkt_cookie_ack, setup_auth, teardown),
+        cmocka_unit_test_setup_teardown(pkt_cookie_ack, setup_crypt, teardown),
+        cmocka_unit_test_setup_teardown(pkt_invalid, setup_none, teardown),
+        cmocka_unit_test_setup_teardown(pkt_invalid, setup_auth, teardown),
+        cmocka_unit_test_setup_teardown(pkt_invalid, setup_crypt, teardown),
+        cmocka_unit_test_setup_teardown(pkt_cookie_binding, setup_none, teardown),
+    };
+
+#if defined(ENABLE_CRYPTO_OPENSSL)
+    OpenSSL_add_all_algorithms();
+#endif
+
+    return cmocka_run_group_tests_name("pkt tests", tests, NULL, NULL);
+}
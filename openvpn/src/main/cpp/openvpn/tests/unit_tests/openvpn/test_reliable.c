@@ -0,0 +1,223 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "reliable.h"
+
+#include "mock_msg.h"
+
+#define TEST_TIMEOUT 2
+
+/* session_id.c is linked for session_id_print(), no session IDs are made */
+void
+prng_bytes(uint8_t *output, int len)
+{
+    memset(output, 0, len);
+}
+
+static int
+test_reliable_setup(void **state)
+{
+    struct reliable *rel = calloc(1, sizeof(struct reliable));
+
+    if (!rel)
+    {
+        return -1;
+    }
+    update_time();
+    reliable_init(rel, 128, 16, 4, false);
+    reliable_set_timeout(rel, TEST_TIMEOUT);
+    *state = rel;
+    return 0;
+}
+
+static int
+test_reliable_teardown(void **state)
+{
+    struct reliable *rel = *state;
+
+    reliable_free(rel);
+    free(rel);
+    return 0;
+}
+
+/* queue and send n packets, return the entry of the first one */
+static struct reliable_entry *
+send_packets(struct reliable *rel, int n)
+{
+    struct reliable_entry *first = NULL;
+    int i, opcode;
+
+    for (i = 0; i < n; ++i)
+    {
+        struct buffer *buf = reliable_get_buf_output_sequenced(rel);
+        assert_non_null(buf);
+        reliable_mark_active_outgoing(rel, buf, 4);
+        assert_non_null(reliable_send(rel, &opcode));
+    }
+    for (i = 0; i < rel->size; ++i)
+    {
+        if (rel->array[i].active && rel->array[i].packet_id == rel->packet_id - n)
+        {
+            first = &rel->array[i];
+        }
+    }
+    assert_non_null(first);
+    return first;
+}
+
+static void
+ack_ids(struct reliable *rel, packet_id_type from, packet_id_type to)
+{
+    struct reliable_ack ack;
+
+    CLEAR(ack);
+    while (from <= to)
+    {
+        ack.packet_id[ack.len++] = from++;
+    }
+    reliable_send_purge(rel, &ack);
+}
+
+static void
+test_reliable_initial_timeout(void **state)
+{
+    struct reliable *rel = *state;
+    struct reliable_entry *e = send_packets(rel, 1);
+
+    assert_int_equal(reliable_retransmit_timeout(rel), TEST_TIMEOUT);
+    assert_int_equal(e->next_try, now + TEST_TIMEOUT);
+    assert_false(reliable_can_send(rel));
+}
+
+static void
+test_reliable_rtt(void **state)
+{
+    struct reliable *rel = *state;
+    struct reliable_entry *e = send_packets(rel, 1);
+
+    /* pretend the packet went out 1.5s ago */
+    e->sent.tv_sec -= 2;
+    e->sent.tv_usec += 500000;
+    if (e->sent.tv_usec >= 1000000)
+    {
+        e->sent.tv_usec -= 1000000;
+        e->sent.tv_sec += 1;
+    }
+    ack_ids(rel, 0, 0);
+
+    assert_true(rel->srtt >= 1500 && rel->srtt < 1600);
+    assert_int_equal(rel->rttvar, rel->srtt / 2);
+    /* 1.5s + 4 * 0.75s, rounded up */
+    assert_int_equal(reliable_retransmit_timeout(rel), 5);
+    assert_true(reliable_empty(rel));
+
+    /* a quick round trip lowers the estimate again */
+    send_packets(rel, 1);
+    ack_ids(rel, 1, 1);
+    assert_true(rel->srtt < 1500);
+}
+
+static void
+test_reliable_karn(void **state)
+{
+    struct reliable *rel = *state;
+    struct reliable_entry *e = send_packets(rel, 1);
+    int opcode;
+
+    /* retransmitted packets do not give an RTT sample */
+    e->next_try = now;
+    assert_ptr_equal(reliable_send(rel, &opcode), &e->buf);
+    assert_int_equal(e->n_sent, 2);
+    assert_int_equal(e->timeout, 2 * 2 * TEST_TIMEOUT);
+    ack_ids(rel, 0, 0);
+    assert_int_equal(rel->srtt, 0);
+    assert_int_equal(reliable_retransmit_timeout(rel), TEST_TIMEOUT);
+}
+
+static void
+test_reliable_fast_retransmit(void **state)
+{
+    struct reliable *rel = *state;
+    struct reliable_entry *e = send_packets(rel, 4);
+    int opcode;
+
+    /* the first packet is lost, ACKs for the others arrive */
+    ack_ids(rel, 1, RELIABLE_FAST_RETRANSMIT - 1);
+    assert_false(reliable_can_send(rel));
+    assert_int_equal(e->n_acks_after, RELIABLE_FAST_RETRANSMIT - 1);
+
+    ack_ids(rel, RELIABLE_FAST_RETRANSMIT, RELIABLE_FAST_RETRANSMIT);
+    assert_true(reliable_can_send(rel));
+    assert_int_equal(reliable_send_timeout(rel), 0);
+    assert_ptr_equal(reliable_send(rel, &opcode), &e->buf);
+    assert_int_equal(e->n_acks_after, 0);
+    assert_false(reliable_can_send(rel));
+}
+
+static void
+test_reliable_backoff_limit(void **state)
+{
+    struct reliable *rel = *state;
+    struct reliable_entry *e = send_packets(rel, 1);
+    int i, opcode;
+
+    for (i = 0; i < 10; ++i)
+    {
+        e->next_try = now;
+        assert_non_null(reliable_send(rel, &opcode));
+    }
+    assert_int_equal(e->timeout, RELIABLE_MAX_TIMEOUT);
+    assert_true(e->next_try <= now + RELIABLE_MAX_TIMEOUT);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_reliable_initial_timeout,
+                                        test_reliable_setup, test_reliable_teardown),
+        cmocka_unit_test_setup_teardown(test_reliable_rtt,
+                                        test_reliable_setup, test_reliable_teardown),
+        cmocka_unit_test_setup_teardown(test_reliable_karn,
+                                        test_reliable_setup, test_reliable_teardown),
+        cmocka_unit_test_setup_teardown(test_reliable_fast_retransmit,
+                                        test_reliable_setup, test_reliable_teardown),
+        cmocka_unit_test_setup_teardown(test_reliable_backoff_limit,
+                                        test_reliable_setup, test_reliable_teardown),
+    };
+
+    return cmocka_run_group_tests_name("reliable tests", tests, NULL, NULL);
+}
@@ -0,0 +1,423 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "rtnl.h"
+
+#include "mock_msg.h"
+
+#define MAX_REQS 1024
+#define TUN_INDEX 7
+
+/*
+ * A fake rtnetlink socket.  sendmsg() keeps a copy of every request
+ * and queues the kernel's answer to it, recv() hands out the answers
+ * a few at a time.
+ */
+static struct {
+    int fd;
+    int n_sendmsg;
+    int chunk[8];                  /* requests per sendmsg() */
+    struct nlmsghdr *req[MAX_REQS];
+    int n_req;
+    int reject[MAX_REQS];          /* errno to answer request i with */
+    bool silent;                   /* don't answer at all */
+    char answers[MAX_REQS * 64];
+    size_t answers_len;
+    size_t answers_off;
+} nl;
+
+static void
+nl_reset(void)
+{
+    const int fd = nl.fd;
+    int i;
+
+    for (i = 0; i < nl.n_req; ++i)
+    {
+        free(nl.req[i]);
+    }
+    CLEAR(nl);
+    nl.fd = fd;
+}
+
+static void
+nl_answer(unsigned int seq, int error)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct nlmsgerr err;
+    } a;
+
+    CLEAR(a);
+    a.nh.nlmsg_len = NLMSG_LENGTH(sizeof(a.err));
+    a.nh.nlmsg_type = NLMSG_ERROR;
+    a.nh.nlmsg_seq = seq;
+    a.err.error = -error;
+    assert_true(nl.answers_len + NLMSG_ALIGN(a.nh.nlmsg_len) <= sizeof(nl.answers));
+    memcpy(nl.answers + nl.answers_len, &a, a.nh.nlmsg_len);
+    nl.answers_len += NLMSG_ALIGN(a.nh.nlmsg_len);
+}
+
+/* a real descriptor, as rtnl_batch_new() sets FD_CLOEXEC on it */
+int
+__wrap_socket(int domain, int type, int protocol)
+{
+    assert_int_equal(domain, PF_NETLINK);
+    assert_int_equal(protocol, NETLINK_ROUTE);
+    nl.fd = open("/dev/null", O_RDONLY);
+    return nl.fd;
+}
+
+int
+__wrap_setsockopt(int fd, int level, int optname, const void *optval, socklen_t optlen)
+{
+    assert_int_equal(fd, nl.fd);
+    return 0;
+}
+
+unsigned int
+__wrap_if_nametoindex(const char *ifname)
+{
+    return strcmp(ifname, "tun0") ? 0 : TUN_INDEX;
+}
+
+ssize_t
+__wrap_sendmsg(int fd, const struct msghdr *mh, int flags)
+{
+    size_t i, len = 0;
+
+    assert_int_equal(fd, nl.fd);
+    assert_true(nl.n_sendmsg < (int) SIZE(nl.chunk));
+    nl.chunk[nl.n_sendmsg++] = mh->msg_iovlen;
+
+    /* an answer to an earlier request, which must be ignored */
+    nl_answer(0, EPERM);
+
+    for (i = 0; i < mh->msg_iovlen; ++i)
+    {
+        const struct nlmsghdr *nh = mh->msg_iov[i].iov_base;
+        const int n = nl.n_req++;
+
+        assert_true(n < MAX_REQS);
+        assert_int_equal(mh->msg_iov[i].iov_len, NLMSG_ALIGN(nh->nlmsg_len));
+        nl.req[n] = malloc(nh->nlmsg_len);
+        assert_non_null(nl.req[n]);
+        memcpy(nl.req[n], nh, nh->nlmsg_len);
+        if (!nl.silent)
+        {
+            nl_answer(nh->nlmsg_seq, nl.reject[n]);
+        }
+        len += mh->msg_iov[i].iov_len;
+    }
+    return len;
+}
+
+ssize_t
+__wrap_recv(int fd, void *buf, size_t len, int flags)
+{
+    /* at most 10 answers per call */
+    const size_t chunk = 10 * NLMSG_ALIGN(NLMSG_LENGTH(sizeof(struct nlmsgerr)));
+    size_t n = nl.answers_len - nl.answers_off;
+
+    assert_int_equal(fd, nl.fd);
+    if (!n)
+    {
+        errno = EAGAIN; /* SO_RCVTIMEO expired */
+        return -1;
+    }
+    if (n > chunk)
+    {
+        n = chunk;
+    }
+    if (n > len)
+    {
+        n = len;
+    }
+    memcpy(buf, nl.answers + nl.answers_off, n);
+    nl.answers_off += n;
+    return n;
+}
+
+static const struct rtattr *
+find_attr(const struct nlmsghdr *nh, size_t hdrlen, unsigned short type)
+{
+    const struct rtattr *rta = (const struct rtattr *)
+                               ((const char *) NLMSG_DATA(nh) + NLMSG_ALIGN(hdrlen));
+    int len = nh->nlmsg_len - NLMSG_SPACE(hdrlen);
+
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        if (rta->rta_type == type)
+        {
+            return rta;
+        }
+    }
+    return NULL;
+}
+
+static void
+assert_attr(const struct nlmsghdr *nh, size_t hdrlen, unsigned short type,
+            const void *data, size_t len)
+{
+    const struct rtattr *rta = find_attr(nh, hdrlen, type);
+
+    assert_non_null(rta);
+    assert_int_equal(RTA_PAYLOAD(rta), len);
+    assert_memory_equal(RTA_DATA(rta), data, len);
+}
+
+/* the results reported by rtnl_batch_commit() */
+static int results[MAX_REQS];
+static int n_results;
+
+static void
+record_result(void *arg, void *cookie, int error)
+{
+    const int i = (int) (intptr_t) cookie;
+
+    assert_ptr_equal(arg, results);
+    assert_int_equal(i, n_results); /* in queueing order */
+    results[n_results++] = error;
+}
+
+static int
+setup(void **state)
+{
+    nl_reset();
+    n_results = 0;
+    *state = rtnl_batch_new();
+    return *state ? 0 : -1;
+}
+
+static int
+teardown(void **state)
+{
+    rtnl_batch_free(*state);
+    nl_reset();
+    return 0;
+}
+
+static void
+rtnl_route_messages(void **state)
+{
+    struct rtnl_batch *b = *state;
+    const in_addr_t dst4 = htonl(0x0a640000), gw4 = htonl(0x0a080001);
+    struct in6_addr dst6;
+    const struct rtmsg *rtm;
+    const int tun_index = TUN_INDEX;
+    const uint32_t metric = 100;
+
+    inet_pton(AF_INET6, "fd00:64::", &dst6);
+
+    assert_true(rtnl_route(b, true, AF_INET, &dst4, 16, &gw4, "tun0", 100,
+                           record_result, (void *) 0));
+    assert_true(rtnl_route(b, false, AF_INET6, &dst6, 64, NULL, NULL, -1,
+                           record_result, (void *) 1));
+    /* unknown interfaces are refused without queueing anything */
+    assert_false(rtnl_route(b, true, AF_INET, &dst4, 16, NULL, "nonexistent0", -1,
+                            record_result, (void *) 2));
+
+    assert_int_equal(rtnl_batch_commit(b, results), 0);
+    assert_int_equal(nl.n_sendmsg, 1);
+    assert_int_equal(nl.n_req, 2);
+    assert_int_equal(n_results, 2);
+    assert_int_equal(results[0], 0);
+    assert_int_equal(results[1], 0);
+
+    /* like "ip route add 10.100.0.0/16 via 10.8.0.1 dev tun0 metric 100" */
+    assert_int_equal(nl.req[0]->nlmsg_type, RTM_NEWROUTE);
+    assert_int_equal(nl.req[0]->nlmsg_flags,
+                     NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL);
+    rtm = NLMSG_DATA(nl.req[0]);
+    assert_int_equal(rtm->rtm_family, AF_INET);
+    assert_int_equal(rtm->rtm_dst_len, 16);
+    assert_int_equal(rtm->rtm_table, RT_TABLE_MAIN);
+    assert_int_equal(rtm->rtm_protocol, RTPROT_BOOT);
+    assert_int_equal(rtm->rtm_scope, RT_SCOPE_UNIVERSE);
+    assert_int_equal(rtm->rtm_type, RTN_UNICAST);
+    assert_attr(nl.req[0], sizeof(*rtm), RTA_DST, &dst4, sizeof(dst4));
+    assert_attr(nl.req[0], sizeof(*rtm), RTA_GATEWAY, &gw4, sizeof(gw4));
+    assert_attr(nl.req[0], sizeof(*rtm), RTA_OIF, &tun_index, sizeof(tun_index));
+    assert_attr(nl.req[0], sizeof(*rtm), RTA_PRIORITY, &metric, sizeof(metric));
+
+    /* like "ip -6 route del fd00:64::/64" */
+    assert_int_equal(nl.req[1]->nlmsg_type, RTM_DELROUTE);
+    assert_int_equal(nl.req[1]->nlmsg_flags, NLM_F_REQUEST | NLM_F_ACK);
+    assert_int_equal(nl.req[1]->nlmsg_seq, nl.req[0]->nlmsg_seq + 1);
+    rtm = NLMSG_DATA(nl.req[1]);
+    assert_int_equal(rtm->rtm_family, AF_INET6);
+    assert_int_equal(rtm->rtm_dst_len, 64);
+    assert_int_equal(rtm->rtm_scope, RT_SCOPE_NOWHERE);
+    assert_attr(nl.req[1], sizeof(*rtm), RTA_DST, &dst6, sizeof(dst6));
+    assert_null(find_attr(nl.req[1], sizeof(*rtm), RTA_GATEWAY));
+    assert_null(find_attr(nl.req[1], sizeof(*rtm), RTA_OIF));
+    assert_null(find_attr(nl.req[1], sizeof(*rtm), RTA_PRIORITY));
+}
+
+static void
+rtnl_addr_messages(void **state)
+{
+    struct rtnl_batch *b = *state;
+    const in_addr_t local4 = htonl(0x0a080006), peer4 = htonl(0x0a080005);
+    const in_addr_t bcast4 = htonl(0x0a0800ff);
+    struct in6_addr local6;
+    const struct ifaddrmsg *ifa;
+
+    inet_pton(AF_INET6, "fd00:8::1000", &local6);
+
+    assert_true(rtnl_addr(b, true, AF_INET, "tun0", &local4, 32, &peer4, NULL,
+                          record_result, (void *) 0));
+    assert_true(rtnl_addr(b, true, AF_INET, "tun0", &local4, 24, NULL, &bcast4,
+                          record_result, (void *) 1));
+    assert_true(rtnl_addr(b, false, AF_INET6, "tun0", &local6, 64, NULL, NULL,
+                          record_result, (void *) 2));
+    assert_false(rtnl_addr(b, true, AF_INET, "nonexistent0", &local4, 24, NULL, NULL,
+                           record_result, (void *) 3));
+
+    assert_int_equal(rtnl_batch_commit(b, results), 0);
+    assert_int_equal(nl.n_req, 3);
+    assert_int_equal(n_results, 3);
+
+    /* net30/p2p: "ip addr add 10.8.0.6 peer 10.8.0.5 dev tun0" */
+    assert_int_equal(nl.req[0]->nlmsg_type, RTM_NEWADDR);
+    assert_int_equal(nl.req[0]->nlmsg_flags,
+                     NLM_F_REQUEST | NLM_F_ACK | NLM_F_CREATE | NLM_F_EXCL);
+    ifa = NLMSG_DATA(nl.req[0]);
+    assert_int_equal(ifa->ifa_family, AF_INET);
+    assert_int_equal(ifa->ifa_prefixlen, 32);
+    assert_int_equal(ifa->ifa_index, TUN_INDEX);
+    assert_attr(nl.req[0], sizeof(*ifa), IFA_LOCAL, &local4, sizeof(local4));
+    assert_attr(nl.req[0], sizeof(*ifa), IFA_ADDRESS, &peer4, sizeof(peer4));
+    assert_null(find_attr(nl.req[0], sizeof(*ifa), IFA_BROADCAST));
+
+    /* subnet: "ip addr add 10.8.0.6/24 broadcast 10.8.0.255 dev tun0" */
+    ifa = NLMSG_DATA(nl.req[1]);
+    assert_int_equal(ifa->ifa_prefixlen, 24);
+    assert_attr(nl.req[1], sizeof(*ifa), IFA_LOCAL, &local4, sizeof(local4));
+    assert_attr(nl.req[1], sizeof(*ifa), IFA_ADDRESS, &local4, sizeof(local4));
+    assert_attr(nl.req[1], sizeof(*ifa), IFA_BROADCAST, &bcast4, sizeof(bcast4));
+
+    /* "ip -6 addr del fd00:8::1000/64 dev tun0" */
+    assert_int_equal(nl.req[2]->nlmsg_type, RTM_DELADDR);
+    assert_int_equal(nl.req[2]->nlmsg_flags, NLM_F_REQUEST | NLM_F_ACK);
+    ifa = NLMSG_DATA(nl.req[2]);
+    assert_int_equal(ifa->ifa_family, AF_INET6);
+    assert_int_equal(ifa->ifa_prefixlen, 64);
+    assert_attr(nl.req[2], sizeof(*ifa), IFA_LOCAL, &local6, sizeof(local6));
+    assert_attr(nl.req[2], sizeof(*ifa), IFA_ADDRESS, &local6, sizeof(local6));
+}
+
+static void
+rtnl_batch_results(void **state)
+{
+    struct rtnl_batch *b = *state;
+    const int n = 600;
+    int i;
+
+    for (i = 0; i < n; ++i)
+    {
+        const in_addr_t dst = htonl(0x0a000000 + (i << 8));
+        assert_true(rtnl_route(b, true, AF_INET, &dst, 24, NULL, "tun0", -1,
+                               record_result, (void *) (intptr_t) i));
+    }
+    nl.reject[300] = EEXIST;
+    nl.reject[599] = ENETUNREACH;
+
+    /* the kernel gets the whole list in a few chunks */
+    assert_int_equal(rtnl_batch_commit(b, results), 2);
+    assert_int_equal(nl.n_sendmsg, 3);
+    assert_int_equal(nl.chunk[0], 256);
+    assert_int_equal(nl.chunk[1], 256);
+    assert_int_equal(nl.chunk[2], 88);
+
+    /* and every route gets its own answer */
+    assert_int_equal(n_results, n);
+    for (i = 0; i < n; ++i)
+    {
+        const int expect = i == 300 ? EEXIST : (i == 599 ? ENETUNREACH : 0);
+        assert_int_equal(results[i], expect);
+        if (i)
+        {
+            assert_int_equal(nl.req[i]->nlmsg_seq, nl.req[i - 1]->nlmsg_seq + 1);
+        }
+    }
+
+    /* the batch can be used again */
+    nl_reset();
+    n_results = 0;
+    assert_true(rtnl_link_up(b, "tun0", 1500, record_result, (void *) 0));
+    assert_int_equal(rtnl_batch_commit(b, results), 0);
+    assert_int_equal(n_results, 1);
+    assert_int_equal(nl.req[0]->nlmsg_type, RTM_NEWLINK);
+}
+
+static void
+rtnl_batch_unanswered(void **state)
+{
+    struct rtnl_batch *b = *state;
+    const in_addr_t dst = htonl(0x0a640000);
+    int i;
+
+    for (i = 0; i < 3; ++i)
+    {
+        assert_true(rtnl_route(b, i == 0, AF_INET, &dst, 16, NULL, "tun0", -1,
+                               record_result, (void *) (intptr_t) i));
+    }
+    nl.silent = true;
+
+    assert_int_equal(rtnl_batch_commit(b, results), 3);
+    assert_int_equal(n_results, 3);
+    for (i = 0; i < 3; ++i)
+    {
+        assert_int_equal(results[i], EAGAIN);
+    }
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(rtnl_route_messages, setup, teardown),
+        cmocka_unit_test_setup_teardown(rtnl_addr_messages, setup, teardown),
+        cmocka_unit_test_setup_teardown(rtnl_batch_results, setup, teardown),
+        cmocka_unit_test_setup_teardown(rtnl_batch_unanswered, setup, teardown),
+    };
+
+    return cmocka_run_group_tests_name("rtnl tests", tests, NULL, NULL);
+}
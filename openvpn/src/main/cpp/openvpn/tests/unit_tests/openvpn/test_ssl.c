@@ -0,0 +1,320 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2018 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#elif defined(_MSC_VER)
+#include "config-msvc.h"
+#endif
+
+#include "syshead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <string.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "ssl_openssl.c"
+
+#include "mock_msg.h"
+
+#ifdef ENABLE_CT_OUT_QUEUE
+
+/* the parts of ssl_openssl.c which are not exercised here */
+struct management *management; /* GLOBAL */
+
+void
+crypto_print_openssl_errors(const unsigned int flags)
+{
+}
+
+void
+management_auth_failure(struct management *man, const char *type, const char *reason)
+{
+}
+
+char *
+management_query_pk_sig(struct management *man, const char *b64_data,
+                        const char *algorithm)
+{
+    return NULL;
+}
+
+int
+pem_password_callback(char *buf, int size, int rwflag, void *u)
+{
+    return 0;
+}
+
+void
+setenv_str(struct env_set *es, const char *name, const char *value)
+{
+}
+
+void
+setenv_del(struct env_set *es, const char *name)
+{
+}
+
+const tls_cipher_name_pair *
+tls_get_cipher_name_pair(const char *cipher_name, size_t len)
+{
+    return NULL;
+}
+
+int
+verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
+{
+    return 0;
+}
+
+#define PAYLOAD     1150
+#define RECORDS     (4 * PAYLOAD)
+#define STREAM      3000    /* bytes written in one go */
+
+/* a control channel frame: 100 bytes of overhead, PAYLOAD bytes of data */
+static const struct frame frame = {
+    .link_mtu = PAYLOAD + 100,
+    .link_mtu_dynamic = PAYLOAD + 100,
+    .extra_frame = 100,
+};
+
+static uint8_t records[RECORDS];
+
+static int
+setup(void **state)
+{
+    int i;
+
+    for (i = 0; i < RECORDS; ++i)
+    {
+        records[i] = (uint8_t) (i * 7);
+    }
+    *state = ct_out_new(&frame);
+    assert_non_null(*state);
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    BIO_free(*state);
+    free_buf_pool();
+    return 0;
+}
+
+/* an empty buffer laid out like those of the reliability layer */
+static struct buffer
+reliable_buf(void)
+{
+    struct buffer buf = alloc_buf(BUF_SIZE(&frame));
+
+    assert_true(buf_init(&buf, FRAME_HEADROOM(&frame)));
+    return buf;
+}
+
+static void
+ct_out_partial_writes(void **state)
+{
+    BIO *b = *state;
+    struct ct_out_queue *q = BIO_get_data(b);
+    uint8_t out[RECORDS];
+
+    /* small writes are packed into one payload, the rest starts a new one */
+    assert_int_equal(BIO_write(b, records, 500), 500);
+    assert_int_equal(BIO_write(b, records + 500, 500), 500);
+    assert_int_equal(BIO_write(b, records + 1000, 500), 500);
+    assert_int_equal(BIO_pending(b), 1500);
+    assert_int_equal(BLEN(&q->head->buf), PAYLOAD);
+    assert_int_equal(q->head->buf.offset, FRAME_HEADROOM(&frame));
+    assert_int_equal(BLEN(&q->tail->buf), 1500 - PAYLOAD);
+
+    /* a large write first tops up the tail, then spans whole payloads */
+    assert_int_equal(BIO_write(b, records + 1500, 1500), 1500);
+    assert_int_equal(BIO_pending(b), STREAM);
+    assert_int_equal(BLEN(&q->head->next->buf), PAYLOAD);
+    assert_int_equal(BLEN(&q->tail->buf), STREAM - 2 * PAYLOAD);
+    assert_ptr_equal(q->head->next->next, q->tail);
+
+    /* copying reads may end anywhere within a payload */
+    assert_int_equal(BIO_read(b, out, 100), 100);
+    assert_int_equal(BIO_read(b, out + 100, PAYLOAD), PAYLOAD);
+    assert_int_equal(BIO_pending(b), STREAM - 100 - PAYLOAD);
+    assert_int_equal(BIO_read(b, out + 100 + PAYLOAD, STREAM), STREAM - 100 - PAYLOAD);
+    assert_memory_equal(out, records, STREAM);
+    assert_int_equal(BIO_pending(b), 0);
+    assert_true(BIO_eof(b));
+    assert_null(q->head);
+    assert_null(q->tail);
+
+    /* nothing left, try again later */
+    assert_int_equal(BIO_read(b, out, sizeof(out)), -1);
+    assert_true(BIO_should_retry(b));
+    assert_true(BIO_should_read(b));
+}
+
+static void
+ct_out_swap_back(void **state)
+{
+    BIO *b = *state;
+    struct ct_out_queue *q = BIO_get_data(b);
+    struct buffer buf = reliable_buf();
+    uint8_t *empty = buf.data;
+    uint8_t *head;
+
+    assert_int_equal(BIO_write(b, records, 1500), 1500);
+    head = q->head->buf.data;
+
+    /* the record buffer changes hands, no copy */
+    assert_true(ct_out_swap(b, &buf, PAYLOAD));
+    assert_ptr_equal(buf.data, head);
+    assert_int_equal(buf.offset, FRAME_HEADROOM(&frame));
+    assert_int_equal(BLEN(&buf), PAYLOAD);
+    assert_memory_equal(BPTR(&buf), records, PAYLOAD);
+    assert_int_equal(BIO_pending(b), 1500 - PAYLOAD);
+
+    /* a full buffer is not swapped */
+    assert_false(ct_out_swap(b, &buf, PAYLOAD));
+    assert_int_equal(BIO_pending(b), 1500 - PAYLOAD);
+
+    /* the empty buffer given in went to the pool and backs the next record */
+    assert_int_equal(BIO_write(b, records + 1500, 900), 900);
+    assert_int_equal(BLEN(&q->head->buf), PAYLOAD);
+    assert_int_equal(BLEN(&q->tail->buf), 100);
+    assert_ptr_equal(q->tail->buf.data, empty);
+
+    /* once sent, the swapped out buffer goes back to the pool as well */
+    free_buf_pooled(&buf);
+    assert_int_equal(BIO_write(b, records + 2400, PAYLOAD), PAYLOAD);
+    assert_int_equal(BLEN(&q->tail->buf), 100);
+    assert_ptr_equal(q->tail->buf.data, head);
+
+    buf = reliable_buf();
+    assert_true(ct_out_swap(b, &buf, PAYLOAD));
+    assert_memory_equal(BPTR(&buf), records + PAYLOAD, PAYLOAD);
+    free_buf_pooled(&buf);
+    buf = reliable_buf();
+    assert_true(ct_out_swap(b, &buf, PAYLOAD));
+    assert_ptr_equal(buf.data, empty);
+    assert_memory_equal(BPTR(&buf), records + 2 * PAYLOAD, PAYLOAD);
+    free_buf_pooled(&buf);
+    assert_int_equal(BIO_pending(b), 100);
+}
+
+static void
+ct_out_swap_refused(void **state)
+{
+    BIO *b = *state;
+    struct key_state_ssl ks_ssl;
+    struct buffer buf = reliable_buf();
+    struct buffer small = alloc_buf(BUF_SIZE(&frame) - 1);
+
+    CLEAR(ks_ssl);
+    ks_ssl.ct_out = b;
+
+    /* nothing queued */
+    assert_false(ct_out_swap(b, &buf, PAYLOAD));
+    assert_int_equal(key_state_read_ciphertext(&ks_ssl, &buf, PAYLOAD), 0);
+
+    assert_int_equal(BIO_write(b, records, STREAM), STREAM);
+
+    /* the record does not fit in maxlen, copy what fits */
+    assert_false(ct_out_swap(b, &buf, 1000));
+    assert_int_equal(key_state_read_ciphertext(&ks_ssl, &buf, 1000), 1);
+    assert_int_equal(BLEN(&buf), 1000);
+    assert_memory_equal(BPTR(&buf), records, 1000);
+    free_buf(&buf);
+
+    /* a buffer of another size gets a copy, across records */
+    assert_true(buf_init(&small, FRAME_HEADROOM(&frame)));
+    assert_false(ct_out_swap(b, &small, PAYLOAD));
+    assert_int_equal(key_state_read_ciphertext(&ks_ssl, &small, PAYLOAD), 1);
+    assert_int_equal(BLEN(&small), PAYLOAD);
+    assert_memory_equal(BPTR(&small), records + 1000, PAYLOAD);
+    free_buf(&small);
+
+    /* as does one with other headroom */
+    buf = alloc_buf(BUF_SIZE(&frame));
+    assert_true(buf_init(&buf, FRAME_HEADROOM(&frame) + 8));
+    assert_false(ct_out_swap(b, &buf, PAYLOAD));
+    assert_int_equal(key_state_read_ciphertext(&ks_ssl, &buf, PAYLOAD), 1);
+    assert_int_equal(BLEN(&buf), STREAM - 1000 - PAYLOAD);
+    assert_memory_equal(BPTR(&buf), records + 1000 + PAYLOAD, BLEN(&buf));
+    free_buf(&buf);
+    assert_int_equal(BIO_pending(b), 0);
+
+    /* and the queue keeps working after the copies */
+    buf = reliable_buf();
+    assert_int_equal(BIO_write(b, records, 10), 10);
+    assert_int_equal(key_state_read_ciphertext(&ks_ssl, &buf, PAYLOAD), 1);
+    assert_int_equal(BLEN(&buf), 10);
+    free_buf_pooled(&buf);
+}
+
+static void
+ct_out_reset(void **state)
+{
+    BIO *b = *state;
+    struct ct_out_queue *q = BIO_get_data(b);
+    struct ct_out_node *spare;
+
+    assert_int_equal(BIO_write(b, records, RECORDS), RECORDS);
+    assert_true(BIO_reset(b) > 0);
+    assert_int_equal(BIO_pending(b), 0);
+    assert_true(BIO_eof(b));
+    assert_null(q->head);
+    assert_null(q->tail);
+
+    /* the nodes are kept for the next records */
+    spare = q->spare;
+    assert_non_null(spare);
+    assert_int_equal(BIO_write(b, records, 10), 10);
+    assert_ptr_equal(q->head, spare);
+    assert_int_equal(BIO_pending(b), 10);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(ct_out_partial_writes, setup, teardown),
+        cmocka_unit_test_setup_teardown(ct_out_swap_back, setup, teardown),
+        cmocka_unit_test_setup_teardown(ct_out_swap_refused, setup, teardown),
+        cmocka_unit_test_setup_teardown(ct_out_reset, setup, teardown),
+    };
+
+    return cmocka_run_group_tests_name("ssl tests", tests, NULL, NULL);
+}
+
+#else  /* ifdef ENABLE_CT_OUT_QUEUE */
+
+int
+main(void)
+{
+    return 77; /* skipped, no ciphertext output BIO in this build */
+}
+
+#endif /* ifdef ENABLE_CT_OUT_QUEUE */
@@ -76,6 +76,7 @@
 #define OPENVPN_LOG_CLASS openvpn::ClientAPI::LogReceiver
 #define OPENVPN_LOG_INFO  openvpn::ClientAPI::LogInfo
 #include <openvpn/log/logthread.hpp>    // should be included early
+#include <openvpn/log/logasync.hpp>
 #endif
 
 // log SSL handshake messages
@@ -96,6 +97,7 @@
 #include <openvpn/time/asiotimer.hpp>
 #include <openvpn/client/cliconnect.hpp>
 #include <openvpn/client/cliopthelper.hpp>
+#include <openvpn/client/cliprofile.hpp>
 #include <openvpn/options/merge.hpp>
 #include <openvpn/error/excode.hpp>
 #include <openvpn/crypto/selftest.hpp>
@@ -209,6 +211,10 @@ namespace openvpn {
 	      last_connected = std::move(event);
 	    else if (event->id() == ClientEvent::DISCONNECTED)
 	      parent->on_disconnect();
+	    else if (event->id() == ClientEvent::PATH_MTU)
+	      pmtu = static_cast<const ClientEvent::PathMTU*>(event.get())->pmtu;
+	    else if (event->id() == ClientEvent::RECONNECTING)
+	      pmtu = 0;
 	    parent->event(ev);
 	  }
       }
@@ -232,6 +238,7 @@ namespace openvpn {
 		ci.gw6 = c->vpn_gw6;
 		ci.clientIp = c->client_ip;
 		ci.tunName = c->tun_name;
+		ci.pmtu = pmtu;
 		ci.defined = true;
 		return;
 	      }
@@ -247,6 +254,7 @@ namespace openvpn {
     private:
       OpenVPNClient* parent;
       ClientEvent::Base::Ptr last_connected;
+      unsigned int pmtu = 0;
     };
 
     class MySocketProtect : public SocketProtect
@@ -424,6 +432,11 @@ namespace openvpn {
 	bool tun_persist = false;
 	bool google_dns_fallback = false;
 	bool synchronous_dns_lookup = false;
+	unsigned int race_endpoints = 0;
+	bool io_uring = false;
+	bool pmtud = false;
+	unsigned int log_queue_size = 0;
+	unsigned int log_rate_limit = 0;
 	bool autologin_sessions = false;
 	bool retry_on_auth_failed = false;
 	std::string private_key_password;
@@ -623,28 +636,68 @@ namespace openvpn {
 	    const KeyValue& kv = config.contentList[i];
 	    kvl.push_back(new OptionList::KeyValue(kv.key, kv.value));
 	  }
-	const ParseClientConfig cc = ParseClientConfig::parse(config.content, &kvl, options);
+
+	CompiledProfile::Summary summary;
+#if !defined(OPENVPN_PLATFORM_WIN)
+	// try a previously compiled profile first
+	std::string cp_hash, cp_fn;
+	bool cp_loaded = false;
+	if (!config.compiledProfileDir.empty())
+	  {
+	    cp_hash = CompiledProfile::source_hash(config.content, &kvl);
+	    cp_fn = CompiledProfile::filename(config.compiledProfileDir, cp_hash);
+	    try {
+	      cp_loaded = CompiledProfile::load(cp_fn, cp_hash, options, summary);
+	      if (cp_loaded)
+		CompiledProfile::touch(cp_fn);
+	    }
+	    catch (const std::exception& e)
+	      {
+		OPENVPN_LOG("Ignoring compiled profile: " << e.what());
+		options.clear();
+		options.update_map();
+	      }
+	  }
+	if (!cp_loaded)
+#endif
+	  {
+	    const ParseClientConfig cc = ParseClientConfig::parse(config.content, &kvl, options);
+	    eval.error = cc.error();
+	    summary = CompiledProfile::Summary(cc);
+#if !defined(OPENVPN_PLATFORM_WIN)
+	    if (!cp_fn.empty() && !eval.error)
+	      {
+		try {
+		  CompiledProfile::save(cp_fn, cp_hash, options, summary);
+		  CompiledProfile::prune(config.compiledProfileDir, cp_fn);
+		}
+		catch (const std::exception& e)
+		  {
+		    OPENVPN_LOG("Error saving compiled profile: " << e.what());
+		  }
+	      }
+#endif
+	  }
 #ifdef OPENVPN_DUMP_CONFIG
 	std::cout << "---------- ARGS ----------" << std::endl;
 	std::cout << options.render(Option::RENDER_PASS_FMT|Option::RENDER_NUMBER|Option::RENDER_BRACKET) << std::endl;
 	std::cout << "---------- MAP ----------" << std::endl;
 	std::cout << options.render_map() << std::endl;
 #endif
-	eval.error = cc.error();
-	eval.message = cc.message();
-	eval.userlockedUsername = cc.userlockedUsername();
-	eval.profileName = cc.profileName();
-	eval.friendlyName = cc.friendlyName();
-	eval.autologin = cc.autologin();
-	eval.externalPki = cc.externalPki();
-	eval.staticChallenge = cc.staticChallenge();
-	eval.staticChallengeEcho = cc.staticChallengeEcho();
-	eval.privateKeyPasswordRequired = cc.privateKeyPasswordRequired();
-	eval.allowPasswordSave = cc.allowPasswordSave();
-	eval.remoteHost = config.serverOverride.empty() ? cc.firstRemoteListItem().host : config.serverOverride;
-	eval.remotePort = cc.firstRemoteListItem().port;
-	eval.remoteProto = cc.firstRemoteListItem().proto;
-	for (ParseClientConfig::ServerList::const_iterator i = cc.serverList().begin(); i != cc.serverList().end(); ++i)
+	eval.message = summary.message;
+	eval.userlockedUsername = summary.userlockedUsername;
+	eval.profileName = summary.profileName;
+	eval.friendlyName = summary.friendlyName;
+	eval.autologin = summary.autologin;
+	eval.externalPki = summary.externalPki;
+	eval.staticChallenge = summary.staticChallenge;
+	eval.staticChallengeEcho = summary.staticChallengeEcho;
+	eval.privateKeyPasswordRequired = summary.privateKeyPasswordRequired;
+	eval.allowPasswordSave = summary.allowPasswordSave;
+	eval.remoteHost = config.serverOverride.empty() ? summary.firstRemoteListItem.host : config.serverOverride;
+	eval.remotePort = summary.firstRemoteListItem.port;
+	eval.remoteProto = summary.firstRemoteListItem.proto;
+	for (ParseClientConfig::ServerList::const_iterator i = summary.serverList.begin(); i != summary.serverList.end(); ++i)
 	  {
 	    ServerEntry se;
 	    se.server = i->server;
@@ -668,6 +721,9 @@ namespace openvpn {
 	state->tun_persist = config.tunPersist;
 	state->google_dns_fallback = config.googleDnsFallback;
 	state->synchronous_dns_lookup = config.synchronousDnsLookup;
+	state->race_endpoints = config.raceEndpoints > 0 ? config.raceEndpoints : 0;
+	state->log_queue_size = config.logQueueSize > 0 ? config.logQueueSize : 0;
+	state->log_rate_limit = config.logRateLimit > 0 ? config.logRateLimit : 0;
 	state->autologin_sessions = config.autologinSessions;
 	state->retry_on_auth_failed = config.retryOnAuthFailed;
 	state->private_key_password = config.privateKeyPassword;
@@ -700,6 +756,13 @@ namespace openvpn {
 	  throw Exception("client not built with OPENVPN_GREMLIN");
 #endif
 	  }
+#ifdef OPENVPN_IO_URING
+	state->io_uring = config.ioUring;
+#else
+	if (config.ioUring)
+	  OPENVPN_LOG("client not built with OPENVPN_IO_URING, using the asio reactor");
+#endif
+	state->pmtud = config.pmtud;
 	state->extra_peer_info = PeerInfo::Set::new_from_foreign_set(config.peerInfo);
 	if (!config.proxyHost.empty())
 	  {
@@ -858,7 +921,12 @@ namespace openvpn {
 #ifdef OPENVPN_LOG_GLOBAL
 #error ovpn3 core logging object only supports thread-local scope
 #endif
-      Log::Context log_context(this);
+      // deliver log() callbacks on a separate thread if requested,
+      // destroyed after log_context, once all messages are delivered
+      std::unique_ptr<AsyncLog<LogReceiver, LogInfo>> async_log;
+      if (state->log_queue_size)
+	async_log.reset(new AsyncLog<LogReceiver, LogInfo>(this, state->log_queue_size, state->log_rate_limit));
+      Log::Context log_context(async_log ? async_log.get() : static_cast<LogReceiver*>(this));
 #endif
       return do_connect();
     }
@@ -937,6 +1005,9 @@ namespace openvpn {
       cc.tun_persist = state->tun_persist;
       cc.google_dns_fallback = state->google_dns_fallback;
       cc.synchronous_dns_lookup = state->synchronous_dns_lookup;
+      cc.race_endpoints = state->race_endpoints;
+      cc.io_uring = state->io_uring;
+      cc.pmtud = state->pmtud;
       cc.autologin_sessions = state->autologin_sessions;
       cc.retry_on_auth_failed = state->retry_on_auth_failed;
       cc.proto_context_options = state->proto_context_options;
@@ -1330,6 +1401,16 @@ namespace openvpn {
 	}
     }
 
+    OPENVPN_CLIENT_EXPORT void OpenVPNClient::latency_trace_enable(bool enable)
+    {
+      LatencyTrace::enable(enable);
+    }
+
+    OPENVPN_CLIENT_EXPORT std::string OpenVPNClient::latency_trace_export()
+    {
+      return LatencyTrace::export_json();
+    }
+
     OPENVPN_CLIENT_EXPORT void OpenVPNClient::clock_tick()
     {
     }
@@ -1377,6 +1458,9 @@ namespace openvpn {
 #endif
 #ifdef OPENVPN_GREMLIN
       ret += " GREMLIN";
+#endif
+#ifdef OPENVPN_IO_URING
+      ret += " IO_URING";
 #endif
       ret += " built on " __DATE__ " " __TIME__;
       return ret;
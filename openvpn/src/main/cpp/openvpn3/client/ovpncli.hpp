@@ -200,6 +200,28 @@ namespace openvpn {
       // if true, do synchronous DNS lookup.
       bool synchronousDnsLookup = false;
 
+      // For UDP, send the first packets of a connection to up to this
+      // many addresses of the remote host at once (alternating IPv6 and
+      // IPv4), and keep the first one to answer.  0 or 1 to disable.
+      int raceEndpoints = 0;
+
+      // If non-empty, a directory in which compiled profiles are
+      // cached, so that evaluating an unchanged profile again skips
+      // parsing it.  Compiled profiles include any embedded keys,
+      // so the directory must only be accessible by this app.
+      // Ignored on Windows.
+      std::string compiledProfileDir;
+
+      // If > 0, log() is called on a separate thread, with up to this
+      // many messages queued for it.  Further messages are dropped and
+      // their number is logged, so that a slow log() implementation
+      // never holds up the tunnel.
+      int logQueueSize = 0;
+
+      // With logQueueSize, log at most this many similar messages
+      // (differing only in numbers) per second.  0 for no limit.
+      int logRateLimit = 0;
+
       // Enable autologin sessions
       bool autologinSessions = true;
 
@@ -293,6 +315,16 @@ namespace openvpn {
 
       // Gremlin configuration (requires that the core is built with OPENVPN_GREMLIN)
       std::string gremlinConfig;
+
+      // Use io_uring for UDP and tun I/O on Linux (requires that the core
+      // is built with OPENVPN_IO_URING).  Falls back to the asio reactor
+      // if the kernel does not support it.
+      bool ioUring = false;
+
+      // Discover the path MTU to the server with padded data channel
+      // probes (RFC 8899) and lower the tun MTU and MSS clamp to match.
+      // UDP only, the server must answer OCC MTU requests (OpenVPN 2.x does).
+      bool pmtud = false;
     };
 
     // used to communicate VPN events such as connect, disconnect, etc.
@@ -321,6 +353,7 @@ namespace openvpn {
       std::string gw6;
       std::string clientIp;
       std::string tunName;
+      unsigned int pmtu = 0;  // discovered path MTU to the server, 0 if not known
     };
 
     // returned by some methods as a status/error indication
@@ -539,6 +572,17 @@ namespace openvpn {
       // post control channel message
       void post_cc_msg(const std::string& msg);
 
+      // Enable or disable per-stage data channel latency tracing.
+      // May be called from any thread.  Enabling discards events
+      // recorded before the call.
+      static void latency_trace_enable(bool enable);
+
+      // Return latency trace events recorded since tracing was last
+      // enabled, as Chrome trace event JSON (loadable in
+      // chrome://tracing or ui.perfetto.dev).  May be called from any
+      // thread, while tracing is enabled or after it is disabled.
+      static std::string latency_trace_export();
+
       // Callback for delivering events during connect() call.
       // Will be called from the thread executing connect().
       virtual void event(const Event&) = 0;
@@ -23,9 +23,11 @@
 #define OPENVPN_ADDR_POOL_H
 
 #include <string>
-#include <sstream>
+#include <vector>
 #include <deque>
 #include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
@@ -38,6 +40,11 @@ namespace openvpn {
 
     // Maintain a pool of IP addresses.
     // A should be IP::Addr, IPv4::Addr, or IPv6::Addr.
+    //
+    // The pool is stored as a sorted list of disjoint address blocks.
+    // Addresses are handed out lazily from the start of each block, and
+    // only acquired addresses are tracked, in a sparse per-block bitmap,
+    // so that memory use doesn't depend on the size of the netblock.
     template <typename ADDR>
     class PoolType
     {
@@ -45,72 +52,117 @@ namespace openvpn {
       PoolType() {}
 
       // Add range of addresses to pool (pool will own the addresses).
+      // Addresses already owned by the pool are skipped.
       void add_range(const RangeType<ADDR>& range)
       {
-	auto iter = range.iterator();
-	while (iter.more())
+	ADDR start = range.start();
+	size_t extent = range.extent();
+	while (extent)
 	  {
-	    const ADDR& a = iter.addr();
-	    add_addr(a);
-	    iter.next();
+	    // first block which ends at or after start
+	    auto b = std::lower_bound(blocks.begin(), blocks.end(), start,
+				      [](const Block& blk, const ADDR& a) { return blk.last < a; });
+	    if (b != blocks.end() && b->start <= start)
+	      {
+		// start is already owned, skip to the end of block
+		const size_t skip = (b->last - start).to_ulong() + 1;
+		if (skip >= extent)
+		  break;
+		start += skip;
+		extent -= skip;
+		continue;
+	      }
+
+	    // add addresses up to the next block
+	    size_t n = extent;
+	    if (b != blocks.end() && b->start <= start + (extent - 1))
+	      n = (b->start - start).to_ulong();
+	    const size_t index = b - blocks.begin();
+	    if (index > 0 && blocks[index-1].last + 1 == start)
+	      blocks[index-1].extend(n);
+	    else
+	      blocks.insert(b, Block(start, n));
+	    fresh_block = std::min(fresh_block, index > 0 ? index - 1 : 0);
+	    n_total += n;
+	    start += n;
+	    extent -= n;
 	  }
       }
 
       // Add single address to pool (pool will own the address).
       void add_addr(const ADDR& addr)
       {
-	auto e = map.find(addr);
-	if (e == map.end())
-	  {
-	    freelist.push_back(addr);
-	    map[addr] = false;
-	  }
+	add_range(RangeType<ADDR>(addr, 1));
       }
 
       // Return number of pool addresses currently in use.
       size_t n_in_use() const
       {
-	return map.size() - freelist.size();
+	return n_in_use_;
       }
 
-      // Return number of pool addresses currently in use.
+      // Return number of pool addresses currently free.
       size_t n_free() const
       {
-	return freelist.size();
+	return n_total - n_in_use_;
       }
 
       // Acquire an address from pool.  Returns true if successful,
       // with address placed in dest, or false if pool depleted.
       bool acquire_addr(ADDR& dest)
       {
-	while (true)
+	freelist_fill();
+
+	// Hand out never-used addresses first, so that released
+	// addresses are reused as late as possible.
+	while (fresh_block < blocks.size())
 	  {
-	    freelist_fill();
-	    if (freelist.empty())
-	      return false;
-	    const ADDR& a = freelist.front();
-	    auto e = map.find(a);
-	    if (e == map.end()) // any address in freelist must exist in map
-	      throw Exception("PoolType: address in freelist doesn't exist in map");
-	    if (!e->second)
+	    Block& b = blocks[fresh_block];
+	    while (b.next < b.extent)
 	      {
-		e->second = true;
+		const size_t i = b.next++;
+		if (!b.test(i))
+		  {
+		    b.set(i);
+		    ++n_in_use_;
+		    dest = b.addr(i);
+		    return true;
+		  }
+	      }
+	    ++fresh_block;
+	  }
+
+	// Then reuse released addresses.  The freelist may hold
+	// addresses that were acquired again by acquire_specific_addr.
+	while (!freelist.empty())
+	  {
+	    const ADDR a = freelist.front();
+	    freelist.pop_front();
+	    size_t i;
+	    Block* b = find(a, i);
+	    if (!b) // any address in freelist must exist in pool
+	      throw Exception("PoolType: address in freelist doesn't exist in pool");
+	    if (!b->test(i))
+	      {
+		b->set(i);
+		++n_in_use_;
 		dest = a;
-		freelist.pop_front();
 		return true;
 	      }
-	    freelist.pop_front();
 	  }
+	return false;
       }
 
       // Acquire a specific address from pool, returning true if
       // successful, or false if the address is not available.
       bool acquire_specific_addr(const ADDR& addr)
       {
-	auto e = map.find(addr);
-	if (e != map.end() && !e->second)
+	size_t i;
+	Block* b = find(addr, i);
+	if (b && !b->test(i))
 	  {
-	    e->second = true;
+	    b->set(i);
+	    ++n_in_use_;
 	    return true;
 	  }
 	else
@@ -122,17 +174,16 @@ namespace openvpn {
       // (b) the address is not owned by the pool.
       void release_addr(const ADDR& addr)
       {
-	auto e = map.find(addr);
-	if (e != map.end() && e->second)
+	size_t i;
+	Block* b = find(addr, i);
+	if (b && b->test(i))
 	  {
+	    b->clear(i);
+	    --n_in_use_;
 	    freelist.push_back(addr);
-	    e->second = false;
 	  }
       }
 
-      // DEBUGGING -- get the map load factor
-      float load_factor() const { return map.load_factor(); }
-
       // Override to refill freelist on demand
       virtual void freelist_fill()
       {
@@ -141,20 +192,104 @@ namespace openvpn {
       std::string to_string() const
       {
 	std::string ret;
-	for (const auto& e : map)
+	for (const auto& b : blocks)
 	  {
-	    if (e.second)
+	    std::vector<size_t> words;
+	    words.reserve(b.in_use.size());
+	    for (const auto& w : b.in_use)
+	      words.push_back(w.first);
+	    std::sort(words.begin(), words.end());
+	    for (const size_t w : words)
 	      {
-		ret += e.first.to_string();
-		ret += '\n';
+		for (size_t i = w * WORD_BITS; i < (w + 1) * WORD_BITS; ++i)
+		  {
+		    if (b.test(i))
+		      {
+			ret += b.addr(i).to_string();
+			ret += '\n';
+		      }
+		  }
 	      }
 	  }
 	return ret;
       }
 
     private:
-      std::deque<ADDR> freelist;
-      std::unordered_map<ADDR, bool> map;
+      enum {
+	WORD_BITS = 64,
+      };
+
+      // A contiguous range of pool addresses.
+      struct Block
+      {
+	Block(const ADDR& start_arg, const size_t extent_arg)
+	  : start(start_arg),
+	    last(start_arg + (extent_arg - 1)),
+	    extent(extent_arg)
+	{
+	}
+
+	void extend(const size_t n)
+	{
+	  last += n;
+	  extent += n;
+	}
+
+	ADDR addr(const size_t i) const
+	{
+	  return start + i;
+	}
+
+	bool test(const size_t i) const
+	{
+	  auto e = in_use.find(i / WORD_BITS);
+	  return e != in_use.end() && (e->second & bit(i));
+	}
+
+	void set(const size_t i)
+	{
+	  in_use[i / WORD_BITS] |= bit(i);
+	}
+
+	void clear(const size_t i)
+	{
+	  auto e = in_use.find(i / WORD_BITS);
+	  if (e != in_use.end() && !(e->second &= ~bit(i)))
+	    in_use.erase(e);
+	}
+
+	static std::uint64_t bit(const size_t i)
+	{
+	  return std::uint64_t(1) << (i % WORD_BITS);
+	}
+
+	ADDR start;
+	ADDR last;
+	size_t extent;
+	size_t next = 0; // addresses at this index and above were never handed out
+	std::unordered_map<size_t, std::uint64_t> in_use; // bitmap words with any address in use
+      };
+
+      // Return the block that owns addr, with the index
+      // of addr in the block placed in index.
+      Block* find(const ADDR& addr, size_t& index)
+      {
+	auto b = std::lower_bound(blocks.begin(), blocks.end(), addr,
+				  [](const Block& blk, const ADDR& a) { return blk.last < a; });
+	if (b != blocks.end() && b->start <= addr)
+	  {
+	    index = (addr - b->start).to_ulong();
+	    return &*b;
+	  }
+	else
+	  return nullptr;
+      }
+
+      std::vector<Block> blocks;    // sorted and disjoint
+      std::deque<ADDR> freelist;    // released addresses
+      size_t fresh_block = 0;       // first block that may have never-used addresses
+      size_t n_total = 0;
+      size_t n_in_use_ = 0;
     };
 
     typedef PoolType<IP::Addr> Pool;
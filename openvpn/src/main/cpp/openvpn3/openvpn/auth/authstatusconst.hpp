@@ -0,0 +1,56 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OPENVPN_AUTH_AUTHSTATUSCONST_H
+#define OPENVPN_AUTH_AUTHSTATUSCONST_H
+
+namespace openvpn {
+  namespace AuthStatus {
+    enum Type {
+      NONE,             // no authentication outcome recorded
+      SUCCEEDED,        // client was authenticated
+      FAILED,           // client failed authentication
+      PENDING,          // authentication is waiting on an external decision
+      DISCONNECTED,     // client was disconnected after authentication
+    };
+
+    inline const char *to_string(const Type type)
+    {
+      switch (type)
+	{
+	case NONE:
+	  return "NONE";
+	case SUCCEEDED:
+	  return "SUCCEEDED";
+	case FAILED:
+	  return "FAILED";
+	case PENDING:
+	  return "PENDING";
+	case DISCONNECTED:
+	  return "DISCONNECTED";
+	default:
+	  return "UNKNOWN";
+	}
+    }
+  }
+}
+
+#endif
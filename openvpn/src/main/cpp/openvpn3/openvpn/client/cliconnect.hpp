@@ -103,9 +103,12 @@ namespace openvpn {
 	    throw ErrorCode(Error::NETWORK_UNAVAILABLE, true, "Network Unavailable");
 
 	  RemoteList::Ptr remote_list = client_options->remote_list_precache();
+	  if (!resolver_pool)
+	    resolver_pool.reset(new RemoteList::ResolverPool());
 	  RemoteList::PreResolve::Ptr preres(new RemoteList::PreResolve(io_context,
 									remote_list,
-									client_options->stats_ptr()));
+									client_options->stats_ptr(),
+									resolver_pool));
 	  if (preres->work_available())
 	    {
 	      ClientEvent::Base::Ptr ev = new ClientEvent::Resolve();
@@ -138,6 +141,11 @@ namespace openvpn {
 	  halt = true;
 	  if (pre_resolve)
 	    pre_resolve->cancel();
+	  if (resolver_pool)
+	    {
+	      resolver_pool->stop();
+	      resolver_pool.reset();
+	    }
 	  if (client)
 	    {
 	      client->tun_set_disconnect();
@@ -658,6 +666,7 @@ namespace openvpn {
     bool conn_timer_pending;
     std::unique_ptr<AsioWork> asio_work;
     RemoteList::PreResolve::Ptr pre_resolve;
+    RemoteList::ResolverPool::Ptr resolver_pool;
   };
 
 }
@@ -56,6 +56,7 @@ namespace openvpn {
       RESUME,
       RELAY,
       UNSUPPORTED_FEATURE,
+      PATH_MTU,
 
       // start of nonfatal errors, must be marked by NONFATAL_ERROR_START below
       TRANSPORT_ERROR,
@@ -109,6 +110,7 @@ namespace openvpn {
 	"RESUME",
 	"RELAY",
 	"UNSUPPORTED_FEATURE",
+	"PATH_MTU",
 
 	// nonfatal errors
 	"TRANSPORT_ERROR",
@@ -320,6 +322,20 @@ namespace openvpn {
       }
     };
 
+    struct PathMTU : public Base
+    {
+      PathMTU(const unsigned int pmtu_arg)
+	: Base(PATH_MTU),
+	  pmtu(pmtu_arg) {}
+
+      unsigned int pmtu; // IP packet size to the server, including IP/UDP headers
+
+      virtual std::string render() const
+      {
+	return std::to_string(pmtu);
+      }
+    };
+
     struct ReasonBase : public Base {
       ReasonBase(const Type id, const std::string& reason_arg)
 	: Base(id),
@@ -136,6 +136,9 @@ namespace openvpn {
       bool tun_persist = false;
       bool google_dns_fallback = false;
       bool synchronous_dns_lookup = false;
+      unsigned int race_endpoints = 0;
+      bool io_uring = false;
+      bool pmtud = false;
       std::string private_key_password;
       bool disable_client_cert = false;
       int ssl_debug_level = 0;
@@ -183,6 +186,9 @@ namespace openvpn {
 	port_override(config.port_override),
 	proto_override(config.proto_override),
 	conn_timeout_(config.conn_timeout),
+	race_endpoints(config.race_endpoints),
+	io_uring(config.io_uring),
+	pmtud(config.pmtud),
 	tcp_queue_limit(64),
 	proto_context_options(config.proto_context_options),
 	http_proxy_options(config.http_proxy_options),
@@ -354,6 +360,7 @@ namespace openvpn {
 	    tunconf->frame = frame;
 	    tunconf->stats = cli_stats;
 	    tunconf->tun_prop.remote_list = remote_list;
+	    tunconf->io_uring = config.io_uring;
 	    tun_factory = tunconf;
 #if defined(OPENVPN_PLATFORM_IPHONE)
 	    tunconf->retain_sd = true;
@@ -381,6 +388,7 @@ namespace openvpn {
 	    tunconf->tun_prop.remote_list = remote_list;
 	    tunconf->frame = frame;
 	    tunconf->stats = cli_stats;
+	    tunconf->io_uring = config.io_uring;
 	    if (config.tun_persist)
 	      tunconf->tun_persist.reset(new TunLinux::TunPersist(true, false, nullptr));
 	    tunconf->load(opt);
@@ -577,6 +585,14 @@ namespace openvpn {
       // not persist across client instantiations.
       cli_config->proto_context_config.reset(new Client::ProtoConfig(proto_config_cached(relay_mode)));
 
+      // TLS sessions are cached by the SSL factory, which outlives the
+      // client instance, and resumed per remote server.
+      {
+	std::string host, port;
+	remote_list->endpoint_available(&host, &port, nullptr);
+	cli_config->proto_context_config->ssl_session_key = host + ':' + port;
+      }
+
       cli_config->proto_context_options = proto_context_options;
       cli_config->push_base = push_base;
       cli_config->transport_factory = transport_factory;
@@ -718,6 +734,7 @@ namespace openvpn {
       cp->now = &now_;
       cp->rng = rng;
       cp->prng = prng;
+      cp->pmtud = config.pmtud;
 
       return cp;
     }
@@ -800,6 +817,10 @@ namespace openvpn {
 	      udpconf->stats = cli_stats;
 	      udpconf->socket_protect = socket_protect;
 	      udpconf->server_addr_float = server_addr_float;
+	      if (race_endpoints)
+		udpconf->race_endpoints = race_endpoints;
+	      udpconf->io_uring = io_uring;
+	      udpconf->pmtud = pmtud;
 #ifdef OPENVPN_GREMLIN
 	      udpconf->gremlin_config = gremlin_config;
 #endif
@@ -854,6 +875,9 @@ namespace openvpn {
     std::string port_override;
     Protocol proto_override;
     int conn_timeout_;
+    unsigned int race_endpoints;
+    bool io_uring;
+    bool pmtud;
     unsigned int tcp_queue_limit;
     ProtoContextOptions::Ptr proto_context_options;
     HTTPProxyTransport::Options::Ptr http_proxy_options;
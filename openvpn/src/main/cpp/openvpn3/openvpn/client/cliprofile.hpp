@@ -0,0 +1,435 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Compiled client profiles.
+//
+// A compiled profile is the result of parsing and evaluating a client
+// profile: the option list produced by ParseClientConfig::parse() and
+// the summary reported by ClientAPI::OpenVPNClient::eval_config().  It
+// is stored in a flat file which is memory-mapped when loaded, so that
+// evaluating an unchanged profile again skips the profile parser and
+// the evaluation, including the decoding of the certificates and keys
+// done by the latter.
+//
+// Compiled profiles are named after, and validated by, a SHA-256 hash
+// over the profile content, the content list and the library version.
+// A second hash over the body of the file rejects truncated or
+// otherwise damaged files.  Numbers are stored in host byte order, a
+// compiled profile is a cache local to one host.  Saving and loading
+// is not supported on Windows.
+
+#ifndef OPENVPN_CLIENT_CLIPROFILE_H
+#define OPENVPN_CLIENT_CLIPROFILE_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <openvpn/common/platform.hpp>
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>  // for AT_FDCWD
+#include <stdio.h>  // for rename()
+#include <unistd.h> // for getpid(), unlink()
+#endif
+
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/options.hpp>
+#include <openvpn/common/version.hpp>
+#include <openvpn/common/path.hpp>
+#if !defined(OPENVPN_PLATFORM_WIN)
+#include <openvpn/common/scoped_fd.hpp>
+#include <openvpn/common/fileunix.hpp>
+#include <openvpn/common/enumdir.hpp>
+#endif
+#include <openvpn/common/string.hpp>
+#include <openvpn/common/memneq.hpp>
+#include <openvpn/buffer/buffer.hpp>
+#include <openvpn/crypto/hashstr.hpp>
+#include <openvpn/ssl/sslchoose.hpp>
+#include <openvpn/client/cliopthelper.hpp>
+
+namespace openvpn {
+  class CompiledProfile
+  {
+  public:
+    OPENVPN_EXCEPTION(compiled_profile_error);
+
+    enum {
+      HASH_SIZE = 32,   // SHA-256
+      MAX_SIZE = 1024*1024*16,
+      MAX_FILES = 16,   // compiled profiles kept in a directory
+      MAX_AGE = 60*60*24*30, // seconds a compiled profile is kept unused
+    };
+
+    // The part of ParseClientConfig which eval_config() reports
+    struct Summary
+    {
+      Summary() {}
+
+      Summary(const ParseClientConfig& cc)
+	: message(cc.message()),
+	  userlockedUsername(cc.userlockedUsername()),
+	  profileName(cc.profileName()),
+	  friendlyName(cc.friendlyName()),
+	  staticChallenge(cc.staticChallenge()),
+	  autologin(cc.autologin()),
+	  externalPki(cc.externalPki()),
+	  staticChallengeEcho(cc.staticChallengeEcho()),
+	  privateKeyPasswordRequired(cc.privateKeyPasswordRequired()),
+	  allowPasswordSave(cc.allowPasswordSave()),
+	  firstRemoteListItem(cc.firstRemoteListItem()),
+	  serverList(cc.serverList())
+      {
+      }
+
+      std::string message;
+      std::string userlockedUsername;
+      std::string profileName;
+      std::string friendlyName;
+      std::string staticChallenge;
+      bool autologin = false;
+      bool externalPki = false;
+      bool staticChallengeEcho = false;
+      bool privateKeyPasswordRequired = false;
+      bool allowPasswordSave = false;
+      ParseClientConfig::RemoteItem firstRemoteListItem;
+      ParseClientConfig::ServerList serverList;
+    };
+
+    // Hash identifying a profile, call before content_list is preprocessed.
+    static std::string source_hash(const std::string& content,
+				   const OptionList::KeyValueList* content_list)
+    {
+      CryptoDigestFactory<SSLLib::CryptoAPI> digest_factory;
+      HashString h(digest_factory, CryptoAlgs::SHA256);
+      update_string(h, MAGIC);
+      update_string(h, OPENVPN_VERSION);
+      update_string(h, content);
+      if (content_list)
+	{
+	  for (auto &kv : *content_list)
+	    {
+	      update_string(h, kv->key);
+	      update_string(h, kv->value);
+	    }
+	}
+      return h.final_hex();
+    }
+
+    // Path of the compiled profile with the given source hash in dir
+    static std::string filename(const std::string& dir, const std::string& hash)
+    {
+      return path::join(dir, hash + ".ovpnc");
+    }
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+    // Atomically write a compiled profile
+    static void save(const std::string& fn,
+		     const std::string& hash,
+		     const OptionList& options,
+		     const Summary& summary)
+    {
+      BufferAllocated body(4096, BufferAllocated::GROW);
+
+      write_u32(body, options.size());
+      for (auto &o : options)
+	{
+	  write_u32(body, o.touched());
+	  write_u32(body, o.size());
+	  for (size_t i = 0; i < o.size(); ++i)
+	    write_string(body, o.ref(i));
+	}
+
+      write_string(body, summary.message);
+      write_string(body, summary.userlockedUsername);
+      write_string(body, summary.profileName);
+      write_string(body, summary.friendlyName);
+      write_string(body, summary.staticChallenge);
+      write_u32(body, summary.autologin);
+      write_u32(body, summary.externalPki);
+      write_u32(body, summary.staticChallengeEcho);
+      write_u32(body, summary.privateKeyPasswordRequired);
+      write_u32(body, summary.allowPasswordSave);
+      write_string(body, summary.firstRemoteListItem.host);
+      write_string(body, summary.firstRemoteListItem.port);
+      write_string(body, summary.firstRemoteListItem.proto);
+      write_u32(body, summary.serverList.size());
+      for (auto &se : summary.serverList)
+	{
+	  write_string(body, se.server);
+	  write_string(body, se.friendlyName);
+	}
+
+      Header header;
+      std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+      header.byte_order = BYTE_ORDER_MARK;
+      header.body_size = body.size();
+      parse_hex(header.source_hash, hash);
+      body_hash(header.body_hash, body.c_data(), body.size());
+
+      BufferAllocated file(sizeof(header) + body.size(), 0);
+      file.write(&header, sizeof(header));
+      file.write(body.c_data(), body.size());
+
+      // write to a temporary file, then move into position
+      const std::string tfn = fn + '.' + std::to_string(::getpid()) + ".tmp";
+      write_binary_unix(tfn, 0600, 0, file);
+      if (::rename(tfn.c_str(), fn.c_str()) == -1)
+	{
+	  const int eno = errno;
+	  ::unlink(tfn.c_str());
+	  OPENVPN_THROW(compiled_profile_error, "error moving '" << tfn << "' -> '" << fn << "' : " << strerror_str(eno));
+	}
+    }
+
+    // Load the compiled profile fn into options and summary, return
+    // false if it doesn't exist.  Throws if it exists but is not valid
+    // for the given source hash, options and summary are undefined then.
+    static bool load(const std::string& fn,
+		     const std::string& hash,
+		     OptionList& options,
+		     Summary& summary)
+    {
+      MappedFile mf;
+      if (!mf.open(fn))
+	return false;
+
+      ConstBuffer file((const unsigned char *)mf.data(), mf.size(), true);
+      Header header;
+      file.read(&header, sizeof(header));
+      unsigned char sh[HASH_SIZE];
+      parse_hex(sh, hash);
+      if (std::memcmp(header.magic, MAGIC, sizeof(header.magic))
+	  || header.byte_order != BYTE_ORDER_MARK
+	  || header.body_size != file.size()
+	  || crypto::memneq(header.source_hash, sh, HASH_SIZE))
+	throw compiled_profile_error(fn + " : not a compiled profile of this profile");
+
+      unsigned char bh[HASH_SIZE];
+      body_hash(bh, file.c_data(), file.size());
+      if (crypto::memneq(header.body_hash, bh, HASH_SIZE))
+	throw compiled_profile_error(fn + " : body hash mismatch");
+
+      options.clear();
+      const std::uint32_t n_options = read_u32(file);
+      options.reserve(n_options);
+      for (std::uint32_t i = 0; i < n_options; ++i)
+	{
+	  Option o;
+	  const bool touched = read_u32(file);
+	  const std::uint32_t n_args = read_u32(file);
+	  o.reserve(n_args);
+	  for (std::uint32_t j = 0; j < n_args; ++j)
+	    o.push_back(read_string(file));
+	  if (touched)
+	    o.touch();
+	  options.push_back(std::move(o));
+	}
+      options.update_map();
+
+      summary.message = read_string(file);
+      summary.userlockedUsername = read_string(file);
+      summary.profileName = read_string(file);
+      summary.friendlyName = read_string(file);
+      summary.staticChallenge = read_string(file);
+      summary.autologin = read_u32(file);
+      summary.externalPki = read_u32(file);
+      summary.staticChallengeEcho = read_u32(file);
+      summary.privateKeyPasswordRequired = read_u32(file);
+      summary.allowPasswordSave = read_u32(file);
+      summary.firstRemoteListItem.host = read_string(file);
+      summary.firstRemoteListItem.port = read_string(file);
+      summary.firstRemoteListItem.proto = read_string(file);
+      summary.serverList.clear();
+      const std::uint32_t n_servers = read_u32(file);
+      for (std::uint32_t i = 0; i < n_servers; ++i)
+	{
+	  ParseClientConfig::ServerEntry se;
+	  se.server = read_string(file);
+	  se.friendlyName = read_string(file);
+	  summary.serverList.push_back(std::move(se));
+	}
+
+      if (file.size())
+	throw compiled_profile_error(fn + " : trailing data");
+      return true;
+    }
+
+    // Compiled profiles of edited or deleted profiles are never loaded
+    // again.  After saving keep, remove the compiled profiles and
+    // leftover temporary files in dir that were not written for
+    // MAX_AGE seconds, and the oldest ones beyond MAX_FILES.
+    static void prune(const std::string& dir, const std::string& keep)
+    {
+      const std::time_t now = std::time(nullptr);
+      std::vector<std::pair<std::time_t, std::string>> files;
+      enum_dir(dir, [&](std::string name) {
+	  if (!string::ends_with(name, ".ovpnc") && !string::ends_with(name, ".tmp"))
+	    return;
+	  std::string fn = path::join(dir, name);
+	  struct stat st;
+	  if (fn == keep || ::lstat(fn.c_str(), &st) == -1 || !S_ISREG(st.st_mode))
+	    return;
+	  if (now - st.st_mtime > MAX_AGE)
+	    ::unlink(fn.c_str());
+	  else if (string::ends_with(name, ".ovpnc"))
+	    files.emplace_back(st.st_mtime, std::move(fn));
+	});
+
+      if (files.size() >= MAX_FILES)
+	{
+	  std::sort(files.begin(), files.end());
+	  for (size_t i = 0; i <= files.size() - MAX_FILES; ++i)
+	    ::unlink(files[i].second.c_str());
+	}
+    }
+
+    // Mark a loaded compiled profile as used, so that prune() keeps it
+    static void touch(const std::string& fn)
+    {
+      ::utimensat(AT_FDCWD, fn.c_str(), nullptr, 0);
+    }
+#endif
+
+  private:
+    static constexpr const char *MAGIC = "OVPNCPF1";
+    static constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    struct Header
+    {
+      char magic[8];
+      std::uint32_t byte_order;
+      std::uint32_t body_size;
+      unsigned char source_hash[HASH_SIZE];
+      unsigned char body_hash[HASH_SIZE];
+    };
+
+#if !defined(OPENVPN_PLATFORM_WIN)
+    // read-only private mapping of a whole file
+    class MappedFile
+    {
+    public:
+      ~MappedFile()
+      {
+	if (addr)
+	  ::munmap(addr, size_);
+      }
+
+      bool open(const std::string& fn)
+      {
+	ScopedFD fd(::open(fn.c_str(), O_RDONLY|O_CLOEXEC));
+	if (!fd.defined())
+	  {
+	    const int eno = errno;
+	    if (eno == ENOENT)
+	      return false;
+	    throw compiled_profile_error(fn + " : open for read : " + strerror_str(eno));
+	  }
+
+	struct stat st;
+	if (::fstat(fd(), &st) == -1)
+	  {
+	    const int eno = errno;
+	    throw compiled_profile_error(fn + " : stat : " + strerror_str(eno));
+	  }
+	if (st.st_size < off_t(sizeof(Header)) || st.st_size > MAX_SIZE)
+	  throw compiled_profile_error(fn + " : bad size");
+
+	void *a = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd(), 0);
+	if (a == MAP_FAILED)
+	  {
+	    const int eno = errno;
+	    throw compiled_profile_error(fn + " : mmap : " + strerror_str(eno));
+	  }
+	addr = a;
+	size_ = st.st_size;
+	return true;
+      }
+
+      const void *data() const { return addr; }
+      size_t size() const { return size_; }
+
+    private:
+      void *addr = nullptr;
+      size_t size_ = 0;
+    };
+#endif
+
+    static void update_string(HashString& h, const std::string& str)
+    {
+      const std::uint32_t len = str.length();
+      h.update(std::string((const char *)&len, sizeof(len)));
+      h.update(str);
+    }
+
+    static void body_hash(unsigned char *out, const unsigned char *data, const size_t size)
+    {
+      CryptoDigestFactory<SSLLib::CryptoAPI> digest_factory;
+      DigestInstance::Ptr d = digest_factory.new_digest(CryptoAlgs::SHA256);
+      d->update(data, size);
+      d->final(out);
+    }
+
+    static void parse_hex(unsigned char *out, const std::string& hash)
+    {
+      std::vector<unsigned char> v;
+      openvpn::parse_hex(v, hash);
+      if (v.size() != HASH_SIZE)
+	throw compiled_profile_error("bad profile hash");
+      std::memcpy(out, v.data(), HASH_SIZE);
+    }
+
+    static void write_u32(Buffer& buf, const size_t value)
+    {
+      const std::uint32_t v = value;
+      buf.write(&v, sizeof(v));
+    }
+
+    static void write_string(Buffer& buf, const std::string& str)
+    {
+      write_u32(buf, str.length());
+      buf.write(str.c_str(), str.length());
+    }
+
+    static std::uint32_t read_u32(ConstBuffer& buf)
+    {
+      std::uint32_t v;
+      buf.read(&v, sizeof(v));
+      return v;
+    }
+
+    static std::string read_string(ConstBuffer& buf)
+    {
+      const std::uint32_t len = read_u32(buf);
+      const unsigned char *p = buf.read_alloc(len);
+      return std::string((const char *)p, len);
+    }
+  };
+}
+
+#endif
@@ -49,6 +49,7 @@
 #include <openvpn/common/count.hpp>
 #include <openvpn/common/string.hpp>
 #include <openvpn/common/base64.hpp>
+#include <openvpn/common/bigmutex.hpp>
 #include <openvpn/ip/ptb.hpp>
 #include <openvpn/tun/client/tunbase.hpp>
 #include <openvpn/transport/client/transbase.hpp>
@@ -63,6 +64,7 @@
 #include <openvpn/time/coarsetime.hpp>
 #include <openvpn/time/durhelper.hpp>
 #include <openvpn/error/excode.hpp>
+#include <openvpn/log/latencytrace.hpp>
 
 #include <openvpn/ssl/proto.hpp>
 
@@ -288,6 +290,10 @@ namespace openvpn {
 	      ClientEvent::Base::Ptr ev = new ClientEvent::Connecting();
 	      cli_events->add_event(std::move(ev));
 	      first_packet_received_ = true;
+
+	      // the transport may have settled on a different server
+	      // address (and family) than the one it started with
+	      Base::set_protocol(transport->transport_protocol());
 	    }
 
 	  // get packet type
@@ -296,6 +302,8 @@ namespace openvpn {
 	  // process packet
 	  if (pt.is_data())
 	    {
+	      LatencyTrace::Span span(LatencyTrace::TRANSPORT_RECV, buf.size());
+
 	      // data packet
 	      Base::data_decrypt(pt, buf);
 	      if (buf.size())
@@ -307,6 +315,7 @@ namespace openvpn {
 		  if (tun)
 		    {
 		      OPENVPN_LOG_CLIPROTO("TUN send, size=" << buf.size());
+		      LatencyTrace::Span tun_span(LatencyTrace::TUN_WRITE, buf.size());
 		      tun->tun_send(buf);
 		    }
 		}
@@ -355,6 +364,7 @@ namespace openvpn {
       {
 	try {
 	  OPENVPN_LOG_CLIPROTO("TUN recv, size=" << buf.size());
+	  LatencyTrace::Span span(LatencyTrace::TUN_READ, buf.size());
 
 	  // update current time
 	  Base::update_now();
@@ -390,6 +400,7 @@ namespace openvpn {
 		  {
 		    // send packet via transport to destination
 		    OPENVPN_LOG_CLIPROTO("Transport SEND " << server_endpoint_render() << ' ' << Base::dump_packet(buf));
+		    LatencyTrace::Span send_span(LatencyTrace::TRANSPORT_SEND, buf.size());
 		    if (transport->transport_send(buf))
 		      Base::update_last_sent();
 		    else if (halt)
@@ -859,6 +870,18 @@ namespace openvpn {
 	schedule_push_request_callback(Time::Duration::seconds(0));
       }
 
+      // base class calls here when path MTU discovery finds a new PLPMTU
+      virtual void plpmtu_changed(const unsigned int plpmtu)
+      {
+	const ProtoContext::Config& c = Base::conf();
+	const unsigned int pmtu = plpmtu + sizeof(struct UDPHeader)
+	  + (c.protocol.is_ipv6() ? sizeof(struct IPv6Header) : sizeof(struct IPv4Header));
+	OPENVPN_LOG("Path MTU " << pmtu << " (tun packets up to " << c.mss_inter << ')');
+	transport->transport_pmtud_probe(Base::pmtud_probe_df());
+	ClientEvent::Base::Ptr ev = new ClientEvent::PathMTU(pmtu);
+	cli_events->add_event(std::move(ev));
+      }
+
       void housekeeping_callback(const openvpn_io::error_code& e)
       {
 	try {
@@ -29,10 +29,17 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <utility>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <thread>
 
 #include <openvpn/io/io.hpp>
+#include <openvpn/asio/asiowork.hpp>
 
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/rc.hpp>
@@ -258,6 +265,88 @@ namespace openvpn {
 
     typedef RCPtr<RemoteList> Ptr;
 
+    // Bounded pool of threads for the blocking host lookups of
+    // PreResolve, owned by the client.  A lookup cannot be cancelled
+    // once getaddrinfo() runs, so rather than a thread per lookup,
+    // which piles up threads while a dead resolver hangs, the pool
+    // never runs more than max_threads.  Further lookups wait in a
+    // queue.  stop() drops the queue and joins the threads, which
+    // may wait for a lookup in progress to time out.
+    class ResolverPool : public RC<thread_unsafe_refcount>
+    {
+    public:
+      typedef RCPtr<ResolverPool> Ptr;
+
+      ResolverPool(const size_t max_threads_arg = 8)
+	: max_threads(std::max(max_threads_arg, size_t(1)))
+      {
+      }
+
+      ~ResolverPool()
+      {
+	stop();
+      }
+
+      // Run lookup on a pool thread.  Ignored after stop().
+      void post(std::function<void()> lookup)
+      {
+	{
+	  std::lock_guard<std::mutex> lock(mutex);
+	  if (halt)
+	    return;
+	  jobs.push_back(std::move(lookup));
+	  if (jobs.size() > n_idle && threads.size() < max_threads)
+	    threads.emplace_back([this]() { run(); });
+	}
+	cond.notify_one();
+      }
+
+      void stop()
+      {
+	{
+	  std::lock_guard<std::mutex> lock(mutex);
+	  halt = true;
+	  jobs.clear();
+	}
+	cond.notify_all();
+	for (auto &t : threads)
+	  t.join();
+	threads.clear();
+      }
+
+      size_t n_threads() const
+      {
+	return threads.size();
+      }
+
+    private:
+      void run()
+      {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true)
+	  {
+	    ++n_idle;
+	    cond.wait(lock, [this]() { return halt || !jobs.empty(); });
+	    --n_idle;
+	    if (halt)
+	      return;
+	    std::function<void()> lookup = std::move(jobs.front());
+	    jobs.pop_front();
+	    lock.unlock();
+	    lookup();
+	    lock.lock();
+	  }
+      }
+
+      const size_t max_threads;
+      std::mutex mutex;
+      std::condition_variable cond;
+      std::deque<std::function<void()>> jobs;
+      std::vector<std::thread> threads;
+      size_t n_idle = 0;
+      bool halt = false;
+    };
+
     // Helper class used to pre-resolve all items in remote list.
     // This is useful in tun_persist mode, where it may be necessary
     // to pre-resolve all potential remote server items prior
@@ -275,13 +364,20 @@ namespace openvpn {
 
       PreResolve(openvpn_io::io_context& io_context_arg,
 		 const RemoteList::Ptr& remote_list_arg,
-		 const SessionStats::Ptr& stats_arg)
-	:  resolver(io_context_arg),
+		 const SessionStats::Ptr& stats_arg,
+		 const ResolverPool::Ptr& resolver_pool_arg)
+	:  io_context(io_context_arg),
 	   notify_callback(nullptr),
 	   remote_list(remote_list_arg),
 	   stats(stats_arg),
-	   index(0)
+	   resolver_pool(resolver_pool_arg),
+	   n_pending(0)
+      {
+      }
+
+      ~PreResolve()
       {
+	cancel();
       }
 
       bool work_available() const
@@ -300,7 +396,9 @@ namespace openvpn {
 	      {
 		notify_callback = notify_callback_arg;
 		remote_list->index.reset();
-		index = 0;
+		batch.reset(new Batch(this, io_context));
+		asio_work.reset(new AsioWork(io_context)); // lookups run outside of io_context
+		queue_hosts();
 		next();
 	      }
 	    else
@@ -311,44 +409,122 @@ namespace openvpn {
       void cancel()
       {
 	notify_callback = nullptr;
-	index = 0;
-	resolver.cancel();
+	queue.clear();
+	n_pending = 0;
+	if (batch)
+	  {
+	    std::lock_guard<std::mutex> lock(batch->mutex);
+	    batch->owner = nullptr;
+	  }
+	batch.reset();
+	asio_work.reset();
       }
 
     private:
-      void next()
+      // A single host lookup, run on a ResolverPool thread.
+      struct Job
       {
-	while (index < remote_list->list.size())
+	typedef std::shared_ptr<Job> Ptr;
+
+	std::string host;
+	std::string port;
+	openvpn_io::error_code error;
+	openvpn_io::ip::tcp::resolver::results_type results;
+      };
+
+      // State shared with the lookups of one start() call.  owner
+      // is cleared on cancel: queued lookups are skipped and results
+      // of lookups in progress are discarded.
+      struct Batch
+      {
+	typedef std::shared_ptr<Batch> Ptr;
+
+	Batch(PreResolve* owner_arg, openvpn_io::io_context& io_context_arg)
+	  : owner(owner_arg),
+	    io_context(io_context_arg)
+	{
+	}
+
+	std::mutex mutex;
+	PreResolve* owner;
+	openvpn_io::io_context& io_context;
+      };
+
+      // Collect the distinct uncached hosts of the remote list.
+      // Items sharing a host with an already resolved item reuse
+      // its address list.
+      void queue_hosts()
+      {
+	for (auto &e : remote_list->list)
 	  {
-	    Item& item = *remote_list->list[index];
+	    Item& item = *e;
+	    if (item.res_addr_list_defined())
+	      continue;
 
-	    // try to resolve item if no cached data present
-	    if (!item.res_addr_list_defined())
+	    const Item* sitem = remote_list->search_server_host(item.server_host);
+	    if (sitem)
 	      {
-		// next item to resolve
-		const Item* sitem = remote_list->search_server_host(item.server_host);
-		if (sitem)
-		  {
-		    // item's server_host matches one previously resolved -- use it
-		    OPENVPN_LOG_REMOTELIST("*** PreResolve USED CACHE for " << item.server_host);
-		    item.res_addr_list = sitem->res_addr_list;
-		  }
-		else
-		  {
-		    // call into Asio to do the resolve operation
-		    OPENVPN_LOG_REMOTELIST("*** PreResolve RESOLVE on " << item.server_host << " : " << item.server_port);
-		    resolver.async_resolve(item.server_host, item.server_port,
-					   [self=Ptr(this)](const openvpn_io::error_code& error, openvpn_io::ip::tcp::resolver::results_type results)
-					   {
-					     OPENVPN_ASYNC_HANDLER;
-					     self->resolve_callback(error, results);
-					   });
+		OPENVPN_LOG_REMOTELIST("*** PreResolve USED CACHE for " << item.server_host);
+		item.res_addr_list = sitem->res_addr_list;
+		continue;
+	      }
+
+	    const bool queued = std::any_of(queue.begin(), queue.end(),
+					    [&item](const Job::Ptr& job) { return job->host == item.server_host; });
+	    if (!queued)
+	      {
+		Job::Ptr job(new Job());
+		job->host = item.server_host;
+		job->port = item.server_port;
+		queue.push_back(std::move(job));
+	      }
+	  }
+      }
+
+      // Hand all lookups to the resolver pool, which runs as many
+      // at once as it has threads, and notify the client once all
+      // of them have completed.
+      void next()
+      {
+	while (!queue.empty())
+	  {
+	    Job::Ptr job = std::move(queue.front());
+	    queue.pop_front();
+	    ++n_pending;
+
+	    // Asio serializes async_resolve through a single resolver
+	    // thread per io_context, hence the pool.
+	    OPENVPN_LOG_REMOTELIST("*** PreResolve RESOLVE on " << job->host << " : " << job->port);
+	    resolver_pool->post([batch=batch, job=std::move(job)]() {
+		{
+		  std::lock_guard<std::mutex> lock(batch->mutex);
+		  if (!batch->owner)
 		    return;
+		}
+
+		try {
+		  openvpn_io::io_context lookup_context(1);
+		  openvpn_io::ip::tcp::resolver resolver(lookup_context);
+		  job->results = resolver.resolve(job->host, job->port, job->error);
+		}
+		catch (const std::exception&)
+		  {
+		    job->error = openvpn_io::error::host_not_found;
 		  }
-	      }
-	    ++index;
+
+		std::lock_guard<std::mutex> lock(batch->mutex);
+		if (batch->owner)
+		  openvpn_io::post(batch->io_context, [batch, job]() {
+		      OPENVPN_ASYNC_HANDLER;
+		      if (batch->owner)
+			batch->owner->resolve_callback(*job);
+		    });
+	      });
 	  }
 
+	if (n_pending)
+	  return;
+
 	// Done resolving list.  Prune out all entries we were unable to
 	// resolve unless doing so would result in an empty list.
 	// Then call client's callback method.
@@ -361,22 +537,34 @@ namespace openvpn {
 	}
       }
 
-      // callback on resolve completion
-      void resolve_callback(const openvpn_io::error_code& error,
-			    openvpn_io::ip::tcp::resolver::results_type results)
+      // callback on resolve completion, runs on io_context thread
+      void resolve_callback(const Job& job)
       {
-	if (notify_callback && index < remote_list->list.size())
+	if (notify_callback && n_pending)
 	  {
-	    Item& item = *remote_list->list[index++];
-	    if (!error)
+	    --n_pending;
+	    if (!job.error)
 	      {
-		// resolve succeeded
-		item.set_endpoint_range(results, remote_list->rng.get());
+		// resolve succeeded, share the result with all items using this host
+		ResolvedAddrList::Ptr res_addr_list;
+		for (auto &e : remote_list->list)
+		  {
+		    Item& item = *e;
+		    if (item.server_host != job.host || item.res_addr_list_defined())
+		      continue;
+		    if (res_addr_list)
+		      item.res_addr_list = res_addr_list;
+		    else
+		      {
+			item.set_endpoint_range(job.results, remote_list->rng.get());
+			res_addr_list = item.res_addr_list;
+		      }
+		  }
 	      }
 	    else
 	      {
 		// resolve failed
-		OPENVPN_LOG("DNS pre-resolve error on " << item.server_host << ": " << error.message());
+		OPENVPN_LOG("DNS pre-resolve error on " << job.host << ": " << job.error.message());
 		if (stats)
 		  stats->error(Error::RESOLVE_ERROR);
 	      }
@@ -384,11 +572,15 @@ namespace openvpn {
 	  }
       }
 
-      openvpn_io::ip::tcp::resolver resolver;
+      openvpn_io::io_context& io_context;
       NotifyCallback* notify_callback;
       RemoteList::Ptr remote_list;
       SessionStats::Ptr stats;
-      size_t index;
+      ResolverPool::Ptr resolver_pool;
+      size_t n_pending;
+      std::deque<Job::Ptr> queue;
+      Batch::Ptr batch;
+      std::unique_ptr<AsioWork> asio_work;
     };
 
     // create an empty remote list
@@ -646,6 +838,38 @@ namespace openvpn {
 	throw remote_list_error("current remote server endpoint is undefined");
     }
 
+    // Get up to max_endpoints endpoints of the current remote item for
+    // racing connection attempts, beginning with the one returned by
+    // get_endpoint().  Address families are interleaved as recommended
+    // by RFC 8305 so that one broken family doesn't starve the other.
+    template <class EP>
+    void get_race_endpoints(std::vector<EP>& endpoints, const size_t max_endpoints) const
+    {
+      const Item& item = *list[primary_index()];
+      endpoints.clear();
+      if (!item.res_addr_list)
+	return;
+
+      std::deque<size_t> same, other;
+      const ResolvedAddrList& ral = *item.res_addr_list;
+      for (size_t i = index.secondary(); i < ral.size(); ++i)
+	{
+	  if (ral[i]->addr.version() == ral[index.secondary()]->addr.version())
+	    same.push_back(i);
+	  else
+	    other.push_back(i);
+	}
+
+      while (endpoints.size() < max_endpoints && (!same.empty() || !other.empty()))
+	{
+	  std::deque<size_t>& from = (endpoints.size() % 2 == 0 && !same.empty()) || other.empty() ? same : other;
+	  EP ep;
+	  item.get_endpoint(ep, from.front());
+	  from.pop_front();
+	  endpoints.push_back(std::move(ep));
+	}
+    }
+
     // return true if object has at least one connection entry
     bool defined() const { return list.size() > 0; }
 
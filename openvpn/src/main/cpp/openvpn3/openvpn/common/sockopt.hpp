@@ -67,6 +67,31 @@ namespace openvpn {
 	throw Exception("error setting TCP_NODELAY on socket");
     }
 
+#if defined(IP_MTU_DISCOVER) && defined(IPV6_MTU_DISCOVER)
+    // get the path MTU discovery mode (IP_PMTUDISC_x) of a UDP socket
+    inline int mtu_discover(const int fd, const bool ipv6)
+    {
+      int val = 0;
+      socklen_t len = sizeof(val);
+      if (::getsockopt(fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+		       ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER,
+		       (void *)&val, &len) < 0)
+	throw Exception("error getting IP_MTU_DISCOVER on socket");
+      return val;
+    }
+
+    // set the path MTU discovery mode of a UDP socket, e.g.
+    // IP_PMTUDISC_PROBE to set DF and never fragment locally, not
+    // even to honor a cached path MTU
+    inline void set_mtu_discover(const int fd, const bool ipv6, int val)
+    {
+      if (::setsockopt(fd, ipv6 ? IPPROTO_IPV6 : IPPROTO_IP,
+		       ipv6 ? IPV6_MTU_DISCOVER : IP_MTU_DISCOVER,
+		       (void *)&val, sizeof(val)) < 0)
+	throw Exception("error setting IP_MTU_DISCOVER on socket");
+    }
+#endif
+
     // set FD_CLOEXEC to prevent fd from being passed across execs
     inline void set_cloexec(const int fd)
     {
@@ -0,0 +1,855 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Completion-based packet I/O for Linux, using io_uring.
+//
+// One Ring is shared by all users of an io_context.  An Endpoint
+// drives one file descriptor (a UDP socket or a tun device) through
+// it: a single multishot receive keeps delivering packets into a
+// ring of kernel-provided buffers, and writes are copied into a
+// registered buffer arena and queued.  Submissions made while the
+// io_context runs a batch of handlers go to the kernel with one
+// io_uring_enter() call, and completions are reaped in one pass when
+// the ring descriptor becomes readable, so a busy tunnel no longer
+// needs a system call per packet.
+//
+// Requires Linux 6.7 (multishot read).  When the kernel cannot
+// provide what we need, Endpoint::new_obj() returns null and the
+// caller keeps using the asio reactor.
+
+#ifndef OPENVPN_IO_URING_H
+#define OPENVPN_IO_URING_H
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/version.h>
+#include <linux/io_uring.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+#include <utility>
+#include <functional>
+
+#include <openvpn/io/io.hpp>
+
+#include <openvpn/common/rc.hpp>
+#include <openvpn/common/size.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/buffer/buffer.hpp>
+
+#if !defined(IORING_RECV_MULTISHOT)
+#error OPENVPN_IO_URING needs kernel headers from Linux 6.0 or later
+#endif
+
+// Multishot read was added in Linux 6.7; older headers lack the opcode,
+// the running kernel is probed for it anyway.
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,7,0)
+#define OPENVPN_IORING_OP_READ_MULTISHOT 49
+#else
+#define OPENVPN_IORING_OP_READ_MULTISHOT IORING_OP_READ_MULTISHOT
+#endif
+
+namespace openvpn {
+  namespace IoUring {
+
+    OPENVPN_EXCEPTION(io_uring_error);
+
+    class Endpoint;
+
+    // A submitted operation, found again through the user_data of
+    // its completions.
+    struct Op
+    {
+      virtual void complete(const struct io_uring_cqe& cqe) = 0;
+      virtual ~Op() {}
+    };
+
+    class Ring : public RC<thread_unsafe_refcount>
+    {
+      friend class Endpoint;
+
+    public:
+      typedef RCPtr<Ring> Ptr;
+
+      enum {
+	SQ_ENTRIES = 256,
+	CQ_ENTRIES = 4096,   // multishot receives produce many completions per submission
+	N_SLOTS = 512,       // registered write buffers
+	SLOT_SIZE = 2048,
+      };
+
+      explicit Ring(openvpn_io::io_context& io_context_arg)
+	: io_context(io_context_arg)
+      {
+	struct io_uring_params p;
+	std::memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL;
+	p.cq_entries = CQ_ENTRIES;
+	const int fd = (int)::syscall(__NR_io_uring_setup, SQ_ENTRIES, &p);
+	if (fd < 0)
+	  throw io_uring_error(std::string("io_uring_setup: ") + std::strerror(errno));
+	descriptor.reset(new openvpn_io::posix::stream_descriptor(io_context, fd));
+	ring_fd = fd;
+
+	try {
+	  if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP))
+	    throw io_uring_error("kernel too old");
+	  map_rings(p);
+	  probe();
+	  register_arena();
+	}
+	catch (...)
+	  {
+	    unmap();
+	    throw;
+	  }
+      }
+
+      ~Ring()
+      {
+	unmap();
+      }
+
+      // Return the ring of io_context, or null if io_uring cannot
+      // be used.  The reason is logged once per io_context.
+      static Ptr get(openvpn_io::io_context& io_context);
+
+      // Close the ring and drop everything still in flight.  Called
+      // when the io_context shuts down.
+      void shutdown();
+
+    private:
+      struct Slot : public Op
+      {
+	virtual void complete(const struct io_uring_cqe& cqe) override;
+
+	Ring* ring = nullptr;
+	RCPtr<Endpoint> owner;     // keeps the endpoint alive until the write completes
+	Slot* next = nullptr;
+	unsigned char* data = nullptr;
+	size_t size = 0;
+	struct msghdr msg;
+	struct iovec iov;
+	struct sockaddr_storage addr;
+      };
+
+      template <typename T>
+      static T* ring_ptr(void* base, const unsigned int offset)
+      {
+	return reinterpret_cast<T*>(static_cast<unsigned char*>(base) + offset);
+      }
+
+      void map_rings(const struct io_uring_params& p)
+      {
+	ring_size = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned int),
+			     p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+	void* rp = ::mmap(nullptr, ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (rp == MAP_FAILED)
+	  throw io_uring_error(std::string("mmap rings: ") + std::strerror(errno));
+	ring_mem = rp;
+
+	sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	void* sp = ::mmap(nullptr, sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sp == MAP_FAILED)
+	  throw io_uring_error(std::string("mmap sqes: ") + std::strerror(errno));
+	sqes = static_cast<struct io_uring_sqe*>(sp);
+
+	sq_khead = ring_ptr<unsigned int>(ring_mem, p.sq_off.head);
+	sq_ktail = ring_ptr<unsigned int>(ring_mem, p.sq_off.tail);
+	sq_kflags = ring_ptr<unsigned int>(ring_mem, p.sq_off.flags);
+	sq_mask = *ring_ptr<unsigned int>(ring_mem, p.sq_off.ring_mask);
+	sq_entries = p.sq_entries;
+	sq_tail = sq_submitted = *sq_ktail;
+
+	// SQ index array maps one to one onto the SQE array
+	unsigned int* array = ring_ptr<unsigned int>(ring_mem, p.sq_off.array);
+	for (unsigned int i = 0; i < sq_entries; ++i)
+	  array[i] = i;
+
+	cq_khead = ring_ptr<unsigned int>(ring_mem, p.cq_off.head);
+	cq_ktail = ring_ptr<unsigned int>(ring_mem, p.cq_off.tail);
+	cq_mask = *ring_ptr<unsigned int>(ring_mem, p.cq_off.ring_mask);
+	cqes = ring_ptr<struct io_uring_cqe>(ring_mem, p.cq_off.cqes);
+      }
+
+      void probe()
+      {
+	const size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	std::unique_ptr<unsigned char[]> mem(new unsigned char[len]);
+	std::memset(mem.get(), 0, len);
+	struct io_uring_probe* pr = reinterpret_cast<struct io_uring_probe*>(mem.get());
+	if (reg(IORING_REGISTER_PROBE, pr, 256) < 0)
+	  throw io_uring_error(std::string("probe: ") + std::strerror(errno));
+
+	static const unsigned int needed[] = {
+	  IORING_OP_RECVMSG,
+	  IORING_OP_SENDMSG,
+	  IORING_OP_WRITE_FIXED,
+	  OPENVPN_IORING_OP_READ_MULTISHOT,
+	  IORING_OP_ASYNC_CANCEL,
+	};
+	for (const unsigned int op : needed)
+	  {
+	    if (op > pr->last_op || !(pr->ops[op].flags & IO_URING_OP_SUPPORTED))
+	      throw io_uring_error("kernel lacks opcode " + std::to_string(op));
+	  }
+      }
+
+      // One registered iovec holds all write slots, so every write
+      // can use buffer index 0.
+      void register_arena()
+      {
+	arena_size = N_SLOTS * SLOT_SIZE;
+	void* a = ::mmap(nullptr, arena_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (a == MAP_FAILED)
+	  throw io_uring_error(std::string("mmap arena: ") + std::strerror(errno));
+	arena = static_cast<unsigned char*>(a);
+
+	struct iovec iov;
+	iov.iov_base = arena;
+	iov.iov_len = arena_size;
+	if (reg(IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+	  throw io_uring_error(std::string("register buffers: ") + std::strerror(errno));
+
+	slots.reset(new Slot[N_SLOTS]);
+	for (size_t i = 0; i < N_SLOTS; ++i)
+	  {
+	    Slot& s = slots[i];
+	    s.ring = this;
+	    s.data = arena + i * SLOT_SIZE;
+	    s.next = free_slots;
+	    free_slots = &s;
+	  }
+      }
+
+      void unmap()
+      {
+	if (arena)
+	  {
+	    ::munmap(arena, arena_size);
+	    arena = nullptr;
+	  }
+	if (sqes)
+	  {
+	    ::munmap(sqes, sqes_size);
+	    sqes = nullptr;
+	  }
+	if (ring_mem)
+	  {
+	    ::munmap(ring_mem, ring_size);
+	    ring_mem = nullptr;
+	  }
+      }
+
+      int reg(const unsigned int opcode, void* arg, const unsigned int nr_args)
+      {
+	return (int)::syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+      }
+
+      int enter(const unsigned int to_submit, const unsigned int flags)
+      {
+	return (int)::syscall(__NR_io_uring_enter, ring_fd, to_submit, 0, flags, nullptr, 0);
+      }
+
+      // Return a zeroed SQE, or null if the ring is closed or full.
+      // The SQE goes to the kernel with the next submit(), which runs
+      // after the handlers already queued on the io_context.
+      struct io_uring_sqe* get_sqe()
+      {
+	if (closed)
+	  return nullptr;
+	if (sq_tail - __atomic_load_n(sq_khead, __ATOMIC_ACQUIRE) >= sq_entries)
+	  {
+	    submit();
+	    if (sq_tail - __atomic_load_n(sq_khead, __ATOMIC_ACQUIRE) >= sq_entries)
+	      return nullptr;
+	  }
+	struct io_uring_sqe* sqe = &sqes[sq_tail & sq_mask];
+	std::memset(sqe, 0, sizeof(*sqe));
+	++sq_tail;
+	schedule_submit();
+	return sqe;
+      }
+
+      // Like get_sqe(), but rather than fail when the kernel does not
+      // take the queued submissions, keep pushing them and reaping
+      // the completions that hold them up until an SQE is free.  Only
+      // null if the ring is closed.
+      struct io_uring_sqe* get_sqe_wait()
+      {
+	struct io_uring_sqe* sqe;
+	while (!(sqe = get_sqe()) && !closed)
+	  {
+	    if (__atomic_load_n(sq_kflags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+	      enter(0, IORING_ENTER_GETEVENTS);
+	    reap();
+	  }
+	return sqe;
+      }
+
+      void schedule_submit()
+      {
+	if (!submit_pending)
+	  {
+	    submit_pending = true;
+	    openvpn_io::post(io_context, [self=Ptr(this)]()
+			     {
+			       OPENVPN_ASYNC_HANDLER;
+			       self->submit_pending = false;
+			       self->submit();
+			     });
+	  }
+      }
+
+      void submit()
+      {
+	if (closed)
+	  return;
+	const unsigned int n = sq_tail - sq_submitted;
+	if (!n)
+	  return;
+	__atomic_store_n(sq_ktail, sq_tail, __ATOMIC_RELEASE);
+	const int ret = enter(n, 0);
+	if (ret > 0)
+	  sq_submitted += ret;
+	else if (ret < 0 && (errno == EAGAIN || errno == EBUSY || errno == EINTR))
+	  schedule_submit();
+      }
+
+      // The ring descriptor is only waited on while requests are in
+      // flight, so that an idle ring does not keep io_context::run()
+      // going.
+      void arm_wait()
+      {
+	waiting = true;
+	descriptor->async_wait(openvpn_io::posix::stream_descriptor::wait_read,
+			       [self=Ptr(this)](const openvpn_io::error_code& error)
+			       {
+				 OPENVPN_ASYNC_HANDLER;
+				 self->waiting = false;
+				 if (self->closed)
+				   return;
+				 if (!error)
+				   self->reap();
+				 if (!self->closed && self->inflight)
+				   self->arm_wait();
+			       });
+      }
+
+      // a request that will complete with a CQE was queued
+      void op_started()
+      {
+	++inflight;
+	if (!waiting && !closed)
+	  arm_wait();
+      }
+
+      // its last CQE was reaped
+      void op_done()
+      {
+	if (!--inflight && waiting && !closed)
+	  descriptor->cancel();
+      }
+
+      // Dispatch the completions present now.  Later ones make the
+      // descriptor readable again and are handled on the next pass,
+      // so a flood of packets cannot starve the other handlers.
+      void reap()
+      {
+	if (__atomic_load_n(sq_kflags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+	  enter(0, IORING_ENTER_GETEVENTS);
+
+	unsigned int head = *cq_khead;
+	const unsigned int tail = __atomic_load_n(cq_ktail, __ATOMIC_ACQUIRE);
+	while (head != tail && !closed)
+	  {
+	    const struct io_uring_cqe cqe = cqes[head & cq_mask];
+	    __atomic_store_n(cq_khead, ++head, __ATOMIC_RELEASE);
+	    if (cqe.user_data)
+	      reinterpret_cast<Op*>(cqe.user_data)->complete(cqe);
+	  }
+      }
+
+      Slot* alloc_slot()
+      {
+	Slot* s = free_slots;
+	if (s)
+	  free_slots = s->next;
+	return s;
+      }
+
+      void free_slot(Slot* s)
+      {
+	s->owner.reset();
+	s->next = free_slots;
+	free_slots = s;
+      }
+
+      unsigned short new_buffer_group()
+      {
+	return next_bgid++;
+      }
+
+      openvpn_io::io_context& io_context;
+      std::unique_ptr<openvpn_io::posix::stream_descriptor> descriptor;
+      int ring_fd = -1;
+      bool closed = false;
+      bool waiting = false;
+      unsigned int inflight = 0;
+      bool submit_pending = false;
+
+      void* ring_mem = nullptr;
+      size_t ring_size = 0;
+      struct io_uring_sqe* sqes = nullptr;
+      size_t sqes_size = 0;
+
+      unsigned int* sq_khead = nullptr;
+      unsigned int* sq_ktail = nullptr;
+      unsigned int* sq_kflags = nullptr;
+      unsigned int sq_mask = 0;
+      unsigned int sq_entries = 0;
+      unsigned int sq_tail = 0;       // next free SQE
+      unsigned int sq_submitted = 0;  // SQEs consumed by the kernel
+
+      unsigned int* cq_khead = nullptr;
+      unsigned int* cq_ktail = nullptr;
+      unsigned int cq_mask = 0;
+      struct io_uring_cqe* cqes = nullptr;
+
+      unsigned char* arena = nullptr;
+      size_t arena_size = 0;
+      std::unique_ptr<Slot[]> slots;
+      Slot* free_slots = nullptr;
+
+      unsigned short next_bgid = 0;
+      std::set<Endpoint*> endpoints;
+    };
+
+    // Packet I/O on one file descriptor.  The descriptor stays owned
+    // by the caller, who must stop() the endpoint before closing it.
+    class Endpoint : public RC<thread_unsafe_refcount>
+    {
+      friend class Ring;
+
+    public:
+      typedef RCPtr<Endpoint> Ptr;
+
+      enum Type {
+	DATAGRAM,  // UDP socket: recvmsg/sendmsg with peer address
+	STREAM,    // tun device: read/write
+      };
+
+      enum {
+	N_BUFS = 256,  // provided receive buffers, a power of 2
+      };
+
+      // Called for each received packet; from is null for STREAM.
+      typedef std::function<void(const unsigned char* data, const size_t size,
+				 const struct sockaddr* from, const socklen_t fromlen)> ReadHandler;
+
+      // Called with an errno value when a read or write fails, or
+      // with 0 after a partial write.
+      typedef std::function<void(const int err, const bool write)> ErrorHandler;
+
+      // Return null if io_uring cannot be used on this io_context.
+      // read_size is the largest packet the caller can accept.
+      static Ptr new_obj(openvpn_io::io_context& io_context,
+			 const int fd,
+			 const Type type,
+			 const size_t read_size)
+      {
+	Ring::Ptr ring = Ring::get(io_context);
+	if (!ring)
+	  return Ptr();
+	try {
+	  return new Endpoint(ring, fd, type, read_size);
+	}
+	catch (const std::exception& e)
+	  {
+	    OPENVPN_LOG("io_uring: cannot use fd " << fd << ", falling back to the reactor: " << e.what());
+	    return Ptr();
+	  }
+      }
+
+      ~Endpoint()
+      {
+	ring->endpoints.erase(this);
+	if (!ring->closed)
+	  {
+	    struct io_uring_buf_reg reg;
+	    std::memset(&reg, 0, sizeof(reg));
+	    reg.bgid = bgid;
+	    ring->reg(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+	  }
+	::munmap(buf_ring, buf_ring_size);
+      }
+
+      void start(ReadHandler read_handler_arg, ErrorHandler error_handler_arg)
+      {
+	read_handler = std::move(read_handler_arg);
+	error_handler = std::move(error_handler_arg);
+	if (!halt && !armed)
+	  arm_read();
+      }
+
+      // Queue a write.  Returns false if the packet could not be
+      // queued (no free slot, or ring closed); the caller should then
+      // write it synchronously.
+      bool write(const Buffer& buf, const struct sockaddr* to, const socklen_t tolen)
+      {
+	const size_t size = buf.size();
+	if (halt || size > Ring::SLOT_SIZE || tolen > sizeof(struct sockaddr_storage))
+	  return false;
+	Ring::Slot* s = ring->alloc_slot();
+	if (!s)
+	  return false;
+	struct io_uring_sqe* sqe = ring->get_sqe();
+	if (!sqe)
+	  {
+	    ring->free_slot(s);
+	    return false;
+	  }
+
+	std::memcpy(s->data, buf.c_data(), size);
+	s->size = size;
+	s->owner.reset(this);
+	if (type == DATAGRAM)
+	  {
+	    std::memset(&s->msg, 0, sizeof(s->msg));
+	    s->iov.iov_base = s->data;
+	    s->iov.iov_len = size;
+	    s->msg.msg_iov = &s->iov;
+	    s->msg.msg_iovlen = 1;
+	    if (to)
+	      {
+		std::memcpy(&s->addr, to, tolen);
+		s->msg.msg_name = &s->addr;
+		s->msg.msg_namelen = tolen;
+	      }
+	    sqe->opcode = IORING_OP_SENDMSG;
+	    sqe->addr = (__u64)(uintptr_t)&s->msg;
+	    sqe->len = 1;
+	  }
+	else
+	  {
+	    sqe->opcode = IORING_OP_WRITE_FIXED;
+	    sqe->addr = (__u64)(uintptr_t)s->data;
+	    sqe->len = (__u32)size;
+	    sqe->buf_index = 0;
+	  }
+	sqe->fd = fd;
+	sqe->user_data = (__u64)(uintptr_t)static_cast<Op*>(s);
+	ring->op_started();
+	return true;
+      }
+
+      // Cancel the pending receive.  No handler is called after this.
+      void stop()
+      {
+	if (!halt)
+	  {
+	    halt = true;
+	    read_handler = nullptr;
+	    error_handler = nullptr;
+	    if (armed)
+	      {
+		Ptr self(this); // get_sqe_wait() may reap our last completion
+		// never drop the cancel, the receive would go on holding
+		// the descriptor and this endpoint; no SQE means the ring
+		// is closed and the receive already gone
+		struct io_uring_sqe* sqe = ring->get_sqe_wait();
+		if (sqe)
+		  {
+		    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		    sqe->addr = (__u64)(uintptr_t)static_cast<Op*>(&read_op);
+		    sqe->fd = -1;
+		  }
+		// the caller is about to close the descriptor
+		ring->submit();
+	      }
+	  }
+      }
+
+    private:
+      struct ReadOp : public Op
+      {
+	virtual void complete(const struct io_uring_cqe& cqe) override
+	{
+	  parent->read_done(cqe);
+	}
+
+	Endpoint* parent = nullptr;
+      };
+
+      Endpoint(const Ring::Ptr& ring_arg,
+	       const int fd_arg,
+	       const Type type_arg,
+	       const size_t read_size)
+	: ring(ring_arg),
+	  fd(fd_arg),
+	  type(type_arg)
+      {
+	read_op.parent = this;
+	hdr_size = type == DATAGRAM ? sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) : 0;
+	buf_size = hdr_size + read_size;
+
+	// kernel-visible ring of buffer descriptors, followed by the buffers
+	const size_t desc_size = N_BUFS * sizeof(struct io_uring_buf);
+	buf_ring_size = desc_size + N_BUFS * buf_size;
+	void* m = ::mmap(nullptr, buf_ring_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (m == MAP_FAILED)
+	  throw io_uring_error(std::string("mmap buffers: ") + std::strerror(errno));
+	buf_ring = static_cast<struct io_uring_buf_ring*>(m);
+	bufs = static_cast<unsigned char*>(m) + desc_size;
+
+	bgid = ring->new_buffer_group();
+	struct io_uring_buf_reg reg;
+	std::memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (__u64)(uintptr_t)buf_ring;
+	reg.ring_entries = N_BUFS;
+	reg.bgid = bgid;
+	if (ring->reg(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	  {
+	    const int err = errno;
+	    ::munmap(buf_ring, buf_ring_size);
+	    throw io_uring_error(std::string("register buffer ring: ") + std::strerror(err));
+	  }
+	for (unsigned int i = 0; i < N_BUFS; ++i)
+	  recycle(i);
+
+	std::memset(&recv_msg, 0, sizeof(recv_msg));
+	recv_msg.msg_namelen = sizeof(struct sockaddr_storage);
+	ring->endpoints.insert(this);
+      }
+
+      void recycle(const unsigned int bid)
+      {
+	// Index from the ring base rather than through buf_ring->bufs:
+	// in C++ the uapi flexible array macro moves bufs to offset 8.
+	struct io_uring_buf* b = reinterpret_cast<struct io_uring_buf*>(buf_ring) + (buf_tail & (N_BUFS - 1));
+	b->addr = (__u64)(uintptr_t)(bufs + bid * buf_size);
+	b->len = (__u32)buf_size;
+	b->bid = (__u16)bid;
+	__atomic_store_n(&buf_ring->tail, ++buf_tail, __ATOMIC_RELEASE);
+      }
+
+      void arm_read()
+      {
+	struct io_uring_sqe* sqe = ring->get_sqe();
+	if (!sqe)
+	  {
+	    if (error_handler)
+	      error_handler(EBUSY, false);
+	    return;
+	  }
+	if (type == DATAGRAM)
+	  {
+	    sqe->opcode = IORING_OP_RECVMSG;
+	    sqe->addr = (__u64)(uintptr_t)&recv_msg;
+	    sqe->ioprio = IORING_RECV_MULTISHOT;
+	  }
+	else
+	  sqe->opcode = OPENVPN_IORING_OP_READ_MULTISHOT;
+	sqe->fd = fd;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+	sqe->user_data = (__u64)(uintptr_t)static_cast<Op*>(&read_op);
+	ring->op_started();
+	armed = true;
+	self_ref.reset(this);
+      }
+
+      void read_done(const struct io_uring_cqe& cqe)
+      {
+	Ptr self(this); // handlers may drop the last outside reference
+	if (cqe.flags & IORING_CQE_F_BUFFER)
+	  {
+	    const unsigned int bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+	    if (cqe.res > 0 && !halt)
+	      deliver(bufs + bid * buf_size, (size_t)cqe.res);
+	    recycle(bid);
+	  }
+	else if (cqe.res < 0 && !halt)
+	  {
+	    // ENOBUFS: we fell behind and the buffer ring ran dry,
+	    // it has been refilled by now
+	    if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED && error_handler)
+	      error_handler(-cqe.res, false);
+	  }
+
+	if (!(cqe.flags & IORING_CQE_F_MORE))
+	  {
+	    ring->op_done();
+	    armed = false;
+	    if (!halt)
+	      arm_read();
+	    if (!armed)
+	      self_ref.reset();
+	  }
+      }
+
+      void deliver(const unsigned char* data, const size_t size)
+      {
+	if (type == DATAGRAM)
+	  {
+	    struct io_uring_recvmsg_out out;
+	    if (size < sizeof(out))
+	      return;
+	    std::memcpy(&out, data, sizeof(out));
+	    if (out.flags & MSG_TRUNC)
+	      {
+		if (error_handler)
+		  error_handler(EMSGSIZE, false);
+		return;
+	      }
+	    const struct sockaddr* from = reinterpret_cast<const struct sockaddr*>(data + sizeof(out));
+	    const socklen_t fromlen = std::min((socklen_t)out.namelen, (socklen_t)sizeof(struct sockaddr_storage));
+	    const size_t payload = hdr_size + recv_msg.msg_controllen;
+	    if (payload + out.payloadlen > size)
+	      return;
+	    read_handler(data + payload, out.payloadlen, from, fromlen);
+	  }
+	else
+	  read_handler(data, size, nullptr, 0);
+      }
+
+      void write_done(const int res, const size_t size)
+      {
+	if (halt || !error_handler)
+	  return;
+	if (res < 0)
+	  error_handler(-res, true);
+	else if ((size_t)res != size)
+	  error_handler(0, true);
+      }
+
+      // the ring is gone, nothing more will complete
+      void ring_closed()
+      {
+	halt = true;
+	armed = false;
+	read_handler = nullptr;
+	error_handler = nullptr;
+	self_ref.reset();
+      }
+
+      Ring::Ptr ring;
+      const int fd;
+      const Type type;
+      bool halt = false;
+      bool armed = false;
+      Ptr self_ref;       // held while the multishot receive is armed
+      ReadOp read_op;
+
+      ReadHandler read_handler;
+      ErrorHandler error_handler;
+
+      struct msghdr recv_msg;
+      unsigned short bgid = 0;
+      struct io_uring_buf_ring* buf_ring = nullptr;
+      size_t buf_ring_size = 0;
+      unsigned char* bufs = nullptr;
+      size_t hdr_size = 0;
+      size_t buf_size = 0;
+      unsigned short buf_tail = 0;
+    };
+
+    inline void Ring::Slot::complete(const struct io_uring_cqe& cqe)
+    {
+      Endpoint::Ptr ep(std::move(owner));
+      const size_t sz = size;
+      ring->free_slot(this);
+      ring->op_done();
+      if (ep)
+	ep->write_done(cqe.res, sz);
+    }
+
+    inline void Ring::shutdown()
+    {
+      closed = true;
+      descriptor.reset(); // closing the ring cancels all requests in flight
+      for (size_t i = 0; i < N_SLOTS; ++i)
+	slots[i].owner.reset();
+      const std::set<Endpoint*> eps(endpoints);
+      for (Endpoint* ep : eps)
+	{
+	  if (endpoints.count(ep))
+	    ep->ring_closed();
+	}
+    }
+
+    // Holds the Ring of an io_context and closes it on shutdown.
+    class Service : public openvpn_io::detail::execution_context_service_base<Service>
+    {
+    public:
+      explicit Service(openvpn_io::io_context& io_context_arg)
+	: openvpn_io::detail::execution_context_service_base<Service>(io_context_arg),
+	  io_context(io_context_arg)
+      {
+      }
+
+      Ring::Ptr ring()
+      {
+	if (!tried)
+	  {
+	    tried = true;
+	    try {
+	      ring_.reset(new Ring(io_context));
+	    }
+	    catch (const std::exception& e)
+	      {
+		OPENVPN_LOG("io_uring not available, using the asio reactor: " << e.what());
+	      }
+	  }
+	return ring_;
+      }
+
+      virtual void shutdown() override
+      {
+	if (ring_)
+	  {
+	    ring_->shutdown();
+	    ring_.reset();
+	  }
+      }
+
+    private:
+      openvpn_io::io_context& io_context;
+      Ring::Ptr ring_;
+      bool tried = false;
+    };
+
+    inline Ring::Ptr Ring::get(openvpn_io::io_context& io_context)
+    {
+      return openvpn_io::use_service<Service>(io_context).ring();
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,114 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Classify a tun packet from its first few header bytes, so that the
+// per-packet hooks (MSS clamping, ICMP PTB, DHCP capture) only parse
+// packets that concern them.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <openvpn/ip/ipcommon.hpp>
+#include <openvpn/ip/ip4.hpp>
+#include <openvpn/ip/ip6.hpp>
+#include <openvpn/ip/tcp.hpp>
+#include <openvpn/ip/udp.hpp>
+#include <openvpn/ip/dhcp.hpp>
+
+namespace openvpn {
+  namespace IPClassify {
+
+    enum {
+      IPV4       = (1<<0),  // IPv4 header present
+      IPV6       = (1<<1),  // IPv6 header present
+      TCP_SYN    = (1<<2),  // whole, unfragmented TCP SYN carrying options
+      DHCP_REPLY = (1<<3),  // whole, unfragmented IPv4 UDP from port 67 to 68
+    };
+
+    // SYN flag set and data offset beyond the 20 byte TCP header
+    inline bool tcp_syn_with_options(const std::uint8_t *tcp)
+    {
+      const TCPHeader *th = (const TCPHeader *)tcp;
+      return ((th->flags & TCPHeader::FLAG_SYN) != 0) & (th->doff_res >= 0x60);
+    }
+
+    // source port 67 and destination port 68, compared as one word
+    inline bool dhcp_reply_ports(const std::uint8_t *udp)
+    {
+      const std::uint32_t ports = (std::uint32_t(udp[0]) << 24) | (udp[1] << 16) | (udp[2] << 8) | udp[3];
+      return ports == ((std::uint32_t(DHCP::BOOTPS_PORT) << 16) | DHCP::BOOTPC_PORT);
+    }
+
+    inline unsigned int classify_ipv4(const std::uint8_t *p, const size_t len, size_t& l4_offset)
+    {
+      const size_t hlen = IPv4Header::length(p[0]);
+      const bool whole = (size_t((p[2] << 8) | p[3]) == len)
+	& ((((p[6] << 8) | p[7]) & IPv4Header::OFFMASK) == 0)
+	& (hlen >= sizeof(IPv4Header))
+	& (hlen + sizeof(TCPHeader) <= len);
+      l4_offset = hlen;
+      if (!whole)
+	return IPV4;
+      if (p[9] == IPCommon::TCP)
+	return IPV4 | (tcp_syn_with_options(p + hlen) ? TCP_SYN : 0);
+      return IPV4 | ((p[9] == IPCommon::UDP) & dhcp_reply_ports(p + hlen) ? DHCP_REPLY : 0);
+    }
+
+    // only "single next header = TCP", like MSSFix always did
+    inline unsigned int classify_ipv6(const std::uint8_t *p, const size_t len, size_t& l4_offset)
+    {
+      const bool tcp = (size_t((p[4] << 8) | p[5]) + sizeof(IPv6Header) == len)
+	& (p[6] == IPCommon::TCP)
+	& (len >= sizeof(IPv6Header) + sizeof(TCPHeader));
+      l4_offset = sizeof(IPv6Header);
+      if (!tcp)
+	return IPV6;
+      return IPV6 | (tcp_syn_with_options(p + sizeof(IPv6Header)) ? TCP_SYN : 0);
+    }
+
+    // Returns IPClassify flags for the IP packet at p.  For TCP_SYN
+    // and DHCP_REPLY, l4_offset is set to the start of the TCP/UDP
+    // header.  Length and fragment checks are combined without
+    // branching, so most packets cost a few loads and compares.
+    inline unsigned int classify(const std::uint8_t *p, const size_t len, size_t& l4_offset)
+    {
+      if (len < sizeof(IPv4Header))
+	return 0;
+      switch (IPCommon::version(p[0]))
+	{
+	case IPCommon::IPv4:
+	  return classify_ipv4(p, len, l4_offset);
+	case IPCommon::IPv6:
+	  return classify_ipv6(p, len, l4_offset);
+	default:
+	  return 0;
+	}
+    }
+
+    inline unsigned int classify(const std::uint8_t *p, const size_t len)
+    {
+      size_t l4_offset;
+      return classify(p, len, l4_offset);
+    }
+  }
+}
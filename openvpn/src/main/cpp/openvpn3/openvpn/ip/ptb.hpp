@@ -25,6 +25,7 @@
 
 #include <openvpn/common/socktypes.hpp>
 #include <openvpn/ip/csum.hpp>
+#include <openvpn/ip/classify.hpp>
 #include <openvpn/ip/ip4.hpp>
 #include <openvpn/ip/ip6.hpp>
 #include <openvpn/ip/icmp4.hpp>
@@ -38,25 +39,12 @@ namespace openvpn {
   public:
     static void generate_icmp_ptb(BufferAllocated& buf, std::uint16_t nexthop_mtu)
     {
-      if (buf.empty())
-	return;
-
-      switch (IPCommon::version(buf[0]))
-      {
-	case IPCommon::IPv4:
-	  if (buf.length() <= sizeof(struct IPv4Header))
-	    break;
-
-	  generate_icmp4_ptb(buf, nexthop_mtu);
-	  break;
-
-	case IPCommon::IPv6:
-	  if (buf.length() <= sizeof(struct IPv6Header))
-	    break;
+      const unsigned int ipc = IPClassify::classify(buf.c_data(), buf.length());
 
-	  generate_icmp6_ptb(buf, nexthop_mtu);
-	  break;
-      }
+      if ((ipc & IPClassify::IPV4) && buf.length() > sizeof(struct IPv4Header))
+	generate_icmp4_ptb(buf, nexthop_mtu);
+      else if ((ipc & IPClassify::IPV6) && buf.length() > sizeof(struct IPv6Header))
+	generate_icmp6_ptb(buf, nexthop_mtu);
     }
 
   private:
@@ -86,5 +86,22 @@ namespace openvpn {
 	cksum = (uint16_t)_acc;
       }
   }
+
+  /*
+   * Incrementally update an internet checksum when one 16-bit
+   * word changes from old_word to new_word (RFC 1624 eqn. 3,
+   * HC' = ~(~HC + ~m + m')).  All values in network byte order.
+   */
+  inline void tcp_update_checksum(std::uint16_t& cksum,
+				  const std::uint16_t old_word,
+				  const std::uint16_t new_word)
+  {
+    std::uint32_t sum = std::uint16_t(~cksum);
+    sum += std::uint16_t(~old_word);
+    sum += new_word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    cksum = std::uint16_t(~sum);
+  }
 }
 
@@ -0,0 +1,298 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Low-overhead per-stage latency tracing for the data channel.
+//
+// Tracing is always compiled in but disabled by default.  When disabled,
+// a trace point costs one relaxed atomic load.  When enabled, each thread
+// records events into its own fixed-size ring buffer without taking any
+// locks; the oldest events are overwritten when the ring wraps.  A mutex
+// is only taken the first time a thread records an event, to attach a
+// ring to that thread.
+//
+// export_json() renders the recorded events in Chrome trace event format,
+// which can be loaded into chrome://tracing or ui.perfetto.dev.
+
+#ifndef OPENVPN_LOG_LATENCYTRACE_H
+#define OPENVPN_LOG_LATENCYTRACE_H
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#include <openvpn/common/size.hpp>
+#include <openvpn/common/extern.hpp>
+
+namespace openvpn {
+  namespace LatencyTrace {
+
+    enum Stage {
+      // outgoing path
+      TUN_READ = 0,      // handling of a packet read from tun, encloses the stages below
+      COMPRESS,          // data channel compression
+      ENCRYPT,           // data channel encryption
+      TRANSPORT_SEND,    // hand-off of the encrypted packet to the transport
+
+      // incoming path
+      TRANSPORT_RECV,    // handling of a packet received from the transport, encloses the stages below
+      DECRYPT,           // data channel decryption
+      DECOMPRESS,        // data channel decompression
+      TUN_WRITE,         // hand-off of the decrypted packet to tun
+
+      N_STAGES,
+    };
+
+    inline const char *stage_name(const unsigned int stage)
+    {
+      static const char *names[] = {
+	"tun_read",
+	"compress",
+	"encrypt",
+	"transport_send",
+	"transport_recv",
+	"decrypt",
+	"decompress",
+	"tun_write",
+      };
+
+      if (stage < N_STAGES)
+	return names[stage];
+      else
+	return "unknown";
+    }
+
+    inline std::uint64_t now_ns()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Event
+    {
+      std::uint64_t start;   // ns, steady clock
+      std::uint32_t dur;     // ns
+      std::uint32_t size;    // packet size at start of stage
+      std::uint32_t stage;
+    };
+
+    // Single-producer ring, written only by the thread it is attached to.
+    // snapshot() may be called from any thread.
+    class Ring
+    {
+    public:
+      enum {
+	SIZE = 4096, // must be a power of 2
+      };
+
+      Ring(const unsigned int id_arg)
+	: id(id_arg)
+      {
+      }
+
+      void push(const Event& ev)
+      {
+	const std::uint64_t h = head.load(std::memory_order_relaxed);
+	events[h & (SIZE-1)] = ev;
+	head.store(h + 1, std::memory_order_release);
+      }
+
+      // Append events which started at or after since to out.  Events
+      // overwritten by the producer while we were copying are dropped.
+      void snapshot(std::vector<Event>& out, const std::uint64_t since) const
+      {
+	const std::uint64_t end = head.load(std::memory_order_acquire);
+	const std::uint64_t begin = end > SIZE ? end - SIZE : 0;
+	std::vector<Event> copy;
+	copy.reserve(end - begin);
+	for (std::uint64_t i = begin; i < end; ++i)
+	  copy.push_back(events[i & (SIZE-1)]);
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const std::uint64_t head_now = head.load(std::memory_order_relaxed);
+	const std::uint64_t valid = head_now > SIZE ? head_now - SIZE : 0;
+	for (std::uint64_t i = std::max(begin, valid); i < end; ++i)
+	  {
+	    const Event& ev = copy[i - begin];
+	    if (ev.start >= since)
+	      out.push_back(ev);
+	  }
+      }
+
+      const unsigned int id;
+      std::atomic<bool> in_use{true};
+
+    private:
+      std::atomic<std::uint64_t> head{0};
+      Event events[SIZE];
+    };
+
+    // Owns all rings.  Rings outlive their threads so that events can
+    // still be exported, and are handed to new threads once their
+    // previous thread has exited.
+    class Registry
+    {
+    public:
+      Ring* attach()
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& r : rings)
+	  {
+	    bool expected = false;
+	    if (r->in_use.compare_exchange_strong(expected, true))
+	      return r.get();
+	  }
+	rings.emplace_back(new Ring((unsigned int)rings.size() + 1));
+	return rings.back().get();
+      }
+
+      void snapshot(std::vector<std::pair<unsigned int, std::vector<Event>>>& out,
+		    const std::uint64_t since)
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& r : rings)
+	  {
+	    out.emplace_back(r->id, std::vector<Event>());
+	    r->snapshot(out.back().second, since);
+	  }
+      }
+
+    private:
+      std::mutex mutex;
+      std::vector<std::unique_ptr<Ring>> rings;
+    };
+
+    // Per-thread handle, returns the ring to the registry on thread exit.
+    struct ThreadRing
+    {
+      ~ThreadRing()
+      {
+	if (ring)
+	  ring->in_use.store(false, std::memory_order_release);
+      }
+
+      Ring* ring = nullptr;
+    };
+
+    OPENVPN_EXTERN std::atomic<bool> enabled_flag; // GLOBAL
+    OPENVPN_EXTERN std::atomic<std::uint64_t> enabled_since; // GLOBAL
+    OPENVPN_EXTERN Registry registry; // GLOBAL
+    OPENVPN_EXTERN thread_local ThreadRing thread_ring; // GLOBAL
+
+    inline bool enabled()
+    {
+      return enabled_flag.load(std::memory_order_relaxed);
+    }
+
+    // May be called from any thread.  Enabling discards events
+    // recorded before this call from subsequent exports.
+    inline void enable(const bool state)
+    {
+      if (state)
+	enabled_since.store(now_ns(), std::memory_order_relaxed);
+      enabled_flag.store(state, std::memory_order_release);
+    }
+
+    inline Ring* ring()
+    {
+      Ring* r = thread_ring.ring;
+      if (!r)
+	r = thread_ring.ring = registry.attach();
+      return r;
+    }
+
+    // Records one stage as a complete event spanning the lifetime
+    // of the object.
+    class Span
+    {
+    public:
+      Span(const Stage stage_arg, const size_t size_arg)
+      {
+	if (enabled())
+	  {
+	    stage = stage_arg;
+	    size = (std::uint32_t)size_arg;
+	    start = now_ns();
+	  }
+      }
+
+      ~Span()
+      {
+	if (start)
+	  {
+	    Event ev;
+	    ev.start = start;
+	    ev.dur = (std::uint32_t)std::min(now_ns() - start, (std::uint64_t)UINT32_MAX);
+	    ev.size = size;
+	    ev.stage = stage;
+	    ring()->push(ev);
+	  }
+      }
+
+      Span(const Span&) = delete;
+      Span& operator=(const Span&) = delete;
+
+    private:
+      std::uint64_t start = 0;
+      std::uint32_t size = 0;
+      std::uint32_t stage = 0;
+    };
+
+    // Render events recorded since tracing was last enabled in
+    // Chrome trace event (JSON object) format.  Timestamps are
+    // in microseconds relative to the enable time.
+    inline std::string export_json()
+    {
+      const std::uint64_t since = enabled_since.load(std::memory_order_relaxed);
+      std::vector<std::pair<unsigned int, std::vector<Event>>> threads;
+      registry.snapshot(threads, since);
+
+      std::ostringstream os;
+      os.setf(std::ios::fixed);
+      os.precision(3);
+      os << "{\"traceEvents\":[";
+      bool first = true;
+      for (const auto& t : threads)
+	{
+	  if (t.second.empty())
+	    continue;
+	  os << (first ? "" : ",")
+	     << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t.first
+	     << ",\"args\":{\"name\":\"ovpn-" << t.first << "\"}}";
+	  first = false;
+	  for (const auto& ev : t.second)
+	    os << ",\n{\"name\":\"" << stage_name(ev.stage)
+	       << "\",\"cat\":\"data\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t.first
+	       << ",\"ts\":" << double(ev.start - since) / 1000.0
+	       << ",\"dur\":" << double(ev.dur) / 1000.0
+	       << ",\"args\":{\"size\":" << ev.size << "}}";
+	}
+      os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+      return os.str();
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,252 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Asynchronous delivery of log messages.
+//
+// AsyncLog is a log receiver which forwards messages to another receiver
+// on a separate thread, so that slow log() callbacks, for example into a
+// UI, never hold up the threads producing them.  Messages are handed over
+// through a bounded lock-free ring; when it is full, messages are dropped
+// and their number is logged once the ring has drained.
+//
+// Optionally, similar messages (those which only differ in numbers, such
+// as repeated packet errors) are limited to rate_limit per second.
+//
+// Messages are formatted by the caller, only delivery is deferred.
+
+#ifndef OPENVPN_LOG_LOGASYNC_H
+#define OPENVPN_LOG_LOGASYNC_H
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace openvpn {
+
+  // RECEIVER must have a virtual void log(const INFO&) method,
+  // INFO must be constructible from and have a text std::string.
+  template <typename RECEIVER, typename INFO>
+  class AsyncLog : public RECEIVER
+  {
+  public:
+    AsyncLog(RECEIVER* target_arg,
+	     const size_t size,
+	     const unsigned int rate_limit_arg)
+      : target(target_arg),
+	mask(ring_size(size) - 1),
+	slots(new Slot[mask + 1]),
+	rate_limit(rate_limit_arg)
+    {
+      for (size_t i = 0; i <= mask; ++i)
+	slots[i].seq.store(i, std::memory_order_relaxed);
+      thread.reset(new std::thread([this]() {
+	    drain();
+	  }));
+    }
+
+    // delivers all queued messages before returning
+    virtual ~AsyncLog()
+    {
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	halt = true;
+      }
+      wake.notify_one();
+      thread->join();
+    }
+
+    // may be called from any thread
+    virtual void log(const INFO& info) override
+    {
+      if (rate_limit && !rate_ok(info.text))
+	return;
+      push(info.text);
+    }
+
+    size_t dropped() const
+    {
+      return n_dropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    // Bounded multi-producer, single-consumer ring (D. Vyukov).  A
+    // producer may fill slot i & mask when its sequence is i, and
+    // publishes it by setting the sequence to i + 1.
+    struct Slot
+    {
+      std::atomic<size_t> seq;
+      std::string text;
+    };
+
+    struct RateClass
+    {
+      std::atomic<std::uint32_t> window{0};
+      std::atomic<std::uint32_t> count{0};
+      std::atomic<std::uint32_t> suppressed{0};
+    };
+
+    enum {
+      MAX_SIZE = 1<<16,
+      N_RATE_CLASSES = 64,
+      RATE_CLASS_CHARS = 64,
+    };
+
+    static size_t ring_size(const size_t size)
+    {
+      size_t n = 2;
+      while (n < size && n < MAX_SIZE)
+	n <<= 1;
+      return n;
+    }
+
+    void push(const std::string& text)
+    {
+      Slot* s;
+      size_t pos = tail.load(std::memory_order_relaxed);
+      while (true)
+	{
+	  s = &slots[pos & mask];
+	  const std::ptrdiff_t diff = std::ptrdiff_t(s->seq.load(std::memory_order_acquire) - pos);
+	  if (diff == 0)
+	    {
+	      if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+		break;
+	    }
+	  else if (diff < 0)
+	    {
+	      n_dropped.fetch_add(1, std::memory_order_relaxed);
+	      return;
+	    }
+	  else
+	    pos = tail.load(std::memory_order_relaxed);
+	}
+
+      s->text = text;
+      s->seq.store(pos + 1, std::memory_order_seq_cst);
+      if (sleeping.load(std::memory_order_seq_cst))
+	{
+	  std::lock_guard<std::mutex> lock(mutex);
+	  wake.notify_one();
+	}
+    }
+
+    bool ready(const size_t pos) const
+    {
+      return slots[pos & mask].seq.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    void drain()
+    {
+      size_t head = 0;
+      size_t reported = 0;
+
+      while (true)
+	{
+	  if (ready(head))
+	    {
+	      Slot& s = slots[head & mask];
+	      std::string text(std::move(s.text));
+	      s.text.clear();
+	      s.seq.store(head + mask + 1, std::memory_order_release);
+	      ++head;
+	      target->log(INFO(std::move(text)));
+	      continue;
+	    }
+
+	  // empty, report drops before going to sleep
+	  const size_t d = n_dropped.load(std::memory_order_relaxed);
+	  if (d != reported)
+	    {
+	      target->log(INFO("NOTE: " + std::to_string(d - reported) + " log message(s) dropped, log queue is full\n"));
+	      reported = d;
+	    }
+
+	  std::unique_lock<std::mutex> lock(mutex);
+	  sleeping.store(true, std::memory_order_seq_cst);
+	  std::atomic_thread_fence(std::memory_order_seq_cst);
+	  if (!ready(head))
+	    {
+	      if (halt)
+		break;
+	      wake.wait(lock);
+	    }
+	  sleeping.store(false, std::memory_order_relaxed);
+	}
+    }
+
+    // Similar messages share a class, found by hashing the start
+    // of the message without digits.
+    bool rate_ok(const std::string& text)
+    {
+      std::uint32_t h = 2166136261u; // FNV-1a
+      size_t n = 0;
+      for (auto c : text)
+	{
+	  if (c >= '0' && c <= '9')
+	    continue;
+	  h = (h ^ (unsigned char)c) * 16777619u;
+	  if (++n >= RATE_CLASS_CHARS)
+	    break;
+	}
+      RateClass& rc = rate_classes[h % N_RATE_CLASSES];
+
+      const std::uint32_t now = (std::uint32_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      if (rc.window.exchange(now, std::memory_order_relaxed) != now)
+	{
+	  rc.count.store(0, std::memory_order_relaxed);
+	  const std::uint32_t suppressed = rc.suppressed.exchange(0, std::memory_order_relaxed);
+	  if (suppressed)
+	    push("NOTE: " + std::to_string(suppressed) + " similar log message(s) suppressed by rate limit\n");
+	}
+      if (rc.count.fetch_add(1, std::memory_order_relaxed) >= rate_limit)
+	{
+	  rc.suppressed.fetch_add(1, std::memory_order_relaxed);
+	  return false;
+	}
+      return true;
+    }
+
+    RECEIVER* target;
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    const unsigned int rate_limit;
+    RateClass rate_classes[N_RATE_CLASSES];
+
+    std::atomic<size_t> tail{0};
+    std::atomic<size_t> n_dropped{0};
+    std::atomic<bool> sleeping{false};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool halt = false;
+    std::unique_ptr<std::thread> thread;
+  };
+}
+
+#endif
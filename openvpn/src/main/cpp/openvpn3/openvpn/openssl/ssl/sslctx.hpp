@@ -29,10 +29,15 @@
 #include <cstring>
 #include <sstream>
 #include <utility>
+#include <map>
+#include <memory>
+#include <ctime>
 
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 #include <openssl/rsa.h>
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
@@ -79,7 +84,8 @@ namespace openvpn {
     typedef CertCRLListTemplate<OpenSSLPKI::X509List, OpenSSLPKI::CRLList> CertCRLList;
 
     enum {
-      MAX_CIPHERTEXT_IN = 64 // maximum number of queued input ciphertext packets
+      MAX_CIPHERTEXT_IN = 64, // maximum number of queued input ciphertext packets
+      MAX_CACHED_SESSIONS = 64, // maximum number of resumable sessions cached by a client
     };
 
     // The data needed to construct an OpenSSLContext.
@@ -98,7 +104,8 @@ namespace openvpn {
 		 tls_cert_profile(TLSCertProfile::UNDEF),
 		 local_cert_enabled(true),
 		 force_aes_cbc_ciphersuites(false),
-		 enable_renegotiation(false) {}
+		 enable_renegotiation(false),
+		 session_ticket_lifetime(0) {}
 
       virtual SSLFactoryAPI::Ptr new_factory()
       {
@@ -361,6 +368,13 @@ namespace openvpn {
 	  {
 	    const std::string& dh_txt = opt.get("dh", 1, Option::MULTILINE);
 	    load_dh(dh_txt);
+
+	    // tls-session-tickets [lifetime]
+	    {
+	      const Option* o = opt.get_ptr("tls-session-tickets");
+	      if (o)
+		session_ticket_lifetime = o->get_num<unsigned int>(1, 3600, 60, 7*24*3600);
+	    }
 	  }
 
 	// relay mode
@@ -422,6 +436,7 @@ namespace openvpn {
       bool local_cert_enabled;
       bool force_aes_cbc_ciphersuites;
       bool enable_renegotiation;
+      unsigned int session_ticket_lifetime; // seconds, server issues session tickets if nonzero
     };
 
     // Represents an actual SSL session.
@@ -555,7 +570,7 @@ namespace openvpn {
       }
 
     private:
-      SSL(const OpenSSLContext& ctx, const char *hostname)
+      SSL(const OpenSSLContext& ctx, const char *hostname, const std::string* session_key_arg)
       {
 	ssl_clear();
 	try {
@@ -596,6 +611,21 @@ namespace openvpn {
 	      if (ctx.config->flags & SSLConst::ENABLE_SNI)
 		if (SSL_set_tlsext_host_name(ssl, hostname) != 1)
 		  throw OpenSSLException("OpenSSLContext::SSL: SSL_set_tlsext_host_name failed");
+
+	      // offer to resume the last session negotiated under session_key,
+	      // new sessions are cached by new_session_callback
+	      if (session_key_arg)
+		{
+		  session_key = *session_key_arg;
+		  ::SSL_SESSION* sess = ctx.session_cache.get(session_key);
+		  if (sess)
+		    {
+		      const int status = SSL_set_session(ssl, sess);
+		      SSL_SESSION_free(sess);
+		      if (status != 1)
+			throw OpenSSLException("OpenSSLContext::SSL: SSL_set_session failed");
+		    }
+		}
 	    }
 	  else
 	    OPENVPN_THROW(ssl_context_error, "OpenSSLContext::SSL: unknown client/server mode");
@@ -723,6 +753,7 @@ namespace openvpn {
       BIO *ct_in;          // write ciphertext to here
       BIO *ct_out;         // read ciphertext from here
       AuthCert::Ptr authcert;
+      std::string session_key; // client: cache new sessions under this key
       bool ssl_bio_linkage;
       bool overflow;
 
@@ -732,6 +763,145 @@ namespace openvpn {
     };
 
   private:
+    // Client-side cache of resumable sessions, usually keyed by remote
+    // server.  It lives as long as the OpenSSLContext, so that sessions
+    // survive client reconnects.
+    class SessionCache
+    {
+    public:
+      SessionCache() {}
+
+      ~SessionCache()
+      {
+	clear();
+      }
+
+      // Returns a copy of the cached session which must be freed by
+      // the caller.  SSL_free marks the session of a connection that
+      // wasn't shut down as not resumable, so it is never shared.
+      ::SSL_SESSION* get(const std::string& key) const
+      {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	auto i = map.find(key);
+	if (i != map.end())
+	  return SSL_SESSION_dup(i->second);
+#endif
+	return nullptr;
+      }
+
+      // takes ownership of sess
+      void put(const std::string& key, ::SSL_SESSION* sess)
+      {
+	auto i = map.find(key);
+	if (i != map.end())
+	  {
+	    SSL_SESSION_free(i->second);
+	    i->second = sess;
+	  }
+	else
+	  {
+	    if (map.size() >= MAX_CACHED_SESSIONS)
+	      clear();
+	    map[key] = sess;
+	  }
+      }
+
+      void clear()
+      {
+	for (auto& e : map)
+	  SSL_SESSION_free(e.second);
+	map.clear();
+      }
+
+    private:
+      SessionCache(const SessionCache&) = delete;
+      SessionCache& operator=(const SessionCache&) = delete;
+
+      std::map<std::string, ::SSL_SESSION*> map;
+    };
+
+    // Server-side session ticket keys.  A new key is generated every
+    // lifetime seconds, tickets encrypted with the previous key are still
+    // accepted but get renewed with the current one.  So no key is used
+    // for more than two lifetimes, and the session timeout, which equals
+    // the lifetime, rejects the sessions older than that.
+    class TicketKeys
+    {
+    public:
+      TicketKeys(const unsigned int lifetime_arg)
+	: lifetime(lifetime_arg)
+      {
+	generate(current);
+	previous = current;
+      }
+
+      int callback(unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, const int enc)
+      {
+	rotate();
+	if (enc)
+	  {
+	    if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+	      return -1;
+	    std::memcpy(key_name, current.name, sizeof(current.name));
+	    if (!EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), nullptr, current.aes_key, iv)
+		|| !HMAC_Init_ex(hctx, current.hmac_key, sizeof(current.hmac_key), EVP_sha256(), nullptr))
+	      return -1;
+	    return 1;
+	  }
+	else
+	  {
+	    const Key* key;
+	    if (!std::memcmp(key_name, current.name, sizeof(current.name)))
+	      key = &current;
+	    else if (!std::memcmp(key_name, previous.name, sizeof(previous.name)))
+	      key = &previous;
+	    else
+	      return 0; // unknown key, do a full handshake
+	    if (!HMAC_Init_ex(hctx, key->hmac_key, sizeof(key->hmac_key), EVP_sha256(), nullptr)
+		|| !EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), nullptr, key->aes_key, iv))
+	      return -1;
+	    return key == &current ? 1 : 2;
+	  }
+      }
+
+    private:
+      struct Key
+      {
+	unsigned char name[16];
+	unsigned char aes_key[32];
+	unsigned char hmac_key[32];
+	std::time_t created;
+      };
+
+      void rotate()
+      {
+	const std::time_t age = std::time(nullptr) - current.created;
+	if (age >= (std::time_t)lifetime)
+	  {
+	    // after an idle period, the current key is too old
+	    // to keep accepting its tickets
+	    if (age < 2 * (std::time_t)lifetime)
+	      previous = current;
+	    else
+	      generate(previous);
+	    generate(current);
+	  }
+      }
+
+      static void generate(Key& key)
+      {
+	if (RAND_bytes(key.name, sizeof(key.name)) != 1
+	    || RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1
+	    || RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1)
+	  throw OpenSSLException("OpenSSLContext::TicketKeys: RAND_bytes failed");
+	key.created = std::time(nullptr);
+      }
+
+      const unsigned int lifetime;
+      Key current;
+      Key previous;
+    };
+
     class ExternalPKIImpl {
     public:
       ExternalPKIImpl(SSL_CTX* ssl_ctx, ::X509* cert, ExternalPKIBase* external_pki_arg)
@@ -926,6 +1096,8 @@ namespace openvpn {
 		throw OpenSSLException("OpenSSLContext: SSL_CTX_set_tmp_dh failed");
 	      if (config->enable_renegotiation)
 		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	      else
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 	      if (config->flags & SSLConst::SERVER_TO_SERVER)
 		SSL_CTX_set_purpose(ctx, X509_PURPOSE_SSL_SERVER);
 	    }
@@ -934,15 +1106,24 @@ namespace openvpn {
 	      ctx = SSL_CTX_new(SSL::tls_method_client());
 	      if (ctx == nullptr)
 		throw OpenSSLException("OpenSSLContext: SSL_CTX_new failed for client method");
+
+
+	      // Sessions are cached by new_session_callback and
+	      // resumed with SSL_set_session, see SSL::SSL.
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	      SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	      SSL_CTX_sess_set_new_cb(ctx, new_session_callback);
+#else
 	      if (config->enable_renegotiation)
-		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT); // note: SSL_set_session must be called as well
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT);
+	      else
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+#endif
 	    }
 	  else
 	    OPENVPN_THROW(ssl_context_error, "OpenSSLContext: unknown config->mode");
 
 	  // Set SSL options
-	  if (!config->enable_renegotiation)
-	    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 	  if (!(config->flags & SSLConst::NO_VERIFY_PEER))
 	    {
 	      SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
@@ -950,7 +1131,7 @@ namespace openvpn {
 	      SSL_CTX_set_verify_depth(ctx, 16);
 	    }
 	  long sslopt = SSL_OP_SINGLE_DH_USE | SSL_OP_SINGLE_ECDH_USE | SSL_OP_NO_COMPRESSION;
-	  if (!config->enable_renegotiation)
+	  if (config->mode.is_server() && !config->enable_renegotiation && !session_tickets_enabled())
 	    sslopt |= SSL_OP_NO_TICKET;
 
 	  /* Disable SSLv2 and SSLv3, might be a noop but does not hurt */
@@ -1087,6 +1268,25 @@ namespace openvpn {
 	  else if (!(config->flags & SSLConst::NO_VERIFY_PEER))
 	    OPENVPN_THROW(ssl_context_error, "OpenSSLContext: CA not defined");
 
+	  // Issue session tickets with our own rotating keys.  Tickets
+	  // carry the AuthCert of the client, as verify_callback_server
+	  // is not called on resumption.
+	  if (session_tickets_enabled())
+	    {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	      static const unsigned char sid_ctx[] = "OpenVPN";
+	      if (!SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1))
+		throw OpenSSLException("OpenSSLContext: SSL_CTX_set_session_id_context failed");
+	      ticket_keys.reset(new TicketKeys(config->session_ticket_lifetime));
+	      // don't resume sessions older than the ticket lifetime,
+	      // whichever key their ticket was encrypted with
+	      SSL_CTX_set_timeout(ctx, config->session_ticket_lifetime);
+	      SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticket_key_callback);
+	      if (!SSL_CTX_set_session_ticket_cb(ctx, ticket_gen_callback, ticket_dec_callback, nullptr))
+		throw OpenSSLException("OpenSSLContext: SSL_CTX_set_session_ticket_cb failed");
+#endif
+	    }
+
 	  // Show handshake debugging info
 	  if (config->ssl_debug_level)
 	    SSL_CTX_set_info_callback (ctx, info_callback);
@@ -1102,13 +1302,19 @@ namespace openvpn {
     // create a new SSL instance
     virtual SSLAPI::Ptr ssl()
     {
-      return SSL::Ptr(new SSL(*this, nullptr));
+      return SSL::Ptr(new SSL(*this, nullptr, nullptr));
     }
 
     // like ssl() above but verify hostname against cert CommonName and/or SubjectAltName
     virtual SSLAPI::Ptr ssl(const std::string& hostname)
     {
-      return SSL::Ptr(new SSL(*this, hostname.c_str()));
+      return SSL::Ptr(new SSL(*this, hostname.c_str(), nullptr));
+    }
+
+    // like ssl() above but optionally resume the session cached under session_key
+    virtual SSLAPI::Ptr ssl(const std::string* hostname, const std::string* session_key)
+    {
+      return SSL::Ptr(new SSL(*this, hostname ? hostname->c_str() : nullptr, session_key));
     }
 
     void update_trust(const CertCRLList& cc)
@@ -1585,6 +1791,109 @@ namespace openvpn {
 			      && self_ssl->authcert->is_fail());  //   authcert has recorded it
     }
 
+    bool session_tickets_enabled() const
+    {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+      // x509-track results are not carried in tickets
+      return config->mode.is_server()
+	&& config->session_ticket_lifetime
+	&& config->x509_track_config.empty();
+#else
+      return false;
+#endif
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+    // Client: cache a newly negotiated session for resumption
+    // on the next connection to the same remote.
+    static int new_session_callback(::SSL *ssl, ::SSL_SESSION *sess)
+    {
+      OpenSSLContext* self = (OpenSSLContext*) SSL_get_ex_data (ssl, SSL::context_data_index);
+      SSL* self_ssl = (SSL *) SSL_get_ex_data (ssl, SSL::mydata_index);
+
+      if (self && self_ssl && !self_ssl->session_key.empty())
+	{
+	  // cache a copy, see SessionCache::get
+	  ::SSL_SESSION* copy = SSL_SESSION_dup(sess);
+	  if (copy)
+	    self->session_cache.put(self_ssl->session_key, copy);
+	}
+      return 0;
+    }
+
+    static int ticket_key_callback(::SSL *ssl, unsigned char *key_name, unsigned char *iv,
+				   EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+    {
+      OpenSSLContext* self = (OpenSSLContext*) SSL_get_ex_data (ssl, SSL::context_data_index);
+      try {
+	return self->ticket_keys->callback(key_name, iv, cctx, hctx, enc);
+      }
+      catch (const std::exception& e)
+	{
+	  OPENVPN_LOG("OpenSSLContext::ticket_key_callback exception: " << e.what());
+	  return -1;
+	}
+    }
+
+    // Server: store the client's AuthCert in a new session ticket.
+    // Clients with cert errors get tickets which can't be resumed.
+    static int ticket_gen_callback(::SSL *ssl, void *arg)
+    {
+      SSL* self_ssl = (SSL *) SSL_get_ex_data (ssl, SSL::mydata_index);
+      const AuthCert* ac = self_ssl->authcert.get();
+      if (ac && ac->defined() && !ac->is_fail())
+	{
+	  std::string data((const char *)ac->issuer_fp, sizeof(ac->issuer_fp));
+	  const long long sn = ac->sn;
+	  data.append((const char *)&sn, sizeof(sn));
+	  data += ac->cn;
+	  if (!SSL_SESSION_set1_ticket_appdata(SSL_get_session(ssl), data.c_str(), data.length()))
+	    return 0;
+	}
+      return 1;
+    }
+
+    // Server: restore the client's AuthCert from a session ticket,
+    // or fall back to a full handshake if it doesn't carry one.
+    static SSL_TICKET_RETURN ticket_dec_callback(::SSL *ssl, ::SSL_SESSION *sess,
+						 const unsigned char *keyname, size_t keyname_len,
+						 SSL_TICKET_STATUS status, void *arg)
+    {
+      switch (status)
+	{
+	case SSL_TICKET_SUCCESS:
+	case SSL_TICKET_SUCCESS_RENEW:
+	  {
+	    const OpenSSLContext* self = (OpenSSLContext*) SSL_get_ex_data (ssl, SSL::context_data_index);
+	    SSL* self_ssl = (SSL *) SSL_get_ex_data (ssl, SSL::mydata_index);
+	    void *data = nullptr;
+	    size_t len = 0;
+	    if (self_ssl->authcert
+		&& SSL_SESSION_get0_ticket_appdata(sess, &data, &len)
+		&& len >= sizeof(AuthCert::issuer_fp) + sizeof(long long))
+	      {
+		const unsigned char *d = (const unsigned char *)data;
+		long long sn;
+		std::memcpy(self_ssl->authcert->issuer_fp, d, sizeof(AuthCert::issuer_fp));
+		std::memcpy(&sn, d + sizeof(AuthCert::issuer_fp), sizeof(sn));
+		self_ssl->authcert->sn = (long)sn;
+		self_ssl->authcert->cn.assign((const char *)d + sizeof(AuthCert::issuer_fp) + sizeof(sn),
+					      len - sizeof(AuthCert::issuer_fp) - sizeof(sn));
+		if (self->config->flags & SSLConst::LOG_VERIFY_STATUS)
+		  OPENVPN_LOG_SSL("VERIFY OK: resumed session for " << self_ssl->authcert->to_string());
+		return status == SSL_TICKET_SUCCESS ? SSL_TICKET_RETURN_USE : SSL_TICKET_RETURN_USE_RENEW;
+	      }
+	    return SSL_TICKET_RETURN_IGNORE_RENEW;
+	  }
+	case SSL_TICKET_FATAL_ERR_MALLOC:
+	case SSL_TICKET_FATAL_ERR_OTHER:
+	  return SSL_TICKET_RETURN_ABORT;
+	default:
+	  return SSL_TICKET_RETURN_IGNORE_RENEW;
+	}
+    }
+#endif
+
     // Print debugging information on SSL/TLS session negotiation.
     static void info_callback (const ::SSL *s, int where, int ret)
     {
@@ -1615,6 +1924,8 @@ namespace openvpn {
     Config::Ptr config;
     SSL_CTX* ctx;
     ExternalPKIImpl* epki;
+    SessionCache session_cache;
+    std::unique_ptr<TicketKeys> ticket_keys;
   };
 
   int OpenSSLContext::SSL::mydata_index = -1;
@@ -31,6 +31,7 @@
 #include <openvpn/common/socktypes.hpp>
 #include <openvpn/buffer/buffer.hpp>
 #include <openvpn/crypto/packet_id.hpp>
+#include <openvpn/time/time.hpp>
 #include <openvpn/reliable/relcommon.hpp>
 
 namespace openvpn {
@@ -51,16 +52,17 @@ namespace openvpn {
 
     // Called to read incoming ACK IDs from buf and mark them as ACKed in rel_send.
     // If live is false, read the ACK IDs, but don't modify rel_send.
+    // now is the time the ACKs were received.
     // Return the number of ACK IDs read.
     template <typename REL_SEND>
-    static size_t ack(REL_SEND& rel_send, Buffer& buf, const bool live)
+    static size_t ack(REL_SEND& rel_send, Buffer& buf, const bool live, const Time& now)
     {
       const size_t len = buf.pop_front();
       for (size_t i = 0; i < len; ++i)
 	{
 	  const id_t id = read_id(buf);
 	  if (live)
-	    rel_send.ack(id);
+	    rel_send.ack(id, now);
 	}
       return len;
     }
@@ -38,6 +38,13 @@ namespace openvpn {
   public:
     typedef reliable::id_t id_t;
 
+    // Retransmit a packet at once when this many packets sent
+    // after it have been acknowledged while it has not.
+    enum { FAST_RETRANSMIT_ACKS = 3 };
+
+    // Upper bound for the retransmit timeout after backoff
+    static Time::Duration max_retransmit_timeout() { return Time::Duration::seconds(60); }
+
     class Message : public ReliableMessageBase<PACKET>
     {
       friend class ReliableSendTemplate;
@@ -64,6 +71,9 @@ namespace openvpn {
 
     private:
       Time retransmit_at_;
+      Time sent_at_;
+      unsigned int n_retransmits_ = 0;
+      unsigned int n_acks_after_ = 0;
     };
 
     ReliableSendTemplate() : next(0) {}
@@ -72,6 +82,8 @@ namespace openvpn {
     void init(const id_t span)
     {
       next = 0;
+      n_unacked_ = 0;
+      srtt_ = rttvar_ = Time::Duration();
       window_.init(next, span);
     }
 
@@ -96,7 +108,9 @@ namespace openvpn {
     Time::Duration until_retransmit(const Time& now)
     {
       Time::Duration ret = Time::Duration::infinite();
-      for (id_t i = head_id(); i < tail_id(); ++i)
+      if (!n_unacked_)
+	return ret;
+      for (id_t i = head_id(); i < next; ++i)
 	{
 	  const Message& msg = ref_by_id(i);
 	  if (msg.defined())
@@ -110,15 +124,21 @@ namespace openvpn {
     }
 
     // Return number of unacknowleged packets in send queue
-    unsigned int n_unacked()
+    unsigned int n_unacked() const
     {
-      unsigned int ret = 0;
-      for (id_t i = head_id(); i < tail_id(); ++i)
-	{
-	  if (ref_by_id(i).defined())
-	    ++ret;
-	}
-      return ret;
+      return n_unacked_;
+    }
+
+    // Return the current retransmit timeout.  Until the first round trip
+    // has been measured, this is tls_timeout.  Afterwards it is
+    // SRTT + 4 * RTTVAR (RFC 6298), but never less than 1/4 of a second.
+    Time::Duration retransmit_timeout(const Time::Duration& tls_timeout) const
+    {
+      if (!srtt_.defined())
+	return tls_timeout;
+      const Time::Duration rto = srtt_ + rttvar_ * 4;
+      const Time::Duration min_rto = Time::Duration::binary_ms(Time::prec / 4);
+      return rto < min_rto ? min_rto : rto;
     }
 
     // Return a fresh Message object that can be used to
@@ -128,18 +148,81 @@ namespace openvpn {
     {
       Message& msg = window_.ref_by_id(next);
       msg.id_ = next++;
-      msg.reset_retransmit(now, tls_timeout);
+      msg.sent_at_ = now;
+      msg.n_retransmits_ = 0;
+      msg.n_acks_after_ = 0;
+      msg.reset_retransmit(now, retransmit_timeout(tls_timeout));
+      ++n_unacked_;
       return msg;
     }
 
+    // Called after msg has been sent again, schedules the
+    // next retransmission with exponential backoff.
+    void retransmitted(Message& msg, const Time& now, const Time::Duration& tls_timeout)
+    {
+      ++msg.n_retransmits_;
+      msg.n_acks_after_ = 0;
+      Time::Duration timeout = retransmit_timeout(tls_timeout);
+      for (unsigned int i = 0; i < msg.n_retransmits_ && timeout < max_retransmit_timeout(); ++i)
+	timeout = timeout * 2;
+      if (timeout > max_retransmit_timeout())
+	timeout = max_retransmit_timeout();
+      msg.reset_retransmit(now, timeout);
+    }
+
     // Return true if send queue is ready to receive another packet
     bool ready() const { return window_.in_window(next); }
 
-    // Remove a message from send queue that has been acknowledged
-    void ack(const id_t id) { window_.rm_by_id(id); }
+    // Remove a message from send queue that has been acknowledged.
+    // The ACK updates the round trip estimate, and makes older
+    // packets which are still unacknowledged due for retransmission
+    // once FAST_RETRANSMIT_ACKS later packets have been acknowledged.
+    void ack(const id_t id, const Time& now)
+    {
+      if (!window_.in_window(id) || id >= next)
+	return;
+      Message& msg = ref_by_id(id);
+      if (!msg.defined())
+	return;
+
+      // Karn's algorithm: the ACK of a retransmitted packet is ambiguous
+      if (!msg.n_retransmits_)
+	update_rtt(now - msg.sent_at_);
+
+      for (id_t i = head_id(); i < id; ++i)
+	{
+	  Message& m = ref_by_id(i);
+	  if (m.defined() && ++m.n_acks_after_ == FAST_RETRANSMIT_ACKS && now < m.retransmit_at_)
+	    m.retransmit_at_ = now;
+	}
+
+      --n_unacked_;
+      window_.rm_by_id(id);
+    }
 
   private:
+    void update_rtt(const Time::Duration& rtt)
+    {
+      if (!srtt_.defined())
+	{
+	  srtt_ = rtt.defined() ? rtt : Time::Duration::binary_ms(1);
+	  rttvar_ = Time::Duration::binary_ms(srtt_.to_binary_ms() / 2);
+	}
+      else
+	{
+	  // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+	  const Time::Duration err = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+	  rttvar_ = Time::Duration::binary_ms((rttvar_.to_binary_ms() * 3 + err.to_binary_ms()) / 4);
+	  srtt_ = Time::Duration::binary_ms((srtt_.to_binary_ms() * 7 + rtt.to_binary_ms()) / 8);
+	  if (!srtt_.defined())
+	    srtt_ = Time::Duration::binary_ms(1);
+	}
+    }
+
     id_t next;
+    unsigned int n_unacked_ = 0;
+    Time::Duration srtt_;
+    Time::Duration rttvar_;
     MessageWindow<Message, id_t> window_;
   };
 
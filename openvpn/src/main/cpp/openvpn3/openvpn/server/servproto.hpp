@@ -225,10 +225,10 @@ namespace openvpn {
 		  log_packet(buf, false);
 #endif
 		  // make packet appear as incoming on tun interface
-		  if (true) // fixme: was tun
+		  if (TunLink::send)
 		    {
 		      OPENVPN_LOG_SERVPROTO("TUN SEND[" << buf.size() << ']');
-		      // fixme -- code me
+		      TunLink::send->tun_send(buf);
 		    }
 		}
 
@@ -259,7 +259,37 @@ namespace openvpn {
       // called with cleartext IP packets from routing layer
       virtual void tun_recv(BufferAllocated& buf) override
       {
-	// fixme -- code me
+	if (halt || !Base::primary_defined())
+	  return;
+	try {
+	  OPENVPN_LOG_SERVPROTO("TUN RECV[" << buf.size() << ']');
+
+	  // update current time
+	  Base::update_now();
+
+	  // encrypt packet
+	  if (buf.size())
+	    {
+	      Base::data_encrypt(buf);
+	      if (buf.size())
+		{
+		  // send packet via transport to client
+		  OPENVPN_LOG_SERVPROTO("Transport SEND[" << buf.size() << "] " << client_endpoint_render() << ' ' << Base::dump_packet(buf));
+		  if (TransportLink::send && TransportLink::send->transport_send(buf))
+		    Base::update_last_sent();
+		}
+	    }
+
+	  // do a lightweight flush
+	  Base::flush(false);
+
+	  // schedule housekeeping wakeup
+	  set_housekeeping_timer();
+	}
+	catch (const std::exception& e)
+	  {
+	    error(e);
+	  }
       }
 
       // Return true if keepalive parameter(s) are enabled.
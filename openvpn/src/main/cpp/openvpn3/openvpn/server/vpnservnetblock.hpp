@@ -23,10 +23,12 @@
 #define OPENVPN_SERVER_VPNSERVNETBLOCK_H
 
 #include <sstream>
+#include <limits>
 
 #include <openvpn/common/size.hpp>
 #include <openvpn/common/exception.hpp>
 #include <openvpn/common/options.hpp>
+
 #include <openvpn/addr/route.hpp>
 #include <openvpn/addr/range.hpp>
 
@@ -84,9 +86,10 @@ namespace openvpn {
       ClientNetblock(const IP::Route& route)
 	: Netblock(route)
       {
-	const size_t extent = route.extent();
-	bcast = net + (extent - 1);
-	clients = IP::Range(net + 2, extent - 3);
+	// bcast is the last address of the whole netblock,
+	// not of the truncated extent
+	bcast = net | ~netmask();
+	clients = IP::Range(net + 2, client_extent(route) - 3);
       }
 
       std::string to_string() const
@@ -98,6 +101,19 @@ namespace openvpn {
 
       IP::Range clients;
       IP::Addr bcast;
+
+    private:
+      // Netblocks with more addresses than can be counted, such as
+      // an IPv6 /64, are truncated.  The address pool allocates
+      // lazily, so this still leaves more addresses than can be used.
+      static size_t client_extent(const IP::Route& route)
+      {
+	const unsigned int max_bits = std::numeric_limits<long>::digits - 1;
+	if (route.host_bits() > max_bits)
+	  return size_t(1) << max_bits;
+	else
+	  return route.extent();
+      }
     };
 
     class PerThread
@@ -27,6 +27,9 @@
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <cstdint> // for std::uint32_t
 
 #include <openvpn/common/exception.hpp>
@@ -68,6 +71,12 @@ namespace openvpn {
       IP::Addr ip6;
     };
 
+    // Client address pool, split into shards so that server threads
+    // don't contend for a single lock.  Each shard owns a slice of the
+    // client netblocks and has its own lock.  Server thread i acquires
+    // from its home shard i % n_shards, and only takes addresses from the
+    // other shards once its home shard is depleted.  Addresses are always
+    // released to the shard that owns them.
     class Pool : public VPNServerNetblock
     {
     public:
@@ -76,47 +85,174 @@ namespace openvpn {
 	IPv6_DEPLETION=(1<<1),
       };
 
-      Pool(const OptionList& opt)
-	: VPNServerNetblock(init_snb_from_opt(opt))
+      // acquire() metrics, summed over all shards
+      struct Stats
       {
-	if (configured(opt, "server"))
+	std::uint64_t acquires = 0;       // calls to acquire()
+	std::uint64_t steals = 0;         // addresses taken from another shard
+	std::uint64_t depletions = 0;     // calls that returned depletion flags
+	std::uint64_t latency_ns = 0;     // total latency of acquire()
+	std::uint64_t max_latency_ns = 0; // maximum latency of acquire()
+
+	std::string to_string() const
+	{
+	  std::ostringstream os;
+	  os << "acquires=" << acquires
+	     << " steals=" << steals
+	     << " depletions=" << depletions
+	     << " avg_latency_ns=" << (acquires ? latency_ns / acquires : 0)
+	     << " max_latency_ns=" << max_latency_ns;
+	  return os.str();
+	}
+      };
+
+      Pool(const OptionList& opt, const unsigned int n_shards=1)
+	: VPNServerNetblock(init_snb_from_opt(opt, std::max(n_shards, 1u))),
+	  shards(new Shard[size()])
+      {
+	for (size_t i = 0; i < size(); ++i)
 	  {
-	    pool4.add_range(netblock4().clients);
-	    pool6.add_range(netblock6().clients);
+	    Shard& s = shards[i];
+	    const PerThread& pt = per_thread(i);
+	    s.range4 = pt.range4();
+	    if (pt.range6_defined())
+	      s.range6 = pt.range6();
+	    if (configured(opt, "server"))
+	      {
+		s.pool4.add_range(s.range4);
+		s.pool6.add_range(s.range6);
+	      }
+	    s.free4 = s.pool4.n_free();
+	    s.free6 = s.pool6.n_free();
 	  }
       }
 
-      // returns flags
-      unsigned int acquire(IP46& addr_pair, const bool request_ipv6)
+      // returns flags, thread_index is the index of the calling server thread
+      unsigned int acquire(IP46& addr_pair, const bool request_ipv6, const unsigned int thread_index=0)
       {
-	std::lock_guard<std::mutex> lock(mutex);
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const size_t home = thread_index % size();
 	unsigned int flags = 0;
-	if (!pool4.acquire_addr(addr_pair.ip4))
+	if (!acquire_addr(home, &Shard::pool4, &Shard::free4, addr_pair.ip4))
 	  flags |= IPv4_DEPLETION;
 	if (request_ipv6 && netblock6().defined())
 	  {
-	    if (!pool6.acquire_addr(addr_pair.ip6))
+	    if (!acquire_addr(home, &Shard::pool6, &Shard::free6, addr_pair.ip6))
 	      flags |= IPv6_DEPLETION;
 	  }
+
+	const std::uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	Metrics& m = shards[home].metrics;
+	m.acquires.fetch_add(1, std::memory_order_relaxed);
+	if (flags)
+	  m.depletions.fetch_add(1, std::memory_order_relaxed);
+	m.latency_ns.fetch_add(latency, std::memory_order_relaxed);
+	std::uint64_t max = m.max_latency_ns.load(std::memory_order_relaxed);
+	while (latency > max && !m.max_latency_ns.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+	  ;
 	return flags;
       }
 
       void release(IP46& addr_pair)
       {
-	std::lock_guard<std::mutex> lock(mutex);
 	if (addr_pair.ip4.defined())
-	  pool4.release_addr(addr_pair.ip4);
+	  release_addr(&Shard::range4, &Shard::pool4, &Shard::free4, addr_pair.ip4);
 	if (addr_pair.ip6.defined())
-	  pool6.release_addr(addr_pair.ip6);
+	  release_addr(&Shard::range6, &Shard::pool6, &Shard::free6, addr_pair.ip6);
+      }
+
+      Stats stats() const
+      {
+	Stats ret;
+	for (size_t i = 0; i < size(); ++i)
+	  {
+	    const Metrics& m = shards[i].metrics;
+	    ret.acquires += m.acquires.load(std::memory_order_relaxed);
+	    ret.steals += m.steals.load(std::memory_order_relaxed);
+	    ret.depletions += m.depletions.load(std::memory_order_relaxed);
+	    ret.latency_ns += m.latency_ns.load(std::memory_order_relaxed);
+	    ret.max_latency_ns = std::max(ret.max_latency_ns, m.max_latency_ns.load(std::memory_order_relaxed));
+	  }
+	return ret;
       }
 
     private:
-      static VPNServerNetblock init_snb_from_opt(const OptionList& opt)
+      struct Metrics
+      {
+	std::atomic<std::uint64_t> acquires{0};
+	std::atomic<std::uint64_t> steals{0};
+	std::atomic<std::uint64_t> depletions{0};
+	std::atomic<std::uint64_t> latency_ns{0};
+	std::atomic<std::uint64_t> max_latency_ns{0};
+      };
+
+      struct Shard
+      {
+	std::mutex mutex;
+	IP::Range range4;
+	IP::Range range6;
+	IP::Pool pool4;
+	IP::Pool pool6;
+
+	// free address counts, readable without the lock,
+	// so that depleted shards are skipped when stealing
+	std::atomic<size_t> free4{0};
+	std::atomic<size_t> free6{0};
+
+	Metrics metrics;
+      };
+
+      bool acquire_addr(const size_t home,
+			IP::Pool Shard::*pool,
+			std::atomic<size_t> Shard::*n_free,
+			IP::Addr& dest)
+      {
+	const size_t n = size();
+	for (size_t i = 0; i < n; ++i)
+	  {
+	    Shard& s = shards[(home + i) % n];
+	    if (i && !(s.*n_free).load(std::memory_order_relaxed))
+	      continue;
+	    std::lock_guard<std::mutex> lock(s.mutex);
+	    if ((s.*pool).acquire_addr(dest))
+	      {
+		(s.*n_free).store((s.*pool).n_free(), std::memory_order_relaxed);
+		if (i)
+		  shards[home].metrics.steals.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	      }
+	  }
+	return false;
+      }
+
+      void release_addr(IP::Range Shard::*range,
+			IP::Pool Shard::*pool,
+			std::atomic<size_t> Shard::*n_free,
+			const IP::Addr& addr)
+      {
+	for (size_t i = 0; i < size(); ++i)
+	  {
+	    Shard& s = shards[i];
+	    const IP::Range& r = s.*range;
+	    if (r.defined()
+		&& r.start().version() == addr.version()
+		&& r.start() <= addr
+		&& addr <= r.start() + (r.extent() - 1))
+	      {
+		std::lock_guard<std::mutex> lock(s.mutex);
+		(s.*pool).release_addr(addr);
+		(s.*n_free).store((s.*pool).n_free(), std::memory_order_relaxed);
+		return;
+	      }
+	  }
+      }
+
+      static VPNServerNetblock init_snb_from_opt(const OptionList& opt, const unsigned int n_shards)
       {
 	if (configured(opt, "server"))
-	  return VPNServerNetblock(opt, "server", false, 0);
+	  return VPNServerNetblock(opt, "server", false, n_shards);
 	else if (configured(opt, "ifconfig"))
-	  return VPNServerNetblock(opt, "ifconfig", false, 0);
+	  return VPNServerNetblock(opt, "ifconfig", false, n_shards);
 	else
 	  throw vpn_serv_pool_error("one of 'server' or 'ifconfig' directives is required");
       }
@@ -127,10 +263,7 @@ namespace openvpn {
 	return opt.exists(opt_name) || opt.exists(opt_name + "-ipv6");
       }
 
-      std::mutex mutex;
-
-      IP::Pool pool4;
-      IP::Pool pool6;
+      std::unique_ptr<Shard[]> shards;
     };
 
     class IP46AutoRelease : public IP46, public RC<thread_safe_refcount>
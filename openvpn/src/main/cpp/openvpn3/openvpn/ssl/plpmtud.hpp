@@ -0,0 +1,248 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Datagram packetization layer path MTU discovery (RFC 8899)
+// state machine for the data channel.  Sizes are UDP payload
+// sizes, i.e. complete encrypted data channel packets.  The
+// caller sends the probes and reports acknowledgements, this
+// class only decides what to probe and when.
+
+#ifndef OPENVPN_SSL_PLPMTUD_H
+#define OPENVPN_SSL_PLPMTUD_H
+
+#include <openvpn/time/time.hpp>
+
+namespace openvpn {
+  class PLPMTUD
+  {
+  public:
+    enum State {
+      DISABLED=0,
+      BASE,            // confirming that BASE_PLPMTU gets through
+      SEARCHING,       // looking for a larger PLPMTU
+      SEARCH_COMPLETE, // PLPMTU found, waiting for the raise timer
+      BASE_FAILED,     // not even BASE_PLPMTU was acknowledged (RFC 8899 ERROR)
+    };
+
+    enum {
+      BASE_PLPMTU = 1200,       // RFC 8899 BASE_PLPMTU for IPv4 and IPv6
+      MAX_PROBES = 3,           // unacknowledged probes before a size is given up
+      SEARCH_GRANULARITY = 8,   // stop searching when the window is this narrow
+    };
+
+    // Start a new search for a path that can carry at most
+    // max_plpmtu bytes.
+    void start(const unsigned int max_plpmtu, const Time& now)
+    {
+      state = BASE;
+      low = BASE_PLPMTU;
+      high = high_max = max_plpmtu > (unsigned int)BASE_PLPMTU ? max_plpmtu : (unsigned int)BASE_PLPMTU;
+      target = BASE_PLPMTU;
+      n_probes = 0;
+      probe_size = 0;
+      plpmtu_ = 0;
+      next = now;
+    }
+
+    bool enabled() const { return state != DISABLED; }
+    State get_state() const { return state; }
+
+    // Largest acknowledged packet size, or 0 if not even
+    // BASE_PLPMTU has been acknowledged yet.  A peer which
+    // never answers leaves the PLPMTU unknown rather than
+    // pinning it to BASE_PLPMTU.
+    unsigned int plpmtu() const { return plpmtu_; }
+
+    // Should the socket set DF and never fragment locally?  Only
+    // once a PLPMTU is confirmed, because only then are tun
+    // packets clamped to fit it (see mss_inter()).  Before that,
+    // and for good in BASE_FAILED, oversized packets must still
+    // get through by local fragmentation.  The BASE_PLPMTU probe
+    // itself is small enough for any real link.
+    bool probe_df() const { return plpmtu_ != 0; }
+
+    // Largest tun packet, given the limit mssfix implies (0 for
+    // none) and the per-packet data channel overhead.
+    unsigned int mss_inter(const unsigned int mssfix_inter, const int encap) const
+    {
+      if (plpmtu_)
+	{
+	  const unsigned int pl_inter = plpmtu_ - encap;
+	  if (!mssfix_inter || pl_inter < mssfix_inter)
+	    return pl_inter;
+	}
+      return mssfix_inter;
+    }
+
+    // When should probe() be called next?
+    Time next_probe() const
+    {
+      return enabled() ? next : Time::infinite();
+    }
+
+    // Returns the size of the probe to send now, or 0 if
+    // no probe is due.  Must be followed by probe_sent().
+    unsigned int probe(const Time& now)
+    {
+      if (!enabled() || now < next)
+	return 0;
+
+      switch (state)
+	{
+	case SEARCH_COMPLETE:
+	  // raise timer expired, see if the full size gets through now
+	  state = SEARCHING;
+	  if (!next_target(now, high_max))
+	    return 0;
+	  target = high;
+	  break;
+	case BASE_FAILED:
+	  state = BASE;
+	  target = BASE_PLPMTU;
+	  n_probes = 0;
+	  break;
+	default:
+	  if (n_probes >= MAX_PROBES && !probe_failed(now))
+	    return 0;
+	  break;
+	}
+
+      ++n_probes;
+      next = now + Time::Duration::seconds(PROBE_TIMER);
+      return target;
+    }
+
+    // Record the actual size of the probe that was sent for
+    // the value returned by probe(), which may be a little
+    // smaller because of cipher block rounding.  Zero means
+    // that the probe could not be sent.
+    void probe_sent(const unsigned int size)
+    {
+      if (size)
+	probe_size = size;
+    }
+
+    // Peer reports that it has received packets of up to
+    // max_recv bytes.  Returns true if the PLPMTU changed.
+    bool ack(const unsigned int max_recv, const Time& now)
+    {
+      if (!enabled() || !probe_size || max_recv < probe_size)
+	return false;
+
+      const unsigned int prev = plpmtu_;
+      if (probe_size > plpmtu_)
+	plpmtu_ = probe_size;
+      probe_size = 0;
+
+      switch (state)
+	{
+	case BASE:
+	  // most paths carry the full size, so try that first
+	  state = SEARCHING;
+	  if (next_target(now, high))
+	    target = high;
+	  break;
+	case SEARCHING:
+	  low = target;
+	  next_target(now, high);
+	  break;
+	default:
+	  break;
+	}
+      return plpmtu_ != prev;
+    }
+
+    static const char *state_str(const State s)
+    {
+      switch (s)
+	{
+	case DISABLED:
+	  return "DISABLED";
+	case BASE:
+	  return "BASE";
+	case SEARCHING:
+	  return "SEARCHING";
+	case SEARCH_COMPLETE:
+	  return "SEARCH_COMPLETE";
+	case BASE_FAILED:
+	  return "BASE_FAILED";
+	default:
+	  return "State_???";
+	}
+    }
+
+  private:
+    enum {
+      // RFC 8899 recommends 15 seconds, but our acknowledgement
+      // is a request/reply exchange with the peer rather than a
+      // retransmission timeout, so a few RTTs are plenty.
+      PROBE_TIMER = 2,
+      PMTU_RAISE_TIMER = 600,
+    };
+
+    // MAX_PROBES probes of the current target went unanswered
+    bool probe_failed(const Time& now)
+    {
+      if (state == BASE)
+	{
+	  state = BASE_FAILED;
+	  next = now + Time::Duration::seconds(PMTU_RAISE_TIMER);
+	  return false;
+	}
+      return next_target(now, target - 1);
+    }
+
+    // Narrow the search window to [low, new_high] and pick the
+    // next target, or finish the search.
+    bool next_target(const Time& now, const unsigned int new_high)
+    {
+      high = new_high;
+      if (high < low + SEARCH_GRANULARITY)
+	{
+	  complete(now);
+	  return false;
+	}
+      target = low + (high - low + 1) / 2;
+      n_probes = 0;
+      next = now;
+      return true;
+    }
+
+    void complete(const Time& now)
+    {
+      state = SEARCH_COMPLETE;
+      low = target = plpmtu_;
+      next = now + Time::Duration::seconds(PMTU_RAISE_TIMER);
+    }
+
+    State state = DISABLED;
+    unsigned int low = 0;           // largest acknowledged target
+    unsigned int high = 0;          // smallest target known to fail, minus one
+    unsigned int high_max = 0;      // upper bound passed to start()
+    unsigned int target = 0;        // size currently being probed
+    unsigned int n_probes = 0;      // probes sent for target
+    unsigned int probe_size = 0;    // actual size of the last probe sent
+    unsigned int plpmtu_ = 0;       // largest acknowledged probe size
+    Time next;
+  };
+}
+
+#endif
@@ -66,11 +66,13 @@
 #include <openvpn/crypto/static_key.hpp>
 #include <openvpn/crypto/bs64_data_limit.hpp>
 #include <openvpn/log/sessionstats.hpp>
+#include <openvpn/log/latencytrace.hpp>
 #include <openvpn/ssl/protostack.hpp>
 #include <openvpn/ssl/psid.hpp>
 #include <openvpn/ssl/tlsprf.hpp>
 #include <openvpn/ssl/datalimit.hpp>
 #include <openvpn/ssl/mssparms.hpp>
+#include <openvpn/ssl/plpmtud.hpp>
 #include <openvpn/transport/mssfix.hpp>
 #include <openvpn/transport/protocol.hpp>
 #include <openvpn/tun/layer.hpp>
@@ -154,6 +156,21 @@ namespace openvpn {
       enum {
 	EXPLICIT_EXIT_NOTIFY_FIRST_BYTE = 0x28  // first byte of exit message
       };
+
+      // OCC messages share the explicit-exit-notify prefix
+      enum {
+	OCC_PREFIX_SIZE = 16,
+	OCC_MTU_LOAD = 3,       // padding, ignored by receiver
+	OCC_MTU_REQUEST = 4,    // ask peer for largest packet size received
+	OCC_MTU_REPLY = 5,      // followed by u16 max recv size, u16 max send size
+      };
+
+      inline bool is_occ(const Buffer& buf)
+      {
+	return buf.size() > OCC_PREFIX_SIZE
+	  && buf[0] == EXPLICIT_EXIT_NOTIFY_FIRST_BYTE
+	  && !std::memcmp(explicit_exit_notify_message, buf.c_data(), OCC_PREFIX_SIZE);
+      }
     }
   }
 
@@ -257,6 +274,11 @@ namespace openvpn {
       // master SSL context factory
       SSLFactoryAPI::Ptr ssl_factory;
 
+      // If defined, the initial TLS handshake of a client session will
+      // try to resume the session last negotiated under this key, usually
+      // identifying the remote server (client-only)
+      std::string ssl_session_key;
+
       // data channel
       CryptoDCSettings dc;
 
@@ -346,6 +368,7 @@ namespace openvpn {
       unsigned int tun_mtu = 1500;
       MSSParms mss_parms;
       unsigned int mss_inter = 0;
+      bool pmtud = false;  // probe path MTU on UDP client sessions (RFC 8899)
 
       // Debugging
       int debug_level = 1;
@@ -1373,6 +1396,7 @@ namespace openvpn {
 
       KeyContext(ProtoContext& p, const bool initiator)
 	: Base(*p.config->ssl_factory,
+	       ssl_session_key(p),
 	       p.config->now, p.config->tls_timeout,
 	       p.config->frame, p.stats,
 	       p.config->reliable_window, p.config->max_ack_list),
@@ -1520,7 +1544,11 @@ namespace openvpn {
 	      buf.advance(head_size);
 
 	      // decrypt packet
-	      const Error::Type err = crypto->decrypt(buf, now->seconds_since_epoch(), op32);
+	      Error::Type err;
+	      {
+		LatencyTrace::Span span(LatencyTrace::DECRYPT, buf.size());
+		err = crypto->decrypt(buf, now->seconds_since_epoch(), op32);
+	      }
 	      if (err)
 		{
 		  proto.stats->error(err);
@@ -1534,7 +1562,10 @@ namespace openvpn {
 
 	      // decompress packet
 	      if (compress)
-		compress->decompress(buf);
+		{
+		  LatencyTrace::Span span(LatencyTrace::DECOMPRESS, buf.size());
+		  compress->decompress(buf);
+		}
 
 	      // set MSS for segments server can receive
 	      if (proto.config->mss_inter > 0)
@@ -1670,6 +1701,44 @@ namespace openvpn {
 	  }
       }
 
+      // send an OCC_MTU_LOAD packet padded to payload_size bytes of
+      // cleartext, followed by an OCC_MTU_REQUEST asking the peer
+      // whether it got through.  Returns the size of the encrypted
+      // probe, or 0 if the data channel isn't up.
+      unsigned int send_plpmtud_probe(const size_t payload_size)
+      {
+	const unsigned int probe_size = send_occ_message(proto_context_private::OCC_MTU_LOAD, payload_size);
+	if (probe_size)
+	  send_occ_message(proto_context_private::OCC_MTU_REQUEST, 0);
+	return probe_size;
+      }
+
+      // send an OCC message to peer via data channel, padded with
+      // random bytes to at least pad_to bytes of cleartext
+      unsigned int send_occ_message(const unsigned char opcode, const size_t pad_to)
+      {
+	if (state >= ACTIVE
+	    && (crypto_flags & CryptoDCInstance::CRYPTO_DEFINED)
+	    && !invalidated())
+	  {
+	    Packet pkt;
+	    pkt.frame_prepare(*proto.config->frame, Frame::WRITE_DC_MSG);
+	    pkt.buf->write(proto_context_private::explicit_exit_notify_message,
+			   proto_context_private::OCC_PREFIX_SIZE);
+	    pkt.buf->push_back(opcode);
+	    if (pad_to > pkt.buf->size())
+	      {
+		const size_t pad = pad_to - pkt.buf->size();
+		proto.config->prng->rand_bytes(pkt.buf->write_alloc(pad), pad);
+	      }
+	    do_encrypt(*pkt.buf, false);
+	    const unsigned int size = (unsigned int)pkt.buf->size();
+	    proto.net_send(key_id_, pkt);
+	    return size;
+	  }
+	return 0;
+      }
+
       // validate the integrity of a packet
       static bool validate(const Buffer& net_buf, ProtoContext& proto, TimePtr now)
       {
@@ -1779,13 +1848,15 @@ namespace openvpn {
 		transport_encap += c.protocol.extra_transport_bytes();
 	      }
 
+	    unsigned int mss_inter = 0;
 	    if (c.mss_parms.mssfix != 0)
 	      {
 		OPENVPN_LOG_PROTO("MTU mssfix=" << c.mss_parms.mssfix <<
 				  " crypto_encap=" << crypto_encap <<
 				  " transport_encap=" << transport_encap);
-		c.mss_inter = c.mss_parms.mssfix - (crypto_encap + transport_encap);
+		mss_inter = c.mss_parms.mssfix - (crypto_encap + transport_encap);
 	      }
+	    proto.update_mss_inter(mss_inter, crypto_encap);
 	  }
       }
 
@@ -1797,6 +1868,16 @@ namespace openvpn {
       }
 
     private:
+      // Only the initial key of a client session resumes a cached
+      // TLS session, renegotiations always do a full handshake.
+      static const std::string* ssl_session_key(const ProtoContext& p)
+      {
+	if (p.is_client() && p.upcoming_key_id == 0 && !p.config->ssl_session_key.empty())
+	  return &p.config->ssl_session_key;
+	else
+	  return nullptr;
+      }
+
       static bool validate_tls_auth(Buffer &recv, ProtoContext& proto, TimePtr now)
       {
 	const unsigned char *orig_data = recv.data();
@@ -1938,7 +2019,10 @@ namespace openvpn {
 
 	// compress packet
 	if (compress)
-	  compress->compress(buf, compress_hint);
+	  {
+	    LatencyTrace::Span span(LatencyTrace::COMPRESS, buf.size());
+	    compress->compress(buf, compress_hint);
+	  }
 
 	// trigger renegotiation if we hit encrypt data limit
 	if (data_limit)
@@ -1951,7 +2035,10 @@ namespace openvpn {
 	    static_assert(sizeof(op32) == OP_SIZE_V2, "OP_SIZE_V2 inconsistency");
 
 	    // encrypt packet
-	    pid_wrap = crypto->encrypt(buf, now->seconds_since_epoch(), (const unsigned char *)&op32);
+	    {
+	      LatencyTrace::Span span(LatencyTrace::ENCRYPT, buf.size());
+	      pid_wrap = crypto->encrypt(buf, now->seconds_since_epoch(), (const unsigned char *)&op32);
+	    }
 
 	    // prepend op
 	    buf.prepend((const unsigned char *)&op32, sizeof(op32));
@@ -1959,7 +2046,10 @@ namespace openvpn {
 	else
 	  {
 	    // encrypt packet
-	    pid_wrap = crypto->encrypt(buf, now->seconds_since_epoch(), nullptr);
+	    {
+	      LatencyTrace::Span span(LatencyTrace::ENCRYPT, buf.size());
+	      pid_wrap = crypto->encrypt(buf, now->seconds_since_epoch(), nullptr);
+	    }
 
 	    // prepend op
 	    buf.push_front(op_compose(DATA_V1, key_id_));
@@ -2488,7 +2578,7 @@ namespace openvpn {
 
 	// process ACKs sent by peer (if packet ID check failed,
 	// read the ACK IDs, but don't modify the rel_send object).
-	if (ReliableAck::ack(rel_send, recv, pid_ok))
+	if (ReliableAck::ack(rel_send, recv, pid_ok, *now))
 	  {
 	    // make sure that our own PSID is contained in packet received from peer
 	    if (!verify_dest_psid (recv))
@@ -2636,7 +2726,7 @@ namespace openvpn {
 	  return false;
 
 	// process ACKs sent by peer
-	if (ReliableAck::ack(rel_send, recv, true))
+	if (ReliableAck::ack(rel_send, recv, true, *now))
 	  {
 	    // make sure that our own PSID is in packet received from peer
 	    if (!verify_dest_psid(recv))
@@ -3268,6 +3358,9 @@ namespace openvpn {
 
       // handle keepalive/expiration
       keepalive_housekeeping();
+
+      // path MTU probes
+      plpmtud_housekeeping();
     }
 
     // When should we next call housekeeping?
@@ -3284,6 +3377,7 @@ namespace openvpn {
 	    ret.min(secondary->next_retransmit());
 	  ret.min(keepalive_xmit);
 	  ret.min(keepalive_expire);
+	  ret.min(plpmtud.next_probe());
 	  return ret;
 	}
       else
@@ -3358,6 +3452,13 @@ namespace openvpn {
 	  in_out.reset_size();
 	}
 
+      // consume OCC messages while probing the path MTU
+      else if (plpmtud.enabled() && proto_context_private::is_occ(in_out))
+	{
+	  plpmtud_occ_recv(in_out);
+	  in_out.reset_size();
+	}
+
       return ret;
     }
 
@@ -3423,6 +3524,20 @@ namespace openvpn {
       keepalive_parms_modified();
     }
 
+    // Current PLPMTU (largest UDP payload known to reach the
+    // peer), or 0 if path MTU discovery isn't running or no
+    // probe has been acknowledged yet.
+    unsigned int plpmtu() const
+    {
+      return plpmtud.enabled() ? plpmtud.plpmtu() : 0;
+    }
+
+    // Should the transport send with DF set, see PLPMTUD::probe_df()
+    bool pmtud_probe_df() const
+    {
+      return plpmtud.enabled() && plpmtud.probe_df();
+    }
+
     // Return the current transport alignment adjustment
     size_t align_adjust_hint() const
     {
@@ -3548,6 +3663,11 @@ namespace openvpn {
     {
     }
 
+    // Called when path MTU discovery changes the PLPMTU
+    virtual void plpmtu_changed(const unsigned int plpmtu)
+    {
+    }
+
     void update_last_received()
     {
       keepalive_expire = *now_ + config->keepalive_timeout;
@@ -3793,6 +3913,71 @@ namespace openvpn {
 	keepalive_xmit = kx;
     }
 
+    // Called by KeyContext when its data channel is initialized,
+    // with the tun packet limit implied by mssfix (0 for none)
+    // and the per-packet data channel overhead.  Path MTU
+    // discovery starts with the first data channel.
+    void update_mss_inter(const unsigned int mssfix_inter, const int crypto_encap)
+    {
+      mss_inter_mssfix = mssfix_inter;
+      dc_encap = crypto_encap;
+      if (config->pmtud && !plpmtud.enabled() && is_client() && is_udp())
+	{
+	  plpmtud.start(config->tun_mtu + dc_encap, *now_);
+	  OPENVPN_LOG_PROTO("PMTUD start base=" << PLPMTUD::BASE_PLPMTU
+			    << " max=" << config->tun_mtu + dc_encap);
+	}
+      apply_mss_inter();
+    }
+
+    // Clamp tun packets to what the PLPMTU can carry, once
+    // one has been acknowledged.  Larger packets trigger ICMP
+    // PTB and TCP MSS is lowered to match.
+    void apply_mss_inter()
+    {
+      config->mss_inter = plpmtud.mss_inter(mss_inter_mssfix, dc_encap);
+    }
+
+    void plpmtud_housekeeping()
+    {
+      const unsigned int prev = plpmtud.plpmtu();
+      const unsigned int target = plpmtud.probe(*now_);
+      if (target && primary)
+	plpmtud.probe_sent(primary->send_plpmtud_probe(target - dc_encap));
+      plpmtud_update(prev);
+    }
+
+    void plpmtud_occ_recv(const Buffer& buf)
+    {
+      using namespace proto_context_private;
+
+      Buffer occ(buf);
+      occ.advance(OCC_PREFIX_SIZE);
+      if (occ.pop_front() == OCC_MTU_REPLY && occ.size() >= 4)
+	{
+	  const unsigned int max_recv = (occ[0] << 8) | occ[1];
+	  const unsigned int prev = plpmtud.plpmtu();
+	  OPENVPN_LOG_PROTO_VERBOSE(debug_prefix() << " PMTUD peer max_recv=" << max_recv);
+	  plpmtud.ack(max_recv, *now_);
+	  plpmtud_update(prev);
+	}
+    }
+
+    void plpmtud_update(const unsigned int prev)
+    {
+      if (plpmtud.get_state() != plpmtud_state)
+	{
+	  plpmtud_state = plpmtud.get_state();
+	  OPENVPN_LOG_PROTO("PMTUD " << PLPMTUD::state_str(plpmtud_state)
+			    << " plpmtu=" << plpmtud.plpmtu());
+	}
+      if (plpmtud.plpmtu() != prev)
+	{
+	  apply_mss_inter();
+	  plpmtu_changed(plpmtud.plpmtu());
+	}
+    }
+
     void tls_crypt_append_wkc(BufferAllocated& dst)
     {
       if (!config->wkc.defined())
@@ -3836,6 +4021,11 @@ namespace openvpn {
     KeyContext::Ptr secondary;
     bool dc_deferred;
 
+    PLPMTUD plpmtud;                   // path MTU discovery (RFC 8899)
+    PLPMTUD::State plpmtud_state = PLPMTUD::DISABLED;
+    unsigned int mss_inter_mssfix = 0; // tun packet limit from mssfix alone
+    int dc_encap = 0;                  // data channel overhead per packet
+
     // END ProtoContext data members
   };
 
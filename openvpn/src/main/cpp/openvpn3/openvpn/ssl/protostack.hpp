@@ -90,6 +90,7 @@ namespace openvpn {
     };
 
     ProtoStackBase(SSLFactoryAPI& ssl_factory, // SSL factory object that can be used to generate new SSL sessions
+		   const std::string* ssl_session_key, // if defined, try to resume the TLS session cached under this key
 		   TimePtr now_arg,                   // pointer to current time
 		   const Time::Duration& tls_timeout_arg, // packet retransmit timeout
 		   const Frame::Ptr& frame,           // contains info on how to allocate and align buffers
@@ -97,7 +98,7 @@ namespace openvpn {
 		   const id_t span,                   // basically the window size for our reliability layer
 		   const size_t max_ack_list)         // maximum number of ACK messages to bundle in one packet
       : tls_timeout(tls_timeout_arg),
-	ssl_(ssl_factory.ssl()),
+	ssl_(ssl_factory.ssl(nullptr, ssl_session_key)),
 	frame_(frame),
 	up_stack_reentry_level(0),
 	invalidated_(false),
@@ -197,7 +198,7 @@ namespace openvpn {
 	      if (m.ready_retransmit(*now))
 		{
 		  parent().net_send(m.packet, NET_SEND_RETRANSMIT);
-		  m.reset_retransmit(*now, tls_timeout);
+		  rel_send.retransmitted(m, *now, tls_timeout);
 		}
 	    }
 	  update_retransmit();
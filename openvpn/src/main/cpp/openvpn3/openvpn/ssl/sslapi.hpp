@@ -90,6 +90,18 @@ namespace openvpn {
     // like ssl() above but verify hostname against cert CommonName and/or SubjectAltName
     virtual SSLAPI::Ptr ssl(const std::string& hostname) = 0;
 
+    // like ssl() above but hostname is optional, and if session_key is
+    // defined, a client will offer to resume the TLS session which was
+    // last negotiated under that key.  Implementations which don't cache
+    // sessions may ignore session_key.
+    virtual SSLAPI::Ptr ssl(const std::string* hostname, const std::string* session_key)
+    {
+      if (hostname)
+	return ssl(*hostname);
+      else
+	return ssl();
+    }
+
     // client or server?
     virtual const Mode& mode() const = 0;
   };
@@ -58,6 +58,10 @@ namespace openvpn {
     virtual void server_endpoint_info(std::string& host, std::string& port, std::string& proto, std::string& ip_addr) const = 0;
     virtual Protocol transport_protocol() const = 0;
     virtual void transport_reparent(TransportClientParent* parent) = 0;
+
+    // Path MTU discovery: send with DF set and never fragment
+    // locally while df is true.  Only UDP transports probe.
+    virtual void transport_pmtud_probe(const bool df) {}
   };
 
   // Base class for parent of client transport object, used by client transport
@@ -25,12 +25,16 @@
 #define OPENVPN_TRANSPORT_CLIENT_UDPCLI_H
 
 #include <sstream>
+#include <vector>
+#include <memory>
+#include <utility>
 
 #include <openvpn/io/io.hpp>
 
 #include <openvpn/common/bigmutex.hpp>
 #include <openvpn/common/likely.hpp>
 #include <openvpn/common/platform.hpp>
+#include <openvpn/common/sockopt.hpp>
 #include <openvpn/transport/udplink.hpp>
 #include <openvpn/transport/client/transbase.hpp>
 #include <openvpn/transport/socket_protect.hpp>
@@ -48,6 +52,13 @@ namespace openvpn {
       bool server_addr_float;
       bool synchronous_dns_lookup;
       int n_parallel;
+
+      // if > 1, race the first packets of the session across up to
+      // this many addresses of the remote host and keep the first
+      // one to answer
+      unsigned int race_endpoints;
+      bool io_uring;          // use io_uring for socket I/O if available
+      bool pmtud;             // path MTU discovery may set DF, see transport_pmtud_probe()
       Frame::Ptr frame;
       SessionStats::Ptr stats;
 
@@ -70,6 +81,9 @@ namespace openvpn {
 	: server_addr_float(false),
 	  synchronous_dns_lookup(false),
 	  n_parallel(8),
+	  race_endpoints(1),
+	  io_uring(false),
+	  pmtud(false),
 	  socket_protect(nullptr)
       {}
     };
@@ -174,6 +188,41 @@ namespace openvpn {
 	  return Protocol();
       }
 
+      // Called with df true once path MTU discovery has confirmed a
+      // PLPMTU and clamps tun packets to it.  Until then, and when it
+      // gives up, the socket keeps its own mode so that oversized
+      // packets are fragmented locally rather than dropped.
+      virtual void transport_pmtud_probe(const bool df)
+      {
+	if (!config->pmtud || halt)
+	  return;
+#if defined(IP_MTU_DISCOVER) && defined(IPV6_MTU_DISCOVER)
+	openvpn_io::ip::udp::socket& sock = race_winner ? race_winner->socket : socket;
+	const bool ipv6 = server_endpoint.address().is_v6();
+	try {
+	  if (df && pmtud_saved_mode < 0)
+	    {
+	      const int mode = SockOpt::mtu_discover(sock.native_handle(), ipv6);
+	      SockOpt::set_mtu_discover(sock.native_handle(), ipv6,
+					ipv6 ? IPV6_PMTUDISC_PROBE : IP_PMTUDISC_PROBE);
+	      pmtud_saved_mode = mode;
+	    }
+	  else if (!df && pmtud_saved_mode >= 0)
+	    {
+	      SockOpt::set_mtu_discover(sock.native_handle(), ipv6, pmtud_saved_mode);
+	      pmtud_saved_mode = -1;
+	    }
+	}
+	catch (const std::exception& e)
+	  {
+	    OPENVPN_LOG("UDP: cannot change DF for path MTU discovery: " << e.what());
+	  }
+#else
+	if (df)
+	  OPENVPN_LOG("UDP path MTU probing not supported on this platform, probes may be fragmented");
+#endif
+      }
+
       virtual void stop() { stop_(); }
       virtual ~Client() { stop_(); }
 
@@ -198,6 +247,11 @@ namespace openvpn {
       {
 	if (impl)
 	  {
+	    // until a server has answered, duplicate packets to all racing endpoints
+	    for (auto &leg : race)
+	      if (leg->impl)
+		leg->impl->send(buf, nullptr);
+
 	    const int err = impl->send(buf, nullptr);
 	    if (unlikely(err))
 	      {
@@ -221,6 +275,8 @@ namespace openvpn {
 
       void udp_read_handler(PacketFrom::SPtr& pfp) // called by LinkImpl
       {
+	if (unlikely(!race.empty()))
+	  race_select(pfp->sender_endpoint);
 	if (config->server_addr_float || pfp->sender_endpoint == server_endpoint)
 	  parent->transport_recv(pfp->buf);
 	else
@@ -235,6 +291,9 @@ namespace openvpn {
 	    if (impl)
 	      impl->stop();
 	    socket.close();
+	    race_stop();
+	    if (race_winner)
+	      race_winner->socket.close();
 	    resolver.cancel();
 	  }
       }
@@ -282,6 +341,8 @@ namespace openvpn {
 	      }
 	  }
 #endif
+	if (config->race_endpoints > 1)
+	  race_open();
 	socket.async_connect(server_endpoint, [self=Ptr(this)](const openvpn_io::error_code& error)
                                               {
                                                 OPENVPN_ASYNC_HANDLER;
@@ -302,8 +363,13 @@ namespace openvpn {
 					config->stats));
 #ifdef OPENVPN_GREMLIN
 		impl->gremlin_config(config->gremlin_config);
+#endif
+#ifdef OPENVPN_IO_URING
+		if (config->io_uring)
+		  impl->io_uring_enable();
 #endif
 		impl->start(config->n_parallel);
+		race_start();
 		parent->transport_connecting();
 	      }
 	    else
@@ -317,6 +383,112 @@ namespace openvpn {
 	  }
       }
 
+      // Happy eyeballs (RFC 8305) style racing.  Besides the primary
+      // socket, open a connected socket to each of the next few
+      // addresses of the remote host, alternating address families.
+      // Outgoing packets are sent on all of them until the first
+      // server answers; that socket then becomes the session socket
+      // and the others are closed.
+      struct RaceLeg
+      {
+	RaceLeg(openvpn_io::io_context& io_context)
+	  : socket(io_context)
+	{
+	}
+
+	openvpn_io::ip::udp::socket socket;
+	UDPTransport::AsioEndpoint endpoint;
+	LinkImpl::Ptr impl;
+      };
+
+      void race_open()
+      {
+	std::vector<UDPTransport::AsioEndpoint> endpoints;
+	config->remote_list->get_race_endpoints(endpoints, config->race_endpoints);
+	for (size_t i = 1; i < endpoints.size(); ++i)
+	  {
+	    std::unique_ptr<RaceLeg> leg(new RaceLeg(resolver.get_executor().context()));
+	    const IP::Addr addr = IP::Addr::from_asio(endpoints[i].address());
+	    openvpn_io::error_code error;
+
+	    leg->endpoint = endpoints[i];
+	    parent->ip_hole_punch(addr);
+	    leg->socket.open(leg->endpoint.protocol(), error);
+	    if (error)
+	      continue;
+#if defined(OPENVPN_PLATFORM_TYPE_UNIX) || defined(OPENVPN_PLATFORM_UWP)
+	    if (config->socket_protect && !config->socket_protect->socket_protect(leg->socket.native_handle(), addr))
+	      {
+		config->stats->error(Error::SOCKET_PROTECT_ERROR);
+		continue;
+	      }
+#endif
+	    // connecting a UDP socket only sets its default peer, it doesn't block
+	    leg->socket.connect(leg->endpoint, error);
+	    if (error)
+	      continue;
+	    OPENVPN_LOG("Racing " << leg->endpoint << " via UDP");
+	    race.push_back(std::move(leg));
+	  }
+      }
+
+      void race_start()
+      {
+	for (auto &leg : race)
+	  {
+	    leg->impl.reset(new LinkImpl(this,
+					 leg->socket,
+					 (*config->frame)[Frame::READ_LINK_UDP],
+					 config->stats));
+#ifdef OPENVPN_GREMLIN
+	    leg->impl->gremlin_config(config->gremlin_config);
+#endif
+#ifdef OPENVPN_IO_URING
+	    if (config->io_uring)
+	      leg->impl->io_uring_enable();
+#endif
+	    leg->impl->start(config->n_parallel);
+	  }
+      }
+
+      // first packet received while racing, keep the socket it arrived on
+      void race_select(const UDPTransport::AsioEndpoint& sender)
+      {
+	if (sender != server_endpoint)
+	  {
+	    for (auto &leg : race)
+	      {
+		if (leg->impl && leg->endpoint == sender)
+		  {
+		    if (impl)
+		      impl->stop();
+		    socket.close();
+		    impl = leg->impl;
+		    server_endpoint = leg->endpoint;
+		    race_winner = std::move(leg);
+		    break;
+		  }
+	      }
+	    if (!race_winner)
+	      return;
+	  }
+	OPENVPN_LOG("Selected " << server_endpoint << " via UDP");
+	race_stop();
+      }
+
+      void race_stop()
+      {
+	for (auto &leg : race)
+	  {
+	    if (!leg)
+	      continue;
+	    if (leg->impl)
+	      leg->impl->stop();
+	    leg->socket.close();
+	  }
+	race.clear();
+      }
+
       std::string server_host;
       std::string server_port;
 
@@ -326,6 +498,9 @@ namespace openvpn {
       LinkImpl::Ptr impl;
       openvpn_io::ip::udp::resolver resolver;
       UDPTransport::AsioEndpoint server_endpoint;
+      std::vector<std::unique_ptr<RaceLeg>> race;
+      std::unique_ptr<RaceLeg> race_winner;
+      int pmtud_saved_mode = -1;  // socket's own IP_MTU_DISCOVER mode while DF is forced
       bool halt;
     };
 
@@ -27,6 +27,7 @@
 #include <vector>
 #include <utility>
 #include <sstream>
+#include <cstdint>
 
 #include <openvpn/common/rc.hpp>
 #include <openvpn/common/string.hpp>
@@ -40,24 +41,60 @@ namespace openvpn {
 
     OPENVPN_EXCEPTION(gremlin_error);
 
+    // Models one direction of a link: a fixed delay, optional random
+    // jitter and an optional bandwidth limit.  With jitter, datagrams
+    // may overtake each other.  An ordered (stream) queue never
+    // reorders, later packets wait for earlier ones instead.
     struct DelayedQueue : public RC<thread_unsafe_refcount>
     {
     public:
       typedef RCPtr<DelayedQueue> Ptr;
 
       DelayedQueue(openvpn_io::io_context& io_context,
-		   const unsigned int delay_ms)
+		   const unsigned int delay_ms,
+		   const unsigned int jitter_ms_arg,
+		   const unsigned int bandwidth_kbps_arg,
+		   const bool ordered_arg)
 	: dur(Time::Duration::milliseconds(delay_ms)),
+	  jitter_ms(jitter_ms_arg),
+	  bandwidth_kbps(bandwidth_kbps_arg),
+	  ordered(ordered_arg),
 	  next_event(io_context)
       {
       }
 
       template <class F>
-      void queue(F&& func_arg)
+      void queue(const size_t size, RandomAPI& rng, F&& func_arg)
       {
-	const bool empty = events.empty();
-	events.emplace_back(new Event<F>(Time::now() + dur, std::move(func_arg)));
-	if (empty)
+	Time fire = Time::now();
+
+	// serialization delay, packets queue up behind each other
+	if (bandwidth_kbps)
+	  {
+	    // like a router queue, drop datagrams beyond half a second of backlog
+	    if (!ordered && link_free > fire + Time::Duration::milliseconds(500))
+	      return;
+	    if (link_free > fire)
+	      fire = link_free;
+	    const std::uint64_t bits = std::uint64_t(size) * 8 * Time::prec + tx_carry;
+	    const std::uint64_t per_unit = std::uint64_t(bandwidth_kbps) * 1000;
+	    fire += Time::Duration::binary_ms(bits / per_unit);
+	    tx_carry = bits % per_unit;
+	    link_free = fire;
+	  }
+
+	fire += dur;
+	if (jitter_ms)
+	  fire += Time::Duration::milliseconds(rng.randrange(jitter_ms + 1));
+	if (ordered && !events.empty() && events.back()->fire_time() > fire)
+	  fire = events.back()->fire_time();
+
+	auto pos = events.end();
+	while (pos != events.begin() && (*(pos - 1))->fire_time() > fire)
+	  --pos;
+	const bool first = (pos == events.begin());
+	events.emplace(pos, new Event<F>(fire, std::move(func_arg)));
+	if (first)
 	  set_timer();
       }
 
@@ -113,16 +150,28 @@ namespace openvpn {
 	next_event.async_wait([self=Ptr(this)](const openvpn_io::error_code& error)
 			      {
 				if (!error)
-				  {
-				    EventBase& ev = *self->events.front();
-				    ev.call();
-				    self->events.pop_front();
-				    self->set_timer();
-				  }
+				  self->expire();
 			      });
       }
 
+      void expire()
+      {
+	const Time now = Time::now();
+	while (!events.empty() && events.front()->fire_time() <= now)
+	  {
+	    std::unique_ptr<EventBase> ev(std::move(events.front()));
+	    events.pop_front();
+	    ev->call();
+	  }
+	set_timer();
+      }
+
       Time::Duration dur;
+      unsigned int jitter_ms;
+      unsigned int bandwidth_kbps;
+      bool ordered;
+      Time link_free;
+      std::uint64_t tx_carry = 0;
       AsioTimer next_event;
       std::deque<std::unique_ptr<EventBase>> events;
     };
@@ -132,11 +181,14 @@ namespace openvpn {
     public:
       typedef RCPtr<Config> Ptr;
 
+      // config_str is either a profile name (see profile() below) or
+      // send_delay_ms,recv_delay_ms,send_drop_prob,recv_drop_prob[,jitter_ms[,bandwidth_kbps]]
+      // where a drop probability of N drops one packet in N.
       Config(const std::string& config_str)
       {
-	const std::vector<std::string> parms = string::split(config_str, ',');
+	const std::vector<std::string> parms = string::split(profile(string::trim_copy(config_str)), ',');
 	if (parms.size() < 4)
-	  throw gremlin_error("need 4 comma-separated values for send_delay_ms, recv_delay_ms, send_drop_prob, recv_drop_prob");
+	  throw gremlin_error("need 4 comma-separated values for send_delay_ms, recv_delay_ms, send_drop_prob, recv_drop_prob, or a profile name");
 	if (!parse_number(string::trim_copy(parms[0]), send_delay_ms))
 	  throw gremlin_error("send_delay_ms");
 	if (!parse_number(string::trim_copy(parms[1]), recv_delay_ms))
@@ -145,12 +197,31 @@ namespace openvpn {
 	  throw gremlin_error("send_drop_probability");
 	if (!parse_number(string::trim_copy(parms[3]), recv_drop_probability))
 	  throw gremlin_error("recv_drop_probability");
+	if (parms.size() >= 5 && !parse_number(string::trim_copy(parms[4]), jitter_ms))
+	  throw gremlin_error("jitter_ms");
+	if (parms.size() >= 6 && !parse_number(string::trim_copy(parms[5]), bandwidth_kbps))
+	  throw gremlin_error("bandwidth_kbps");
+      }
+
+      // Link profiles for benchmarking.  Delays are one way, the
+      // bandwidth applies to each direction.
+      static std::string profile(const std::string& name)
+      {
+	if (name == "3g")
+	  return "75,75,100,100,40,2000";
+	else if (name == "wifi-lossy")
+	  return "3,3,20,20,15,20000";
+	else if (name == "satellite")
+	  return "300,300,200,200,20,1000";
+	else
+	  return name;
       }
 
       std::string to_string() const
       {
 	std::ostringstream os;
-	os << '[' << send_delay_ms << ',' << recv_delay_ms << ',' << send_drop_probability << ',' << recv_drop_probability << ']';
+	os << '[' << send_delay_ms << ',' << recv_delay_ms << ',' << send_drop_probability << ',' << recv_drop_probability
+	   << ',' << jitter_ms << ',' << bandwidth_kbps << ']';
 	return os.str();
       }
 
@@ -158,6 +229,8 @@ namespace openvpn {
       unsigned int recv_delay_ms = 0;
       unsigned int send_drop_probability = 0;
       unsigned int recv_drop_probability = 0;
+      unsigned int jitter_ms = 0;
+      unsigned int bandwidth_kbps = 0;
     };
 
     class SendRecvQueue
@@ -167,24 +240,24 @@ namespace openvpn {
 		    const Config::Ptr& conf_arg,
 		    const bool tcp_arg)
 	: conf(conf_arg),
-	  send(new DelayedQueue(io_context, conf->send_delay_ms)),
-	  recv(new DelayedQueue(io_context, conf->recv_delay_ms)),
+	  send(new DelayedQueue(io_context, conf->send_delay_ms, conf->jitter_ms, conf->bandwidth_kbps, tcp_arg)),
+	  recv(new DelayedQueue(io_context, conf->recv_delay_ms, conf->jitter_ms, conf->bandwidth_kbps, tcp_arg)),
 	  tcp(tcp_arg)
       {
       }
 
       template <class F>
-      void send_queue(F&& func_arg)
+      void send_queue(const size_t size, F&& func_arg)
       {
 	if (tcp || flip(conf->send_drop_probability))
-	  send->queue(std::move(func_arg));
+	  send->queue(size, ri, std::move(func_arg));
       }
 
       template <class F>
-      void recv_queue(F&& func_arg)
+      void recv_queue(const size_t size, F&& func_arg)
       {
 	if (tcp || flip(conf->recv_drop_probability))
-	  recv->queue(std::move(func_arg));
+	  recv->queue(size, ri, std::move(func_arg));
       }
 
       size_t send_size() const
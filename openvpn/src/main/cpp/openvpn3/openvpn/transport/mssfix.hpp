@@ -21,7 +21,10 @@
 
 #pragma once
 
+#include <cstring>
+
 #include <openvpn/buffer/buffer.hpp>
+#include <openvpn/ip/classify.hpp>
 #include <openvpn/ip/ipcommon.hpp>
 #include <openvpn/ip/ip4.hpp>
 #include <openvpn/ip/ip6.hpp>
@@ -38,88 +41,39 @@ namespace openvpn {
   public:
     static void mssfix(BufferAllocated& buf, int mss_inter)
     {
-      if (buf.empty())
-	return;
-
-      switch (IPCommon::version(buf[0]))
-      {
-      case IPCommon::IPv4:
+      size_t l4_offset;
+      const unsigned int ipc = IPClassify::classify(buf.c_data(), buf.length(), l4_offset);
+      if (ipc & IPClassify::TCP_SYN)
 	{
-	  if (buf.length() <= sizeof(struct IPv4Header))
-	    break;
-
-	  const IPv4Header *iphdr = (const IPv4Header *)buf.c_data();
-
-	  auto ipv4hlen = IPv4Header::length(iphdr->version_len);
-
-	  if (iphdr->protocol == IPCommon::TCP &&
-	      ntohs(iphdr->tot_len) == buf.length() &&
-	      (ntohs(iphdr->frag_off) & IPv4Header::OFFMASK) == 0 &&
-	      ipv4hlen <= buf.length() &&
-	      buf.length() - ipv4hlen >= sizeof(struct TCPHeader))
-	    {
-	      TCPHeader* tcphdr = (TCPHeader*)(buf.data() + ipv4hlen);
-	      int ip_payload_len = buf.length() - ipv4hlen;
-
-	      do_mssfix(tcphdr, mss_inter - (sizeof(struct IPv4Header) + sizeof(struct TCPHeader)), ip_payload_len);
-	    }
+	  const int iphlen = (ipc & IPClassify::IPV4) ? sizeof(struct IPv4Header) : sizeof(struct IPv6Header);
+	  do_mssfix((TCPHeader *)(buf.data() + l4_offset),
+		    mss_inter - (iphlen + sizeof(struct TCPHeader)),
+		    buf.length() - l4_offset);
 	}
-	break;
-
-      case IPCommon::IPv6:
-	{
-	  if (buf.length() <= sizeof(struct IPv6Header))
-	    break;
-
-	  const IPv6Header *iphdr = (const IPv6Header *)buf.c_data();
-
-	  if (buf.length() != ntohs(iphdr->payload_len) + sizeof(struct IPv6Header))
-	    break;
-
-	  /* follow header chain until we reach final header, then check for TCP
-	   *
-	   * An IPv6 packet could, theoretically, have a chain of multiple headers
-	   * before the final header (TCP, UDP, ...), so we'd need to walk that
-	   * chain (see RFC 2460 and RFC 6564 for details).
-	   *
-	   * In practice, "most typically used" extention headers (AH, routing,
-	   * fragment, mobility) are very unlikely to be seen inside an OpenVPN
-	   * tun, so for now, we only handle the case of "single next header = TCP"
-	   */
-	  if (iphdr->nexthdr != IPCommon::TCP)
-	    break;
-
-	  /* skip IPv6 header (40 bytes),
-	   * verify remainder is large enough to contain a full TCP header
-	   */
-	  int payload_len = buf.length() - sizeof(struct IPv6Header);
-	  if (payload_len >= (int) sizeof(struct TCPHeader))
-	    {
-	      TCPHeader *tcphdr = (TCPHeader *)(buf.data() + sizeof(struct IPv6Header));
-	      do_mssfix(tcphdr, mss_inter - (sizeof(struct IPv6Header) + sizeof(struct TCPHeader)),
-			payload_len);
-	    }
-	}
-	break;
-      }
     }
 
   private:
+    // Called for SYN packets with TCP options only, see IPClassify
     static void do_mssfix(TCPHeader *tcphdr, int max_mss, int ip_payload_len)
     {
-      if ((tcphdr->flags & TCPHeader::FLAG_SYN) == 0)
-	return;
-
       int tcphlen = TCPHeader::length(tcphdr->doff_res);
-      if (tcphlen <= (int) sizeof(struct TCPHeader) || tcphlen > ip_payload_len)
+      if (tcphlen > ip_payload_len)
 	return;
 
       int olen, optlen; // length of options field and Option-Length
       uint8_t *opt; // option type
 
-      for (olen = tcphlen - sizeof(struct TCPHeader), opt = (uint8_t *)(tcphdr + 1);
-	   olen > 1;
-	   olen -= optlen, opt += optlen)
+      olen = tcphlen - sizeof(struct TCPHeader);
+      opt = (uint8_t *)(tcphdr + 1);
+
+      // every common stack sends MSS as the first option
+      if (opt[0] == TCPHeader::OPT_MAXSEG && opt[1] == TCPHeader::OPTLEN_MAXSEG)
+	{
+	  update_mss(tcphdr, opt, max_mss);
+	  return;
+	}
+
+      for (; olen > 1; olen -= optlen, opt += optlen)
       {
 	if (*opt == TCPHeader::OPT_EOL)
 	  break;
@@ -131,20 +85,31 @@ namespace openvpn {
 	    if (optlen <= 0 || optlen > olen)
 	      break;
 	    if ((*opt == TCPHeader::OPT_MAXSEG) && (optlen == TCPHeader::OPTLEN_MAXSEG))
-	      {
-		uint16_t mssval = (opt[2] << 8) + opt[3];
-		if (mssval > max_mss)
-		  {
-		    OPENVPN_LOG_MSSFIX("MTU MSS " << mssval << " -> " << max_mss);
-		    int accumulate = htons(mssval);
-		    opt[2] = (max_mss >> 8) & 0xff;
-		    opt[3] = max_mss & 0xff;
-		    accumulate -= htons(max_mss);
-		    tcp_adjust_checksum(accumulate, tcphdr->check);
-		  }
-	      }
+	      update_mss(tcphdr, opt, max_mss);
 	  }
       }
     }
+
+    static void update_mss(TCPHeader *tcphdr, uint8_t *opt, int max_mss)
+    {
+      uint16_t mssval = (opt[2] << 8) + opt[3];
+      if (mssval > max_mss)
+	{
+	  OPENVPN_LOG_MSSFIX("MTU MSS " << mssval << " -> " << max_mss);
+	  uint16_t old_word, new_word;
+	  std::memcpy(&old_word, opt + 2, sizeof(old_word));
+	  opt[2] = (max_mss >> 8) & 0xff;
+	  opt[3] = max_mss & 0xff;
+	  std::memcpy(&new_word, opt + 2, sizeof(new_word));
+	  if ((opt - (uint8_t *)tcphdr) & 1)
+	    {
+	      // at an odd offset, the MSS bytes fall in the other
+	      // halves of two checksum words
+	      old_word = uint16_t((old_word << 8) | (old_word >> 8));
+	      new_word = uint16_t((new_word << 8) | (new_word >> 8));
+	    }
+	  tcp_update_checksum(tcphdr->check, old_word, new_word);
+	}
+    }
   };
 }
@@ -4,6 +4,9 @@
 
 #include <openvpn/buffer/buffer.hpp>
 #include <openvpn/common/rc.hpp>
+#ifdef OPENVPN_GREMLIN
+#include <openvpn/transport/gremlin.hpp>
+#endif
 
 #pragma once
 
@@ -34,6 +37,9 @@ namespace openvpn
       virtual void set_raw_mode(const bool mode) = 0;
       virtual void start() = 0;
       virtual void stop() = 0;
+#ifdef OPENVPN_GREMLIN
+      virtual void gremlin_config(const Gremlin::Config::Ptr& config) = 0;
+#endif
     };
   }
 }
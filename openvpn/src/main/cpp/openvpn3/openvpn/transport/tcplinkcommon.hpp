@@ -388,7 +388,8 @@ namespace openvpn {
 #ifdef OPENVPN_GREMLIN
       void gremlin_queue_send_buffer(BufferPtr& buf)
       {
-	gremlin->send_queue([self=Ptr(this), buf=std::move(buf)]() mutable {
+	const size_t size = buf->size();
+	gremlin->send_queue(size, [self=Ptr(this), buf=std::move(buf)]() mutable {
 	    if (!self->halt)
 	      {
 		self->queue_send_buffer(buf);
@@ -398,7 +399,8 @@ namespace openvpn {
 
       bool gremlin_recv(BufferAllocated& buf)
       {
-	gremlin->recv_queue([self=Ptr(this), buf=std::move(buf)]() mutable {
+	const size_t size = buf.size();
+	gremlin->recv_queue(size, [self=Ptr(this), buf=std::move(buf)]() mutable {
 	    if (!self->halt)
 	      {
 		const bool requeue = self->read_handler->tcp_read_handler(buf);
@@ -37,6 +37,10 @@
 #include <openvpn/transport/gremlin.hpp>
 #endif
 
+#ifdef OPENVPN_IO_URING
+#include <openvpn/io/uring.hpp>
+#endif
+
 #if defined(OPENVPN_DEBUG_UDPLINK) && OPENVPN_DEBUG_UDPLINK >= 1
 #define OPENVPN_LOG_UDPLINK_ERROR(x) OPENVPN_LOG(x)
 #else
@@ -92,6 +96,18 @@ namespace openvpn {
       }
 #endif
 
+#ifdef OPENVPN_IO_URING
+      // Move socket reads and writes to io_uring, if the kernel
+      // supports it.  Must be called before start().
+      void io_uring_enable()
+      {
+	uring = IoUring::Endpoint::new_obj(socket.get_executor().context(),
+					   socket.native_handle(),
+					   IoUring::Endpoint::DATAGRAM,
+					   frame_context.capacity());
+      }
+#endif
+
       // Returns 0 on success, or a system error code on error.
       // May also return SEND_PARTIAL or SEND_SOCKET_HALTED.
       int send(const Buffer& buf, const AsioEndpoint* endpoint)
@@ -111,6 +127,13 @@ namespace openvpn {
       {
 	if (!halt)
 	  {
+#ifdef OPENVPN_IO_URING
+	    if (uring)
+	      {
+		uring_start();
+		return;
+	      }
+#endif
 	    for (int i = 0; i < n_parallel; i++)
 	      queue_read(nullptr);
 	  }
@@ -119,6 +142,10 @@ namespace openvpn {
       void stop()
       {
 	halt = true;
+#ifdef OPENVPN_IO_URING
+	if (uring)
+	  uring->stop();
+#endif
 #ifdef OPENVPN_GREMLIN
 	if (gremlin)
 	  gremlin->stop();
@@ -158,15 +185,7 @@ namespace openvpn {
 		if (!error)
 		  {
 		    OPENVPN_LOG_UDPLINK_VERBOSE("UDP[" << bytes_recvd << "] from " << pfp->sender_endpoint);
-		    pfp->buf.set_size(bytes_recvd);
-		    stats->inc_stat(SessionStats::BYTES_IN, bytes_recvd);
-		    stats->inc_stat(SessionStats::PACKETS_IN, 1);
-#ifdef OPENVPN_GREMLIN
-		    if (gremlin)
-		      gremlin_recv(pfp);
-		    else
-#endif
-		    read_handler->udp_read_handler(pfp);
+		    read_done(pfp, bytes_recvd);
 		  }
 		else
 		  {
@@ -179,10 +198,33 @@ namespace openvpn {
 	  }
       }
 
+      void read_done(PacketFrom::SPtr& pfp, const size_t bytes_recvd)
+      {
+	pfp->buf.set_size(bytes_recvd);
+	stats->inc_stat(SessionStats::BYTES_IN, bytes_recvd);
+	stats->inc_stat(SessionStats::PACKETS_IN, 1);
+#ifdef OPENVPN_GREMLIN
+	if (gremlin)
+	  gremlin_recv(pfp);
+	else
+#endif
+	read_handler->udp_read_handler(pfp);
+      }
+
       int do_send(const Buffer& buf, const AsioEndpoint* endpoint)
       {
 	if (!halt)
 	  {
+#ifdef OPENVPN_IO_URING
+	    if (uring && uring->write(buf,
+				      endpoint ? endpoint->data() : nullptr,
+				      endpoint ? (socklen_t)endpoint->size() : 0))
+	      {
+		stats->inc_stat(SessionStats::BYTES_OUT, buf.size());
+		stats->inc_stat(SessionStats::PACKETS_OUT, 1);
+		return 0;
+	      }
+#endif
 	    try {
 	      const size_t wrote = endpoint
 		? socket.send_to(buf.const_buffer(), *endpoint)
@@ -209,13 +251,56 @@ namespace openvpn {
 	  return SEND_SOCKET_HALTED;
       }
 
+#ifdef OPENVPN_IO_URING
+      void uring_start()
+      {
+	uring->start([this](const unsigned char* data, const size_t size,
+			    const struct sockaddr* from, const socklen_t fromlen)
+		     {
+		       Ptr self(this);
+		       if (halt)
+			 return;
+		       if (!uring_pfp)
+			 uring_pfp.reset(new PacketFrom());
+		       frame_context.prepare(uring_pfp->buf);
+		       if (size > uring_pfp->buf.remaining(0))
+			 {
+			   OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: packet too large");
+			   stats->error(Error::NETWORK_RECV_ERROR);
+			   return;
+			 }
+		       std::memcpy(uring_pfp->buf.data(), data, size);
+		       if (from)
+			 {
+			   std::memcpy(uring_pfp->sender_endpoint.data(), from, fromlen);
+			   uring_pfp->sender_endpoint.resize(fromlen);
+			 }
+		       OPENVPN_LOG_UDPLINK_VERBOSE("UDP[" << size << "] from " << uring_pfp->sender_endpoint);
+		       read_done(uring_pfp, size);
+		     },
+		     [this](const int err, const bool write)
+		     {
+		       if (write)
+			 {
+			   OPENVPN_LOG_UDPLINK_ERROR("UDP send error: " << std::strerror(err));
+			   stats->error(Error::NETWORK_SEND_ERROR);
+			 }
+		       else
+			 {
+			   OPENVPN_LOG_UDPLINK_ERROR("UDP recv error: " << std::strerror(err));
+			   stats->error(Error::NETWORK_RECV_ERROR);
+			 }
+		     });
+      }
+#endif
+
 #ifdef OPENVPN_GREMLIN
       void gremlin_send(const Buffer& buf, const AsioEndpoint* endpoint)
       {
 	std::unique_ptr<AsioEndpoint> ep;
 	if (endpoint)
 	  ep.reset(new AsioEndpoint(*endpoint));
-	gremlin->send_queue([self=Ptr(this), buf=BufferAllocated(buf, 0), ep=std::move(ep)]() mutable {
+	gremlin->send_queue(buf.size(), [self=Ptr(this), buf=BufferAllocated(buf, 0), ep=std::move(ep)]() mutable {
 	    if (!self->halt)
 	      self->do_send(buf, ep.get());
 	  });
@@ -223,7 +308,8 @@ namespace openvpn {
 
       void gremlin_recv(PacketFrom::SPtr& pfp)
       {
-	gremlin->recv_queue([self=Ptr(this), pfp=std::move(pfp)]() mutable {
+	const size_t size = pfp->buf.size();
+	gremlin->recv_queue(size, [self=Ptr(this), pfp=std::move(pfp)]() mutable {
 	    if (!self->halt)
 	      self->read_handler->udp_read_handler(pfp);
 	  });
@@ -239,6 +325,11 @@ namespace openvpn {
 #ifdef OPENVPN_GREMLIN
       std::unique_ptr<Gremlin::SendRecvQueue> gremlin;
 #endif
+
+#ifdef OPENVPN_IO_URING
+      IoUring::Endpoint::Ptr uring;
+      PacketFrom::SPtr uring_pfp;  // reused unless the read handler keeps it
+#endif
     };
   }
 } // namespace openvpn
@@ -86,6 +86,7 @@ namespace openvpn {
       int n_parallel;            // number of parallel async reads on tun socket
       bool retain_sd;
       bool tun_prefix;
+      bool io_uring;             // use io_uring for tun I/O if available
       Frame::Ptr frame;
       SessionStats::Ptr stats;
       EmulateExcludeRouteFactory::Ptr eer_factory;
@@ -109,7 +110,7 @@ namespace openvpn {
 
     private:
       ClientConfig()
-	: n_parallel(8), retain_sd(false), tun_prefix(false), builder(nullptr) {}
+	: n_parallel(8), retain_sd(false), tun_prefix(false), io_uring(false), builder(nullptr) {}
     };
 
     // The tun interface
@@ -182,6 +183,10 @@ namespace openvpn {
 				     config->frame,
 				     config->stats
 				     ));
+#ifdef OPENVPN_IO_URING
+	      if (config->io_uring)
+		impl->io_uring_enable();
+#endif
 	      impl->start(config->n_parallel);
 
 	      // signal that we are connected
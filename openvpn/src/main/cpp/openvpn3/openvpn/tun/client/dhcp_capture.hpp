@@ -28,6 +28,7 @@
 #include <openvpn/buffer/buffer.hpp>
 #include <openvpn/ip/ipcommon.hpp>
 #include <openvpn/ip/dhcp.hpp>
+#include <openvpn/ip/classify.hpp>
 #include <openvpn/tun/builder/capture.hpp>
 
 namespace openvpn {
@@ -54,9 +55,12 @@ namespace openvpn {
 	return false;
 
       DHCPPacket* dhcp = (DHCPPacket*)buf.data();
-      if (dhcp->ip.protocol == IPCommon::UDP
-	  && dhcp->udp.source == htons(DHCP::BOOTPS_PORT)
-	  && dhcp->udp.dest == htons(DHCP::BOOTPC_PORT)
+      size_t l4_offset;
+      const unsigned int ipc = IPClassify::classify(buf.c_data() + sizeof(EthHeader),
+						    buf.size() - sizeof(EthHeader),
+						    l4_offset);
+      if ((ipc & IPClassify::DHCP_REPLY)
+	  && l4_offset == sizeof(IPv4Header) // DHCPPacket has no room for IP options
 	  && dhcp->dhcp.op == DHCP::BOOTREPLY)
 	{
 	  const unsigned int optlen = buf.size() - sizeof(DHCPPacket);
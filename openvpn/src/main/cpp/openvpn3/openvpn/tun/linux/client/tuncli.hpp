@@ -87,6 +87,7 @@ namespace openvpn {
       TunProp::Config tun_prop;
 
       int n_parallel = 8;
+      bool io_uring = false;  // use io_uring for tun I/O if available
       Frame::Ptr frame;
       SessionStats::Ptr stats;
 
@@ -220,6 +221,10 @@ namespace openvpn {
 				     sd,
 				     state->iface_name
 				     ));
+#ifdef OPENVPN_IO_URING
+	      if (config->io_uring)
+		impl->io_uring_enable();
+#endif
 	      impl->start(config->n_parallel);
 
 	      // signal that we are connected
@@ -35,6 +35,10 @@
 #include <openvpn/log/sessionstats.hpp>
 #include <openvpn/tun/tunlog.hpp>
 
+#ifdef OPENVPN_IO_URING
+#include <openvpn/io/uring.hpp>
+#endif
+
 namespace openvpn {
 
   template <typename ReadHandler, typename PacketFrom, typename STREAM>
@@ -96,6 +100,18 @@ namespace openvpn {
 		  }
 	      }
 
+#ifdef OPENVPN_IO_URING
+	    if (uring && uring->write(buf, nullptr, 0))
+	      {
+		if (stats)
+		  {
+		    stats->inc_stat(SessionStats::TUN_BYTES_OUT, buf.size());
+		    stats->inc_stat(SessionStats::TUN_PACKETS_OUT, 1);
+		  }
+		return true;
+	      }
+#endif
+
 	    // write data to tun device
 	    const size_t wrote = stream->write_some(buf.const_buffer());
 	    if (stats)
@@ -156,10 +172,29 @@ namespace openvpn {
 	return false;
     }
 
+#ifdef OPENVPN_IO_URING
+    // Move tun reads and writes to io_uring, if the kernel supports
+    // it.  Must be called after the stream is set and before start().
+    void io_uring_enable()
+    {
+      uring = IoUring::Endpoint::new_obj(stream->get_executor().context(),
+					 stream->native_handle(),
+					 IoUring::Endpoint::STREAM,
+					 frame_context.capacity());
+    }
+#endif
+
     void start(const int n_parallel)
     {
       if (!halt)
 	{
+#ifdef OPENVPN_IO_URING
+	  if (uring)
+	    {
+	      uring_start();
+	      return;
+	    }
+#endif
 	  for (int i = 0; i < n_parallel; i++)
 	    queue_read(nullptr);
 	}
@@ -171,6 +206,10 @@ namespace openvpn {
       if (!halt)
 	{
 	  halt = true;
+#ifdef OPENVPN_IO_URING
+	  if (uring)
+	    uring->stop();
+#endif
 	  if (stream)
 	    {
 	      stream->cancel();
@@ -220,29 +259,7 @@ namespace openvpn {
       if (!halt)
 	{
 	  if (!error)
-	    {
-	      pfp->buf.set_size(bytes_recvd);
-	      if (stats)
-		{
-		  stats->inc_stat(SessionStats::TUN_BYTES_IN, bytes_recvd);
-		  stats->inc_stat(SessionStats::TUN_PACKETS_IN, 1);
-		}
-	      if (!tun_prefix)
-		{
-		  read_handler->tun_read_handler(pfp);
-		}
-	      else if (pfp->buf.size() >= 4)
-		{
-		  // handle tun packet prefix, if enabled
-		  pfp->buf.advance(4);
-		  read_handler->tun_read_handler(pfp);
-		}
-	      else
-		{
-		  OPENVPN_LOG_TUN_ERROR("TUN Read Error: cannot read prefix");
-		  tun_error(Error::TUN_READ_ERROR, nullptr);
-		}
-	    }
+	    read_done(pfp, bytes_recvd);
 	  else
 	    {
 	      OPENVPN_LOG_TUN_ERROR("TUN Read Error: " << error.message());
@@ -253,6 +270,70 @@ namespace openvpn {
 	}
     }
 
+    void read_done(typename PacketFrom::SPtr& pfp, const size_t bytes_recvd)
+    {
+      pfp->buf.set_size(bytes_recvd);
+      if (stats)
+	{
+	  stats->inc_stat(SessionStats::TUN_BYTES_IN, bytes_recvd);
+	  stats->inc_stat(SessionStats::TUN_PACKETS_IN, 1);
+	}
+      if (!tun_prefix)
+	{
+	  read_handler->tun_read_handler(pfp);
+	}
+      else if (pfp->buf.size() >= 4)
+	{
+	  // handle tun packet prefix, if enabled
+	  pfp->buf.advance(4);
+	  read_handler->tun_read_handler(pfp);
+	}
+      else
+	{
+	  OPENVPN_LOG_TUN_ERROR("TUN Read Error: cannot read prefix");
+	  tun_error(Error::TUN_READ_ERROR, nullptr);
+	}
+    }
+
+#ifdef OPENVPN_IO_URING
+    void uring_start()
+    {
+      uring->start([this](const unsigned char* data, const size_t size,
+			  const struct sockaddr*, const socklen_t)
+		   {
+		     Ptr self(this);
+		     if (halt)
+		       return;
+		     if (!uring_pfp)
+		       uring_pfp.reset(new PacketFrom());
+		     frame_context.prepare(uring_pfp->buf);
+		     if (size > uring_pfp->buf.remaining(0))
+		       {
+			 OPENVPN_LOG_TUN_ERROR("TUN Read Error: packet too large");
+			 tun_error(Error::TUN_READ_ERROR, nullptr);
+			 return;
+		       }
+		     std::memcpy(uring_pfp->buf.data(), data, size);
+		     read_done(uring_pfp, size);
+		   },
+		   [this](const int err, const bool write)
+		   {
+		     Ptr self(this);
+		     const openvpn_io::error_code error(err, openvpn_io::error::get_system_category());
+		     if (write)
+		       {
+			 OPENVPN_LOG_TUN_ERROR("TUN write error: " << error.message());
+			 tun_error(Error::TUN_WRITE_ERROR, err ? &error : nullptr);
+		       }
+		     else
+		       {
+			 OPENVPN_LOG_TUN_ERROR("TUN Read Error: " << error.message());
+			 tun_error(Error::TUN_READ_ERROR, &error);
+		       }
+		   });
+    }
+#endif
+
     void tun_error(const Error::Type errtype, const openvpn_io::error_code* error)
     {
       if (stats)
@@ -271,6 +352,11 @@ namespace openvpn {
     const Frame::Ptr frame;
     const Frame::Context& frame_context;
     SessionStats::Ptr stats;
+
+#ifdef OPENVPN_IO_URING
+    IoUring::Endpoint::Ptr uring;
+    typename PacketFrom::SPtr uring_pfp;  // reused unless the read handler keeps it
+#endif
   };
 }
 
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Traffic probe for the gremlin benchmark.
+
+  probe.py serve PORT                  -- TCP source and UDP echo server
+  probe.py goodput ADDR PORT SECONDS   -- bulk TCP download, prints bits/s
+  probe.py latency ADDR PORT COUNT MS  -- UDP echo every MS milliseconds,
+                                          prints RTT percentiles and loss
+"""
+
+import socket
+import struct
+import sys
+import threading
+import time
+
+CHUNK = 65536
+
+
+def serve(port):
+    def udp_echo():
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        s.bind(('0.0.0.0', port))
+        while True:
+            data, addr = s.recvfrom(2048)
+            s.sendto(data, addr)
+
+    def source(conn):
+        buf = bytes(CHUNK)
+        try:
+            while True:
+                conn.sendall(buf)
+        except OSError:
+            pass
+        finally:
+            conn.close()
+
+    threading.Thread(target=udp_echo, daemon=True).start()
+    ls = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    ls.bind(('0.0.0.0', port))
+    ls.listen(8)
+    while True:
+        conn, _ = ls.accept()
+        threading.Thread(target=source, args=(conn,), daemon=True).start()
+
+
+def goodput(addr, port, seconds):
+    s = socket.create_connection((addr, port), timeout=30)
+    # skip the first second, it is dominated by slow start
+    warmup = time.monotonic() + 1.0
+    end = warmup + seconds
+    total = 0
+    start = None
+    while True:
+        now = time.monotonic()
+        if now >= end:
+            break
+        n = len(s.recv(CHUNK))
+        if not n:
+            break
+        if now >= warmup:
+            if start is None:
+                start = now
+            else:
+                total += n
+    s.close()
+    elapsed = time.monotonic() - start if start else 0
+    print('goodput_bps %d' % (total * 8 / elapsed if elapsed > 0 else 0))
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    k = min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))
+    return values[k]
+
+
+def latency(addr, port, count, interval_ms):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.connect((addr, port))
+    sent = {}
+    rtts = []
+    done = threading.Event()
+
+    def receive():
+        # after the last echo request, wait up to 3s for stragglers
+        while True:
+            try:
+                data = s.recv(2048)
+            except socket.timeout:
+                if done.is_set():
+                    return
+                continue
+            except OSError:
+                return
+            seq, = struct.unpack('!I', data[:4])
+            if seq in sent:
+                rtts.append((time.monotonic() - sent.pop(seq)) * 1000.0)
+
+    s.settimeout(3.0)
+    t = threading.Thread(target=receive)
+    t.start()
+    for seq in range(count):
+        sent[seq] = time.monotonic()
+        s.send(struct.pack('!I', seq) + bytes(60))
+        time.sleep(interval_ms / 1000.0)
+    done.set()
+    t.join()
+    rtts.sort()
+    print('latency_ms %.1f %.1f %.1f loss_pct %.1f' % (
+        percentile(rtts, 50), percentile(rtts, 90), percentile(rtts, 99),
+        100.0 * (count - len(rtts)) / count))
+
+
+def main(argv):
+    if len(argv) >= 3 and argv[1] == 'serve':
+        serve(int(argv[2]))
+    elif len(argv) >= 5 and argv[1] == 'goodput':
+        goodput(argv[2], int(argv[3]), float(argv[4]))
+    elif len(argv) >= 6 and argv[1] == 'latency':
+        latency(argv[2], int(argv[3]), int(argv[4]), float(argv[5]))
+    else:
+        sys.stderr.write(__doc__)
+        return 2
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
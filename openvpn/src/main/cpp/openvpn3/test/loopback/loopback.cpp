@@ -0,0 +1,972 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+// Data path benchmark: a ClientProto::Session and a ServerProto
+// session in one process, connected by an in-memory link, with
+// packet generators in place of the tun devices.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+#include <openvpn/common/platform.hpp>
+
+#ifdef VERBOSE
+#include <openvpn/log/logsimple.hpp>
+#else
+#include <openvpn/log/lognull.hpp>
+#endif
+
+#include <openvpn/io/io.hpp>
+#include <openvpn/common/exception.hpp>
+#include <openvpn/common/file.hpp>
+#include <openvpn/common/options.hpp>
+#include <openvpn/common/string.hpp>
+#include <openvpn/time/time.hpp>
+#include <openvpn/frame/frame_init.hpp>
+#include <openvpn/init/initprocess.hpp>
+#include <openvpn/ssl/sslchoose.hpp>
+#include <openvpn/crypto/cryptodcsel.hpp>
+#include <openvpn/client/cliproto.hpp>
+#include <openvpn/server/servproto.hpp>
+
+using namespace openvpn;
+
+typedef std::chrono::steady_clock Clock;
+
+OPENVPN_EXCEPTION(loopback_error);
+
+// Generates the packets for one measurement and collects them at the
+// far end.  Each packet is an IPv4/UDP datagram with a compressible
+// payload; the generator stamps a sequence number into the UDP header
+// and the receiver uses it to look up the send time and to check that
+// the packet arrived intact.
+class Probe
+{
+public:
+  Probe(const size_t count, const size_t size)
+    : send_time(count),
+      packet(std::max(size, size_t(28)))
+  {
+    static const char text[] =
+      "It was a bright cold day in April, and the clocks were striking thirteen. ";
+
+    latency.reserve(count);
+    for (size_t i = 28; i < packet.size(); ++i)
+      packet[i] = text[(i - 28) % (sizeof(text) - 1)];
+
+    // IPv4 header: 10.198.0.2 -> 10.198.0.1, UDP
+    packet[0] = 0x45;
+    packet[2] = std::uint8_t(packet.size() >> 8);
+    packet[3] = std::uint8_t(packet.size());
+    packet[8] = 64;
+    packet[9] = 17;
+    const std::uint8_t addrs[] = { 10, 198, 0, 2, 10, 198, 0, 1 };
+    std::memcpy(&packet[12], addrs, sizeof(addrs));
+  }
+
+  void generate(BufferAllocated& buf, const std::uint32_t seq)
+  {
+    std::memcpy(&packet[20], &seq, sizeof(seq));
+    buf.write(packet.data(), packet.size());
+    send_time[seq] = Clock::now();
+  }
+
+  void receive(const Buffer& buf)
+  {
+    const Clock::time_point now = Clock::now();
+    std::uint32_t seq;
+    if (buf.size() != packet.size())
+      {
+	++errors;
+	return;
+      }
+    std::memcpy(&seq, buf.c_data() + 20, sizeof(seq));
+    if (seq >= send_time.size()
+	|| std::memcmp(buf.c_data() + 24, &packet[24], packet.size() - 24))
+      {
+	++errors;
+	return;
+      }
+    latency.push_back(std::chrono::duration<double, std::micro>(now - send_time[seq]).count());
+    bytes += buf.size();
+  }
+
+  size_t received() const { return latency.size(); }
+  size_t size() const { return packet.size(); }
+
+  std::vector<Clock::time_point> send_time;
+  std::vector<double> latency; // microseconds
+  size_t bytes = 0;
+  size_t errors = 0;
+
+private:
+  std::vector<std::uint8_t> packet;
+};
+
+// One direction of the in-memory link.  Packets are copied, as a
+// socket would, and delivered from the io_context, so that neither
+// side is re-entered from within its own send.
+class Wire
+{
+public:
+  typedef std::function<void(BufferAllocated&)> RecvFunc;
+
+  Wire(openvpn_io::io_context& io_context_arg,
+       const Frame::Context& frame_context_arg)
+    : io_context(io_context_arg),
+      frame_context(frame_context_arg)
+  {
+  }
+
+  bool send(const Buffer& buf)
+  {
+    BufferAllocated b;
+    if (!free_list.empty())
+      {
+	b = std::move(free_list.back());
+	free_list.pop_back();
+      }
+    frame_context.prepare(b);
+    b.write(buf.c_data(), buf.size());
+    queue.push_back(std::move(b));
+    if (!scheduled)
+      {
+	scheduled = true;
+	openvpn_io::post(io_context, [this]() {
+	    drain();
+	  });
+      }
+    return true;
+  }
+
+  RecvFunc recv;
+
+private:
+  void drain()
+  {
+    scheduled = false;
+    while (!queue.empty())
+      {
+	BufferAllocated b(std::move(queue.front()));
+	queue.pop_front();
+	if (recv)
+	  recv(b);
+	free_list.push_back(std::move(b));
+      }
+  }
+
+  openvpn_io::io_context& io_context;
+  Frame::Context frame_context;
+  std::deque<BufferAllocated> queue;
+  std::vector<BufferAllocated> free_list;
+  bool scheduled = false;
+};
+
+// client transport: sends on one wire, receives from the other
+class LinkClient : public TransportClient
+{
+public:
+  typedef RCPtr<LinkClient> Ptr;
+
+  LinkClient(openvpn_io::io_context& io_context_arg,
+	     Wire& out_arg,
+	     TransportClientParent* parent_arg)
+    : io_context(io_context_arg),
+      out(out_arg),
+      parent(parent_arg)
+  {
+  }
+
+  void recv(BufferAllocated& buf)
+  {
+    if (!halt)
+      parent->transport_recv(buf);
+  }
+
+  virtual void transport_start() override
+  {
+    openvpn_io::post(io_context, [self=Ptr(this)]() {
+	if (!self->halt)
+	  self->parent->transport_connecting();
+      });
+  }
+
+  virtual void stop() override { halt = true; }
+
+  virtual bool transport_send_const(const Buffer& buf) override
+  {
+    return !halt && out.send(buf);
+  }
+
+  virtual bool transport_send(BufferAllocated& buf) override
+  {
+    return !halt && out.send(buf);
+  }
+
+  virtual bool transport_send_queue_empty() override { return true; }
+  virtual bool transport_has_send_queue() override { return false; }
+  virtual void transport_stop_requeueing() override {}
+  virtual unsigned int transport_send_queue_size() override { return 0; }
+  virtual void reset_align_adjust(const size_t align_adjust) override {}
+
+  virtual IP::Addr server_endpoint_addr() const override
+  {
+    return IP::Addr::from_string("10.199.0.2");
+  }
+
+  virtual void server_endpoint_info(std::string& host, std::string& port,
+				    std::string& proto, std::string& ip_addr) const override
+  {
+    host = "loopback";
+    port = "1194";
+    proto = "UDP";
+    ip_addr = "10.199.0.2";
+  }
+
+  virtual Protocol transport_protocol() const override
+  {
+    return Protocol(Protocol::UDPv4);
+  }
+
+  virtual void transport_reparent(TransportClientParent* parent_arg) override
+  {
+    parent = parent_arg;
+  }
+
+private:
+  openvpn_io::io_context& io_context;
+  Wire& out;
+  TransportClientParent* parent;
+  bool halt = false;
+};
+
+class LinkClientFactory : public TransportClientFactory
+{
+public:
+  typedef RCPtr<LinkClientFactory> Ptr;
+
+  explicit LinkClientFactory(Wire& out_arg)
+    : out(out_arg)
+  {
+  }
+
+  virtual TransportClient::Ptr new_transport_client_obj(openvpn_io::io_context& io_context,
+							TransportClientParent* parent) override
+  {
+    client.reset(new LinkClient(io_context, out, parent));
+    return client;
+  }
+
+  LinkClient::Ptr client;
+
+private:
+  Wire& out;
+};
+
+// server transport for the one client instance
+class LinkServer : public TransportClientInstance::Send
+{
+public:
+  typedef RCPtr<LinkServer> Ptr;
+
+  explicit LinkServer(Wire& out_arg)
+    : out(out_arg),
+      info("UDP 10.199.0.1:1194")
+  {
+  }
+
+  virtual bool defined() const override { return !halt; }
+  virtual void stop() override { halt = true; }
+
+  virtual bool transport_send_const(const Buffer& buf) override
+  {
+    return !halt && out.send(buf);
+  }
+
+  virtual bool transport_send(BufferAllocated& buf) override
+  {
+    return !halt && out.send(buf);
+  }
+
+  virtual const std::string& transport_info() const override { return info; }
+  virtual bool stats_pending() const override { return false; }
+  virtual PeerStats stats_poll() override { return PeerStats(); }
+
+private:
+  Wire& out;
+  std::string info;
+  bool halt = false;
+};
+
+// client tun: hands generated packets to the session, feeds
+// decrypted ones to the probe
+class TunClientGen : public TunClient
+{
+public:
+  typedef RCPtr<TunClientGen> Ptr;
+
+  explicit TunClientGen(TunClientParent& parent_arg)
+    : parent(parent_arg)
+  {
+  }
+
+  void inject(BufferAllocated& buf)
+  {
+    parent.tun_recv(buf);
+  }
+
+  virtual void tun_start(const OptionList&, TransportClient&, CryptoDCSettings&) override
+  {
+    parent.tun_connected();
+  }
+
+  virtual void stop() override { probe = nullptr; }
+  virtual void set_disconnect() override {}
+
+  virtual bool tun_send(BufferAllocated& buf) override
+  {
+    if (probe)
+      probe->receive(buf);
+    return true;
+  }
+
+  virtual std::string tun_name() const override { return "TUN_GEN"; }
+  virtual std::string vpn_ip4() const override { return "10.198.0.2"; }
+  virtual std::string vpn_ip6() const override { return ""; }
+
+  Probe* probe = nullptr;
+
+private:
+  TunClientParent& parent;
+};
+
+class TunClientGenFactory : public TunClientFactory
+{
+public:
+  typedef RCPtr<TunClientGenFactory> Ptr;
+
+  virtual TunClient::Ptr new_tun_client_obj(openvpn_io::io_context& io_context,
+					    TunClientParent& parent,
+					    TransportClient* transcli) override
+  {
+    tun.reset(new TunClientGen(parent));
+    return tun;
+  }
+
+  TunClientGen::Ptr tun;
+};
+
+// server tun, the same in the other direction
+class TunServerGen : public TunClientInstance::Send
+{
+public:
+  typedef RCPtr<TunServerGen> Ptr;
+
+  explicit TunServerGen(TunClientInstance::Recv* parent_arg)
+    : parent(parent_arg),
+      info("TUN_GEN")
+  {
+  }
+
+  void inject(BufferAllocated& buf)
+  {
+    if (parent)
+      parent->tun_recv(buf);
+  }
+
+  virtual void stop() override
+  {
+    parent = nullptr;
+    probe = nullptr;
+  }
+
+  virtual bool tun_send_const(const Buffer& buf) override
+  {
+    if (probe)
+      probe->receive(buf);
+    return true;
+  }
+
+  virtual bool tun_send(BufferAllocated& buf) override
+  {
+    return tun_send_const(buf);
+  }
+
+  virtual TunClientInstance::NativeHandle tun_native_handle() override
+  {
+    return TunClientInstance::NativeHandle();
+  }
+
+  virtual void relay(const IP::Addr& target, const int port) override {}
+  virtual const std::string& tun_info() const override { return info; }
+
+  Probe* probe = nullptr;
+
+private:
+  TunClientInstance::Recv* parent;
+  std::string info;
+};
+
+class TunServerGenFactory : public TunClientInstance::Factory
+{
+public:
+  typedef RCPtr<TunServerGenFactory> Ptr;
+
+  virtual TunClientInstance::Send::Ptr new_obj(TunClientInstance::Recv* parent) override
+  {
+    tun.reset(new TunServerGen(parent));
+    return tun;
+  }
+
+  TunServerGen::Ptr tun;
+};
+
+// Management layer that accepts every client and answers its
+// PUSH_REQUEST with a fixed PUSH_REPLY.
+class ManPush : public ManClientInstance::Send
+{
+public:
+  typedef RCPtr<ManPush> Ptr;
+
+  ManPush(openvpn_io::io_context& io_context_arg,
+	  ManClientInstance::Recv* instance_arg,
+	  const std::string& push_reply_arg)
+    : io_context(io_context_arg),
+      instance(instance_arg),
+      push_reply(push_reply_arg)
+  {
+  }
+
+  virtual void pre_stop() override {}
+  virtual void stop() override { instance = nullptr; }
+
+  virtual void auth_request(const AuthCreds::Ptr& auth_creds,
+			    const AuthCert::Ptr& auth_cert,
+			    const PeerAddr::Ptr& peer_addr) override
+  {
+  }
+
+  virtual void push_request(ProtoContext::Config::Ptr pconf) override
+  {
+    // reply asynchronously, as a real management layer would
+    openvpn_io::post(io_context, [self=Ptr(this)]() {
+	if (self->instance)
+	  {
+	    BufferPtr buf(new BufferAllocated(256, BufferAllocated::GROW));
+	    buf_append_string(*buf, self->push_reply);
+	    std::vector<BufferPtr> msgs;
+	    msgs.push_back(std::move(buf));
+	    self->instance->push_reply(std::move(msgs));
+	  }
+      });
+  }
+
+  virtual void info_request(const std::string& imsg) override {}
+  virtual void stats_notify(const PeerStats& ps, const bool final) override {}
+  virtual void float_notify(const PeerAddr::Ptr& addr) override {}
+  virtual std::string instance_name() const override { return "loopback"; }
+  virtual std::uint64_t instance_id() const override { return 0; }
+  virtual std::string describe_user() override { return "{}"; }
+
+  virtual void disconnect_user(const HaltRestart::Type type,
+			       const AuthStatus::Type auth_status,
+			       const std::string& reason,
+			       const bool tell_client) override
+  {
+  }
+
+  virtual void post_info_user(BufferPtr&& info) override {}
+
+  virtual void set_acl_index(const int acl_index,
+			     const std::string* username,
+			     const bool challenge) override
+  {
+  }
+
+  virtual void userprop_local_update() override {}
+
+private:
+  openvpn_io::io_context& io_context;
+  ManClientInstance::Recv* instance;
+  std::string push_reply;
+};
+
+class ManPushFactory : public ManClientInstance::Factory
+{
+public:
+  typedef RCPtr<ManPushFactory> Ptr;
+
+  ManPushFactory(openvpn_io::io_context& io_context_arg,
+		 const std::string& push_reply_arg)
+    : io_context(io_context_arg),
+      push_reply(push_reply_arg)
+  {
+  }
+
+  virtual void start() override {}
+  virtual void stop() override {}
+
+  virtual ManClientInstance::Send::Ptr new_obj(ManClientInstance::Recv* instance) override
+  {
+    return new ManPush(io_context, instance, push_reply);
+  }
+
+private:
+  openvpn_io::io_context& io_context;
+  std::string push_reply;
+};
+
+class NullEvents : public ClientEvent::Queue
+{
+public:
+  typedef RCPtr<NullEvents> Ptr;
+
+  virtual void add_event(ClientEvent::Base::Ptr event) override
+  {
+    if (event->is_error())
+      std::cerr << "client: " << event->name() << ' ' << event->render() << std::endl;
+  }
+};
+
+// certificates and keys, read from a directory
+struct Keys
+{
+  explicit Keys(const std::string& dir)
+    : ca(read_text(dir + "/ca.crt")),
+      client_crt(read_text(dir + "/client.crt")),
+      client_key(read_text(dir + "/client.key")),
+      server_crt(read_text(dir + "/server.crt")),
+      server_key(read_text(dir + "/server.key")),
+      dh(read_text(dir + "/dh.pem"))
+  {
+  }
+
+  std::string ca;
+  std::string client_crt;
+  std::string client_key;
+  std::string server_crt;
+  std::string server_key;
+  std::string dh;
+};
+
+enum Direction {
+  UP,   // client tun -> server tun
+  DOWN, // server tun -> client tun
+};
+
+struct Result
+{
+  double seconds = 0;
+  size_t sent = 0;
+  size_t received = 0;
+  size_t bytes = 0;
+  size_t errors = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double max = 0;
+};
+
+// A connected client/server pair for one cipher and compression setting.
+class Loopback : public ClientProto::NotifyCallback
+{
+public:
+  Loopback(openvpn_io::io_context& io_context_arg,
+	   const Keys& keys,
+	   const std::string& cipher,
+	   const std::string& digest,
+	   const std::string& comp)
+    : io_context(io_context_arg),
+      frame(frame_init(true, 1500, 1250, false)),
+      to_server(io_context_arg, (*frame)[Frame::READ_LINK_UDP]),
+      to_client(io_context_arg, (*frame)[Frame::READ_LINK_UDP])
+  {
+    std::string profile = "dev tun\ncipher " + cipher + "\nauth " + digest + '\n';
+    std::string push = "PUSH_REPLY,cipher " + cipher + ",auth " + digest;
+    if (comp != "none")
+      {
+	profile += "compress " + comp + '\n';
+	push += ",compress " + comp;
+      }
+    push += ",peer-id 0,topology subnet,ifconfig 10.198.0.2 255.255.255.0";
+    const OptionList opt = OptionList::parse_from_config_static(profile, nullptr);
+
+    ProtoContextOptions::Ptr pco(new ProtoContextOptions());
+    if (comp != "none")
+      pco->compression_mode = ProtoContextOptions::COMPRESS_YES;
+
+    // server
+    {
+      SSLLib::RandomAPI::Ptr rng(new SSLLib::RandomAPI(false));
+      SSLLib::RandomAPI::Ptr prng(new SSLLib::RandomAPI(true));
+      SSLLib::SSLAPI::Config::Ptr sc(new SSLLib::SSLAPI::Config());
+      sc->set_mode(Mode(Mode::SERVER));
+      sc->set_frame(frame);
+      sc->load_ca(keys.ca, true);
+      sc->load_cert(keys.server_crt);
+      sc->load_private_key(keys.server_key);
+      sc->load_dh(keys.dh);
+      sc->set_rng(rng);
+
+      serv_stats.reset(new SessionStats());
+      ProtoContext::Config::Ptr sp(new ProtoContext::Config());
+      sp->load(opt, *pco, -1, true);
+      sp->ssl_factory = sc->new_factory();
+      sp->dc.set_factory(new CryptoDCSelect<SSLLib::CryptoAPI>(frame, serv_stats, prng));
+      sp->tlsprf_factory.reset(new CryptoTLSPRFFactory<SSLLib::CryptoAPI>());
+      sp->dc_deferred = true;
+      sp->frame = frame;
+      sp->now = &now;
+      sp->rng = rng;
+      sp->prng = prng;
+      sp->protocol = Protocol(Protocol::UDPv4);
+
+      server_factory.reset(new ServerProto::Factory(io_context, *sp));
+      server_factory->proto_context_config = sp;
+      server_factory->man_factory.reset(new ManPushFactory(io_context, push));
+      server_tun_factory.reset(new TunServerGenFactory());
+      server_factory->tun_factory = server_tun_factory;
+      server_factory->stats = serv_stats;
+    }
+
+    // client
+    {
+      SSLLib::RandomAPI::Ptr rng(new SSLLib::RandomAPI(false));
+      SSLLib::RandomAPI::Ptr prng(new SSLLib::RandomAPI(true));
+      SSLLib::SSLAPI::Config::Ptr cc(new SSLLib::SSLAPI::Config());
+      cc->set_mode(Mode(Mode::CLIENT));
+      cc->set_frame(frame);
+      cc->load_ca(keys.ca, true);
+      cc->load_cert(keys.client_crt);
+      cc->load_private_key(keys.client_key);
+      cc->set_rng(rng);
+
+      cli_stats.reset(new SessionStats());
+      ProtoContext::Config::Ptr cp(new ProtoContext::Config());
+      cp->load(opt, *pco, -1, false);
+      cp->ssl_factory = cc->new_factory();
+      cp->dc.set_factory(new CryptoDCSelect<SSLLib::CryptoAPI>(frame, cli_stats, prng));
+      cp->tlsprf_factory.reset(new CryptoTLSPRFFactory<SSLLib::CryptoAPI>());
+      cp->dc_deferred = true;
+      cp->frame = frame;
+      cp->now = &now;
+      cp->rng = rng;
+      cp->prng = prng;
+
+      transport_factory.reset(new LinkClientFactory(to_server));
+      client_tun_factory.reset(new TunClientGenFactory());
+
+      ClientProto::Session::Config cs;
+      cs.proto_context_config = cp;
+      cs.proto_context_options = pco;
+      cs.transport_factory = transport_factory;
+      cs.tun_factory = client_tun_factory;
+      cs.cli_stats = cli_stats;
+      cs.cli_events.reset(new NullEvents());
+      client.reset(new ClientProto::Session(io_context, cs, this));
+    }
+
+    // the server instance is created by the first packet from the client
+    to_server.recv = [this](BufferAllocated& buf) {
+      if (!server)
+	{
+	  if (!server_factory->validate_initial_packet(buf))
+	    return;
+	  server_link.reset(new LinkServer(to_client));
+	  server = server_factory->new_client_instance();
+	  server->start(server_link, new PeerAddr(), 0);
+	}
+      server->transport_recv(buf);
+    };
+    to_client.recv = [this](BufferAllocated& buf) {
+      if (transport_factory->client)
+	transport_factory->client->recv(buf);
+    };
+  }
+
+  ~Loopback()
+  {
+    stop();
+  }
+
+  void connect(const unsigned int timeout_seconds)
+  {
+    const Clock::time_point deadline = Clock::now() + std::chrono::seconds(timeout_seconds);
+    now.update();
+    client->start();
+    while (!connected && !terminated && Clock::now() < deadline)
+      io_context.run_one_for(std::chrono::milliseconds(100));
+    if (!connected)
+      OPENVPN_THROW(loopback_error, "not connected: " << Error::name(client->fatal())
+		    << ' ' << client->fatal_reason());
+  }
+
+  Result measure(const Direction dir, const size_t size,
+		 const size_t count, const size_t burst)
+  {
+    Probe probe(count, size);
+    const Frame::Context& fc = (*frame)[Frame::READ_TUN];
+    TunClientGen& ctun = *client_tun_factory->tun;
+    TunServerGen& stun = *server_tun_factory->tun;
+    BufferAllocated buf;
+    Result r;
+
+    if (dir == UP)
+      stun.probe = &probe;
+    else
+      ctun.probe = &probe;
+
+    const Clock::time_point t0 = Clock::now();
+    while (r.sent < count && !terminated)
+      {
+	for (size_t i = 0; i < burst && r.sent < count; ++i)
+	  {
+	    fc.prepare(buf);
+	    probe.generate(buf, std::uint32_t(r.sent++));
+	    if (dir == UP)
+	      ctun.inject(buf);
+	    else
+	      stun.inject(buf);
+	  }
+	io_context.poll();
+      }
+    while (probe.received() + probe.errors < r.sent && io_context.poll())
+      ;
+    r.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    stun.probe = nullptr;
+    ctun.probe = nullptr;
+
+    r.received = probe.received();
+    r.bytes = probe.bytes;
+    r.errors = probe.errors;
+    if (!probe.latency.empty())
+      {
+	std::vector<double>& l = probe.latency;
+	std::sort(l.begin(), l.end());
+	r.p50 = l[(l.size() - 1) / 2];
+	r.p90 = l[(l.size() - 1) * 90 / 100];
+	r.p99 = l[(l.size() - 1) * 99 / 100];
+	r.max = l.back();
+      }
+    return r;
+  }
+
+  void stop()
+  {
+    if (client)
+      client->stop(false);
+    if (server)
+      server->stop();
+    io_context.poll();
+  }
+
+private:
+  virtual void client_proto_terminate() override
+  {
+    terminated = true;
+  }
+
+  virtual void client_proto_connected() override
+  {
+    connected = true;
+  }
+
+  openvpn_io::io_context& io_context;
+  Time now;
+  Frame::Ptr frame;
+  Wire to_server;
+  Wire to_client;
+
+  SessionStats::Ptr cli_stats;
+  SessionStats::Ptr serv_stats;
+
+  LinkClientFactory::Ptr transport_factory;
+  TunClientGenFactory::Ptr client_tun_factory;
+  ClientProto::Session::Ptr client;
+
+  ServerProto::Factory::Ptr server_factory;
+  TunServerGenFactory::Ptr server_tun_factory;
+  LinkServer::Ptr server_link;
+  TransportClientInstance::Recv::Ptr server;
+
+  bool connected = false;
+  bool terminated = false;
+};
+
+static std::vector<std::string> split_list(const std::string& s)
+{
+  std::vector<std::string> ret;
+  size_t pos = 0;
+  while (pos <= s.length())
+    {
+      size_t end = s.find(',', pos);
+      if (end == std::string::npos)
+	end = s.length();
+      if (end > pos)
+	ret.push_back(s.substr(pos, end - pos));
+      pos = end + 1;
+    }
+  return ret;
+}
+
+static void usage()
+{
+  std::cerr << "usage: loopback [options]" << std::endl
+	    << "  -k dir          -- directory with ca.crt, client.crt, client.key," << std::endl
+	    << "                     server.crt, server.key and dh.pem (default: .)" << std::endl
+	    << "  -c c1,c2,...    -- ciphers (default: AES-128-GCM,AES-256-GCM,AES-256-CBC)" << std::endl
+	    << "  -a digest       -- HMAC digest for CBC ciphers (default: SHA256)" << std::endl
+#ifdef HAVE_LZ4
+	    << "  -z m1,m2,...    -- compression: none, stub-v2, lz4-v2, ... (default: none,lz4-v2)" << std::endl
+#else
+	    << "  -z m1,m2,...    -- compression: none, stub-v2, ... (default: none,stub-v2)" << std::endl
+#endif
+	    << "  -s n1,n2,...    -- IP packet sizes (default: 64,512,1400)" << std::endl
+	    << "  -n count        -- packets per measurement (default: 200000)" << std::endl
+	    << "  -b burst        -- packets generated per event loop pass (default: 8)" << std::endl
+	    << "  -d up|down|both -- direction (default: both)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string key_dir = ".";
+  std::vector<std::string> ciphers = { "AES-128-GCM", "AES-256-GCM", "AES-256-CBC" };
+  std::string digest = "SHA256";
+#ifdef HAVE_LZ4
+  std::vector<std::string> comps = { "none", "lz4-v2" };
+#else
+  std::vector<std::string> comps = { "none", "stub-v2" };
+#endif
+  std::vector<size_t> sizes = { 64, 512, 1400 };
+  size_t count = 200000;
+  size_t burst = 8;
+  std::vector<Direction> dirs = { UP, DOWN };
+
+  for (int i = 1; i < argc; ++i)
+    {
+      const std::string a = argv[i];
+      if (i + 1 >= argc || a.length() != 2 || a[0] != '-')
+	{
+	  usage();
+	  return 2;
+	}
+      const std::string v = argv[++i];
+      switch (a[1])
+	{
+	case 'k':
+	  key_dir = v;
+	  break;
+	case 'c':
+	  ciphers = split_list(v);
+	  break;
+	case 'a':
+	  digest = v;
+	  break;
+	case 'z':
+	  comps = split_list(v);
+	  break;
+	case 's':
+	  sizes.clear();
+	  for (auto& s : split_list(v))
+	    sizes.push_back(std::strtoul(s.c_str(), nullptr, 10));
+	  break;
+	case 'n':
+	  count = std::strtoul(v.c_str(), nullptr, 10);
+	  break;
+	case 'b':
+	  burst = std::max(std::strtoul(v.c_str(), nullptr, 10), 1UL);
+	  break;
+	case 'd':
+	  if (v == "up")
+	    dirs = { UP };
+	  else if (v == "down")
+	    dirs = { DOWN };
+	  else
+	    dirs = { UP, DOWN };
+	  break;
+	default:
+	  usage();
+	  return 2;
+	}
+    }
+
+  int ret = 0;
+  InitProcess::init();
+
+  try {
+    const Keys keys(key_dir);
+
+    std::cout << std::left << std::setw(12) << "cipher" << std::setw(8) << "comp"
+	      << std::right << std::setw(6) << "size" << std::setw(6) << "dir"
+	      << std::setw(9) << "Gbit/s" << std::setw(9) << "kpps"
+	      << std::setw(9) << "p50 us" << std::setw(9) << "p90 us"
+	      << std::setw(9) << "p99 us" << std::setw(9) << "max us"
+	      << std::setw(7) << "lost" << std::endl;
+
+    for (auto& cipher : ciphers)
+      for (auto& comp : comps)
+	{
+	  openvpn_io::io_context io_context(1);
+	  Loopback lb(io_context, keys, cipher, digest, comp);
+	  lb.connect(10);
+	  for (auto size : sizes)
+	    for (auto dir : dirs)
+	      {
+		lb.measure(dir, size, std::min(count / 10, size_t(10000)), burst); // warm up
+		const Result r = lb.measure(dir, size, count, burst);
+		std::cout << std::left << std::setw(12) << cipher << std::setw(8) << comp
+			  << std::right << std::setw(6) << size
+			  << std::setw(6) << (dir == UP ? "up" : "down")
+			  << std::fixed << std::setprecision(3)
+			  << std::setw(9) << r.bytes * 8 / r.seconds / 1e9
+			  << std::setprecision(0)
+			  << std::setw(9) << r.received / r.seconds / 1e3
+			  << std::setprecision(1)
+			  << std::setw(9) << r.p50 << std::setw(9) << r.p90
+			  << std::setw(9) << r.p99 << std::setw(9) << r.max
+			  << std::setw(7) << r.sent - r.received
+			  << std::endl;
+		if (r.errors)
+		  {
+		    std::cerr << r.errors << " packets corrupted" << std::endl;
+		    ret = 1;
+		  }
+	      }
+	  lb.stop();
+	}
+  }
+  catch (const std::exception& e)
+    {
+      std::cerr << "Exception: " << e.what() << std::endl;
+      ret = 1;
+    }
+
+  InitProcess::uninit();
+  return ret;
+}
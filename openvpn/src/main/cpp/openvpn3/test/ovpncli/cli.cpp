@@ -606,6 +606,8 @@ int openvpn_client(int argc, char *argv[], const std::string* profile_content)
     { "epki-cert",      required_argument,  nullptr,       2  },
     { "epki-ca",        required_argument,  nullptr,       3  },
     { "epki-key",       required_argument,  nullptr,       4  },
+    { "io-uring",       no_argument,        nullptr,       6  },
+    { "pmtud",          no_argument,        nullptr,       7  },
 #ifdef OPENVPN_REMOTE_OVERRIDE
     { "remote-override",required_argument,  nullptr,       5  },
 #endif
@@ -655,6 +657,8 @@ int openvpn_client(int argc, char *argv[], const std::string* profile_content)
 	bool version = false;
 	bool altProxy = false;
 	bool dco = false;
+	bool ioUring = false;
+	bool pmtud = false;
 	std::string epki_cert_fn;
 	std::string epki_ca_fn;
 	std::string epki_key_fn;
@@ -685,6 +689,12 @@ int openvpn_client(int argc, char *argv[], const std::string* profile_content)
 		remote_override_cmd = optarg;
 		break;
 #endif
+	      case 6: // --io-uring
+		ioUring = true;
+		break;
+	      case 7: // --pmtud
+		pmtud = true;
+		break;
 	      case 'e':
 		eval = true;
 		break;
@@ -862,6 +872,8 @@ int openvpn_client(int argc, char *argv[], const std::string* profile_content)
 	      config.retryOnAuthFailed = retryOnAuthFailed;
 	      config.tunPersist = tunPersist;
 	      config.gremlinConfig = gremlin;
+	      config.ioUring = ioUring;
+	      config.pmtud = pmtud;
 	      config.info = true;
 #if defined(OPENVPN_OVPNCLI_SINGLE_THREAD)
 	      config.clockTickMS = 250;
@@ -1041,7 +1053,10 @@ int openvpn_client(int argc, char *argv[], const std::string* profile_content)
       std::cout << "--auth-retry, -Y      : retry connection on auth failure" << std::endl;
       std::cout << "--persist-tun, -j     : keep TUN interface open across reconnects" << std::endl;
       std::cout << "--peer-info, -I       : peer info key/value list in the form K1=V1,K2=V2,..." << std::endl;
-      std::cout << "--gremlin, -G         : gremlin info (send_delay_ms, recv_delay_ms, send_drop_prob, recv_drop_prob)" << std::endl;
+      std::cout << "--gremlin, -G         : gremlin info (send_delay_ms, recv_delay_ms, send_drop_prob, recv_drop_prob[, jitter_ms[, bandwidth_kbps]])" << std::endl;
+      std::cout << "                        or link profile (3g, wifi-lossy, satellite)" << std::endl;
+      std::cout << "--io-uring            : use io_uring for UDP and tun I/O (needs IO_URING=1 build)" << std::endl;
+      std::cout << "--pmtud               : discover the path MTU to the server (UDP only)" << std::endl;
       std::cout << "--epki-ca             : simulate external PKI cert supporting intermediate/root certs" << std::endl;
       std::cout << "--epki-cert           : simulate external PKI cert" << std::endl;
       std::cout << "--epki-key            : simulate external PKI private key" << std::endl;
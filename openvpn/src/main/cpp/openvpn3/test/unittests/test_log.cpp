@@ -34,6 +34,26 @@ namespace unittests
 
     ASSERT_EQ(text, msg);
   }
+
+  TEST(LatencyTraceTest, TestExport)
+  {
+    using namespace openvpn;
+
+    ClientAPI::OpenVPNClient::latency_trace_enable(true);
+    {
+      LatencyTrace::Span span(LatencyTrace::ENCRYPT, 1400);
+    }
+    ClientAPI::OpenVPNClient::latency_trace_enable(false);
+    {
+      LatencyTrace::Span span(LatencyTrace::DECRYPT, 1400);
+    }
+
+    const std::string json = ClientAPI::OpenVPNClient::latency_trace_export();
+    ASSERT_EQ(json.find("{\"traceEvents\":["), 0u);
+    ASSERT_NE(json.find("\"name\":\"encrypt\""), std::string::npos);
+    ASSERT_NE(json.find("\"size\":1400"), std::string::npos);
+    ASSERT_EQ(json.find("\"name\":\"decrypt\""), std::string::npos);
+  }
 }  // namespace
 
 int main(int argc, char **argv)
@@ -0,0 +1,272 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+#include <openvpn/ssl/plpmtud.hpp>
+#include <openvpn/common/sockopt.hpp>
+#include <gtest/gtest.h>
+#include <algorithm>
+
+namespace unittests
+{
+  using namespace openvpn;
+
+  // A path carrying packets of up to mtu bytes to a peer which,
+  // like a 2.x server, reports the largest packet received so far.
+  struct Path
+  {
+    unsigned int mtu;
+    bool replies = true;
+    unsigned int drop = 0;     // lose this many probes that would fit
+    unsigned int max_recv = 0;
+    unsigned int n_probes = 0;
+
+    // Step time by one second until seconds have passed, sending
+    // every probe that is due.
+    void run(PLPMTUD& pl, Time& now, const unsigned int seconds)
+    {
+      for (unsigned int i = 0; i < seconds; ++i)
+	{
+	  unsigned int size;
+	  while ((size = pl.probe(now)))
+	    {
+	      ++n_probes;
+	      pl.probe_sent(size);
+	      if (size > mtu)
+		continue;
+	      if (drop)
+		{
+		  --drop;
+		  continue;
+		}
+	      max_recv = std::max(max_recv, size);
+	      if (replies)
+		pl.ack(max_recv, now);
+	    }
+	  now += Time::Duration::seconds(1);
+	}
+    }
+  };
+
+  class PLPMTUDTest : public testing::Test
+  {
+  protected:
+    PLPMTUD pl;
+    Time now = Time::zero() + Time::Duration::seconds(1);
+  };
+
+  TEST_F(PLPMTUDTest, DisabledUntilStarted)
+  {
+    ASSERT_FALSE(pl.enabled());
+    ASSERT_EQ(pl.probe(now), 0u);
+    ASSERT_EQ(pl.plpmtu(), 0u);
+    ASSERT_TRUE(pl.next_probe().is_infinite());
+  }
+
+  TEST_F(PLPMTUDTest, ProbeSuccess)
+  {
+    Path path{1552};
+
+    pl.start(1552, now);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::BASE);
+    ASSERT_EQ(pl.plpmtu(), 0u);
+
+    // BASE_PLPMTU first, then straight to the maximum
+    ASSERT_EQ(pl.probe(now), (unsigned int)PLPMTUD::BASE_PLPMTU);
+    pl.probe_sent(PLPMTUD::BASE_PLPMTU);
+    ASSERT_TRUE(pl.ack(PLPMTUD::BASE_PLPMTU, now));
+    ASSERT_EQ(pl.plpmtu(), (unsigned int)PLPMTUD::BASE_PLPMTU);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::SEARCHING);
+
+    path.run(pl, now, 1);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::SEARCH_COMPLETE);
+    ASSERT_EQ(pl.plpmtu(), 1552u);
+    ASSERT_EQ(path.n_probes, 1u);
+  }
+
+  TEST_F(PLPMTUDTest, ProbeSizeRounding)
+  {
+    pl.start(1552, now);
+    ASSERT_EQ(pl.probe(now), (unsigned int)PLPMTUD::BASE_PLPMTU);
+
+    // cipher rounding made the probe a little smaller
+    pl.probe_sent(PLPMTUD::BASE_PLPMTU - 3);
+    ASSERT_FALSE(pl.ack(PLPMTUD::BASE_PLPMTU - 4, now));
+    ASSERT_TRUE(pl.ack(PLPMTUD::BASE_PLPMTU - 3, now));
+    ASSERT_EQ(pl.plpmtu(), (unsigned int)PLPMTUD::BASE_PLPMTU - 3);
+  }
+
+  TEST_F(PLPMTUDTest, ProbeLossIsRetried)
+  {
+    Path path{1552};
+    path.drop = PLPMTUD::MAX_PROBES - 1;
+
+    pl.start(1552, now);
+    path.run(pl, now, 10);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::SEARCH_COMPLETE);
+    ASSERT_EQ(pl.plpmtu(), 1552u);
+  }
+
+  TEST_F(PLPMTUDTest, SearchNarrowPath)
+  {
+    Path path{1400};
+
+    pl.start(1552, now);
+    path.run(pl, now, 120);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::SEARCH_COMPLETE);
+    ASSERT_LE(pl.plpmtu(), 1400u);
+    ASSERT_GT(pl.plpmtu(), 1400u - PLPMTUD::SEARCH_GRANULARITY);
+
+    // nothing more to probe until the raise timer expires
+    const unsigned int n_probes = path.n_probes;
+    path.run(pl, now, 300);
+    ASSERT_EQ(path.n_probes, n_probes);
+  }
+
+  TEST_F(PLPMTUDTest, RaiseTimer)
+  {
+    Path path{1400};
+
+    pl.start(1552, now);
+    path.run(pl, now, 120);
+    ASSERT_LE(pl.plpmtu(), 1400u);
+
+    path.mtu = 1552;
+    path.run(pl, now, 600);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::SEARCH_COMPLETE);
+    ASSERT_EQ(pl.plpmtu(), 1552u);
+  }
+
+  TEST_F(PLPMTUDTest, BlackHoleFallback)
+  {
+    Path path{1100};
+
+    pl.start(1552, now);
+    path.run(pl, now, 2 * PLPMTUD::MAX_PROBES + 1);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::BASE_FAILED);
+    ASSERT_EQ(pl.plpmtu(), 0u);
+    ASSERT_EQ(path.n_probes, (unsigned int)PLPMTUD::MAX_PROBES);
+
+    // BASE_PLPMTU is retried after the raise timer
+    path.mtu = 1500;
+    path.run(pl, now, 590);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::BASE_FAILED);
+    path.run(pl, now, 120);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::SEARCH_COMPLETE);
+    ASSERT_LE(pl.plpmtu(), 1500u);
+    ASSERT_GT(pl.plpmtu(), 1500u - PLPMTUD::SEARCH_GRANULARITY);
+  }
+
+  TEST_F(PLPMTUDTest, PeerNeverReplies)
+  {
+    Path path{1552};
+    path.replies = false;
+
+    pl.start(1552, now);
+    path.run(pl, now, 2 * PLPMTUD::MAX_PROBES + 1);
+    ASSERT_EQ(pl.get_state(), PLPMTUD::BASE_FAILED);
+
+    // no confirmed PLPMTU, so nothing is clamped to BASE_PLPMTU
+    ASSERT_EQ(pl.plpmtu(), 0u);
+    path.run(pl, now, 3600);
+    ASSERT_EQ(pl.plpmtu(), 0u);
+  }
+
+  // The socket may only set DF while tun packets are clamped to a
+  // confirmed PLPMTU.  Otherwise every tun packet which encrypts to
+  // more than the local link MTU would fail with EMSGSIZE instead of
+  // being fragmented.
+  static void check_df_needs_clamp(const PLPMTUD& pl, const Path& path)
+  {
+    const int encap = 60;
+    const unsigned int mssfix_inter = 1450;
+    const unsigned int mss_inter = pl.mss_inter(mssfix_inter, encap);
+
+    if (pl.probe_df())
+      {
+	ASSERT_NE(pl.plpmtu(), 0u);
+	ASSERT_LE(mss_inter + encap, pl.plpmtu());
+	ASSERT_LE(mss_inter + encap, path.mtu);
+      }
+    else
+      ASSERT_EQ(mss_inter, mssfix_inter);
+  }
+
+  TEST_F(PLPMTUDTest, NoDFUntilClamped)
+  {
+    Path path{1400};
+
+    ASSERT_FALSE(pl.probe_df());
+    pl.start(1552, now);
+    ASSERT_FALSE(pl.probe_df());
+    for (unsigned int i = 0; i < 120; ++i)
+      {
+	path.run(pl, now, 1);
+	check_df_needs_clamp(pl, path);
+      }
+    ASSERT_TRUE(pl.probe_df());
+    ASSERT_EQ(pl.mss_inter(0, 60), pl.plpmtu() - 60);
+  }
+
+  TEST_F(PLPMTUDTest, NoDFWhenPeerNeverReplies)
+  {
+    Path path{1552};
+    path.replies = false;
+
+    pl.start(1552, now);
+    for (unsigned int i = 0; i < 1800; ++i)
+      {
+	path.run(pl, now, 1);
+	ASSERT_FALSE(pl.probe_df());
+	check_df_needs_clamp(pl, path);
+      }
+    ASSERT_EQ(pl.mss_inter(0, 60), 0u);
+  }
+
+  TEST_F(PLPMTUDTest, NoDFAfterBlackHole)
+  {
+    Path path{1100};
+
+    pl.start(1552, now);
+    for (unsigned int i = 0; i < 700; ++i)
+      {
+	path.run(pl, now, 1);
+	ASSERT_FALSE(pl.probe_df());
+      }
+    ASSERT_EQ(pl.get_state(), PLPMTUD::BASE_FAILED);
+  }
+
+#if defined(IP_MTU_DISCOVER) && defined(IPV6_MTU_DISCOVER)
+  // the UDP transport saves the socket's own mode before forcing
+  // IP_PMTUDISC_PROBE and puts it back when DF must go
+  TEST(PLPMTUDSocket, ModeRoundTrip)
+  {
+    const int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+
+    const int mode = SockOpt::mtu_discover(fd, false);
+    SockOpt::set_mtu_discover(fd, false, IP_PMTUDISC_PROBE);
+    ASSERT_EQ(SockOpt::mtu_discover(fd, false), IP_PMTUDISC_PROBE);
+    SockOpt::set_mtu_discover(fd, false, mode);
+    ASSERT_EQ(SockOpt::mtu_discover(fd, false), mode);
+    ::close(fd);
+  }
+#endif
+}
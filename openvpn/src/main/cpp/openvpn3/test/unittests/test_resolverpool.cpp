@@ -0,0 +1,132 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+#include <openvpn/log/logsimple.hpp>
+#include <openvpn/common/bigmutex.hpp>
+#include <openvpn/client/remotelist.hpp>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+
+namespace unittests
+{
+  using namespace openvpn;
+
+  // Lookups which block until released, like getaddrinfo() on a
+  // dead resolver.
+  struct Blocker
+  {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool released = false;
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::atomic<int> done{0};
+
+    std::function<void()> lookup()
+    {
+      return [this]() {
+	const int n = ++running;
+	int m = max_running;
+	while (n > m && !max_running.compare_exchange_weak(m, n))
+	  ;
+	std::unique_lock<std::mutex> lock(mutex);
+	cond.wait(lock, [this]() { return released; });
+	--running;
+	++done;
+      };
+    }
+
+    void release()
+    {
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	released = true;
+      }
+      cond.notify_all();
+    }
+
+    void wait_running(const int n)
+    {
+      for (int i = 0; i < 5000 && running < n; ++i)
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+
+  TEST(ResolverPool, CapsThreadsAcrossBatches)
+  {
+    Blocker b;
+    RemoteList::ResolverPool::Ptr pool(new RemoteList::ResolverPool(3));
+
+    // several reconnects' worth of hung lookups
+    for (int i = 0; i < 20; ++i)
+      pool->post(b.lookup());
+    b.wait_running(3);
+    ASSERT_EQ(pool->n_threads(), 3u);
+    ASSERT_EQ(b.running, 3);
+
+    b.release();
+    pool->stop();
+    ASSERT_EQ(pool->n_threads(), 0u);
+    ASSERT_EQ(b.max_running, 3);
+  }
+
+  TEST(ResolverPool, StopJoinsAndDropsQueue)
+  {
+    Blocker b;
+    RemoteList::ResolverPool::Ptr pool(new RemoteList::ResolverPool(2));
+
+    for (int i = 0; i < 10; ++i)
+      pool->post(b.lookup());
+    b.wait_running(2);
+
+    std::thread releaser([&b]() {
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	b.release();
+      });
+    pool->stop();
+
+    // the lookups in progress ran to completion, the queued ones never ran
+    ASSERT_EQ(b.done, 2);
+    ASSERT_EQ(b.running, 0);
+    releaser.join();
+
+    // a stopped pool ignores further lookups
+    pool->post(b.lookup());
+    ASSERT_EQ(pool->n_threads(), 0u);
+    ASSERT_EQ(b.done, 2);
+  }
+
+  TEST(ResolverPool, ReusesIdleThreads)
+  {
+    RemoteList::ResolverPool::Ptr pool(new RemoteList::ResolverPool(4));
+    std::atomic<int> done{0};
+
+    for (int i = 0; i < 50; ++i)
+      {
+	pool->post([&done]() { ++done; });
+	for (int j = 0; j < 5000 && done <= i; ++j)
+	  std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    ASSERT_EQ(done, 50);
+    ASSERT_EQ(pool->n_threads(), 1u);
+  }
+}
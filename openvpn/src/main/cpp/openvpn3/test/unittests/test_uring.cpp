@@ -0,0 +1,159 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+#ifdef OPENVPN_IO_URING
+
+#include <openvpn/log/logsimple.hpp>
+#include <openvpn/io/uring.hpp>
+#include <gtest/gtest.h>
+
+namespace unittests
+{
+  using namespace openvpn;
+
+  struct UDPSocket
+  {
+    UDPSocket(openvpn_io::io_context& io_context)
+      : socket(io_context)
+    {
+      socket.open(openvpn_io::ip::udp::v4());
+      socket.bind(openvpn_io::ip::udp::endpoint(openvpn_io::ip::address_v4::loopback(), 0));
+      local = socket.local_endpoint();
+    }
+
+    openvpn_io::ip::udp::socket socket;
+    openvpn_io::ip::udp::endpoint local;
+  };
+
+  // Run io_context until done() or the timeout expires.
+  template <typename F>
+  static void run_until(openvpn_io::io_context& io_context, F done)
+  {
+    const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done() && std::chrono::steady_clock::now() < end)
+      {
+	io_context.restart();
+	io_context.run_for(std::chrono::milliseconds(10));
+      }
+  }
+
+  static IoUring::Endpoint::Ptr new_endpoint(openvpn_io::io_context& io_context, UDPSocket& s)
+  {
+    return IoUring::Endpoint::new_obj(io_context,
+				      s.socket.native_handle(),
+				      IoUring::Endpoint::DATAGRAM,
+				      2048);
+  }
+
+  TEST(IoUring, UDPEcho)
+  {
+    openvpn_io::io_context io_context(1);
+    UDPSocket client_sock(io_context), echo_sock(io_context);
+    IoUring::Endpoint::Ptr client = new_endpoint(io_context, client_sock);
+    IoUring::Endpoint::Ptr echo = new_endpoint(io_context, echo_sock);
+    if (!client || !echo)
+      {
+	std::cout << "io_uring not available, skipped" << std::endl;
+	return;
+      }
+
+    echo->start([&echo](const unsigned char* data, const size_t size,
+			const struct sockaddr* from, const socklen_t fromlen)
+		{
+		  Buffer buf(const_cast<unsigned char*>(data), size, true);
+		  ASSERT_TRUE(echo->write(buf, from, fromlen));
+		},
+		[](const int err, const bool write)
+		{
+		  FAIL() << "echo error " << err << (write ? " on write" : " on read");
+		});
+
+    const int N = 1000;
+    int n_recv = 0;
+    client->start([&n_recv](const unsigned char* data, const size_t size,
+			    const struct sockaddr* from, const socklen_t fromlen)
+		  {
+		    // packet i has i % 1400 + 1 bytes of value i & 0xff
+		    ASSERT_GE(size, 1u);
+		    ASSERT_EQ(size, (size_t)(n_recv % 1400 + 1));
+		    for (size_t j = 0; j < size; ++j)
+		      ASSERT_EQ(data[j], (unsigned char)n_recv);
+		    ++n_recv;
+		  },
+		  [](const int err, const bool write)
+		  {
+		    FAIL() << "client error " << err << (write ? " on write" : " on read");
+		  });
+
+    // keep no more than a window of packets in flight, so that
+    // the loopback socket buffers don't drop any
+    int n_sent = 0;
+    run_until(io_context, [&]() {
+	while (n_sent < N && n_sent - n_recv < 32)
+	  {
+	    BufferAllocated buf(n_sent % 1400 + 1, BufferAllocated::ARRAY);
+	    std::memset(buf.data(), n_sent & 0xff, buf.size());
+	    if (!client->write(buf, (const struct sockaddr*)echo_sock.local.data(), echo_sock.local.size()))
+	      break;
+	    ++n_sent;
+	  }
+	return n_recv == N;
+      });
+    ASSERT_EQ(n_recv, N);
+
+    // the cancels end the multishot receives, which release the endpoints
+    client->stop();
+    echo->stop();
+    run_until(io_context, [&]() { return client->use_count() == 1 && echo->use_count() == 1; });
+    ASSERT_EQ(client->use_count(), 1);
+    ASSERT_EQ(echo->use_count(), 1);
+  }
+
+  TEST(IoUring, StopWithFullSubmissionQueue)
+  {
+    openvpn_io::io_context io_context(1);
+    UDPSocket sock(io_context), peer(io_context);
+    IoUring::Endpoint::Ptr ep = new_endpoint(io_context, sock);
+    if (!ep)
+      {
+	std::cout << "io_uring not available, skipped" << std::endl;
+	return;
+      }
+
+    bool called = false;
+    ep->start([&called](const unsigned char*, const size_t, const struct sockaddr*, const socklen_t) { called = true; },
+	      [&called](const int, const bool) { called = true; });
+    io_context.poll(); // submit the receive
+
+    // queue writes without letting the io_context submit them,
+    // so that stop() finds no free SQE without pushing them first
+    BufferAllocated buf(100, BufferAllocated::ARRAY);
+    for (int i = 0; i < IoUring::Ring::SQ_ENTRIES; ++i)
+      ASSERT_TRUE(ep->write(buf, (const struct sockaddr*)peer.local.data(), peer.local.size()));
+    ep->stop();
+
+    run_until(io_context, [&]() { return ep->use_count() == 1; });
+    ASSERT_EQ(ep->use_count(), 1);
+    ASSERT_FALSE(called);
+  }
+}
+
+#endif
@@ -0,0 +1,152 @@
+//    OpenVPN -- An application to securely tunnel IP networks
+//               over a single port, with support for SSL/TLS-based
+//               session authentication and key exchange,
+//               packet encryption, packet authentication, and
+//               packet compression.
+//
+//    Copyright (C) 2012-2017 OpenVPN Inc.
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU Affero General Public License Version 3
+//    as published by the Free Software Foundation.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU Affero General Public License for more details.
+//
+//    You should have received a copy of the GNU Affero General Public License
+//    along with this program in the COPYING file.
+//    If not, see <http://www.gnu.org/licenses/>.
+
+#include <openvpn/log/logsimple.hpp>
+#include <openvpn/io/io.hpp>
+#include <openvpn/server/vpnservpool.hpp>
+#include <gtest/gtest.h>
+#include <set>
+
+namespace unittests
+{
+  using namespace openvpn;
+
+  enum {
+    N_THREADS = 4,
+    N_ROUNDS = 200,
+  };
+
+  static OptionList pool_options()
+  {
+    // 1021 IPv4 and 65533 IPv6 client addresses
+    return OptionList::parse_from_config_static("server 10.8.0.1 255.255.252.0\n"
+						"server-ipv6 fd00:8::/112\n", nullptr);
+  }
+
+  // Each server thread repeatedly acquires a batch of addresses that
+  // fits its shard and releases it again.
+  static void churn(VPNServerPool::Pool& pool,
+		    const unsigned int thread_index,
+		    const size_t batch,
+		    std::vector<VPNServerPool::IP46>& held,
+		    bool& ok)
+  {
+    ok = true;
+    for (int r = 0; r < N_ROUNDS; ++r)
+      {
+	held.clear();
+	for (size_t i = 0; i < batch; ++i)
+	  {
+	    VPNServerPool::IP46 a;
+	    if (pool.acquire(a, true, thread_index))
+	      ok = false;
+	    held.push_back(a);
+	  }
+	if (r == N_ROUNDS - 1)
+	  break; // keep the last batch for the caller to check
+	for (auto& a : held)
+	  pool.release(a);
+      }
+  }
+
+  TEST(VPNServerPool, ConcurrentAcquireRelease)
+  {
+    VPNServerPool::Pool pool(pool_options(), N_THREADS);
+    const size_t batch = pool.per_thread(0).range4().extent() / 2;
+
+    std::vector<VPNServerPool::IP46> held[N_THREADS];
+    bool ok[N_THREADS];
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < N_THREADS; ++t)
+      threads.emplace_back([&, t]() { churn(pool, t, batch, held[t], ok[t]); });
+    for (auto& t : threads)
+      t.join();
+
+    // no address was handed out twice, and every thread
+    // got its addresses from its own shard
+    std::set<IP::Addr> seen;
+    for (unsigned int t = 0; t < N_THREADS; ++t)
+      {
+	ASSERT_TRUE(ok[t]);
+	ASSERT_EQ(held[t].size(), batch);
+	const IP::Range& r4 = pool.per_thread(t).range4();
+	const IP::Range& r6 = pool.per_thread(t).range6();
+	for (const auto& a : held[t])
+	  {
+	    ASSERT_TRUE(seen.insert(a.ip4).second);
+	    ASSERT_TRUE(seen.insert(a.ip6).second);
+	    ASSERT_TRUE(r4.start() <= a.ip4 && a.ip4 <= r4.start() + (r4.extent() - 1));
+	    ASSERT_TRUE(r6.start() <= a.ip6 && a.ip6 <= r6.start() + (r6.extent() - 1));
+	  }
+      }
+
+    const VPNServerPool::Pool::Stats st = pool.stats();
+    ASSERT_EQ(st.acquires, (std::uint64_t)N_THREADS * N_ROUNDS * batch);
+    ASSERT_EQ(st.steals, 0u);
+    ASSERT_EQ(st.depletions, 0u);
+
+    for (auto& h : held)
+      for (auto& a : h)
+	pool.release(a);
+  }
+
+  TEST(VPNServerPool, StealWhenHomeShardDepleted)
+  {
+    VPNServerPool::Pool pool(pool_options(), N_THREADS);
+    const size_t n4 = pool.netblock4().clients.extent();
+
+    // all server threads share the address space, whatever
+    // their home shard is, and run out together
+    std::vector<VPNServerPool::IP46> held[N_THREADS];
+    std::vector<std::thread> threads;
+    std::atomic<size_t> n_ok{0};
+    for (unsigned int t = 0; t < N_THREADS; ++t)
+      threads.emplace_back([&, t]() {
+	  for (size_t i = 0; i < n4; ++i)
+	    {
+	      VPNServerPool::IP46 a;
+	      if (!(pool.acquire(a, false, t) & VPNServerPool::Pool::IPv4_DEPLETION))
+		{
+		  ++n_ok;
+		  held[t].push_back(a);
+		}
+	    }
+	});
+    for (auto& t : threads)
+      t.join();
+
+    ASSERT_EQ(n_ok, n4);
+    std::set<IP::Addr> seen;
+    for (auto& h : held)
+      for (auto& a : h)
+	ASSERT_TRUE(seen.insert(a.ip4).second);
+
+    // released addresses can be acquired again from any thread
+    for (auto& h : held)
+      for (auto& a : h)
+	pool.release(a);
+    for (size_t i = 0; i < n4; ++i)
+      {
+	VPNServerPool::IP46 a;
+	ASSERT_EQ(pool.acquire(a, false, 1), 0u);
+      }
+  }
+}
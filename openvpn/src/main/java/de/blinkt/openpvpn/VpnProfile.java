@@ -354,6 +354,8 @@ public class VpnProfile implements Serializable, Cloneable {
 
         if (!configForOvpn3) {
             cfg.append("machine-readable-output\n");
+            // We log at a high verbosity, keep the writes off the packet path
+            cfg.append("log-queue 1024\n");
             if (!mIsOpenVPN22)
                 cfg.append("allow-recursive-routing\n");
 
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2012-2016 Arne Schwabe
+ * Distributed under the GNU GPL v2 with additional terms. For full terms see the file doc/LICENSE.txt
+ */
+
+package de.blinkt.openpvpn.core;
+
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Collects the items of a CONFIG_BATCH request from the management interface.
+ * <p>
+ * The NEED-OK line carries "count length", followed by count lines of
+ * "COMMAND argument". length is the total size of these lines in bytes,
+ * including their "\r\n" endings, and is used to check that the whole
+ * batch arrived.
+ */
+class ConfigBatch {
+    private static final int LINE_END_LENGTH = 2;
+
+    private final int mCount;
+    private final int mLength;
+    private int mReceived;
+    private final List<String[]> mItems = new ArrayList<>();
+
+    ConfigBatch(String header) {
+        String[] parts = header.trim().split(" ");
+        if (parts.length != 2)
+            throw new IllegalArgumentException("Malformed CONFIG_BATCH header: " + header);
+
+        mCount = Integer.parseInt(parts[0]);
+        mLength = Integer.parseInt(parts[1]);
+        if (mCount < 0 || mLength < 0)
+            throw new IllegalArgumentException("Malformed CONFIG_BATCH header: " + header);
+    }
+
+    /**
+     * @param line an item, without its line ending
+     * @return true once all items of the batch have been added
+     */
+    boolean addLine(String line) {
+        if (!isComplete()) {
+            mReceived += line.getBytes(StandardCharsets.UTF_8).length + LINE_END_LENGTH;
+            mItems.add(line.split(" ", 2));
+        }
+        return isComplete();
+    }
+
+    boolean isComplete() {
+        return mItems.size() >= mCount;
+    }
+
+    boolean isValid() {
+        if (!isComplete() || mReceived != mLength)
+            return false;
+
+        for (String[] item : mItems) {
+            if (item.length != 2)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @return the items as {command, argument} pairs in the order they were sent
+     */
+    List<String[]> getItems() {
+        return mItems;
+    }
+}
@@ -49,6 +49,7 @@ public class OpenVpnManagementThread implements Runnable, OpenVPNManagement {
     private pauseReason lastPauseReason = pauseReason.noNetwork;
     private PausedStateCallback mPauseCallback;
     private boolean mShuttingDown;
+    private ConfigBatch mConfigBatch;
     private Runnable mResumeHoldRunnable = () -> {
         if (shouldBeRunning()) {
             releaseHoldCmd();
@@ -195,7 +196,8 @@ public class OpenVpnManagementThread implements Runnable, OpenVPNManagement {
 
             // Closing one of the two sockets also closes the other
             //mServerSocketLocal.close();
-            managmentCommand("version 3\n");
+            // version 4 receives the tun configuration as a single CONFIG_BATCH
+            managmentCommand("version 4\n");
 
             while (true) {
 
@@ -286,6 +288,12 @@ public class OpenVpnManagementThread implements Runnable, OpenVPNManagement {
     private void processCommand(String command) {
         //Log.i(TAG, "Line from managment" + command);
 
+        if (mConfigBatch != null) {
+            if (mConfigBatch.addLine(command))
+                finishConfigBatch();
+            return;
+        }
+
         if (command.startsWith(">") && command.contains(":")) {
             String[] parts = command.split(":", 2);
             String cmd = parts[0].substring(1);
@@ -555,6 +563,50 @@ public class OpenVpnManagementThread implements Runnable, OpenVPNManagement {
                 protectFileDescriptor(fdtoprotect);
                 break;
             case "DNSSERVER":
+            case "DNS6SERVER":
+            case "DNSDOMAIN":
+            case "ROUTE":
+            case "ROUTE6":
+            case "IFCONFIG":
+            case "IFCONFIG6":
+                processConfigItem(needed, extra);
+                break;
+            case "CONFIG_BATCH":
+                try {
+                    mConfigBatch = new ConfigBatch(extra);
+                } catch (IllegalArgumentException e) {
+                    VpnStatus.logException("Could not parse " + argument, e);
+                    status = "cancel";
+                    break;
+                }
+                // The items follow on the next lines, the batch is acknowledged once complete
+                if (mConfigBatch.isComplete())
+                    finishConfigBatch();
+                return;
+            case "PERSIST_TUN_ACTION":
+                // check if tun cfg stayed the same
+                status = mOpenVPNService.getTunReopenStatus();
+                break;
+            case "OPENTUN":
+                if (sendTunFD(needed, extra))
+                    return;
+                else
+                    status = "cancel";
+                // This not nice or anything but setFileDescriptors accepts only FilDescriptor class :(
+
+                break;
+            default:
+                Log.e(TAG, "Unknown needok command " + argument);
+                return;
+        }
+
+        String cmd = String.format("needok '%s' %s\n", needed, status);
+        managmentCommand(cmd);
+    }
+
+    private void processConfigItem(String needed, String extra) {
+        switch (needed) {
+            case "DNSSERVER":
             case "DNS6SERVER":
                 mOpenVPNService.addDNS(extra);
                 break;
@@ -577,7 +629,7 @@ public class OpenVpnManagementThread implements Runnable, OpenVPNManagement {
                 } else if (routeparts.length >= 3) {
                     mOpenVPNService.addRoute(routeparts[0], routeparts[1], routeparts[2], null);
                 } else {
-                    VpnStatus.logError("Unrecognized ROUTE cmd:" + Arrays.toString(routeparts) + " | " + argument);
+                    VpnStatus.logError("Unrecognized ROUTE cmd:" + Arrays.toString(routeparts) + " | " + extra);
                 }
 
                 break;
@@ -597,26 +649,26 @@ public class OpenVpnManagementThread implements Runnable, OpenVPNManagement {
                 mtu = Integer.parseInt(ifconfig6parts[1]);
                 mOpenVPNService.setMtu(mtu);
                 mOpenVPNService.setLocalIPv6(ifconfig6parts[0]);
-                break;
-            case "PERSIST_TUN_ACTION":
-                // check if tun cfg stayed the same
-                status = mOpenVPNService.getTunReopenStatus();
-                break;
-            case "OPENTUN":
-                if (sendTunFD(needed, extra))
-                    return;
-                else
-                    status = "cancel";
-                // This not nice or anything but setFileDescriptors accepts only FilDescriptor class :(
-
                 break;
             default:
-                Log.e(TAG, "Unknown needok command " + argument);
-                return;
+                Log.e(TAG, "Unknown config item " + needed + " " + extra);
+                break;
         }
+    }
 
-        String cmd = String.format("needok '%s' %s\n", needed, status);
-        managmentCommand(cmd);
+    private void finishConfigBatch() {
+        ConfigBatch batch = mConfigBatch;
+        mConfigBatch = null;
+
+        String status = "ok";
+        if (batch.isValid()) {
+            for (String[] item : batch.getItems())
+                processConfigItem(item[0], item[1]);
+        } else {
+            VpnStatus.logError("Incomplete or malformed CONFIG_BATCH from management");
+            status = "cancel";
+        }
+        managmentCommand(String.format("needok '%s' %s\n", "CONFIG_BATCH", status));
     }
 
     private boolean sendTunFD(String needed, String extra) {
@@ -1,6 +1,8 @@
 package de.blinkt.openpvpn.core;
 
 import android.content.Context;
+
+import java.io.File;
 import de.blinkt.openpvpn.R;
 import de.blinkt.openpvpn.VpnProfile;
 import net.openvpn.ovpn3.*;
@@ -186,6 +188,12 @@ public class OpenVPNThreadv3 extends ClientAPI_OpenVPNClient implements Runnable
 		config.setAllowLocalLanAccess(mVp.mAllowLocalLAN);
 		boolean retryOnAuthFailed= mVp.mAuthRetry == AUTH_RETRY_NOINTERACT;
 		config.setRetryOnAuthFailed(retryOnAuthFailed);
+		// log() calls into Java, keep it off the tunnel thread
+		config.setLogQueueSize(1024);
+
+		File profileCache = new File(mService.getCacheDir(), "ovpn3-profiles");
+		if (profileCache.isDirectory() || profileCache.mkdirs())
+			config.setCompiledProfileDir(profileCache.getAbsolutePath());
 
 		ClientAPI_EvalConfig ec = eval_config(config);
 		if(ec.getExternalPki()) {
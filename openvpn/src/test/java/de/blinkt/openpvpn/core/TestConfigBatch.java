@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012-2017 Arne Schwabe
+ * Distributed under the GNU GPL v2 with additional terms. For full terms see the file doc/LICENSE.txt
+ */
+
+package de.blinkt.openpvpn.core;
+
+import junit.framework.Assert;
+
+import org.junit.Test;
+
+public class TestConfigBatch {
+
+    @Test
+    public void testCompleteBatch() {
+        String[] lines = {
+                "IFCONFIG 10.8.0.2 255.255.255.0 1500 subnet",
+                "ROUTE 10.100.0.0 255.255.255.0 10.8.0.1",
+                "DNSDOMAIN example.org"
+        };
+        int length = 0;
+        for (String line : lines)
+            length += line.length() + 2;
+
+        ConfigBatch batch = new ConfigBatch(lines.length + " " + length);
+        Assert.assertFalse(batch.addLine(lines[0]));
+        Assert.assertFalse(batch.addLine(lines[1]));
+        Assert.assertTrue(batch.addLine(lines[2]));
+        Assert.assertTrue(batch.isValid());
+
+        Assert.assertEquals(3, batch.getItems().size());
+        Assert.assertEquals("ROUTE", batch.getItems().get(1)[0]);
+        Assert.assertEquals("10.100.0.0 255.255.255.0 10.8.0.1", batch.getItems().get(1)[1]);
+        Assert.assertEquals("example.org", batch.getItems().get(2)[1]);
+    }
+
+    @Test
+    public void testLengthInUtf8Bytes() {
+        // "ü" is one UTF-16 unit but two bytes on the wire
+        String line = "DNSDOMAIN m\u00fcnchen.example";
+        ConfigBatch batch = new ConfigBatch("1 " + (line.length() + 1 + 2));
+        Assert.assertTrue(batch.addLine(line));
+        Assert.assertTrue(batch.isValid());
+
+        batch = new ConfigBatch("1 " + (line.length() + 2));
+        Assert.assertTrue(batch.addLine(line));
+        Assert.assertFalse(batch.isValid());
+    }
+
+    @Test
+    public void testEmptyBatch() {
+        ConfigBatch batch = new ConfigBatch("0 0");
+        Assert.assertTrue(batch.isComplete());
+        Assert.assertTrue(batch.isValid());
+    }
+
+    @Test
+    public void testLengthMismatch() {
+        ConfigBatch batch = new ConfigBatch("1 10");
+        Assert.assertTrue(batch.addLine("ROUTE6 fd00::/64 tun"));
+        Assert.assertFalse(batch.isValid());
+    }
+
+    @Test
+    public void testItemWithoutArgument() {
+        ConfigBatch batch = new ConfigBatch("1 7");
+        Assert.assertTrue(batch.addLine("ROUTE"));
+        Assert.assertFalse(batch.isValid());
+    }
+
+    @Test(expected = IllegalArgumentException.class)
+    public void testMalformedHeader() {
+        new ConfigBatch("12");
+    }
+}